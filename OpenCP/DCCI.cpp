@@ -4997,16 +4997,18 @@ namespace cp
 	void DCCI(const Mat& src, Mat& dest, const float threshold)
 	{
 		CV_Assert(src.channels() == 1);
+		//the loop-fused kernel runs all passes on a row band (with 3 rows overlap) per thread; too thin bands are not efficient.
+		const int threads = max(1, min(omp_get_max_threads(), src.rows / 16));
 		if (src.depth() != CV_32F)
 		{
 			Mat tmp, out;
 			src.convertTo(tmp, CV_32F, 1.f/255.f);
-			DCCI32FC1_SIMD_LoopFusion(tmp, out, threshold, 1);
+			DCCI32FC1_SIMD_LoopFusion(tmp, out, threshold, threads);
 			out.convertTo(dest, src.depth(), 255.f);
 		}
 		else
 		{
-			DCCI32FC1_SIMD_LoopFusion(src, dest, threshold, 1);
+			DCCI32FC1_SIMD_LoopFusion(src, dest, threshold, threads);
 		}
 	}
 }
\ No newline at end of file
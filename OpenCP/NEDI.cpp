@@ -1,6 +1,8 @@
 #include "upsample.hpp"
 #include "NEDI.hpp"
 #include <inlineSIMDFunctions.hpp>
+#include <atomic>
+#include <omp.h>
 using namespace std;
 using namespace cv;
 
@@ -568,6 +570,263 @@ namespace cp
 		return;
 	}
 
+	//p[0], p[2], ..., p[14]
+	inline __m256 _mm256_loadu_stride2_ps(const float* p)
+	{
+		return _mm256_unpackeven_ps(_mm256_loadu_ps(p), _mm256_loadu_ps(p + 8));
+	}
+
+	//regularized normal equation (C^T C + eps I) a = C^T y for one target pixel t, which is solved by Cholesky decomposition.
+	//the order of operations is the same as nediLUFusedRow for the same output as the SIMD lanes.
+	static float nediLUCholeskyPixel(const float* t, const int* sample, const int sample_size, const int* regressor, const int* predictor, const float threshold, const float eps)
+	{
+		const float n0 = t[predictor[0]];
+		const float n1 = t[predictor[1]];
+		const float n2 = t[predictor[2]];
+		const float n3 = t[predictor[3]];
+		const float ave = (n0 + n1 + n2 + n3) * 0.25f;
+		const float var = ((ave - n0) * (ave - n0) + (ave - n1) * (ave - n1) + (ave - n2) * (ave - n2) + (ave - n3) * (ave - n3)) * 0.25f;
+		if (!(var >= threshold)) return t[0];
+
+		float a00 = 0.f, a01 = 0.f, a02 = 0.f, a03 = 0.f, a11 = 0.f, a12 = 0.f, a13 = 0.f, a22 = 0.f, a23 = 0.f, a33 = 0.f;
+		float c0 = 0.f, c1 = 0.f, c2 = 0.f, c3 = 0.f;
+		for (int i = 0; i < sample_size; i++)
+		{
+			const float* s = t + sample[i];
+			const float v = s[0];
+			const float r0 = s[regressor[0]];
+			const float r1 = s[regressor[1]];
+			const float r2 = s[regressor[2]];
+			const float r3 = s[regressor[3]];
+			c0 += v * r0; c1 += v * r1; c2 += v * r2; c3 += v * r3;
+			a00 += r0 * r0; a01 += r0 * r1; a02 += r0 * r2; a03 += r0 * r3;
+			a11 += r1 * r1; a12 += r1 * r2; a13 += r1 * r3;
+			a22 += r2 * r2; a23 += r2 * r3;
+			a33 += r3 * r3;
+		}
+		a00 += eps; a11 += eps; a22 += eps; a33 += eps;
+
+		const float i00 = 1.f / sqrt(a00);
+		const float l10 = a01 * i00;
+		const float l20 = a02 * i00;
+		const float l30 = a03 * i00;
+		const float d1 = a11 - l10 * l10;
+		const float i11 = 1.f / sqrt(d1);
+		const float l21 = (a12 - l20 * l10) * i11;
+		const float l31 = (a13 - l30 * l10) * i11;
+		const float d2 = a22 - l20 * l20 - l21 * l21;
+		const float i22 = 1.f / sqrt(d2);
+		const float l32 = (a23 - l30 * l20 - l31 * l21) * i22;
+		const float d3 = a33 - l30 * l30 - l31 * l31 - l32 * l32;
+		const float i33 = 1.f / sqrt(d3);
+		if (!(a00 > 0.f && d1 > 0.f && d2 > 0.f && d3 > 0.f)) return ave;
+
+		const float z0 = c0 * i00;
+		const float z1 = (c1 - l10 * z0) * i11;
+		const float z2 = (c2 - l20 * z0 - l21 * z1) * i22;
+		const float z3 = (c3 - l30 * z0 - l31 * z1 - l32 * z2) * i33;
+		const float x3 = z3 * i33;
+		const float x2 = (z2 - l32 * x3) * i22;
+		const float x1 = (z1 - l21 * x2 - l31 * x3) * i11;
+		const float x0 = (z0 - l10 * x1 - l20 * x2 - l30 * x3) * i00;
+
+		const float asum = x0 + x1 + x2 + x3;
+		if (!(x0 != 0.f && asum != 0.f)) return ave;
+		return (x0 * n0 + x1 * n1 + x2 * n2 + x3 * n3) * (1.f / asum);
+	}
+
+	//target pixels are t[0], t[2], ..., t[2*(count-1)]; 8 pixels are estimated at once, and the 4x4 systems are solved in SoA.
+	static void nediLUFusedRow(float* t, const int count, const int* sample, const int sample_size, const int* regressor, const int* predictor, const float threshold, const float eps)
+	{
+		const int simd_count = get_simd_floor(count, 8);
+		const __m256 mthreshold = _mm256_set1_ps(threshold);
+		const __m256 meps = _mm256_set1_ps(eps);
+		const __m256 mquarter = _mm256_set1_ps(0.25f);
+		const __m256 mone = _mm256_set1_ps(1.f);
+		const __m256 mzero = _mm256_setzero_ps();
+		float out[8];
+		for (int k = 0; k < simd_count; k += 8)
+		{
+			float* p = t + 2 * k;
+			const __m256 n0 = _mm256_loadu_stride2_ps(p + predictor[0]);
+			const __m256 n1 = _mm256_loadu_stride2_ps(p + predictor[1]);
+			const __m256 n2 = _mm256_loadu_stride2_ps(p + predictor[2]);
+			const __m256 n3 = _mm256_loadu_stride2_ps(p + predictor[3]);
+			const __m256 ave = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_add_ps(n0, n1), n2), n3), mquarter);
+			const __m256 e0 = _mm256_sub_ps(ave, n0);
+			const __m256 e1 = _mm256_sub_ps(ave, n1);
+			const __m256 e2 = _mm256_sub_ps(ave, n2);
+			const __m256 e3 = _mm256_sub_ps(ave, n3);
+			const __m256 var = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e0, e0), _mm256_mul_ps(e1, e1)), _mm256_mul_ps(e2, e2)), _mm256_mul_ps(e3, e3)), mquarter);
+			const __m256 mask = _mm256_cmp_ps(var, mthreshold, _CMP_GE_OQ);
+			if (_mm256_movemask_ps(mask) == 0) continue;
+
+			__m256 a00 = mzero, a01 = mzero, a02 = mzero, a03 = mzero, a11 = mzero, a12 = mzero, a13 = mzero, a22 = mzero, a23 = mzero, a33 = mzero;
+			__m256 c0 = mzero, c1 = mzero, c2 = mzero, c3 = mzero;
+			for (int i = 0; i < sample_size; i++)
+			{
+				const float* s = p + sample[i];
+				const __m256 v = _mm256_loadu_stride2_ps(s);
+				const __m256 r0 = _mm256_loadu_stride2_ps(s + regressor[0]);
+				const __m256 r1 = _mm256_loadu_stride2_ps(s + regressor[1]);
+				const __m256 r2 = _mm256_loadu_stride2_ps(s + regressor[2]);
+				const __m256 r3 = _mm256_loadu_stride2_ps(s + regressor[3]);
+				c0 = _mm256_add_ps(c0, _mm256_mul_ps(v, r0));
+				c1 = _mm256_add_ps(c1, _mm256_mul_ps(v, r1));
+				c2 = _mm256_add_ps(c2, _mm256_mul_ps(v, r2));
+				c3 = _mm256_add_ps(c3, _mm256_mul_ps(v, r3));
+				a00 = _mm256_add_ps(a00, _mm256_mul_ps(r0, r0));
+				a01 = _mm256_add_ps(a01, _mm256_mul_ps(r0, r1));
+				a02 = _mm256_add_ps(a02, _mm256_mul_ps(r0, r2));
+				a03 = _mm256_add_ps(a03, _mm256_mul_ps(r0, r3));
+				a11 = _mm256_add_ps(a11, _mm256_mul_ps(r1, r1));
+				a12 = _mm256_add_ps(a12, _mm256_mul_ps(r1, r2));
+				a13 = _mm256_add_ps(a13, _mm256_mul_ps(r1, r3));
+				a22 = _mm256_add_ps(a22, _mm256_mul_ps(r2, r2));
+				a23 = _mm256_add_ps(a23, _mm256_mul_ps(r2, r3));
+				a33 = _mm256_add_ps(a33, _mm256_mul_ps(r3, r3));
+			}
+			a00 = _mm256_add_ps(a00, meps);
+			a11 = _mm256_add_ps(a11, meps);
+			a22 = _mm256_add_ps(a22, meps);
+			a33 = _mm256_add_ps(a33, meps);
+
+			//Cholesky decomposition
+			const __m256 i00 = _mm256_div_ps(mone, _mm256_sqrt_ps(a00));
+			const __m256 l10 = _mm256_mul_ps(a01, i00);
+			const __m256 l20 = _mm256_mul_ps(a02, i00);
+			const __m256 l30 = _mm256_mul_ps(a03, i00);
+			const __m256 d1 = _mm256_sub_ps(a11, _mm256_mul_ps(l10, l10));
+			const __m256 i11 = _mm256_div_ps(mone, _mm256_sqrt_ps(d1));
+			const __m256 l21 = _mm256_mul_ps(_mm256_sub_ps(a12, _mm256_mul_ps(l20, l10)), i11);
+			const __m256 l31 = _mm256_mul_ps(_mm256_sub_ps(a13, _mm256_mul_ps(l30, l10)), i11);
+			const __m256 d2 = _mm256_sub_ps(_mm256_sub_ps(a22, _mm256_mul_ps(l20, l20)), _mm256_mul_ps(l21, l21));
+			const __m256 i22 = _mm256_div_ps(mone, _mm256_sqrt_ps(d2));
+			const __m256 l32 = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(a23, _mm256_mul_ps(l30, l20)), _mm256_mul_ps(l31, l21)), i22);
+			const __m256 d3 = _mm256_sub_ps(_mm256_sub_ps(_mm256_sub_ps(a33, _mm256_mul_ps(l30, l30)), _mm256_mul_ps(l31, l31)), _mm256_mul_ps(l32, l32));
+			const __m256 i33 = _mm256_div_ps(mone, _mm256_sqrt_ps(d3));
+			__m256 valid = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(a00, mzero, _CMP_GT_OQ), _mm256_cmp_ps(d1, mzero, _CMP_GT_OQ)), _mm256_and_ps(_mm256_cmp_ps(d2, mzero, _CMP_GT_OQ), _mm256_cmp_ps(d3, mzero, _CMP_GT_OQ)));
+
+			//forward and backward substitution
+			const __m256 z0 = _mm256_mul_ps(c0, i00);
+			const __m256 z1 = _mm256_mul_ps(_mm256_sub_ps(c1, _mm256_mul_ps(l10, z0)), i11);
+			const __m256 z2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(c2, _mm256_mul_ps(l20, z0)), _mm256_mul_ps(l21, z1)), i22);
+			const __m256 z3 = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(_mm256_sub_ps(c3, _mm256_mul_ps(l30, z0)), _mm256_mul_ps(l31, z1)), _mm256_mul_ps(l32, z2)), i33);
+			const __m256 x3 = _mm256_mul_ps(z3, i33);
+			const __m256 x2 = _mm256_mul_ps(_mm256_sub_ps(z2, _mm256_mul_ps(l32, x3)), i22);
+			const __m256 x1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(z1, _mm256_mul_ps(l21, x2)), _mm256_mul_ps(l31, x3)), i11);
+			const __m256 x0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(_mm256_sub_ps(z0, _mm256_mul_ps(l10, x1)), _mm256_mul_ps(l20, x2)), _mm256_mul_ps(l30, x3)), i00);
+
+			const __m256 asum = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(x0, x1), x2), x3);
+			valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(x0, mzero, _CMP_NEQ_OQ), _mm256_cmp_ps(asum, mzero, _CMP_NEQ_OQ)));
+			const __m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x0, n0), _mm256_mul_ps(x1, n1)), _mm256_mul_ps(x2, n2)), _mm256_mul_ps(x3, n3));
+			const __m256 pred = _mm256_blendv_ps(ave, _mm256_mul_ps(dot, _mm256_div_ps(mone, asum)), valid);
+
+			_mm256_storeu_ps(out, _mm256_blendv_ps(_mm256_loadu_stride2_ps(p), pred, mask));
+			for (int i = 0; i < 8; i++) p[2 * i] = out[i];
+		}
+		for (int k = simd_count; k < count; k++)
+		{
+			t[2 * k] = nediLUCholeskyPixel(t + 2 * k, sample, sample_size, regressor, predictor, threshold, eps);
+		}
+	}
+
+	//diagonal pass: (odd, odd) from the 4 diagonal (even, even) pixels
+	static void nediLUFusedBandDiagonal(Mat& dim, const int ystart, const int yend, const int window_size, const int* sample, const int* regressor, const int* predictor, const float threshold, const float eps)
+	{
+		const int xstart = window_size + 1;
+		const int count = (dim.cols - (window_size + 1) - xstart + 1) / 2;
+		const int ymin = window_size + 1;
+		const int ymax = dim.rows - (window_size + 1);
+		for (int y = max(ystart, ymin); y < min(yend, ymax); y++)
+		{
+			if (((y - ymin) & 1) != 0) continue;
+			nediLUFusedRow(dim.ptr<float>(y, xstart), count, sample, window_size * window_size, regressor, predictor, threshold, eps);
+		}
+	}
+
+	//axial pass: (even, odd) and (odd, even) from the 4 axial pixels, which only refer to the original and the diagonal pass pixels
+	static void nediLUFusedBandAxial(Mat& dim, const int ystart, const int yend, const int window_size, const int* sample, const int* regressor, const int* predictor, const float threshold, const float eps)
+	{
+		for (int y = max(ystart, window_size * 2); y < yend; y++)
+		{
+			const int C = (y - window_size * 2) & 1;
+			if (y >= dim.rows - window_size * 2 - C) break;
+			const int xstart = window_size * 2 + 1 - C;
+			const int count = (dim.cols - (window_size * 2 + 1 - C) - xstart + 1) / 2;
+			nediLUFusedRow(dim.ptr<float>(y, xstart), count, sample, window_size * window_size, regressor, predictor, threshold, eps);
+		}
+	}
+
+	void NewEdgeDirectedInterpolation::upsampleGrayDoubleLUFused(const cv::Mat& sim, cv::Mat& dim, const float threshold, const int window_size, const float eps)
+	{
+		//with an odd window, the stride-2 samples include targets of the same pass, which other bands write in a thread-dependent order.
+		//Only even windows keep the output independent of the thread count.
+		CV_Assert(window_size % 2 == 0);
+
+		//copy src to dest(2y,2x)
+		cp::upsampleCubic_parallel(sim, dim, 2, -1.5);
+
+		const int width = dim.cols;
+		const int height = dim.rows;
+
+		//offsets from a target pixel: window samples, regressors of each sample, and predictors of the target
+		AutoBuffer<int> diagonal_sample(window_size * window_size);
+		AutoBuffer<int> axial_sample(window_size * window_size);
+		for (int Y = 0; Y < window_size; Y++)
+		{
+			for (int X = 0; X < window_size; X++)
+			{
+				diagonal_sample[window_size * Y + X] = (2 * Y - (window_size - 1)) * width + (2 * X - (window_size - 1));
+				axial_sample[window_size * Y + X] = (Y - X) * width + (Y + X - (window_size - 1));
+			}
+		}
+		const int diagonal_regressor[4] = { -2 - 2 * width, 2 - 2 * width, -2 + 2 * width, 2 + 2 * width };
+		const int diagonal_predictor[4] = { -1 - width, 1 - width, -1 + width, 1 + width };
+		const int axial_regressor[4] = { -2, -2 * width, 2 * width, 2 };
+		const int axial_predictor[4] = { -1, -width, width, 1 };
+
+		//the axial pass of a row refers to the diagonal pass pixels within +-(window_size+1) rows,
+		//so that the axial pass of band k can run after the diagonal pass of band k-1, k, k+1.
+		const int band_height = max(32, 2 * (window_size + 2));
+		const int band_num = (height + band_height - 1) / band_height;
+		std::vector<std::atomic<int>> diagonal_done(band_num);
+		for (int k = 0; k < band_num; k++) diagonal_done[k].store(0);
+
+		const int thread_max = max(1, min(omp_get_max_threads(), band_num));
+#pragma omp parallel num_threads(thread_max)
+		{
+			const int tindex = omp_get_thread_num();
+			const int nthreads = omp_get_num_threads();
+			//each thread has a contiguous range of bands; the diagonal pass runs one band ahead of the axial pass.
+			const int kstart = band_num * tindex / nthreads;
+			const int kend = band_num * (tindex + 1) / nthreads;
+			if (kstart < kend)
+			{
+				nediLUFusedBandDiagonal(dim, kstart * band_height, (kstart + 1) * band_height, window_size, diagonal_sample, diagonal_regressor, diagonal_predictor, threshold, eps);
+				diagonal_done[kstart].store(1, std::memory_order_release);
+			}
+			for (int k = kstart; k < kend; k++)
+			{
+				if (k + 1 < kend)
+				{
+					nediLUFusedBandDiagonal(dim, (k + 1) * band_height, (k + 2) * band_height, window_size, diagonal_sample, diagonal_regressor, diagonal_predictor, threshold, eps);
+					diagonal_done[k + 1].store(1, std::memory_order_release);
+				}
+				else if (k + 1 < band_num)
+				{
+					while (diagonal_done[k + 1].load(std::memory_order_acquire) == 0) _mm_pause();
+				}
+				if (k == kstart && k > 0)
+				{
+					while (diagonal_done[k - 1].load(std::memory_order_acquire) == 0) _mm_pause();
+				}
+
+				nediLUFusedBandAxial(dim, k * band_height, (k + 1) * band_height, window_size, axial_sample, axial_regressor, axial_predictor, threshold, eps);
+			}
+		}
+	}
+
 	void NewEdgeDirectedInterpolation::upsample(InputArray src, OutputArray dest, const int scale, const float threshold, const int WindowSize, int method)
 	{
 		CV_Assert(!src.empty());
@@ -632,6 +891,10 @@ namespace cp
 					//upsampleGrayDoubleLU(image_border[i], dest_border[i], threshold, WindowSize);
 					upsampleGrayDoubleLUOpt(image_border[i], dest_border[i], threshold, WindowSize, float(eps * 1.0 / 2560.0));
 				}
+				else if (method == 2)
+				{
+					upsampleGrayDoubleLUFused(image_border[i], dest_border[i], threshold, WindowSize, float(eps * 1.0 / 2560.0));
+				}
 			}
 
 			int i = level - 1;
@@ -670,6 +933,10 @@ namespace cp
 						//upsampleGrayDoubleLU(image_border[i], dest_border[i], threshold, WindowSize);
 						upsampleGrayDoubleLUOpt(image_border[i], dest_border[i], threshold, WindowSize, float(eps * 1.0 / 2560.0));
 					}
+					else if (method == 2)
+					{
+						upsampleGrayDoubleLUFused(image_border[i], dest_border[i], threshold, WindowSize, float(eps * 1.0 / 2560.0));
+					}
 
 				}
 
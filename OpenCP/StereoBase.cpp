@@ -529,26 +529,44 @@ namespace cp
 #pragma endregion
 
 #pragma region matching:postfiltering
+		postFiltering(leftim, destDisparityMap);
+
+#ifdef TIMER_STEREO_BASE
+		cout << "=====================" << endl;
+#endif
+#pragma endregion
+	}
+
+	//post filtering of the WTA disparity map: uniqueness, subpixel, LR check, speckle, hole filling and refinement
+	void StereoBase::postFiltering(Mat& leftim, Mat& destDisparityMap)
+	{
+#ifdef TIMER_STEREO_BASE
+		Timer t("===Post Filterings===");
+#endif
 		{
 #ifdef TIMER_STEREO_BASE
-			Timer t("===Post Filterings===");
+			Timer t("Post: uniqueness");
 #endif
-			{
+			uniquenessFilter(minCostMap, destDisparityMap);
+		}
+		//subpix;
+		{
 #ifdef TIMER_STEREO_BASE
-				Timer t("Post: uniqueness");
+			Timer t("Post: subpix");
 #endif
-				uniquenessFilter(minCostMap, destDisparityMap);
-			}
-			//subpix;
-			{
+			subpixelInterpolation(destDisparityMap, (SUBPIXEL)subpixelInterpolationMethod);
+			if (isRangeFilterSubpix) binaryWeightedRangeFilter(destDisparityMap, destDisparityMap, subpixelRangeFilterWindow, (float)subpixelRangeFilterCap);
+		}
+		//R depth map;
+		if (isFusedPostFilter)
+		{
 #ifdef TIMER_STEREO_BASE
-				Timer t("Post: subpix");
+			Timer t("Post: fused LR, mincost, speckle and occlusion");
 #endif
-				subpixelInterpolation(destDisparityMap, (SUBPIXEL)subpixelInterpolationMethod);
-				if (isRangeFilterSubpix) binaryWeightedRangeFilter(destDisparityMap, destDisparityMap, subpixelRangeFilterWindow, (float)subpixelRangeFilterCap);
-			}
-			//R depth map;
-
+			fusedPostFilter(minCostMap, destDisparityMap);
+		}
+		else
+		{
 			{
 #ifdef TIMER_STEREO_BASE
 				Timer t("Post: LR");
@@ -575,234 +593,537 @@ namespace cp
 				if (isSpeckleFilter)
 					filterSpeckles(destDisparityMap, 0, speckleWindowSize, speckleRange, specklebuffer);
 			}
+		}
 
+		{
+			if (!isFusedPostFilter) computeValidRatio(destDisparityMap);
+
+			int occsearch2 = 4;
+			int occth = 17;
+			int occsearch = 4;
+			int occsearchh = 2;
+			int occiter = 0;
+			if (holeFillingMethod == 1 && !isFusedPostFilter)
 			{
-				computeValidRatio(destDisparityMap);
-
-				int occsearch2 = 4;
-				int occth = 17;
-				int occsearch = 4;
-				int occsearchh = 2;
-				int occiter = 0;
-				if (holeFillingMethod == 1)
-				{
 #ifdef TIMER_STEREO_BASE
-					Timer t("occ");
+				Timer t("occ");
 #endif
-					//fillOcclusion(destDisparity, (minDisparity - 1) * 16);
-					fillOcclusion(destDisparityMap);
-				}
-				else if (holeFillingMethod == 2)
+				//fillOcclusion(destDisparity, (minDisparity - 1) * 16);
+				fillOcclusion(destDisparityMap);
+			}
+			else if (holeFillingMethod == 2)
+			{
+				fillOcclusion(destDisparityMap);
 				{
-					fillOcclusion(destDisparityMap);
-					{
-						//Timer t("border");
-						correctDisparityBoundaryE<short>(destDisparityMap, leftim, occsearch, occth, destDisparityMap, occsearch2, 32);
-					}
+					//Timer t("border");
+					correctDisparityBoundaryE<short>(destDisparityMap, leftim, occsearch, occth, destDisparityMap, occsearch2, 32);
 				}
-				else if (holeFillingMethod == 3)
-				{
-					fillOcclusion(destDisparityMap);
-					correctDisparityBoundaryEC<short>(destDisparityMap, leftim, occsearch, occth, destDisparityMap);
+			}
+			else if (holeFillingMethod == 3)
+			{
+				fillOcclusion(destDisparityMap);
+				correctDisparityBoundaryEC<short>(destDisparityMap, leftim, occsearch, occth, destDisparityMap);
+
+				Mat dt;
+				transpose(destDisparityMap, dt);
+				Mat lt; transpose(leftim, lt);
+
+				correctDisparityBoundaryECV<short>(dt, lt, occsearchh, occth, dt);
+				Mat dest2;
+				transpose(dt, dest2);
+				Mat mask = Mat::zeros(destDisparityMap.size(), CV_8U);
+				cv::rectangle(mask, Rect(40, 40, destDisparityMap.cols - 80, destDisparityMap.rows - 80), 255, FILLED);
+				dest2.copyTo(destDisparityMap, mask);
+			}
+			else if (holeFillingMethod == 4)
+			{
+				fillOcclusion(destDisparityMap);
 
+				correctDisparityBoundaryE<short>(destDisparityMap, leftim, occsearch, 32, destDisparityMap, occsearch2, 30);
+
+				for (int i = 0; i < occiter; i++)
+				{
 					Mat dt;
 					transpose(destDisparityMap, dt);
 					Mat lt; transpose(leftim, lt);
-
-					correctDisparityBoundaryECV<short>(dt, lt, occsearchh, occth, dt);
-					Mat dest2;
-					transpose(dt, dest2);
-					Mat mask = Mat::zeros(destDisparityMap.size(), CV_8U);
-					cv::rectangle(mask, Rect(40, 40, destDisparityMap.cols - 80, destDisparityMap.rows - 80), 255, FILLED);
-					dest2.copyTo(destDisparityMap, mask);
-				}
-				else if (holeFillingMethod == 4)
-				{
-					fillOcclusion(destDisparityMap);
-
+					correctDisparityBoundaryE<short>(dt, lt, 2, 32, destDisparityMap, occsearch2, 30);
+					transpose(dt, destDisparityMap);
 					correctDisparityBoundaryE<short>(destDisparityMap, leftim, occsearch, 32, destDisparityMap, occsearch2, 30);
-
-					for (int i = 0; i < occiter; i++)
-					{
-						Mat dt;
-						transpose(destDisparityMap, dt);
-						Mat lt; transpose(leftim, lt);
-						correctDisparityBoundaryE<short>(dt, lt, 2, 32, destDisparityMap, occsearch2, 30);
-						transpose(dt, destDisparityMap);
-						correctDisparityBoundaryE<short>(destDisparityMap, leftim, occsearch, 32, destDisparityMap, occsearch2, 30);
-						filterSpeckles(destDisparityMap, 0, speckleWindowSize, speckleRange);
-						fillOcclusion(destDisparityMap);
-					}
+					filterSpeckles(destDisparityMap, 0, speckleWindowSize, speckleRange);
+					fillOcclusion(destDisparityMap);
 				}
 			}
+		}
 #pragma region refinement
 
-			{
+		{
 #ifdef TIMER_STEREO_BASE
-				Timer t("Post: refinement");
+			Timer t("Post: refinement");
 #endif
 
-				static int rrad = 5; createTrackbar("rrad", "", &rrad, 100);
-				static int ss = 32; createTrackbar("ss", "", &ss, 10000);
-				static int sr1 = 32; createTrackbar("sr1", "", &sr1, 250);
-				static int sr2 = 32; createTrackbar("sr2", "", &sr2, 250);
+			static int rrad = 5; createTrackbar("rrad", "", &rrad, 100);
+			static int ss = 32; createTrackbar("ss", "", &ss, 10000);
+			static int sr1 = 32; createTrackbar("sr1", "", &sr1, 250);
+			static int sr2 = 32; createTrackbar("sr2", "", &sr2, 250);
 
-				if (refinementMethod == (int)REFINEMENT::GIF_JNF)
-				{
-					//crossBasedAdaptiveBoxFilter(destDisparity, leftim, destDisparity, Size(2 * gr + 1, 2 * gr + 1), ge);
+			if (refinementMethod == (int)REFINEMENT::GIF_JNF)
+			{
+				//crossBasedAdaptiveBoxFilter(destDisparity, leftim, destDisparity, Size(2 * gr + 1, 2 * gr + 1), ge);
 
-					Mat temp;
-					guidedImageFilter(destDisparityMap, leftim, temp, refinementR, (float)refinementSigmaRange, GUIDED_SEP_VHI);
-					jointNearestFilter(temp, destDisparityMap, Size(2 * jointNearestR + 1, 2 * jointNearestR + 1), destDisparityMap);
-				}
-				else if (refinementMethod == (int)REFINEMENT::WGIF_GAUSS_JNF)
+				Mat temp;
+				guidedImageFilter(destDisparityMap, leftim, temp, refinementR, (float)refinementSigmaRange, GUIDED_SEP_VHI);
+				jointNearestFilter(temp, destDisparityMap, Size(2 * jointNearestR + 1, 2 * jointNearestR + 1), destDisparityMap);
+			}
+			else if (refinementMethod == (int)REFINEMENT::WGIF_GAUSS_JNF)
+			{
+				weightMap.create(leftim.size(), CV_32F);
+				const Size ksize = Size(2 * refinementWeightR + 1, 2 * refinementWeightR + 1);
+
+				Mat bim;
+				GaussianBlur(destDisparityMap, bim, ksize, refinementWeightR / 3.0);
+				short* disp = destDisparityMap.ptr<short>(0);
+				short* dispb = bim.ptr<short>();
+				float* s = weightMap.ptr<float>();
+				for (int i = 0; i < weightMap.size().area(); i++)
 				{
-					weightMap.create(leftim.size(), CV_32F);
-					const Size ksize = Size(2 * refinementWeightR + 1, 2 * refinementWeightR + 1);
+					float diff = (disp[i] - dispb[i]) * (disp[i] - dispb[i]) / (-2.f * 16 * 16 * refinementWeightSigma * refinementWeightSigma);
+					s[i] = exp(diff);
+				}
 
-					Mat bim;
-					GaussianBlur(destDisparityMap, bim, ksize, refinementWeightR / 3.0);
-					short* disp = destDisparityMap.ptr<short>(0);
-					short* dispb = bim.ptr<short>();
-					float* s = weightMap.ptr<float>();
-					for (int i = 0; i < weightMap.size().area(); i++)
-					{
-						float diff = (disp[i] - dispb[i]) * (disp[i] - dispb[i]) / (-2.f * 16 * 16 * refinementWeightSigma * refinementWeightSigma);
-						s[i] = exp(diff);
-					}
+				Mat a, b;
+				multiply(destDisparityMap, weightMap, a, 1, CV_32F);
+				guidedImageFilter(a, leftim, a, refinementR, refinementSigmaRange, GUIDED_SEP_VHI);
+				guidedImageFilter(weightMap, leftim, b, refinementR, refinementSigmaRange, GUIDED_SEP_VHI);
+				Mat temp;
+				divide(a, b, temp, 1, CV_16S);
+				jointNearestFilter(temp, destDisparityMap, Size(2 * jointNearestR + 1, 2 * jointNearestR + 1), destDisparityMap);
+			}
+			else if (refinementMethod == (int)REFINEMENT::WGIF_BFSUB_JNF)
+			{
+				weightMap.create(leftim.size(), CV_32F);
+				const Size ksize = Size(2 * refinementWeightR + 1, 2 * refinementWeightR + 1);
+
+				Mat bim;
+
+				Mat sim; destDisparityMap.convertTo(sim, CV_32F);
+				//cp::bilateralFilter(sim, bim, ksize, 100, refinementWeightR / 3.0);
+				cv::bilateralFilter(sim, bim, 2 * refinementWeightR + 1, 100, refinementWeightR / 3.0);
+				float* disp = sim.ptr<float>();
+				float* dispb = bim.ptr<float>();
+				float* s = weightMap.ptr<float>();
+				for (int i = 0; i < weightMap.size().area(); i++)
+				{
+					float diff = (disp[i] - dispb[i]) * (disp[i] - dispb[i]) / (-2.f * 16 * 16 * refinementWeightSigma * refinementWeightSigma);
+					s[i] = exp(diff);
+				}
 
-					Mat a, b;
-					multiply(destDisparityMap, weightMap, a, 1, CV_32F);
-					guidedImageFilter(a, leftim, a, refinementR, refinementSigmaRange, GUIDED_SEP_VHI);
-					guidedImageFilter(weightMap, leftim, b, refinementR, refinementSigmaRange, GUIDED_SEP_VHI);
-					Mat temp;
-					divide(a, b, temp, 1, CV_16S);
-					jointNearestFilter(temp, destDisparityMap, Size(2 * jointNearestR + 1, 2 * jointNearestR + 1), destDisparityMap);
+				/*
+				 //min cost weight map
+				uchar* minc = minCostMap.ptr<uchar>();
+				float* s = weightMap.ptr<float>();
+				for (int i = 0; i < weightMap.size().area(); i++)
+				{
+					float diff = (minc[i]) / (-2.f * 16 * 16 * refinementWeightSigma * refinementWeightSigma);
+					s[i] = exp(diff);
+				}*/
+
+				Mat a, b;
+				multiply(destDisparityMap, weightMap, a, 1, CV_32F);
+				guidedImageFilter(a, leftim, a, refinementR, refinementSigmaRange, GUIDED_SEP_VHI);
+				guidedImageFilter(weightMap, leftim, b, refinementR, refinementSigmaRange, GUIDED_SEP_VHI);
+				Mat temp;
+				divide(a, b, temp, 1, CV_16S);
+				jointNearestFilter(temp, destDisparityMap, Size(2 * jointNearestR + 1, 2 * jointNearestR + 1), destDisparityMap);
+			}
+			else if (refinementMethod == (int)REFINEMENT::WGIF_BFW_JNF)
+			{
+				weightMap.create(leftim.size(), CV_32F);
+				const Size ksize = Size(4 * refinementWeightR + 1, 4 * refinementWeightR + 1);
+
+				cp::bilateralWeightMap(destDisparityMap, weightMap, Size(2 * rrad + 1, 2 * rrad + 1), sr1, ss, 0, 1);
+
+				Mat a, b;
+				multiply(destDisparityMap, weightMap, a, 1, CV_32F);
+				guidedImageFilter(a, leftim, a, refinementR, refinementSigmaRange, GUIDED_SEP_VHI);
+				guidedImageFilter(weightMap, leftim, b, refinementR, refinementSigmaRange, GUIDED_SEP_VHI);
+				Mat temp;
+				divide(a, b, temp, 1, CV_16S);
+				jointNearestFilter(temp, destDisparityMap, Size(2 * jointNearestR + 1, 2 * jointNearestR + 1), destDisparityMap);
+			}
+			else if (refinementMethod == (int)REFINEMENT::WGIF_DUALBFW_JNF)
+			{
+				weightMap.create(leftim.size(), CV_32F);
+				const Size ksize = Size(4 * refinementWeightR + 1, 4 * refinementWeightR + 1);
+
+				cp::dualBilateralWeightMap(destDisparityMap, leftim, weightMap, Size(2 * rrad + 1, 2 * rrad + 1), sr1, sr2, 100000, 0, 1);
+
+				Mat a, b;
+				multiply(destDisparityMap, weightMap, a, 1, CV_32F);
+				guidedImageFilter(a, leftim, a, refinementR, refinementSigmaRange, GUIDED_SEP_VHI);
+				guidedImageFilter(weightMap, leftim, b, refinementR, refinementSigmaRange, GUIDED_SEP_VHI);
+				Mat temp;
+				divide(a, b, temp, 1, CV_16S);
+				jointNearestFilter(temp, destDisparityMap, Size(2 * jointNearestR + 1, 2 * jointNearestR + 1), destDisparityMap);
+			}
+			else if (refinementMethod == (int)REFINEMENT::JBF_JNF)
+			{
+				Mat temp;
+				jointBilateralFilter(destDisparityMap, leftim, temp, 2 * refinementR + 1, refinementSigmaRange, refinementSigmaSpace);
+				jointNearestFilter(temp, destDisparityMap, Size(2 * jointNearestR + 1, 2 * jointNearestR + 1), destDisparityMap);
+			}
+			else if (refinementMethod == (int)REFINEMENT::WJBF_GAUSS_JNF)
+			{
+				Mat bim;
+				GaussianBlur(destDisparityMap, bim, Size(2 * refinementWeightR + 1, 2 * refinementWeightR + 1), refinementWeightR / 3.0);
+				short* disp = destDisparityMap.ptr<short>(0);
+				short* dispb = bim.ptr<short>(0);
+				float* s = weightMap.ptr<float>();
+				for (int i = 0; i < weightMap.size().area(); i++)
+				{
+					float diff = (disp[i] - dispb[i]) * (disp[i] - dispb[i]) / (-2.f * 16 * 16 * refinementWeightSigma * refinementWeightSigma);
+					s[i] = exp(diff);
 				}
-				else if (refinementMethod == (int)REFINEMENT::WGIF_BFSUB_JNF)
+
+				Mat temp;
+				weightedJointBilateralFilter(destDisparityMap, weightMap, leftim, temp, 2 * refinementR + 1, refinementSigmaRange, refinementSigmaSpace);
+				jointNearestFilter(temp, destDisparityMap, Size(2 * jointNearestR + 1, 2 * jointNearestR + 1), destDisparityMap);
+			}
+			else if (refinementMethod == (int)REFINEMENT::WMF)
+			{
+				cp::weightedModeFilter(destDisparityMap, leftim, destDisparityMap, refinementR, refinementSigmaRange, refinementSigmaSpace, refinementSigmaHistogram);
+			}
+			else if (refinementMethod == (int)REFINEMENT::WWMF_GAUSS)
+			{
+				Mat bim;
+				GaussianBlur(destDisparityMap, bim, Size(2 * refinementWeightR + 1, 2 * refinementWeightR + 1), refinementWeightR / 3.0);
+				short* disp = destDisparityMap.ptr<short>(0);
+				short* dispb = bim.ptr<short>(0);
+				float* s = weightMap.ptr<float>();
+				for (int i = 0; i < weightMap.size().area(); i++)
 				{
-					weightMap.create(leftim.size(), CV_32F);
-					const Size ksize = Size(2 * refinementWeightR + 1, 2 * refinementWeightR + 1);
+					float diff = (disp[i] - dispb[i]) * (disp[i] - dispb[i]) / (-2.f * 16 * 16 * refinementWeightSigma * refinementWeightSigma);
+					s[i] = exp(diff);
+				}
+
+				cp::weightedModeFilter(destDisparityMap, leftim, destDisparityMap, refinementR, refinementSigmaRange, refinementSigmaSpace, refinementSigmaHistogram);
+			}
+		}
+#pragma endregion
+	}
 
-					Mat bim;
+	void StereoBase::operator()(Mat& leftim, Mat& rightim, Mat& dest)
+	{
+		matching(leftim, rightim, dest);
+	}
 
-					Mat sim; destDisparityMap.convertTo(sim, CV_32F);
-					//cp::bilateralFilter(sim, bim, ksize, 100, refinementWeightR / 3.0);
-					cv::bilateralFilter(sim, bim, 2 * refinementWeightR + 1, 100, refinementWeightR / 3.0);
-					float* disp = sim.ptr<float>();
-					float* dispb = bim.ptr<float>();
-					float* s = weightMap.ptr<float>();
-					for (int i = 0; i < weightMap.size().area(); i++)
-					{
-						float diff = (disp[i] - dispb[i]) * (disp[i] - dispb[i]) / (-2.f * 16 * 16 * refinementWeightSigma * refinementWeightSigma);
-						s[i] = exp(diff);
-					}
+#pragma region parameter sweep
+	StereoBase::Parameter StereoBase::getParameter()
+	{
+		Parameter ret;
+		ret.preFilterCap = preFilterCap;
+		ret.pixelMatchingMethod = pixelMatchingMethod;
+		ret.color_distance = color_distance;
+		ret.pixelMatchErrorCap = pixelMatchErrorCap;
+		ret.costAlphaImageSobel = costAlphaImageSobel;
+		ret.aggregationMethod = aggregationMethod;
+		ret.aggregationRadiusH = aggregationRadiusH;
+		ret.aggregationRadiusV = aggregationRadiusV;
+		ret.aggregationGuidedfilterEps = aggregationGuidedfilterEps;
+		ret.aggregationSigmaSpace = aggregationSigmaSpace;
+		ret.P1 = P1;
+		ret.P2 = P2;
+		ret.isUniquenessFilter = isUniquenessFilter;
+		ret.uniquenessRatio = uniquenessRatio;
+		ret.subpixelInterpolationMethod = subpixelInterpolationMethod;
+		ret.isRangeFilterSubpix = isRangeFilterSubpix;
+		ret.LRCheckMethod = LRCheckMethod;
+		ret.isMinCostFilter = isMinCostFilter;
+		ret.isSpeckleFilter = isSpeckleFilter;
+		ret.holeFillingMethod = holeFillingMethod;
+		ret.refinementMethod = refinementMethod;
+		ret.refinementR = refinementR;
+		ret.refinementSigmaRange = refinementSigmaRange;
+		ret.refinementSigmaSpace = refinementSigmaSpace;
+		ret.jointNearestR = jointNearestR;
+		return ret;
+	}
 
-					/*
-					 //min cost weight map
-					uchar* minc = minCostMap.ptr<uchar>();
-					float* s = weightMap.ptr<float>();
-					for (int i = 0; i < weightMap.size().area(); i++)
-					{
-						float diff = (minc[i]) / (-2.f * 16 * 16 * refinementWeightSigma * refinementWeightSigma);
-						s[i] = exp(diff);
-					}*/
+	void StereoBase::setParameter(const Parameter& param)
+	{
+		preFilterCap = param.preFilterCap;
+		pixelMatchingMethod = param.pixelMatchingMethod;
+		color_distance = param.color_distance;
+		pixelMatchErrorCap = param.pixelMatchErrorCap;
+		costAlphaImageSobel = param.costAlphaImageSobel;
+		aggregationMethod = param.aggregationMethod;
+		aggregationRadiusH = param.aggregationRadiusH;
+		aggregationRadiusV = param.aggregationRadiusV;
+		aggregationGuidedfilterEps = param.aggregationGuidedfilterEps;
+		aggregationSigmaSpace = param.aggregationSigmaSpace;
+		P1 = param.P1;
+		P2 = param.P2;
+		isUniquenessFilter = param.isUniquenessFilter;
+		uniquenessRatio = param.uniquenessRatio;
+		subpixelInterpolationMethod = param.subpixelInterpolationMethod;
+		isRangeFilterSubpix = param.isRangeFilterSubpix;
+		LRCheckMethod = param.LRCheckMethod;
+		isMinCostFilter = param.isMinCostFilter;
+		isSpeckleFilter = param.isSpeckleFilter;
+		holeFillingMethod = param.holeFillingMethod;
+		refinementMethod = param.refinementMethod;
+		refinementR = param.refinementR;
+		refinementSigmaRange = param.refinementSigmaRange;
+		refinementSigmaSpace = param.refinementSigmaSpace;
+		jointNearestR = param.jointNearestR;
+	}
 
-					Mat a, b;
-					multiply(destDisparityMap, weightMap, a, 1, CV_32F);
-					guidedImageFilter(a, leftim, a, refinementR, refinementSigmaRange, GUIDED_SEP_VHI);
-					guidedImageFilter(weightMap, leftim, b, refinementR, refinementSigmaRange, GUIDED_SEP_VHI);
-					Mat temp;
-					divide(a, b, temp, 1, CV_16S);
-					jointNearestFilter(temp, destDisparityMap, Size(2 * jointNearestR + 1, 2 * jointNearestR + 1), destDisparityMap);
-				}
-				else if (refinementMethod == (int)REFINEMENT::WGIF_BFW_JNF)
-				{
-					weightMap.create(leftim.size(), CV_32F);
-					const Size ksize = Size(4 * refinementWeightR + 1, 4 * refinementWeightR + 1);
+	static auto sweepCostKey(const StereoBase::Parameter& p)
+	{
+		return std::make_tuple(p.preFilterCap, p.pixelMatchingMethod, p.color_distance, p.pixelMatchErrorCap, p.costAlphaImageSobel);
+	}
 
-					cp::bilateralWeightMap(destDisparityMap, weightMap, Size(2 * rrad + 1, 2 * rrad + 1), sr1, ss, 0, 1);
+	static auto sweepAggregationKey(const StereoBase::Parameter& p)
+	{
+		return std::make_tuple(p.aggregationMethod, p.aggregationRadiusH, p.aggregationRadiusV, p.aggregationGuidedfilterEps, p.aggregationSigmaSpace);
+	}
 
-					Mat a, b;
-					multiply(destDisparityMap, weightMap, a, 1, CV_32F);
-					guidedImageFilter(a, leftim, a, refinementR, refinementSigmaRange, GUIDED_SEP_VHI);
-					guidedImageFilter(weightMap, leftim, b, refinementR, refinementSigmaRange, GUIDED_SEP_VHI);
-					Mat temp;
-					divide(a, b, temp, 1, CV_16S);
-					jointNearestFilter(temp, destDisparityMap, Size(2 * jointNearestR + 1, 2 * jointNearestR + 1), destDisparityMap);
-				}
-				else if (refinementMethod == (int)REFINEMENT::WGIF_DUALBFW_JNF)
-				{
-					weightMap.create(leftim.size(), CV_32F);
-					const Size ksize = Size(4 * refinementWeightR + 1, 4 * refinementWeightR + 1);
+	static auto sweepOptimizationKey(const StereoBase::Parameter& p)
+	{
+		return std::make_tuple(p.P1, p.P2);
+	}
 
-					cp::dualBilateralWeightMap(destDisparityMap, leftim, weightMap, Size(2 * rrad + 1, 2 * rrad + 1), sr1, sr2, 100000, 0, 1);
+	void StereoBase::matchingSweep(Mat& leftim, Mat& rightim, const vector<Parameter>& parameters, vector<Mat>& dest)
+	{
+		const int num = (int)parameters.size();
+		dest.resize(num);
+		if (num == 0) return;
+		const Parameter backup = getParameter();
+
+		//depth-first order of the configuration tree (cost -> aggregation -> optimization -> post filtering),
+		//so that each stage is recomputed only when its prefix changes
+		vector<int> order(num);
+		for (int i = 0; i < num; i++) order[i] = i;
+		std::stable_sort(order.begin(), order.end(), [&](const int a, const int b)
+			{
+				const Parameter& pa = parameters[a];
+				const Parameter& pb = parameters[b];
+				return std::make_tuple(sweepCostKey(pa), sweepAggregationKey(pa), sweepOptimizationKey(pa))
+					< std::make_tuple(sweepCostKey(pb), sweepAggregationKey(pb), sweepOptimizationKey(pb));
+			});
+
+		if ((int)DSI.size() < numberOfDisparities) DSI.resize(numberOfDisparities);
+		if ((int)DSICost.size() < numberOfDisparities) DSICost.resize(numberOfDisparities);
+		if ((int)DSIAggregation.size() < numberOfDisparities) DSIAggregation.resize(numberOfDisparities);
+		computeGuideImageForAggregation(leftim);
 
-					Mat a, b;
-					multiply(destDisparityMap, weightMap, a, 1, CV_32F);
-					guidedImageFilter(a, leftim, a, refinementR, refinementSigmaRange, GUIDED_SEP_VHI);
-					guidedImageFilter(weightMap, leftim, b, refinementR, refinementSigmaRange, GUIDED_SEP_VHI);
-					Mat temp;
-					divide(a, b, temp, 1, CV_16S);
-					jointNearestFilter(temp, destDisparityMap, Size(2 * jointNearestR + 1, 2 * jointNearestR + 1), destDisparityMap);
+		for (int n = 0; n < num; n++)
+		{
+			const Parameter& param = parameters[order[n]];
+			const Parameter* prev = (n == 0) ? nullptr : &parameters[order[n - 1]];
+			const bool isNewCost = (prev == nullptr) || sweepCostKey(param) != sweepCostKey(*prev);
+			const bool isNewAggregation = isNewCost || sweepAggregationKey(param) != sweepAggregationKey(*prev);
+			const bool isNewOptimization = isNewAggregation || sweepOptimizationKey(param) != sweepOptimizationKey(*prev);
+			setParameter(param);
+
+			if (isNewCost)
+			{
+#ifdef TIMER_STEREO_BASE
+				Timer t("Sweep: pre filter & cost computation");
+#endif
+				computePrefilter(leftim, rightim);
+#pragma omp parallel for
+				for (int i = 0; i < numberOfDisparities; i++)
+				{
+					computePixelMatchingCost(minDisparity + i, DSICost[i]);
 				}
-				else if (refinementMethod == (int)REFINEMENT::JBF_JNF)
+			}
+
+			if (isNewAggregation)
+			{
+#ifdef TIMER_STEREO_BASE
+				Timer t("Sweep: cost aggregation");
+#endif
+				if (aggregationMethod == CrossBasedBox) clf.makeKernel(guideImage, aggregationRadiusH, (int)aggregationGuidedfilterEps, 0);
+#pragma omp parallel for
+				for (int i = 0; i < numberOfDisparities; i++)
 				{
-					Mat temp;
-					jointBilateralFilter(destDisparityMap, leftim, temp, 2 * refinementR + 1, refinementSigmaRange, refinementSigmaSpace);
-					jointNearestFilter(temp, destDisparityMap, Size(2 * jointNearestR + 1, 2 * jointNearestR + 1), destDisparityMap);
+					computeCostAggregation(DSICost[i], DSIAggregation[i], guideImage);
 				}
-				else if (refinementMethod == (int)REFINEMENT::WJBF_GAUSS_JNF)
+			}
+
+			if (isNewOptimization)
+			{
+#ifdef TIMER_STEREO_BASE
+				Timer t("Sweep: cost optimization");
+#endif
+				if (P1 != 0 && P2 != 0)
 				{
-					Mat bim;
-					GaussianBlur(destDisparityMap, bim, Size(2 * refinementWeightR + 1, 2 * refinementWeightR + 1), refinementWeightR / 3.0);
-					short* disp = destDisparityMap.ptr<short>(0);
-					short* dispb = bim.ptr<short>(0);
-					float* s = weightMap.ptr<float>();
-					for (int i = 0; i < weightMap.size().area(); i++)
+					//scanline optimization is in-place, so the aggregated costs are copied
+					for (int i = 0; i < numberOfDisparities; i++)
 					{
-						float diff = (disp[i] - dispb[i]) * (disp[i] - dispb[i]) / (-2.f * 16 * 16 * refinementWeightSigma * refinementWeightSigma);
-						s[i] = exp(diff);
+						if (DSI[i].data == DSIAggregation[i].data) DSI[i].release();
+						DSIAggregation[i].copyTo(DSI[i]);
 					}
-
-					Mat temp;
-					weightedJointBilateralFilter(destDisparityMap, weightMap, leftim, temp, 2 * refinementR + 1, refinementSigmaRange, refinementSigmaSpace);
-					jointNearestFilter(temp, destDisparityMap, Size(2 * jointNearestR + 1, 2 * jointNearestR + 1), destDisparityMap);
+					computeOptimizeScanline();
 				}
-				else if (refinementMethod == (int)REFINEMENT::WMF)
+				else
 				{
-					cp::weightedModeFilter(destDisparityMap, leftim, destDisparityMap, refinementR, refinementSigmaRange, refinementSigmaSpace, refinementSigmaHistogram);
+					//the post filters only read DSI
+					for (int i = 0; i < numberOfDisparities; i++) DSI[i] = DSIAggregation[i];
 				}
-				else if (refinementMethod == (int)REFINEMENT::WWMF_GAUSS)
+			}
+
+			Mat& destDisparityMap = dest[order[n]];
+			destDisparityMap.create(leftim.size(), CV_16S);
+			minCostMap.create(leftim.size(), CV_8U);
+			minCostMap.setTo(255);
+			computeWTA(DSI, destDisparityMap, minCostMap);
+			postFiltering(leftim, destDisparityMap);
+		}
+
+		//DSI must not alias the memoized stages for the next matching call
+		for (int i = 0; i < numberOfDisparities; i++)
+		{
+			if (DSI[i].data == DSIAggregation[i].data) DSI[i].release();
+		}
+		setParameter(backup);
+	}
+#pragma endregion
+
+#pragma region stream
+	void StereoBase::setTemporalParameter(const int searchMargin, const int keyFrameInterval, const double fallbackRatio)
+	{
+		temporalSearchMargin = searchMargin;
+		temporalKeyFrameInterval = keyFrameInterval;
+		temporalFallbackRatio = fallbackRatio;
+	}
+
+	void StereoBase::resetStream()
+	{
+		isStreamPending = false;
+		isTemporalLost = true;
+		streamFrameCount = 0;
+		prevDisparity.release();
+	}
+
+	//saturate costs farther than margin from the previous disparity (16x); pixels without a previous disparity keep the full range
+	static void limitCostAroundDisparity(Mat& cost, const int d, const Mat& disparity16, const int margin)
+	{
+		const int size = cost.size().area();
+		const short* prev = disparity16.ptr<short>();
+		uchar* c = cost.ptr<uchar>();
+		const int d16 = d << 4;
+		const int margin16 = margin << 4;
+		for (int i = 0; i < size; i++)
+		{
+			c[i] = (prev[i] != 0 && abs(d16 - prev[i]) > margin16) ? 255 : c[i];
+		}
+	}
+
+	bool StereoBase::matchingStream(Mat& leftim, Mat& rightim, Mat& dest)
+	{
+		const bool isInput = !leftim.empty();
+		if (!isStreamPending)
+		{
+			if (!isInput) return false;
+			computePrefilter(leftim, rightim, targetNext, referenceNext);
+			computeGuideImageForAggregation(leftim, guideImageNext);
+			leftim.copyTo(leftNext);
+			isStreamPending = true;
+			return false;
+		}
+
+		//the pending frame becomes current, and its buffers are reused for the next frame
+		std::swap(target, targetNext);
+		std::swap(reference, referenceNext);
+		std::swap(guideImage, guideImageNext);
+		std::swap(leftStream, leftNext);
+		isStreamPending = isInput;
+
+		if ((int)DSI.size() < numberOfDisparities) DSI.resize(numberOfDisparities);
+		const int minDisparityFull = minDisparity;
+		const int numberOfDisparitiesFull = numberOfDisparities;
+
+		//search range: full on key frames and after confidence loss, otherwise around the previous disparity map
+		bool isFullSearch = isTemporalLost || prevDisparity.empty() || prevDisparity.size() != leftStream.size()
+			|| (temporalKeyFrameInterval > 0 && streamFrameCount % temporalKeyFrameInterval == 0);
+		if (!isFullSearch)
+		{
+			Mat mask;
+			cv::compare(prevDisparity, 0, mask, cv::CMP_NE);
+			double minv, maxv;
+			minMaxLoc(prevDisparity, &minv, &maxv, nullptr, nullptr, mask);
+			if (countNonZero(mask) == 0)
+			{
+				isFullSearch = true;
+			}
+			else
+			{
+				const int dmin = max(minDisparityFull, (int)floor(minv / 16.0) - temporalSearchMargin);
+				const int dmax = min(minDisparityFull + numberOfDisparitiesFull - 1, (int)ceil(maxv / 16.0) + temporalSearchMargin);
+				minDisparity = dmin;
+				numberOfDisparities = max(dmax - dmin + 1, 3);//subpixel needs 3 planes
+				if (minDisparity + numberOfDisparities > minDisparityFull + numberOfDisparitiesFull) minDisparity = minDisparityFull + numberOfDisparitiesFull - numberOfDisparities;
+			}
+		}
+
+		{
+#ifdef TIMER_STEREO_BASE
+			Timer t("Stream: cost computation & aggregation (overlapped with next prefilter)");
+#endif
+			if (aggregationMethod == CrossBasedBox) clf.makeKernel(guideImage, aggregationRadiusH, (int)aggregationGuidedfilterEps, 0);
+#pragma omp parallel
+			{
+#pragma omp single
 				{
-					Mat bim;
-					GaussianBlur(destDisparityMap, bim, Size(2 * refinementWeightR + 1, 2 * refinementWeightR + 1), refinementWeightR / 3.0);
-					short* disp = destDisparityMap.ptr<short>(0);
-					short* dispb = bim.ptr<short>(0);
-					float* s = weightMap.ptr<float>();
-					for (int i = 0; i < weightMap.size().area(); i++)
+					if (isInput)
 					{
-						float diff = (disp[i] - dispb[i]) * (disp[i] - dispb[i]) / (-2.f * 16 * 16 * refinementWeightSigma * refinementWeightSigma);
-						s[i] = exp(diff);
+#pragma omp task
+						{
+							computePrefilter(leftim, rightim, targetNext, referenceNext);
+							computeGuideImageForAggregation(leftim, guideImageNext);
+							leftim.copyTo(leftNext);
+						}
+					}
+					for (int i = 0; i < numberOfDisparities; i++)
+					{
+#pragma omp task firstprivate(i)
+						{
+							const int d = minDisparity + i;
+							computePixelMatchingCost(d, DSI[i]);
+							computeCostAggregation(DSI[i], DSI[i], guideImage);
+							if (!isFullSearch) limitCostAroundDisparity(DSI[i], d, prevDisparity, temporalSearchMargin);
+						}
 					}
-
-					cp::weightedModeFilter(destDisparityMap, leftim, destDisparityMap, refinementR, refinementSigmaRange, refinementSigmaSpace, refinementSigmaHistogram);
 				}
 			}
-#pragma endregion
 		}
 
-#ifdef TIMER_STEREO_BASE
-		cout << "=====================" << endl;
-#endif
-#pragma endregion
+		if (dest.empty() || leftStream.size() != dest.size() || dest.type() != CV_16S) dest.create(leftStream.size(), CV_16S);
+		minCostMap.create(leftStream.size(), CV_8U);
+		minCostMap.setTo(255);
+		if (P1 != 0 && P2 != 0) computeOptimizeScanline();
+		computeWTA(DSI, dest, minCostMap);
+		postFiltering(leftStream, dest);
 
-	}
+		//confidence: valid ratio (before hole filling) relative to the last full search
+		if (isFullSearch)
+		{
+			keyFrameValidRatio = valid_ratio;
+			isTemporalLost = false;
+		}
+		else
+		{
+			isTemporalLost = (valid_ratio < temporalFallbackRatio * keyFrameValidRatio);
+		}
+		dest.copyTo(prevDisparity);
+		streamFrameCount++;
 
-	void StereoBase::operator()(Mat& leftim, Mat& rightim, Mat& dest)
-	{
-		matching(leftim, rightim, dest);
+		minDisparity = minDisparityFull;
+		numberOfDisparities = numberOfDisparitiesFull;
+		return true;
 	}
+#pragma endregion
 
 	static void guiStereoMatchingOnMouse(int events, int x, int y, int flags, void* param)
 	{
@@ -1003,6 +1324,9 @@ namespace cp
 			if (holeFillingMethod == 0) ci(CV_RGB(255, 0, 0), "Occlusion         (8)| NONE");
 			else ci(CV_RGB(0, 255, 0), "Occlusion         (8)| " + getHollFillingMethodName((HOLE_FILL)holeFillingMethod));
 
+			if (isFusedPostFilter) ci(CV_RGB(0, 255, 0), "fused post filter (p)| true");
+			else ci(CV_RGB(255, 0, 0), "fused post filter (p)| false");
+
 			if (refinementMethod == 0) ci(CV_RGB(255, 0, 0), "Refinement        (9)| NONE");
 			else ci(CV_RGB(0, 255, 0), "Refinement      (9-o)| " + getRefinementMethodName((REFINEMENT)refinementMethod));
 
@@ -1357,6 +1681,7 @@ namespace cp
 			if (key == '9') { refinementMethod++; refinementMethod = (refinementMethod > (int)REFINEMENT::REFINEMENT_SIZE - 1) ? 0 : refinementMethod; }
 			if (key == 'o') { refinementMethod--; refinementMethod = (refinementMethod < 0) ? (int)REFINEMENT::REFINEMENT_SIZE - 2 : refinementMethod; }
 			if (key == '0') isStreak = (isStreak) ? false : true;
+			if (key == 'p') isFusedPostFilter = (isFusedPostFilter) ? false : true;
 			if (key == '-') isMedian = (isMedian) ? false : true;
 
 			if (key == 'n') noise_state++; noise_state = (noise_state > 2) ? 0 : noise_state;
@@ -1809,6 +2134,12 @@ namespace cp
 
 	//0: gray image, 1: sobel/CENSUS image
 	void StereoBase::computePrefilter(Mat& targetImage, Mat& referenceImage)
+	{
+		computePrefilter(targetImage, referenceImage, target, reference);
+	}
+
+	//output to the given buffers (the arguments shadow the members), e.g., for the next frame in matchingStream
+	void StereoBase::computePrefilter(Mat& targetImage, Mat& referenceImage, vector<Mat>& target, vector<Mat>& reference)
 	{
 		const bool isColor = (pixelMatchingMethod % 2 == 1);
 		if (isColor)
@@ -1937,6 +2268,11 @@ namespace cp
 	}
 
 	void StereoBase::computeGuideImageForAggregation(Mat& input)
+	{
+		computeGuideImageForAggregation(input, guideImage);
+	}
+
+	void StereoBase::computeGuideImageForAggregation(Mat& input, Mat& guideImage)
 	{
 		if (input.channels() == 3) cvtColorBGR2GRAY_AVG(input, guideImage);
 		else input.copyTo(guideImage);
@@ -3564,6 +3900,302 @@ namespace cp
 		}
 	}
 
+#pragma region fused post filter
+	//scanline version of fillOcclusion(src, 0, FILL_DISPARITY) for CV_16S
+	//a row without valid pixels is left invalid instead of scanning past the row end
+	static void fillOcclusionScanline(short* s, const int width)
+	{
+		const int MAX_LENGTH = width - 3;
+		s[0] = SHRT_MAX;
+		s[width - 1] = SHRT_MAX;
+
+		for (int i = 1; i < width - 1; ++i)
+		{
+			if (s[i] <= 0)
+			{
+				int t = i;
+				do
+				{
+					t++;
+					if (t > width - 1) break;
+				} while (s[t] == 0);
+
+				const short dd = min(s[i - 1], s[t]);
+				if (t - i > MAX_LENGTH)
+				{
+					for (int n = 0; n < width; ++n)
+					{
+						s[n] = 0;
+					}
+					return;
+				}
+				else
+				{
+					for (; i < t; ++i)
+					{
+						s[i] = dd;
+					}
+				}
+			}
+		}
+		s[0] = s[1];
+		s[width - 1] = s[width - 2];
+	}
+
+	//union-find for band-parallel speckle filter (4-connectivity, same as cv::filterSpeckles)
+	inline static int findSpeckleRoot(const int* parent, int i)
+	{
+		while (parent[i] != i) i = parent[i];
+		return i;
+	}
+
+	inline static int findSpeckleRootCompress(int* parent, int i)
+	{
+		while (parent[i] != i)
+		{
+			parent[i] = parent[parent[i]];
+			i = parent[i];
+		}
+		return i;
+	}
+
+	inline static void uniteSpeckle(int* parent, int a, int b)
+	{
+		a = findSpeckleRootCompress(parent, a);
+		b = findSpeckleRootCompress(parent, b);
+		if (a < b) parent[b] = a;
+		else if (b < a) parent[a] = b;
+	}
+
+	//LR check, min cost filter, speckle filter, valid ratio and scanline hole filling in one band-parallel pass.
+	//Each band runs the row-local filters and labels speckle segments while the rows are in cache;
+	//labels are merged across band boundaries, and the second pass removes speckles and fills holes per scanline.
+	void StereoBase::fusedPostFilter(Mat& costMap, Mat& dest)
+	{
+		CV_Assert(dest.type() == CV_16S);
+		const int width = dest.cols;
+		const int height = dest.rows;
+		const int band_num = min(height, thread_max * 4);
+		const int disparity_max = min(minDisparity + numberOfDisparities, width);
+
+		const bool isSpeckle = isSpeckleFilter && speckleWindowSize > 0;
+		if (isSpeckle)
+		{
+			postFilterLabel.create(dest.size(), CV_32S);
+			postFilterArea.create(dest.size(), CV_32S);
+		}
+		int* parent = (isSpeckle) ? postFilterLabel.ptr<int>() : nullptr;
+		int* area = (isSpeckle) ? postFilterArea.ptr<int>() : nullptr;
+		const int range = speckleRange;
+		const bool isFill = holeFillingMethod == NEAREST_MIN_SCANLINE;
+		int valid = 0;
+		vector<vector<std::pair<int, int>>> bandRuns((isSpeckle) ? band_num : 0);//(root, area) of segments rooted in upper bands
+
+#pragma omp parallel
+		{
+			AutoBuffer<short> bufL(width);
+			AutoBuffer<short> bufR(width);
+			AutoBuffer<uchar> bufC(width);
+			short* dl = &bufL[0];
+			short* dr = &bufR[0];
+			uchar* cr = &bufC[0];
+
+#pragma omp for schedule(dynamic)
+			for (int b = 0; b < band_num; b++)
+			{
+				const int ystart = height * b / band_num;
+				const int yend = height * (b + 1) / band_num;
+				for (int j = ystart; j < yend; j++)
+				{
+					short* dst = dest.ptr<short>(j);
+					const uchar* cost = costMap.ptr<uchar>(j);
+
+					if (LRCheckMethod != (int)LRCHECK::NONE)
+					{
+						for (int i = 0; i < width; i++) dl[i] = saturate_cast<short>(dst[i] * (1.f / 16.f));
+						memset(dr, 0, sizeof(short) * width);
+
+						if (LRCheckMethod == (int)LRCHECK::WITH_MINCOST)
+						{
+							if (isProcessLBorder)
+							{
+								memset(dl, 0, sizeof(short) * min(minDisparity + 1, width));
+								for (int i = minDisparity + 1; i < disparity_max; i++)
+								{
+									dl[i] = (dl[i] >= i) ? 0 : dl[i];
+								}
+							}
+
+							memset(cr, 255, width);
+							for (int i = 0; i < width; i++)
+							{
+								const short d = dl[i];
+								const int x = i - d;
+								if (d != 0 && x >= 0 && x < width && cost[i] < cr[x])
+								{
+									cr[x] = cost[i];
+									dr[x] = d;
+								}
+							}
+							for (int i = 0; i < width; i++)
+							{
+								const short d = dl[i];
+								const int x = i - d;
+								if (x > 0 && x < width && abs(dr[x] - d) > disp12diff) dl[i] = 0;
+							}
+
+							if (isProcessLBorder)
+							{
+								for (int i = minDisparity + 1; i < disparity_max; i++)
+								{
+									const short d = dl[i];
+									if (d != 0 && i + d < width && dl[i + d] == 0) dl[i] = 0;
+								}
+							}
+						}
+						else
+						{
+							for (int i = 0; i < width; i++)
+							{
+								const short d = dl[i];
+								const int x = i - d;
+								if (d != 0 && x >= 0 && x < width && dr[x] < d) dr[x] = d;
+							}
+							for (int i = 0; i < width; i++)
+							{
+								const short d = dl[i];
+								const int x = i - d;
+								if (x > 0 && x < width && abs(dr[x] - d) > disp12diff + 1) dl[i] = 0;
+							}
+						}
+
+						for (int i = 0; i < width; i++) dst[i] = (dl[i] == 0) ? 0 : dst[i];
+					}
+
+					if (isMinCostFilter)
+					{
+						for (int i = 0; i < width; i++) dst[i] = (cost[i] > minCostThreshold) ? 0 : dst[i];
+					}
+
+					if (isSpeckle)
+					{
+						const int offset = width * j;
+						int* p = parent + offset;
+						memset(area + offset, 0, sizeof(int) * width);
+						for (int i = 0; i < width; i++) p[i] = (dst[i] != 0) ? offset + i : -1;
+						for (int i = 1; i < width; i++)
+						{
+							if (p[i] >= 0 && p[i - 1] >= 0 && abs(dst[i] - dst[i - 1]) <= range) uniteSpeckle(parent, offset + i, offset + i - 1);
+						}
+						if (j != ystart)
+						{
+							const short* up = dst - width;
+							for (int i = 0; i < width; i++)
+							{
+								if (p[i] >= 0 && p[i - width] >= 0 && abs(dst[i] - up[i]) <= range) uniteSpeckle(parent, offset + i, offset + i - width);
+							}
+						}
+					}
+				}
+			}
+
+			if (isSpeckle)
+			{
+#pragma omp single
+				{
+					for (int b = 1; b < band_num; b++)
+					{
+						const int j = height * b / band_num;
+						const short* dst = dest.ptr<short>(j);
+						const short* up = dest.ptr<short>(j - 1);
+						const int offset = width * j;
+						for (int i = 0; i < width; i++)
+						{
+							if (parent[offset + i] >= 0 && parent[offset + i - width] >= 0 && abs(dst[i] - up[i]) <= range) uniteSpeckle(parent, offset + i, offset + i - width);
+						}
+					}
+				}
+
+				//area counting without atomics: the root is the minimum index of its segment, so it lies in the topmost band of the segment.
+				//Roots inside the band are counted directly (only this band writes there); roots of segments from upper bands
+				//are run-length counted per band and added in one short serial step.
+#pragma omp for schedule(dynamic)
+				for (int b = 0; b < band_num; b++)
+				{
+					const int start = width * (height * b / band_num);
+					const int end = width * (height * (b + 1) / band_num);
+					vector<std::pair<int, int>>& runs = bandRuns[b];
+					runs.clear();
+					int run_root = -1;
+					int run_count = 0;
+					for (int i = start; i < end; i++)
+					{
+						if (parent[i] < 0) continue;
+
+						const int r = findSpeckleRoot(parent, i);
+						if (r >= start)
+						{
+							area[r]++;
+						}
+						else if (r == run_root)
+						{
+							run_count++;
+						}
+						else
+						{
+							if (run_count != 0) runs.push_back(std::make_pair(run_root, run_count));
+							run_root = r;
+							run_count = 1;
+						}
+					}
+					if (run_count != 0) runs.push_back(std::make_pair(run_root, run_count));
+
+					//merge runs of the same root, e.g., one run per row for a segment crossing the band
+					std::sort(runs.begin(), runs.end());
+					int n = 0;
+					for (int k = 1; k < (int)runs.size(); k++)
+					{
+						if (runs[k].first == runs[n].first) runs[n].second += runs[k].second;
+						else runs[++n] = runs[k];
+					}
+					if (!runs.empty()) runs.resize(n + 1);
+				}
+
+#pragma omp single
+				{
+					for (int b = 1; b < band_num; b++)
+					{
+						for (const std::pair<int, int>& run : bandRuns[b]) area[run.first] += run.second;
+					}
+				}
+			}
+
+#pragma omp for schedule(dynamic) reduction(+:valid)
+			for (int b = 0; b < band_num; b++)
+			{
+				const int ystart = height * b / band_num;
+				const int yend = height * (b + 1) / band_num;
+				for (int j = ystart; j < yend; j++)
+				{
+					short* dst = dest.ptr<short>(j);
+					if (isSpeckle)
+					{
+						const int* p = parent + width * j;
+						for (int i = 0; i < width; i++)
+						{
+							if (p[i] >= 0 && area[findSpeckleRoot(parent, p[i])] <= speckleWindowSize) dst[i] = 0;
+						}
+					}
+					for (int i = 0; i < width; i++) valid += (dst[i] != 0) ? 1 : 0;
+
+					if (isFill) fillOcclusionScanline(dst, width);
+				}
+			}
+		}
+		valid_ratio = 100.0 * valid / dest.size().area();
+	}
+#pragma endregion
+
 	string StereoBase::getHollFillingMethodName(const HOLE_FILL method)
 	{
 		string ret = "not support getHollFillingMethod";
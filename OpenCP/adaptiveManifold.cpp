@@ -1,918 +1,675 @@
-#include <cmath>
-#include <limits>
-#include <opencv2/imgproc/imgproc.hpp>
+#include "adaptiveManifold.hpp"
+#include "inlineSIMDFunctions.hpp"
+#include <omp.h>
 
 using namespace std;
 using namespace cv;
 
-namespace cv
+namespace cp
 {
-
-	class AdaptiveManifoldFilter : public Algorithm
-	{
-	public:
-		/**
-		* @brief Apply High-dimensional filtering using adaptive manifolds
-		* @param src       Input image to be filtered.
-		* @param dst       Adaptive-manifold filter response adjusted for outliers.
-		* @param tilde_dst Adaptive-manifold filter response NOT adjusted for outliers.
-		* @param src_joint Image for joint filtering (optional).
-		*/
-		virtual void apply(InputArray src, OutputArray dst, OutputArray tilde_dst = noArray(), InputArray src_joint = noArray()) = 0;
-
-		virtual void collectGarbage() = 0;
-
-		static Ptr<AdaptiveManifoldFilter> create();
-	};
-	/*
-	namespace
-	{
-	struct Buf
-	{
-	Mat_<Point3f> eta_1;
-	Mat_<uchar> cluster_1;
-
-	Mat_<Point3f> tilde_dst;
-	Mat_<float> alpha;
-	Mat_<Point3f> diff;
-	Mat_<Point3f> dst;
-
-	Mat_<float> V;
-
-	Mat_<Point3f> dIcdx;
-	Mat_<Point3f> dIcdy;
-	Mat_<float> dIdx;
-	Mat_<float> dIdy;
-	Mat_<float> dHdx;
-	Mat_<float> dVdy;
-
-	Mat_<float> t;
-
-	Mat_<float> theta_masked;
-	Mat_<Point3f> mul;
-	Mat_<Point3f> numerator;
-	Mat_<float> denominator;
-	Mat_<Point3f> numerator_filtered;
-	Mat_<float> denominator_filtered;
-
-	Mat_<Point3f> X;
-	Mat_<Point3f> eta_k_small;
-	Mat_<Point3f> eta_k_big;
-	Mat_<Point3f> X_squared;
-	Mat_<float> pixel_dist_to_manifold_squared;
-	Mat_<float> gaussian_distance_weights;
-	Mat_<Point3f> Psi_splat;
-	Mat_<Vec4f> Psi_splat_joined;
-	Mat_<Vec4f> Psi_splat_joined_resized;
-	Mat_<Vec4f> blurred_projected_values;
-	Mat_<Point3f> w_ki_Psi_blur;
-	Mat_<float> w_ki_Psi_blur_0;
-	Mat_<Point3f> w_ki_Psi_blur_resized;
-	Mat_<float> w_ki_Psi_blur_0_resized;
-	Mat_<float> rand_vec;
-	Mat_<float> v1;
-	Mat_<float> Nx_v1_mult;
-	Mat_<float> theta;
-
-	std::vector<Mat_<Point3f> > eta_minus;
-	std::vector<Mat_<uchar> > cluster_minus;
-	std::vector<Mat_<Point3f> > eta_plus;
-	std::vector<Mat_<uchar> > cluster_plus;
-
-	void release();
-	};
-
-	void Buf::release()
-	{
-	eta_1.release();
-	cluster_1.release();
-
-	tilde_dst.release();
-	alpha.release();
-	diff.release();
-	dst.release();
-
-	V.release();
-
-	dIcdx.release();
-	dIcdy.release();
-	dIdx.release();
-	dIdy.release();
-	dHdx.release();
-	dVdy.release();
-
-	t.release();
-
-	theta_masked.release();
-	mul.release();
-	numerator.release();
-	denominator.release();
-	numerator_filtered.release();
-	denominator_filtered.release();
-
-	X.release();
-	eta_k_small.release();
-	eta_k_big.release();
-	X_squared.release();
-	pixel_dist_to_manifold_squared.release();
-	gaussian_distance_weights.release();
-	Psi_splat.release();
-	Psi_splat_joined.release();
-	Psi_splat_joined_resized.release();
-	blurred_projected_values.release();
-	w_ki_Psi_blur.release();
-	w_ki_Psi_blur_0.release();
-	w_ki_Psi_blur_resized.release();
-	w_ki_Psi_blur_0_resized.release();
-	rand_vec.release();
-	v1.release();
-	Nx_v1_mult.release();
-	theta.release();
-
-	eta_minus.clear();
-	cluster_minus.clear();
-	eta_plus.clear();
-	cluster_plus.clear();
-	}
-
-	class AdaptiveManifoldFilterImpl : public AdaptiveManifoldFilter
-	{
-	public:
-	AlgorithmInfo* info() const;
-
-	AdaptiveManifoldFilterImpl();
-
-	void apply(InputArray src, OutputArray dst, OutputArray tilde_dst = noArray(), InputArray src_joint = noArray());
-
-	void collectGarbage();
-
-	protected:
-	double sigma_s_;
-	double sigma_r_;
-	int tree_height_;
-	int num_pca_iterations_;
-
-	private:
-	void buildManifoldsAndPerformFiltering(const Mat_<Point3f>& eta_k, const Mat_<uchar>& cluster_k, int current_tree_level);
-
-	Buf buf_;
-
-	Mat_<Point3f> src_f_;
-	Mat_<Point3f> src_joint_f_;
-
-	Mat_<Point3f> sum_w_ki_Psi_blur_;
-	Mat_<float> sum_w_ki_Psi_blur_0_;
-
-	Mat_<float> min_pixel_dist_to_manifold_squared_;
-
-	RNG rng_;
-
-	int cur_tree_height_;
-	float sigma_r_over_sqrt_2_;
+	struct AdaptiveManifoldFilter::Buf
+	{
+		//per-node temporaries
+		Mat_<Point3f> X;
+		Mat_<Point3f> eta_k_small;
+		Mat_<Point3f> eta_k_big;
+		Mat_<float> w_ki;
+		Mat_<Vec4f> Psi_splat_joined;
+		Mat_<Vec4f> Psi_splat_joined_resized;
+		Mat_<float> VH;
+		Mat_<float> VV;
+		Mat_<Vec4f> blurred_projected_values_resized;
+		Mat_<Vec4f> theta_minus;
+		Mat_<Vec4f> theta_plus;
+		Mat_<Vec4f> theta_small;
+		Mat_<Vec4f> theta_filtered;
+
+		//per-thread accumulators, reduced after the tree is traversed
+		Mat_<Vec4f> sum_w_ki_Psi_blur;//xyz: sum of w_ki*Psi_blur, w: sum of w_ki*Psi_blur_0
+		Mat_<float> min_pixel_dist_to_manifold_squared;
+		bool isUsed = false;
 	};
 
-	AdaptiveManifoldFilterImpl::AdaptiveManifoldFilterImpl()
-	{
-	sigma_s_ = 16.0;
-	sigma_r_ = 0.2;
-	tree_height_ = -1;
-	num_pca_iterations_ = 1;
-	}
-
-	void AdaptiveManifoldFilterImpl::collectGarbage()
-	{
-	buf_.release();
-
-	src_f_.release();
-	src_joint_f_.release();
-
-	sum_w_ki_Psi_blur_.release();
-	sum_w_ki_Psi_blur_0_.release();
-
-	min_pixel_dist_to_manifold_squared_.release();
-	}
-
-	CV_INIT_ALGORITHM(AdaptiveManifoldFilterImpl, "AdaptiveManifoldFilter",
-	obj.info()->addParam(obj, "sigma_s", obj.sigma_s_, false, 0, 0, "Filter spatial standard deviation");
-	obj.info()->addParam(obj, "sigma_r", obj.sigma_r_, false, 0, 0, "Filter range standard deviation");
-	obj.info()->addParam(obj, "tree_height", obj.tree_height_, false, 0, 0, "Height of the manifold tree (default = -1 : automatically computed)");
-	obj.info()->addParam(obj, "num_pca_iterations", obj.num_pca_iterations_, false, 0, 0, "Number of iterations to computed the eigenvector v1"));
-
 	inline double Log2(double n)
 	{
-	return log(n) / log(2.0);
+		return log(n) / log(2.0);
 	}
 
 	inline int computeManifoldTreeHeight(double sigma_s, double sigma_r)
 	{
-	const double Hs = floor(Log2(sigma_s)) - 1.0;
-	const double Lr = 1.0 - sigma_r;
-	return max(2, static_cast<int>(ceil(Hs * Lr)));
-	}
-
-	void ensureSizeIsEnough(int rows, int cols, int type, Mat& m)
-	{
-	if (m.empty() || m.type() != type || m.data != m.datastart)
-	m.create(rows, cols, type);
-	else
-	{
-	const size_t esz = m.elemSize();
-	const ptrdiff_t delta2 = m.dataend - m.datastart;
-
-	const size_t minstep = m.cols * esz;
-
-	Size wholeSize;
-	wholeSize.height = std::max(static_cast<int>((delta2 - minstep) / m.step + 1), m.rows);
-	wholeSize.width = std::max(static_cast<int>((delta2 - m.step * (wholeSize.height - 1)) / esz), m.cols);
-
-	if (wholeSize.height < rows || wholeSize.width < cols)
-	m.create(rows, cols, type);
-	else
-	{
-	m.cols = cols;
-	m.rows = rows;
-	}
-	}
-	}
-
-	inline void ensureSizeIsEnough(Size size, int type, Mat& m)
-	{
-	ensureSizeIsEnough(size.height, size.width, type, m);
-	}
-
-	template <typename T>
-	inline void ensureSizeIsEnough(int rows, int cols, Mat_<T>& m)
-	{
-	if (m.empty() || m.data != m.datastart)
-	m.create(rows, cols);
-	else
-	{
-	const size_t esz = m.elemSize();
-	const ptrdiff_t delta2 = m.dataend - m.datastart;
-
-	const size_t minstep = m.cols * esz;
-
-	Size wholeSize;
-	wholeSize.height = std::max(static_cast<int>((delta2 - minstep) / m.step + 1), m.rows);
-	wholeSize.width = std::max(static_cast<int>((delta2 - m.step * (wholeSize.height - 1)) / esz), m.cols);
-
-	if (wholeSize.height < rows || wholeSize.width < cols)
-	m.create(rows, cols);
-	else
-	{
-	m.cols = cols;
-	m.rows = rows;
-	}
-	}
-	}
-
-	template <typename T>
-	inline void ensureSizeIsEnough(Size size, Mat_<T>& m)
-	{
-	ensureSizeIsEnough(size.height, size.width, m);
-	}
-
-	template <typename T>
-	void h_filter(const Mat_<T>& src, Mat_<T>& dst, float sigma)
-	{
-	CV_DbgAssert( src.depth() == CV_32F );
-
-	const float a = exp(-sqrt(2.0f) / sigma);
-
-	ensureSizeIsEnough(src.size(), dst);
-	src.copyTo(dst);
-
-	for (int y = 0; y < src.rows; ++y)
-	{
-	const T* src_row = src[y];
-	T* dst_row = dst[y];
-
-	for (int x = 1; x < src.cols; ++x)
-	{
-	dst_row[x] = src_row[x] + a * (src_row[x - 1] - src_row[x]);
-	}
-	for (int x = src.cols - 2; x >= 0; --x)
-	{
-	dst_row[x] = dst_row[x] + a * (dst_row[x + 1] - dst_row[x]);
-	}
-	}
-
-	for (int y = 1; y < src.rows; ++y)
-	{
-	T* dst_cur_row = dst[y];
-	T* dst_prev_row = dst[y - 1];
-
-	for (int x = 0; x < src.cols; ++x)
-	{
-	dst_cur_row[x] = dst_cur_row[x] + a * (dst_prev_row[x] - dst_cur_row[x]);
-	}
-	}
-	for (int y = src.rows - 2; y >= 0; --y)
-	{
-	T* dst_cur_row = dst[y];
-	T* dst_prev_row = dst[y + 1];
-
-	for (int x = 0; x < src.cols; ++x)
-	{
-	dst_cur_row[x] = dst_cur_row[x] + a * (dst_prev_row[x] - dst_cur_row[x]);
-	}
-	}
-	}
-
-	template <typename T>
-	void rdivide(const Mat_<T>& a, const Mat_<float>& b, Mat_<T>& dst)
-	{
-	CV_DbgAssert( a.depth() == CV_32F );
-	CV_DbgAssert( a.size() == b.size() );
-
-	ensureSizeIsEnough(a.size(), dst);
-	dst.setTo(0);
-
-	for (int y = 0; y < a.rows; ++y)
-	{
-	const T* a_row = a[y];
-	const float* b_row = b[y];
-	T* dst_row = dst[y];
-
-	for (int x = 0; x < a.cols; ++x)
-	{
-	if (b_row[x] > numeric_limits<float>::epsilon())
-	dst_row[x] = a_row[x] * (1.0f / b_row[x]);
-	}
-	}
-	}
-
-	template <typename T>
-	void times(const Mat_<T>& a, const Mat_<float>& b, Mat_<T>& dst)
-	{
-	CV_DbgAssert( a.depth() == CV_32F );
-	CV_DbgAssert( a.size() == b.size() );
-
-	ensureSizeIsEnough(a.size(), dst);
-
-	for (int y = 0; y < a.rows; ++y)
-	{
-	const T* a_row = a[y];
-	const float* b_row = b[y];
-	T* dst_row = dst[y];
-
-	for (int x = 0; x < a.cols; ++x)
-	{
-	dst_row[x] = a_row[x] * b_row[x];
-	}
-	}
-	}
-
-	void AdaptiveManifoldFilterImpl::apply(InputArray _src, OutputArray _dst, OutputArray _tilde_dst, InputArray _src_joint)
-	{
-	const Mat src = _src.getMat();
-	const Mat src_joint = _src_joint.getMat();
-
-	const Size srcSize = src.size();
-
-	CV_Assert( src.type() == CV_8UC3 );
-	CV_Assert( src_joint.empty() || (src_joint.type() == src.type() && src_joint.size() == srcSize) );
-
-	ensureSizeIsEnough(srcSize, src_f_);
-	src.convertTo(src_f_, src_f_.type(), 1.0 / 255.0);
-
-	// Use the center pixel as seed to random number generation.
-	const Point3f centralPix = src_f_(src_f_.rows / 2, src_f_.cols / 2);
-	const double seedCoeff = (centralPix.x + centralPix.y + centralPix.z + 1.0f) / 4.0f;
-	rng_.state = static_cast<uint64>(seedCoeff * numeric_limits<uint64>::max());
-
-	ensureSizeIsEnough(srcSize, sum_w_ki_Psi_blur_);
-	sum_w_ki_Psi_blur_.setTo(Scalar::all(0));
-
-	ensureSizeIsEnough(srcSize, sum_w_ki_Psi_blur_0_);
-	sum_w_ki_Psi_blur_0_.setTo(Scalar::all(0));
-
-	ensureSizeIsEnough(srcSize, min_pixel_dist_to_manifold_squared_);
-	min_pixel_dist_to_manifold_squared_.setTo(Scalar::all(numeric_limits<float>::max()));
-
-	// If the tree_height was not specified, compute it using Eq. (10) of our paper.
-	cur_tree_height_ = tree_height_ > 0 ? tree_height_ : computeManifoldTreeHeight(sigma_s_, sigma_r_);
-
-	// If no joint signal was specified, use the original signal
-	ensureSizeIsEnough(srcSize, src_joint_f_);
-	if (src_joint.empty())
-	src_f_.copyTo(src_joint_f_);
-	else
-	src_joint.convertTo(src_joint_f_, src_joint_f_.type(), 1.0 / 255.0);
-
-	// Dividing the covariance matrix by 2 is equivalent to dividing the standard deviations by sqrt(2).
-	sigma_r_over_sqrt_2_ = static_cast<float>(sigma_r_ / sqrt(2.0));
-
-	// Algorithm 1, Step 1: compute the first manifold by low-pass filtering.
-	h_filter(src_joint_f_, buf_.eta_1, static_cast<float>(sigma_s_));
-
-	ensureSizeIsEnough(srcSize, buf_.cluster_1);
-	buf_.cluster_1.setTo(Scalar::all(1));
-
-	buf_.eta_minus.resize(cur_tree_height_);
-	buf_.cluster_minus.resize(cur_tree_height_);
-	buf_.eta_plus.resize(cur_tree_height_);
-	buf_.cluster_plus.resize(cur_tree_height_);
-	buildManifoldsAndPerformFiltering(buf_.eta_1, buf_.cluster_1, 1);
-
-	// Compute the filter response by normalized convolution -- Eq. (4)
-	rdivide(sum_w_ki_Psi_blur_, sum_w_ki_Psi_blur_0_, buf_.tilde_dst);
-
-	// Adjust the filter response for outlier pixels -- Eq. (10)
-	ensureSizeIsEnough(srcSize, buf_.alpha);
-	exp(min_pixel_dist_to_manifold_squared_ * (-0.5 / sigma_r_ / sigma_r_), buf_.alpha);
-
-	ensureSizeIsEnough(srcSize, buf_.diff);
-	subtract(buf_.tilde_dst, src_f_, buf_.diff);
-	times(buf_.diff, buf_.alpha, buf_.diff);
-
-	ensureSizeIsEnough(srcSize, buf_.dst);
-	add(src_f_, buf_.diff, buf_.dst);
-
-	buf_.dst.convertTo(_dst, CV_8U, 255.0);
-	if (_tilde_dst.needed())
-	buf_.tilde_dst.convertTo(_tilde_dst, CV_8U, 255.0);
+		const double Hs = floor(Log2(sigma_s)) - 1.0;
+		const double Lr = 1.0 - sigma_r;
+		return max(2, static_cast<int>(ceil(Hs * Lr)));
 	}
 
 	inline double floor_to_power_of_two(double r)
 	{
-	return pow(2.0, floor(Log2(r)));
-	}
-
-	void channelsSum(const Mat_<Point3f>& src, Mat_<float>& dst)
-	{
-	ensureSizeIsEnough(src.size(), dst);
-
-	for (int y = 0; y < src.rows; ++y)
-	{
-	const Point3f* src_row = src[y];
-	float* dst_row = dst[y];
-
-	for (int x = 0; x < src.cols; ++x)
-	{
-	const Point3f src_val = src_row[x];
-	dst_row[x] = src_val.x + src_val.y + src_val.z;
-	}
-	}
-	}
-
-	void phi(const Mat_<float>& src, Mat_<float>& dst, float sigma)
-	{
-	ensureSizeIsEnough(src.size(), dst);
-
-	for (int y = 0; y < dst.rows; ++y)
-	{
-	const float* src_row = src[y];
-	float* dst_row = dst[y];
-
-	for (int x = 0; x < dst.cols; ++x)
-	{
-	dst_row[x] = exp(-0.5f * src_row[x] / sigma / sigma);
-	}
-	}
-	}
-
-	void catCn(const Mat_<Point3f>& a, const Mat_<float>& b, Mat_<Vec4f>& dst)
-	{
-	ensureSizeIsEnough(a.size(), dst);
-
-	for (int y = 0; y < a.rows; ++y)
-	{
-	const Point3f* a_row = a[y];
-	const float* b_row = b[y];
-	Vec4f* dst_row = dst[y];
-
-	for (int x = 0; x < a.cols; ++x)
-	{
-	const Point3f a_val = a_row[x];
-	const float b_val = b_row[x];
-	dst_row[x] = Vec4f(a_val.x, a_val.y, a_val.z, b_val);
-	}
-	}
-	}
-
-	void diffY(const Mat_<Point3f>& src, Mat_<Point3f>& dst)
-	{
-	ensureSizeIsEnough(src.rows - 1, src.cols, dst);
-
-	for (int y = 0; y < src.rows - 1; ++y)
-	{
-	const Point3f* src_cur_row = src[y];
-	const Point3f* src_next_row = src[y + 1];
-	Point3f* dst_row = dst[y];
-
-	for (int x = 0; x < src.cols; ++x)
-	{
-	dst_row[x] = src_next_row[x] - src_cur_row[x];
-	}
-	}
-	}
-
-	void diffX(const Mat_<Point3f>& src, Mat_<Point3f>& dst)
-	{
-	ensureSizeIsEnough(src.rows, src.cols - 1, dst);
-
-	for (int y = 0; y < src.rows; ++y)
-	{
-	const Point3f* src_row = src[y];
-	Point3f* dst_row = dst[y];
-
-	for (int x = 0; x < src.cols - 1; ++x)
-	{
-	dst_row[x] = src_row[x + 1] - src_row[x];
-	}
-	}
-	}
-
-	void TransformedDomainRecursiveFilter(const Mat_<Vec4f>& I, const Mat_<float>& DH, const Mat_<float>& DV, Mat_<Vec4f>& dst, float sigma, Buf& buf)
-	{
-	CV_DbgAssert( I.size() == DH.size() );
-
-	const float a = exp(-sqrt(2.0f) / sigma);
-
-	ensureSizeIsEnough(I.size(), dst);
-	I.copyTo(dst);
-
-	ensureSizeIsEnough(DH.size(), buf.V);
-
-	for (int y = 0; y < DH.rows; ++y)
-	{
-	const float* D_row = DH[y];
-	float* V_row = buf.V[y];
-
-	for (int x = 0; x < DH.cols; ++x)
-	{
-	V_row[x] = pow(a, D_row[x]);
-	}
-	}
-	for (int y = 0; y < I.rows; ++y)
-	{
-	const float* V_row = buf.V[y];
-	Vec4f* dst_row = dst[y];
-
-	for (int x = 1; x < I.cols; ++x)
-	{
-	Vec4f dst_cur_val = dst_row[x];
-	const Vec4f dst_prev_val = dst_row[x - 1];
-	const float V_val = V_row[x];
-
-	dst_cur_val[0] += V_val * (dst_prev_val[0] - dst_cur_val[0]);
-	dst_cur_val[1] += V_val * (dst_prev_val[1] - dst_cur_val[1]);
-	dst_cur_val[2] += V_val * (dst_prev_val[2] - dst_cur_val[2]);
-	dst_cur_val[3] += V_val * (dst_prev_val[3] - dst_cur_val[3]);
-
-	dst_row[x] = dst_cur_val;
-	}
-	for (int x = I.cols - 2; x >= 0; --x)
-	{
-	Vec4f dst_cur_val = dst_row[x];
-	const Vec4f dst_prev_val = dst_row[x + 1];
-	const float V_val = V_row[x];
-
-	dst_cur_val[0] += V_val * (dst_prev_val[0] - dst_cur_val[0]);
-	dst_cur_val[1] += V_val * (dst_prev_val[1] - dst_cur_val[1]);
-	dst_cur_val[2] += V_val * (dst_prev_val[2] - dst_cur_val[2]);
-	dst_cur_val[3] += V_val * (dst_prev_val[3] - dst_cur_val[3]);
-
-	dst_row[x] = dst_cur_val;
-	}
-	}
-
-	for (int y = 0; y < DV.rows; ++y)
-	{
-	const float* D_row = DV[y];
-	float* V_row = buf.V[y];
-
-	for (int x = 0; x < DV.cols; ++x)
-	{
-	V_row[x] = pow(a, D_row[x]);
-	}
-	}
-	for (int y = 1; y < I.rows; ++y)
-	{
-	const float* V_row = buf.V[y];
-	Vec4f* dst_cur_row = dst[y];
-	Vec4f* dst_prev_row = dst[y - 1];
-
-	for (int x = 0; x < I.cols; ++x)
-	{
-	Vec4f dst_cur_val = dst_cur_row[x];
-	const Vec4f dst_prev_val = dst_prev_row[x];
-	const float V_val = V_row[x];
-
-	dst_cur_val[0] += V_val * (dst_prev_val[0] - dst_cur_val[0]);
-	dst_cur_val[1] += V_val * (dst_prev_val[1] - dst_cur_val[1]);
-	dst_cur_val[2] += V_val * (dst_prev_val[2] - dst_cur_val[2]);
-	dst_cur_val[3] += V_val * (dst_prev_val[3] - dst_cur_val[3]);
-
-	dst_cur_row[x] = dst_cur_val;
-	}
-	}
-	for (int y = I.rows - 2; y >= 0; --y)
-	{
-	const float* V_row = buf.V[y];
-	Vec4f* dst_cur_row = dst[y];
-	Vec4f* dst_prev_row = dst[y + 1];
-
-	for (int x = 0; x < I.cols; ++x)
-	{
-	Vec4f dst_cur_val = dst_cur_row[x];
-	const Vec4f dst_prev_val = dst_prev_row[x];
-	const float V_val = V_row[x];
-
-	dst_cur_val[0] += V_val * (dst_prev_val[0] - dst_cur_val[0]);
-	dst_cur_val[1] += V_val * (dst_prev_val[1] - dst_cur_val[1]);
-	dst_cur_val[2] += V_val * (dst_prev_val[2] - dst_cur_val[2]);
-	dst_cur_val[3] += V_val * (dst_prev_val[3] - dst_cur_val[3]);
-
-	dst_cur_row[x] = dst_cur_val;
-	}
-	}
-	}
-
-	void RF_filter(const Mat_<Vec4f>& src, const Mat_<Point3f>& src_joint, Mat_<Vec4f>& dst, float sigma_s, float sigma_r, Buf& buf)
-	{
-	CV_DbgAssert( src_joint.size() == src.size() );
-
-	diffX(src_joint, buf.dIcdx);
-	diffY(src_joint, buf.dIcdy);
-
-	ensureSizeIsEnough(src.size(), buf.dIdx);
-	buf.dIdx.setTo(Scalar::all(0));
-	for (int y = 0; y < src.rows; ++y)
-	{
-	const Point3f* dIcdx_row = buf.dIcdx[y];
-	float* dIdx_row = buf.dIdx[y];
-
-	for (int x = 1; x < src.cols; ++x)
-	{
-	const Point3f val = dIcdx_row[x - 1];
-	dIdx_row[x] = val.dot(val);
-	}
-	}
-
-	ensureSizeIsEnough(src.size(), buf.dIdy);
-	buf.dIdy.setTo(Scalar::all(0));
-	for (int y = 1; y < src.rows; ++y)
-	{
-	const Point3f* dIcdy_row = buf.dIcdy[y - 1];
-	float* dIdy_row = buf.dIdy[y];
-
-	for (int x = 0; x < src.cols; ++x)
-	{
-	const Point3f val = dIcdy_row[x];
-	dIdy_row[x] = val.dot(val);
-	}
-	}
-
-	ensureSizeIsEnough(buf.dIdx.size(), buf.dHdx);
-	buf.dIdx.convertTo(buf.dHdx, buf.dHdx.type(), (sigma_s / sigma_r) * (sigma_s / sigma_r), (sigma_s / sigma_s) * (sigma_s / sigma_s));
-	sqrt(buf.dHdx, buf.dHdx);
-
-	ensureSizeIsEnough(buf.dIdy.size(), buf.dVdy);
-	buf.dIdy.convertTo(buf.dVdy, buf.dVdy.type(), (sigma_s / sigma_r) * (sigma_s / sigma_r), (sigma_s / sigma_s) * (sigma_s / sigma_s));
-	sqrt(buf.dVdy, buf.dVdy);
-
-	ensureSizeIsEnough(src.size(), dst);
-	src.copyTo(dst);
-	TransformedDomainRecursiveFilter(src, buf.dHdx, buf.dVdy, dst, sigma_s, buf);
-	}
-
-	void split_3_1(const Mat_<Vec4f>& src, Mat_<Point3f>& dst1, Mat_<float>& dst2)
-	{
-	ensureSizeIsEnough(src.size(), dst1);
-	ensureSizeIsEnough(src.size(), dst2);
-
-	for (int y = 0; y < src.rows; ++y)
-	{
-	const Vec4f* src_row = src[y];
-	Point3f* dst1_row = dst1[y];
-	float* dst2_row = dst2[y];
-
-	for (int x = 0; x < src.cols; ++x)
-	{
-	Vec4f val = src_row[x];
-	dst1_row[x] = Point3f(val[0], val[1], val[2]);
-	dst2_row[x] = val[3];
-	}
-	}
-	}
-
-	void computeEigenVector(const Mat_<float>& X, const Mat_<uchar>& mask, Mat_<float>& dst, int num_pca_iterations, const Mat_<float>& rand_vec, Buf& buf)
-	{
-	CV_DbgAssert( X.cols == rand_vec.cols );
-	CV_DbgAssert( X.rows == mask.size().area() );
-	CV_DbgAssert( rand_vec.rows == 1 );
-
-	ensureSizeIsEnough(rand_vec.size(), dst);
-	rand_vec.copyTo(dst);
-
-	ensureSizeIsEnough(X.size(), buf.t);
-
-	float* dst_row = dst[0];
-
-	for (int i = 0; i < num_pca_iterations; ++i)
-	{
-	buf.t.setTo(Scalar::all(0));
-
-	for (int y = 0, ind = 0; y < mask.rows; ++y)
-	{
-	const uchar* mask_row = mask[y];
-
-	for (int x = 0; x < mask.cols; ++x, ++ind)
-	{
-	if (mask_row[x])
-	{
-	const float* X_row = X[ind];
-	float* t_row = buf.t[ind];
-
-	float dots = 0.0;
-	for (int c = 0; c < X.cols; ++c)
-	dots += dst_row[c] * X_row[c];
-
-	for (int c = 0; c < X.cols; ++c)
-	t_row[c] = dots * X_row[c];
-	}
-	}
-	}
-
-	dst.setTo(0.0);
-	for (int i = 0; i < X.rows; ++i)
-	{
-	const float* t_row = buf.t[i];
-
-	for (int c = 0; c < X.cols; ++c)
-	{
-	dst_row[c] += t_row[c];
-	}
-	}
-	}
-
-	double n = norm(dst);
-	divide(dst, n, dst);
-	}
-
-	void calcEta(const Mat_<Point3f>& src_joint_f, const Mat_<float>& theta, const Mat_<uchar>& cluster, Mat_<Point3f>& dst, float sigma_s, float df, Buf& buf)
-	{
-	ensureSizeIsEnough(theta.size(), buf.theta_masked);
-	buf.theta_masked.setTo(Scalar::all(0));
-	theta.copyTo(buf.theta_masked, cluster);
-
-	times(src_joint_f, buf.theta_masked, buf.mul);
-
-	const Size nsz = Size(saturate_cast<int>(buf.mul.cols * (1.0 / df)), saturate_cast<int>(buf.mul.rows * (1.0 / df)));
-
-	ensureSizeIsEnough(nsz, buf.numerator);
-	resize(buf.mul, buf.numerator, Size(), 1.0 / df, 1.0 / df);
-
-	ensureSizeIsEnough(nsz, buf.denominator);
-	resize(buf.theta_masked, buf.denominator, Size(), 1.0 / df, 1.0 / df);
-
-	h_filter(buf.numerator, buf.numerator_filtered, sigma_s / df);
-	h_filter(buf.denominator, buf.denominator_filtered, sigma_s / df);
-
-	rdivide(buf.numerator_filtered, buf.denominator_filtered, dst);
-	}
-
-	void AdaptiveManifoldFilterImpl::buildManifoldsAndPerformFiltering(const Mat_<Point3f>& eta_k, const Mat_<uchar>& cluster_k, int current_tree_level)
-	{
-	// Compute downsampling factor
-
-	double df = min(sigma_s_ / 4.0, 256.0 * sigma_r_);
-	df = floor_to_power_of_two(df);
-	df = max(1.0, df);
-
-	// Splatting: project the pixel values onto the current manifold eta_k
-
-	if (eta_k.rows == src_joint_f_.rows)
-	{
-	ensureSizeIsEnough(src_joint_f_.size(), buf_.X);
-	subtract(src_joint_f_, eta_k, buf_.X);
-
-	const Size nsz = Size(saturate_cast<int>(eta_k.cols * (1.0 / df)), saturate_cast<int>(eta_k.rows * (1.0 / df)));
-	ensureSizeIsEnough(nsz, buf_.eta_k_small);
-	resize(eta_k, buf_.eta_k_small, Size(), 1.0 / df, 1.0 / df);
-	}
-	else
-	{
-	ensureSizeIsEnough(eta_k.size(), buf_.eta_k_small);
-	eta_k.copyTo(buf_.eta_k_small);
-
-	ensureSizeIsEnough(src_joint_f_.size(), buf_.eta_k_big);
-	resize(eta_k, buf_.eta_k_big, src_joint_f_.size());
-
-	ensureSizeIsEnough(src_joint_f_.size(), buf_.X);
-	subtract(src_joint_f_, buf_.eta_k_big, buf_.X);
-	}
-
-	// Project pixel colors onto the manifold -- Eq. (3), Eq. (5)
-
-	ensureSizeIsEnough(buf_.X.size(), buf_.X_squared);
-	multiply(buf_.X, buf_.X, buf_.X_squared);
-
-	channelsSum(buf_.X_squared, buf_.pixel_dist_to_manifold_squared);
-
-	phi(buf_.pixel_dist_to_manifold_squared, buf_.gaussian_distance_weights, sigma_r_over_sqrt_2_);
-
-	times(src_f_, buf_.gaussian_distance_weights, buf_.Psi_splat);
-
-	const Mat_<float>& Psi_splat_0 = buf_.gaussian_distance_weights;
-
-	// Save min distance to later perform adjustment of outliers -- Eq. (10)
-
-	min(min_pixel_dist_to_manifold_squared_, buf_.pixel_dist_to_manifold_squared, min_pixel_dist_to_manifold_squared_);
-
-	// Blurring: perform filtering over the current manifold eta_k
-
-	catCn(buf_.Psi_splat, Psi_splat_0, buf_.Psi_splat_joined);
-
-	ensureSizeIsEnough(buf_.eta_k_small.size(), buf_.Psi_splat_joined_resized);
-	resize(buf_.Psi_splat_joined, buf_.Psi_splat_joined_resized, buf_.eta_k_small.size());
-
-	RF_filter(buf_.Psi_splat_joined_resized, buf_.eta_k_small, buf_.blurred_projected_values, static_cast<float>(sigma_s_ / df), sigma_r_over_sqrt_2_, buf_);
-
-	split_3_1(buf_.blurred_projected_values, buf_.w_ki_Psi_blur, buf_.w_ki_Psi_blur_0);
-
-	// Slicing: gather blurred values from the manifold
-
-	// Since we perform splatting and slicing at the same points over the manifolds,
-	// the interpolation weights are equal to the gaussian weights used for splatting.
-
-	const Mat_<float>& w_ki = buf_.gaussian_distance_weights;
-
-	ensureSizeIsEnough(src_f_.size(), buf_.w_ki_Psi_blur_resized);
-	resize(buf_.w_ki_Psi_blur, buf_.w_ki_Psi_blur_resized, src_f_.size());
-	times(buf_.w_ki_Psi_blur_resized, w_ki, buf_.w_ki_Psi_blur_resized);
-	add(sum_w_ki_Psi_blur_, buf_.w_ki_Psi_blur_resized, sum_w_ki_Psi_blur_);
-
-	ensureSizeIsEnough(src_f_.size(), buf_.w_ki_Psi_blur_0_resized);
-	resize(buf_.w_ki_Psi_blur_0, buf_.w_ki_Psi_blur_0_resized, src_f_.size());
-	times(buf_.w_ki_Psi_blur_0_resized, w_ki, buf_.w_ki_Psi_blur_0_resized);
-	add(sum_w_ki_Psi_blur_0_, buf_.w_ki_Psi_blur_0_resized, sum_w_ki_Psi_blur_0_);
-
-	// Compute two new manifolds eta_minus and eta_plus
-
-	if (current_tree_level < cur_tree_height_)
-	{
-	// Algorithm 1, Step 2: compute the eigenvector v1
-	const Mat_<float> nX(src_joint_f_.size().area(), 3, (float*) buf_.X.data);
-
-	ensureSizeIsEnough(1, nX.cols, buf_.rand_vec);
-	rng_.fill(buf_.rand_vec, RNG::UNIFORM, -0.5, 0.5);
-
-	computeEigenVector(nX, cluster_k, buf_.v1, num_pca_iterations_, buf_.rand_vec, buf_);
-
-	// Algorithm 1, Step 3: Segment pixels into two clusters -- Eq. (6)
-
-	ensureSizeIsEnough(nX.rows, buf_.v1.rows, buf_.Nx_v1_mult);
-	gemm(nX, buf_.v1, 1.0, noArray(), 0.0, buf_.Nx_v1_mult, GEMM_2_T);
-
-	const Mat_<float> dot(src_joint_f_.rows, src_joint_f_.cols, (float*) buf_.Nx_v1_mult.data);
-
-	Mat_<uchar>& cluster_minus = buf_.cluster_minus[current_tree_level];
-	ensureSizeIsEnough(dot.size(), cluster_minus);
-	compare(dot, 0, cluster_minus, CMP_LT);
-	bitwise_and(cluster_minus, cluster_k, cluster_minus);
-
-	Mat_<uchar>& cluster_plus = buf_.cluster_plus[current_tree_level];
-	ensureSizeIsEnough(dot.size(), cluster_plus);
-	compare(dot, 0, cluster_plus, CMP_GT);
-	bitwise_and(cluster_plus, cluster_k, cluster_plus);
-
-	// Algorithm 1, Step 4: Compute new manifolds by weighted low-pass filtering -- Eq. (7-8)
-
-	ensureSizeIsEnough(w_ki.size(), buf_.theta);
-	buf_.theta.setTo(Scalar::all(1.0));
-	subtract(buf_.theta, w_ki, buf_.theta);
-
-	Mat_<Point3f>& eta_minus = buf_.eta_minus[current_tree_level];
-	calcEta(src_joint_f_, buf_.theta, cluster_minus, eta_minus, sigma_s_, df, buf_);
-
-	Mat_<Point3f>& eta_plus = buf_.eta_plus[current_tree_level];
-	calcEta(src_joint_f_, buf_.theta, cluster_plus, eta_plus, sigma_s_, df, buf_);
-
-	// Algorithm 1, Step 5: recursively build more manifolds.
-
-	buildManifoldsAndPerformFiltering(eta_minus, cluster_minus, current_tree_level + 1);
-	buildManifoldsAndPerformFiltering(eta_plus, cluster_plus, current_tree_level + 1);
-	}
-	}
-	}
-
-	Ptr<AdaptiveManifoldFilter> AdaptiveManifoldFilter::create()
-	{
-	return new AdaptiveManifoldFilterImpl;
-	}
-
-	void adaptiveManifold(Mat& src, Mat& guide, Mat& dest, float sigma_r, float sigma_s, int tree_height, int num_pca_iterations)
-	{
-	Ptr<AdaptiveManifoldFilter> filter = AdaptiveManifoldFilter::create();
-	filter->set("sigma_s", sigma_s);
-	filter->set("sigma_r", sigma_r/255.0);
-	filter->set("tree_height", tree_height);
-	filter->set("num_pca_iterations", num_pca_iterations);
-
-	filter->apply(src, dest, noArray(), guide);
-	}
-	*/
-}
\ No newline at end of file
+		return pow(2.0, floor(Log2(r)));
+	}
+
+	//(v[0] x4, v[1] x4): per-pixel weights of two Vec4f pixels
+	STATIC_INLINE __m256 _mm256_load_broadcast2x4_ps(const float* v)
+	{
+		return _mm256_set_m128(_mm_set1_ps(v[1]), _mm_set1_ps(v[0]));
+	}
+
+	//plain b,g,r,a to interleaved bgra: 8 pixels to 32 floats
+	STATIC_INLINE void _mm256_storeu_planar2bgra_ps(float* dst, const __m256 b, const __m256 g, const __m256 r, const __m256 a)
+	{
+		const __m256 bg_lo = _mm256_unpacklo_ps(b, g);
+		const __m256 bg_hi = _mm256_unpackhi_ps(b, g);
+		const __m256 ra_lo = _mm256_unpacklo_ps(r, a);
+		const __m256 ra_hi = _mm256_unpackhi_ps(r, a);
+		const __m256 p04 = _mm256_shuffle_ps(bg_lo, ra_lo, _MM_SHUFFLE(1, 0, 1, 0));
+		const __m256 p15 = _mm256_shuffle_ps(bg_lo, ra_lo, _MM_SHUFFLE(3, 2, 3, 2));
+		const __m256 p26 = _mm256_shuffle_ps(bg_hi, ra_hi, _MM_SHUFFLE(1, 0, 1, 0));
+		const __m256 p37 = _mm256_shuffle_ps(bg_hi, ra_hi, _MM_SHUFFLE(3, 2, 3, 2));
+		_mm256_storeu_ps(dst + 0, _mm256_permute2f128_ps(p04, p15, 0x20));
+		_mm256_storeu_ps(dst + 8, _mm256_permute2f128_ps(p26, p37, 0x20));
+		_mm256_storeu_ps(dst + 16, _mm256_permute2f128_ps(p04, p15, 0x31));
+		_mm256_storeu_ps(dst + 24, _mm256_permute2f128_ps(p26, p37, 0x31));
+	}
+
+	//recursive filter with a constant feedback coefficient for a multi-channel float image
+	static void hFilter(const Mat& src, Mat& dst, const float sigma, const bool isParallel)
+	{
+		CV_DbgAssert(src.depth() == CV_32F);
+
+		const int cn = src.channels();
+		const int width = src.cols;
+		const int height = src.rows;
+		const float a = exp(-sqrt(2.f) / sigma);
+		src.copyTo(dst);
+
+#pragma omp parallel for schedule(static) if(isParallel)
+		for (int y = 0; y < height; y++)
+		{
+			float* d = dst.ptr<float>(y);
+			for (int x = cn; x < width * cn; x++)
+			{
+				d[x] += a * (d[x - cn] - d[x]);
+			}
+			for (int x = (width - 1) * cn - 1; x >= 0; x--)
+			{
+				d[x] += a * (d[x + cn] - d[x]);
+			}
+		}
+
+		//the coefficient does not depend on the pixel, so the vertical pass runs over interleaved channels as a flat row
+		const int rowsize = width * cn;
+		const int STRIP = 256;
+		const int strips = (rowsize + STRIP - 1) / STRIP;
+		const __m256 ma = _mm256_set1_ps(a);
+#pragma omp parallel for schedule(static) if(isParallel)
+		for (int s = 0; s < strips; s++)
+		{
+			const int xs = s * STRIP;
+			const int xe = min(xs + STRIP, rowsize);
+			const int simdend = xs + get_simd_floor(xe - xs, 8);
+			for (int y = 1; y < height; y++)
+			{
+				float* cur = dst.ptr<float>(y);
+				const float* prev = dst.ptr<float>(y - 1);
+				int x = xs;
+				for (; x < simdend; x += 8)
+				{
+					const __m256 mc = _mm256_loadu_ps(cur + x);
+					_mm256_storeu_ps(cur + x, _mm256_add_ps(mc, _mm256_mul_ps(ma, _mm256_sub_ps(_mm256_loadu_ps(prev + x), mc))));
+				}
+				for (; x < xe; x++)
+				{
+					cur[x] += a * (prev[x] - cur[x]);
+				}
+			}
+			for (int y = height - 2; y >= 0; y--)
+			{
+				float* cur = dst.ptr<float>(y);
+				const float* prev = dst.ptr<float>(y + 1);
+				int x = xs;
+				for (; x < simdend; x += 8)
+				{
+					const __m256 mc = _mm256_loadu_ps(cur + x);
+					_mm256_storeu_ps(cur + x, _mm256_add_ps(mc, _mm256_mul_ps(ma, _mm256_sub_ps(_mm256_loadu_ps(prev + x), mc))));
+				}
+				for (; x < xe; x++)
+				{
+					cur[x] += a * (prev[x] - cur[x]);
+				}
+			}
+		}
+	}
+
+	//feedback coefficients V=a^D of the transformed domain recursive filter; VH(x) links x-1 and x, VV(y) links y-1 and y
+	static void computeRFWeight(const Mat_<Point3f>& joint, Mat_<float>& VH, Mat_<float>& VV, const float sigma_s, const float sigma_r, const bool isParallel)
+	{
+		const int width = joint.cols;
+		const int height = joint.rows;
+		const float lna = -sqrt(2.f) / sigma_s;
+		const float ratio = (sigma_s / sigma_r) * (sigma_s / sigma_r);
+		VH.create(joint.size());
+		VV.create(joint.size());
+
+		const __m256 mlna = _mm256_set1_ps(lna);
+		const __m256 mratio = _mm256_set1_ps(ratio);
+		const __m256 mone = _mm256_set1_ps(1.f);
+		const int simdend = get_simd_floor(width - 1, 8) + 1;
+#pragma omp parallel for schedule(static) if(isParallel)
+		for (int y = 0; y < height; y++)
+		{
+			const float* j = joint.ptr<float>(y);
+			const float* jp = joint.ptr<float>(max(y - 1, 0));
+			float* vh = VH[y];
+			float* vv = VV[y];
+
+			vh[0] = exp(lna);
+			{
+				const float db = j[0] - jp[0];
+				const float dg = j[1] - jp[1];
+				const float dr = j[2] - jp[2];
+				vv[0] = exp(lna * sqrt(1.f + ratio * (db * db + dg * dg + dr * dr)));
+			}
+			int x = 1;
+			for (; x < simdend; x += 8)
+			{
+				__m256 b0, g0, r0, b1, g1, r1, b2, g2, r2;
+				_mm256_loadu_cvtps_bgr2planar_ps(j + 3 * x, b0, g0, r0);
+				_mm256_loadu_cvtps_bgr2planar_ps(j + 3 * (x - 1), b1, g1, r1);
+				_mm256_loadu_cvtps_bgr2planar_ps(jp + 3 * x, b2, g2, r2);
+
+				__m256 db = _mm256_sub_ps(b0, b1);
+				__m256 dg = _mm256_sub_ps(g0, g1);
+				__m256 dr = _mm256_sub_ps(r0, r1);
+				__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(db, db), _mm256_mul_ps(dg, dg)), _mm256_mul_ps(dr, dr));
+				_mm256_storeu_ps(vh + x, _mm256_exp_ps(_mm256_mul_ps(mlna, _mm256_sqrt_ps(_mm256_add_ps(mone, _mm256_mul_ps(mratio, d))))));
+
+				db = _mm256_sub_ps(b0, b2);
+				dg = _mm256_sub_ps(g0, g2);
+				dr = _mm256_sub_ps(r0, r2);
+				d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(db, db), _mm256_mul_ps(dg, dg)), _mm256_mul_ps(dr, dr));
+				_mm256_storeu_ps(vv + x, _mm256_exp_ps(_mm256_mul_ps(mlna, _mm256_sqrt_ps(_mm256_add_ps(mone, _mm256_mul_ps(mratio, d))))));
+			}
+			for (; x < width; x++)
+			{
+				float db = j[3 * x + 0] - j[3 * x - 3];
+				float dg = j[3 * x + 1] - j[3 * x - 2];
+				float dr = j[3 * x + 2] - j[3 * x - 1];
+				vh[x] = exp(lna * sqrt(1.f + ratio * (db * db + dg * dg + dr * dr)));
+
+				db = j[3 * x + 0] - jp[3 * x + 0];
+				dg = j[3 * x + 1] - jp[3 * x + 1];
+				dr = j[3 * x + 2] - jp[3 * x + 2];
+				vv[x] = exp(lna * sqrt(1.f + ratio * (db * db + dg * dg + dr * dr)));
+			}
+		}
+	}
+
+	//in-place recursive filter of a Vec4f image: the horizontal pass carries two rows in one AVX register, the vertical pass two pixels of a row
+	static void transformedDomainRecursiveFilter(Mat_<Vec4f>& dst, const Mat_<float>& VH, const Mat_<float>& VV, const bool isParallel)
+	{
+		CV_DbgAssert(dst.size() == VH.size());
+		CV_DbgAssert(dst.size() == VV.size());
+
+		const int width = dst.cols;
+		const int height = dst.rows;
+
+#pragma omp parallel for schedule(static) if(isParallel)
+		for (int j = 0; j < (height + 1) / 2; j++)
+		{
+			//the last row of an odd height is processed in both halves and stored twice with the same values
+			const int y0 = 2 * j;
+			const int y1 = min(y0 + 1, height - 1);
+			float* d0 = dst.ptr<float>(y0);
+			float* d1 = dst.ptr<float>(y1);
+			const float* v0 = VH[y0];
+			const float* v1 = VH[y1];
+
+			__m256 mprev = _mm256_set_m128(_mm_loadu_ps(d1), _mm_loadu_ps(d0));
+			for (int x = 1; x < width; x++)
+			{
+				__m256 mcur = _mm256_set_m128(_mm_loadu_ps(d1 + 4 * x), _mm_loadu_ps(d0 + 4 * x));
+				const __m256 mv = _mm256_set_m128(_mm_set1_ps(v1[x]), _mm_set1_ps(v0[x]));
+				mcur = _mm256_add_ps(mcur, _mm256_mul_ps(mv, _mm256_sub_ps(mprev, mcur)));
+				_mm_storeu_ps(d0 + 4 * x, _mm256_castps256_ps128(mcur));
+				_mm_storeu_ps(d1 + 4 * x, _mm256_extractf128_ps(mcur, 1));
+				mprev = mcur;
+			}
+			for (int x = width - 2; x >= 0; x--)
+			{
+				__m256 mcur = _mm256_set_m128(_mm_loadu_ps(d1 + 4 * x), _mm_loadu_ps(d0 + 4 * x));
+				const __m256 mv = _mm256_set_m128(_mm_set1_ps(v1[x + 1]), _mm_set1_ps(v0[x + 1]));
+				mcur = _mm256_add_ps(mcur, _mm256_mul_ps(mv, _mm256_sub_ps(mprev, mcur)));
+				_mm_storeu_ps(d0 + 4 * x, _mm256_castps256_ps128(mcur));
+				_mm_storeu_ps(d1 + 4 * x, _mm256_extractf128_ps(mcur, 1));
+				mprev = mcur;
+			}
+		}
+
+		const int STRIP = 64;
+		const int strips = (width + STRIP - 1) / STRIP;
+#pragma omp parallel for schedule(static) if(isParallel)
+		for (int s = 0; s < strips; s++)
+		{
+			const int xs = s * STRIP;
+			const int xe = min(xs + STRIP, width);
+			const int simdend = xs + get_simd_floor(xe - xs, 2);
+			for (int y = 1; y < height; y++)
+			{
+				float* cur = dst.ptr<float>(y);
+				const float* prev = dst.ptr<float>(y - 1);
+				const float* v = VV[y];
+				int x = xs;
+				for (; x < simdend; x += 2)
+				{
+					const __m256 mc = _mm256_loadu_ps(cur + 4 * x);
+					const __m256 mv = _mm256_load_broadcast2x4_ps(v + x);
+					_mm256_storeu_ps(cur + 4 * x, _mm256_add_ps(mc, _mm256_mul_ps(mv, _mm256_sub_ps(_mm256_loadu_ps(prev + 4 * x), mc))));
+				}
+				for (; x < xe; x++)
+				{
+					const __m128 mc = _mm_loadu_ps(cur + 4 * x);
+					_mm_storeu_ps(cur + 4 * x, _mm_add_ps(mc, _mm_mul_ps(_mm_set1_ps(v[x]), _mm_sub_ps(_mm_loadu_ps(prev + 4 * x), mc))));
+				}
+			}
+			for (int y = height - 2; y >= 0; y--)
+			{
+				float* cur = dst.ptr<float>(y);
+				const float* prev = dst.ptr<float>(y + 1);
+				const float* v = VV[y + 1];
+				int x = xs;
+				for (; x < simdend; x += 2)
+				{
+					const __m256 mc = _mm256_loadu_ps(cur + 4 * x);
+					const __m256 mv = _mm256_load_broadcast2x4_ps(v + x);
+					_mm256_storeu_ps(cur + 4 * x, _mm256_add_ps(mc, _mm256_mul_ps(mv, _mm256_sub_ps(_mm256_loadu_ps(prev + 4 * x), mc))));
+				}
+				for (; x < xe; x++)
+				{
+					const __m128 mc = _mm_loadu_ps(cur + 4 * x);
+					_mm_storeu_ps(cur + 4 * x, _mm_add_ps(mc, _mm_mul_ps(_mm_set1_ps(v[x]), _mm_sub_ps(_mm_loadu_ps(prev + 4 * x), mc))));
+				}
+			}
+		}
+	}
+
+	//new manifold by weighted low-pass filtering -- Eq. (7-8); theta holds (theta*joint, theta) of the cluster pixels
+	static void calcEta(const Mat_<Vec4f>& theta, Mat_<Point3f>& dst, const Size nsz, const float sigma_s, Mat_<Vec4f>& theta_small, Mat_<Vec4f>& theta_filtered, const bool isParallel)
+	{
+		resize(theta, theta_small, nsz);
+		hFilter(theta_small, theta_filtered, sigma_s, isParallel);
+
+		dst.create(nsz);
+#pragma omp parallel for schedule(static) if(isParallel)
+		for (int y = 0; y < nsz.height; y++)
+		{
+			const Vec4f* s = theta_filtered[y];
+			Point3f* d = dst[y];
+			for (int x = 0; x < nsz.width; x++)
+			{
+				const Vec4f v = s[x];
+				if (v[3] > numeric_limits<float>::epsilon())
+				{
+					const float div = 1.f / v[3];
+					d[x] = Point3f(v[0] * div, v[1] * div, v[2] * div);
+				}
+				else
+				{
+					d[x] = Point3f(0.f, 0.f, 0.f);
+				}
+			}
+		}
+	}
+
+	AdaptiveManifoldFilter::AdaptiveManifoldFilter()
+	{
+		sigma_s = 16.0;
+		sigma_r = 0.2;
+		num_pca_iterations = 1;
+		cur_tree_height = 2;
+		sigma_r_over_sqrt_2 = float(sigma_r / sqrt(2.0));
+		df = 1.0;
+		seed = 0;
+	}
+
+	void AdaptiveManifoldFilter::collectGarbage()
+	{
+		buf.clear();
+
+		src_f.release();
+		src_joint_f.release();
+		eta_1.release();
+		cluster_1.release();
+	}
+
+	void AdaptiveManifoldFilter::buildManifoldsAndPerformFiltering(const Mat_<Point3f>& eta_k, const Mat_<uchar>& cluster_k, const int current_tree_level, const uint64 node_index)
+	{
+		//The root manifold is filtered with data-parallel loops, and deeper manifolds run as tasks with serial kernels.
+		//A tied task may execute its children on the same thread, so the thread's arena is not touched after the child tasks are spawned.
+		const bool isParallel = current_tree_level == 1;
+		Buf& b = *buf[isParallel ? 0 : omp_get_thread_num()];
+
+		const Size size = src_f.size();
+		const int width = size.width;
+		const int height = size.height;
+		const Size nsz = Size(saturate_cast<int>(width * (1.0 / df)), saturate_cast<int>(height * (1.0 / df)));
+
+		if (!b.isUsed)
+		{
+			b.sum_w_ki_Psi_blur.create(size);
+			b.sum_w_ki_Psi_blur.setTo(Scalar::all(0));
+			b.min_pixel_dist_to_manifold_squared.create(size);
+			b.min_pixel_dist_to_manifold_squared.setTo(Scalar::all(numeric_limits<float>::max()));
+			b.isUsed = true;
+		}
+
+		// Splatting: project the pixel values onto the current manifold eta_k
+
+		const bool isFullSize = eta_k.size() == size;
+		if (isFullSize)
+		{
+			resize(eta_k, b.eta_k_small, nsz);
+		}
+		else
+		{
+			resize(eta_k, b.eta_k_big, size);
+		}
+		const Mat_<Point3f>& eta_k_small = isFullSize ? b.eta_k_small : eta_k;
+		const Mat_<Point3f>& eta_k_big = isFullSize ? eta_k : b.eta_k_big;
+
+		// Project pixel colors onto the manifold -- Eq. (3), Eq. (5), and save min distance to later perform adjustment of outliers -- Eq. (10)
+
+		b.X.create(size);
+		b.w_ki.create(size);
+		b.Psi_splat_joined.create(size);
+		const float coeff = -0.5f / (sigma_r_over_sqrt_2 * sigma_r_over_sqrt_2);
+		const int simdend = get_simd_floor(width, 8);
+#pragma omp parallel for schedule(static) if(isParallel)
+		for (int y = 0; y < height; y++)
+		{
+			const float* j = src_joint_f.ptr<float>(y);
+			const float* e = eta_k_big.ptr<float>(y);
+			const float* s = src_f.ptr<float>(y);
+			float* X = b.X.ptr<float>(y);
+			float* w = b.w_ki[y];
+			float* psi = b.Psi_splat_joined.ptr<float>(y);
+			float* mind = b.min_pixel_dist_to_manifold_squared[y];
+
+			const __m256 mcoeff = _mm256_set1_ps(coeff);
+			int x = 0;
+			for (; x < simdend; x += 8)
+			{
+				__m256 jb, jg, jr, eb, eg, er, sb, sg, sr;
+				_mm256_loadu_cvtps_bgr2planar_ps(j + 3 * x, jb, jg, jr);
+				_mm256_loadu_cvtps_bgr2planar_ps(e + 3 * x, eb, eg, er);
+				_mm256_loadu_cvtps_bgr2planar_ps(s + 3 * x, sb, sg, sr);
+
+				const __m256 xb = _mm256_sub_ps(jb, eb);
+				const __m256 xg = _mm256_sub_ps(jg, eg);
+				const __m256 xr = _mm256_sub_ps(jr, er);
+				__m256 d0, d1, d2;
+				_mm256_cvtps_planar2bgr(xb, xg, xr, d0, d1, d2);
+				_mm256_storeu_ps(X + 3 * x + 0, d0);
+				_mm256_storeu_ps(X + 3 * x + 8, d1);
+				_mm256_storeu_ps(X + 3 * x + 16, d2);
+
+				const __m256 mdist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(xb, xb), _mm256_mul_ps(xg, xg)), _mm256_mul_ps(xr, xr));
+				_mm256_storeu_ps(mind + x, _mm256_min_ps(_mm256_loadu_ps(mind + x), mdist));
+				const __m256 mw = _mm256_exp_ps(_mm256_mul_ps(mcoeff, mdist));
+				_mm256_storeu_ps(w + x, mw);
+				_mm256_storeu_planar2bgra_ps(psi + 4 * x, _mm256_mul_ps(sb, mw), _mm256_mul_ps(sg, mw), _mm256_mul_ps(sr, mw), mw);
+			}
+			for (; x < width; x++)
+			{
+				const float xb = j[3 * x + 0] - e[3 * x + 0];
+				const float xg = j[3 * x + 1] - e[3 * x + 1];
+				const float xr = j[3 * x + 2] - e[3 * x + 2];
+				X[3 * x + 0] = xb;
+				X[3 * x + 1] = xg;
+				X[3 * x + 2] = xr;
+
+				const float dist = xb * xb + xg * xg + xr * xr;
+				mind[x] = min(mind[x], dist);
+				const float wv = exp(coeff * dist);
+				w[x] = wv;
+				psi[4 * x + 0] = s[3 * x + 0] * wv;
+				psi[4 * x + 1] = s[3 * x + 1] * wv;
+				psi[4 * x + 2] = s[3 * x + 2] * wv;
+				psi[4 * x + 3] = wv;
+			}
+		}
+
+		// Blurring: perform filtering over the current manifold eta_k
+
+		resize(b.Psi_splat_joined, b.Psi_splat_joined_resized, nsz);
+		computeRFWeight(eta_k_small, b.VH, b.VV, static_cast<float>(sigma_s / df), sigma_r_over_sqrt_2, isParallel);
+		transformedDomainRecursiveFilter(b.Psi_splat_joined_resized, b.VH, b.VV, isParallel);
+
+		// Slicing: gather blurred values from the manifold
+
+		// Since we perform splatting and slicing at the same points over the manifolds,
+		// the interpolation weights are equal to the gaussian weights used for splatting.
+
+		resize(b.Psi_splat_joined_resized, b.blurred_projected_values_resized, size);
+		const int simdend2 = get_simd_floor(width, 2);
+#pragma omp parallel for schedule(static) if(isParallel)
+		for (int y = 0; y < height; y++)
+		{
+			const float* blur = b.blurred_projected_values_resized.ptr<float>(y);
+			const float* w = b.w_ki[y];
+			float* sum = b.sum_w_ki_Psi_blur.ptr<float>(y);
+			int x = 0;
+			for (; x < simdend2; x += 2)
+			{
+				_mm256_storeu_ps(sum + 4 * x, _mm256_add_ps(_mm256_loadu_ps(sum + 4 * x), _mm256_mul_ps(_mm256_loadu_ps(blur + 4 * x), _mm256_load_broadcast2x4_ps(w + x))));
+			}
+			for (; x < width; x++)
+			{
+				_mm_storeu_ps(sum + 4 * x, _mm_add_ps(_mm_loadu_ps(sum + 4 * x), _mm_mul_ps(_mm_loadu_ps(blur + 4 * x), _mm_set1_ps(w[x]))));
+			}
+		}
+
+		// Compute two new manifolds eta_minus and eta_plus
+
+		if (current_tree_level >= cur_tree_height) return;
+
+		// Algorithm 1, Step 2: compute the eigenvector v1 by power iteration over the pixels of the cluster
+		// Each node has its own random stream, so that the result does not depend on the task schedule.
+		RNG rng(seed ^ (0x9E3779B97F4A7C15ULL * node_index));
+		float v1[3];
+		v1[0] = rng.uniform(-0.5f, 0.5f);
+		v1[1] = rng.uniform(-0.5f, 0.5f);
+		v1[2] = rng.uniform(-0.5f, 0.5f);
+		for (int i = 0; i < num_pca_iterations; i++)
+		{
+			double t0 = 0.0, t1 = 0.0, t2 = 0.0;
+#pragma omp parallel for schedule(static) reduction(+:t0, t1, t2) if(isParallel)
+			for (int y = 0; y < height; y++)
+			{
+				const uchar* mask = cluster_k[y];
+				const Point3f* X = b.X[y];
+				float s0 = 0.f, s1 = 0.f, s2 = 0.f;
+				for (int x = 0; x < width; x++)
+				{
+					if (mask[x])
+					{
+						const float dots = v1[0] * X[x].x + v1[1] * X[x].y + v1[2] * X[x].z;
+						s0 += dots * X[x].x;
+						s1 += dots * X[x].y;
+						s2 += dots * X[x].z;
+					}
+				}
+				t0 += s0;
+				t1 += s1;
+				t2 += s2;
+			}
+			v1[0] = float(t0);
+			v1[1] = float(t1);
+			v1[2] = float(t2);
+		}
+		const float n = sqrt(v1[0] * v1[0] + v1[1] * v1[1] + v1[2] * v1[2]);
+		if (n > 0.f)
+		{
+			v1[0] /= n;
+			v1[1] /= n;
+			v1[2] /= n;
+		}
+
+		// Algorithm 1, Step 3: Segment pixels into two clusters -- Eq. (6)
+		// Algorithm 1, Step 4: and splat them for the new manifolds by weighted low-pass filtering -- Eq. (7-8)
+
+		Mat_<uchar> cluster_minus(size);
+		Mat_<uchar> cluster_plus(size);
+		b.theta_minus.create(size);
+		b.theta_plus.create(size);
+#pragma omp parallel for schedule(static) if(isParallel)
+		for (int y = 0; y < height; y++)
+		{
+			const uchar* mask = cluster_k[y];
+			const Point3f* X = b.X[y];
+			const Point3f* j = src_joint_f[y];
+			const float* w = b.w_ki[y];
+			uchar* cm = cluster_minus[y];
+			uchar* cpl = cluster_plus[y];
+			Vec4f* tm = b.theta_minus[y];
+			Vec4f* tp = b.theta_plus[y];
+			for (int x = 0; x < width; x++)
+			{
+				const float dot = v1[0] * X[x].x + v1[1] * X[x].y + v1[2] * X[x].z;
+				const float theta = 1.f - w[x];
+				const Vec4f v = Vec4f(j[x].x * theta, j[x].y * theta, j[x].z * theta, theta);
+				cm[x] = (mask[x] && dot < 0.f) ? 1 : 0;
+				cpl[x] = (mask[x] && dot > 0.f) ? 1 : 0;
+				tm[x] = cm[x] ? v : Vec4f::all(0.f);
+				tp[x] = cpl[x] ? v : Vec4f::all(0.f);
+			}
+		}
+
+		Mat_<Point3f> eta_minus;
+		calcEta(b.theta_minus, eta_minus, nsz, static_cast<float>(sigma_s / df), b.theta_small, b.theta_filtered, isParallel);
+		Mat_<Point3f> eta_plus;
+		calcEta(b.theta_plus, eta_plus, nsz, static_cast<float>(sigma_s / df), b.theta_small, b.theta_filtered, isParallel);
+
+		// Algorithm 1, Step 5: recursively build more manifolds.
+
+		if (isParallel)
+		{
+#pragma omp parallel num_threads((int)buf.size())
+			{
+#pragma omp single nowait
+				{
+#pragma omp task
+					buildManifoldsAndPerformFiltering(eta_minus, cluster_minus, current_tree_level + 1, 2 * node_index);
+#pragma omp task
+					buildManifoldsAndPerformFiltering(eta_plus, cluster_plus, current_tree_level + 1, 2 * node_index + 1);
+				}
+			}
+		}
+		else
+		{
+#pragma omp task
+			buildManifoldsAndPerformFiltering(eta_minus, cluster_minus, current_tree_level + 1, 2 * node_index);
+#pragma omp task
+			buildManifoldsAndPerformFiltering(eta_plus, cluster_plus, current_tree_level + 1, 2 * node_index + 1);
+		}
+	}
+
+	void AdaptiveManifoldFilter::filter(InputArray src_, InputArray guide_, OutputArray dest, const float sigma_r, const float sigma_s, const int tree_height, const int num_pca_iterations)
+	{
+		const Mat src = src_.getMat();
+		const Mat guide = guide_.getMat();
+
+		const Size size = src.size();
+
+		CV_Assert(src.type() == CV_8UC3);
+		CV_Assert(guide.empty() || (guide.type() == src.type() && guide.size() == size));
+
+		this->sigma_s = sigma_s;
+		this->sigma_r = sigma_r / 255.0;
+		this->num_pca_iterations = num_pca_iterations;
+
+		src.convertTo(src_f, src_f.type(), 1.0 / 255.0);
+
+		// Use the center pixel as seed to random number generation.
+		const Point3f centralPix = src_f(src_f.rows / 2, src_f.cols / 2);
+		const double seedCoeff = (centralPix.x + centralPix.y + centralPix.z + 1.0f) / 4.0f;
+		seed = static_cast<uint64>(seedCoeff * numeric_limits<uint64>::max());
+
+		// If the tree_height was not specified, compute it using Eq. (10) of our paper.
+		cur_tree_height = tree_height > 0 ? tree_height : computeManifoldTreeHeight(this->sigma_s, this->sigma_r);
+
+		// If no joint signal was specified, use the original signal
+		if (guide.empty())
+			src_f.copyTo(src_joint_f);
+		else
+			guide.convertTo(src_joint_f, src_joint_f.type(), 1.0 / 255.0);
+
+		// Dividing the covariance matrix by 2 is equivalent to dividing the standard deviations by sqrt(2).
+		sigma_r_over_sqrt_2 = static_cast<float>(this->sigma_r / sqrt(2.0));
+
+		// Compute downsampling factor
+		df = min(this->sigma_s / 4.0, 256.0 * this->sigma_r);
+		df = floor_to_power_of_two(df);
+		df = max(1.0, df);
+
+		const int threads = omp_get_max_threads();
+		if ((int)buf.size() != threads) buf.resize(threads);
+		for (int i = 0; i < threads; i++)
+		{
+			if (buf[i].empty()) buf[i] = makePtr<Buf>();
+			buf[i]->isUsed = false;
+		}
+
+		// Algorithm 1, Step 1: compute the first manifold by low-pass filtering.
+		hFilter(src_joint_f, eta_1, static_cast<float>(this->sigma_s), true);
+
+		cluster_1.create(size);
+		cluster_1.setTo(Scalar::all(1));
+
+		buildManifoldsAndPerformFiltering(eta_1, cluster_1, 1, 1);
+
+		// Compute the filter response by normalized convolution -- Eq. (4), and adjust it for outlier pixels -- Eq. (10)
+		vector<const Buf*> used;
+		for (int i = 0; i < threads; i++)
+		{
+			if (buf[i]->isUsed) used.push_back(buf[i].get());
+		}
+		const int num_used = (int)used.size();
+
+		dest.create(size, CV_8UC3);
+		Mat dst = dest.getMat();
+		const float coeff = static_cast<float>(-0.5 / this->sigma_r / this->sigma_r);
+#pragma omp parallel for schedule(static)
+		for (int y = 0; y < size.height; y++)
+		{
+			const Point3f* s = src_f[y];
+			uchar* d = dst.ptr<uchar>(y);
+			for (int x = 0; x < size.width; x++)
+			{
+				Vec4f sum = used[0]->sum_w_ki_Psi_blur(y, x);
+				float mind = used[0]->min_pixel_dist_to_manifold_squared(y, x);
+				for (int i = 1; i < num_used; i++)
+				{
+					sum += used[i]->sum_w_ki_Psi_blur(y, x);
+					mind = min(mind, used[i]->min_pixel_dist_to_manifold_squared(y, x));
+				}
+
+				Point3f tilde_dst(0.f, 0.f, 0.f);
+				if (sum[3] > numeric_limits<float>::epsilon())
+				{
+					const float div = 1.f / sum[3];
+					tilde_dst = Point3f(sum[0] * div, sum[1] * div, sum[2] * div);
+				}
+				const float alpha = exp(coeff * mind);
+				const Point3f v = s[x] + alpha * (tilde_dst - s[x]);
+				d[3 * x + 0] = saturate_cast<uchar>(v.x * 255.f);
+				d[3 * x + 1] = saturate_cast<uchar>(v.y * 255.f);
+				d[3 * x + 2] = saturate_cast<uchar>(v.z * 255.f);
+			}
+		}
+	}
+
+	void adaptiveManifoldFilter(InputArray src, InputArray guide, OutputArray dest, const float sigma_r, const float sigma_s, const int tree_height, const int num_pca_iterations)
+	{
+		AdaptiveManifoldFilter amf;
+		amf.filter(src, guide, dest, sigma_r, sigma_s, tree_height, num_pca_iterations);
+	}
+}
@@ -1,4 +1,5 @@
 #include "bilateralGuidedUpsample.hpp"
+#include "inlineSIMDFunctions.hpp"
 using namespace std;
 using namespace cv;
 
@@ -461,28 +462,32 @@ namespace cp
 		return (min(max(val, min_), max_));
 	}
 
-	void BilateralGuidedUpsample::color2gray(Mat& input, Mat& output)
+	//d = sum_k w[k]*p[k] for n contiguous values (7 taps)
+	static void weightedSum7(const float* const* p, float* d, const int n, const float* w)
 	{
-		output.create(input.rows, input.cols, CV_32FC1);
-
-		const float inv = 1.f / 3.f;
-		//cvtColor(input, output, COLOR_BGR2GRAY);
-
-#pragma omp parallel for schedule(dynamic)
-		for (int y = 0; y < input.rows; y++)
+		const int simdn = get_simd_floor(n, 8);
+		const __m256 mw0 = _mm256_set1_ps(w[0]);
+		const __m256 mw1 = _mm256_set1_ps(w[1]);
+		const __m256 mw2 = _mm256_set1_ps(w[2]);
+		const __m256 mw3 = _mm256_set1_ps(w[3]);
+		for (int i = 0; i < simdn; i += 8)
 		{
-			float* input_y = input.ptr<float>(y);
-			float* output_y = output.ptr<float>(y);
-
-			for (int x = 0; x < input.cols; x++)
-			{
-				output_y[x] = (0.25f * input_y[3 * x + 0] + 0.5f * input_y[3 * x + 1] + 0.25f * input_y[3 * x + 2]);
-				//output_y[x] = (input_y[3 * x + 0] + input_y[3 * x + 1] + input_y[3 * x + 2])*inv;
-			}
+			__m256 msum = _mm256_mul_ps(mw0, _mm256_loadu_ps(p[0] + i));
+			msum = _mm256_fmadd_ps(mw1, _mm256_loadu_ps(p[1] + i), msum);
+			msum = _mm256_fmadd_ps(mw2, _mm256_loadu_ps(p[2] + i), msum);
+			msum = _mm256_fmadd_ps(mw3, _mm256_loadu_ps(p[3] + i), msum);
+			msum = _mm256_fmadd_ps(mw2, _mm256_loadu_ps(p[4] + i), msum);
+			msum = _mm256_fmadd_ps(mw1, _mm256_loadu_ps(p[5] + i), msum);
+			msum = _mm256_fmadd_ps(mw0, _mm256_loadu_ps(p[6] + i), msum);
+			_mm256_storeu_ps(d + i, msum);
+		}
+		for (int i = simdn; i < n; i++)
+		{
+			d[i] = p[0][i] * w[0] + p[1][i] * w[1] + p[2][i] * w[2] + p[3][i] * w[3] + p[4][i] * w[2] + p[5][i] * w[1] + p[6][i] * w[0];
 		}
 	}
 
-	void BilateralGuidedUpsample::constructBilateralGrid(const Mat& low_in_border, const Mat& low_out_border, const Mat& gray_low_in_border, Mat& dest, const int num_spatial_blocks, const int num_bin)
+	void BilateralGuidedUpsample::constructBilateralGrid(const Mat& low_in_border, const Mat& low_out_border, Mat& dest, const int num_spatial_blocks, const int num_bin)
 	{
 		const int grid_width_border = low_in_border.cols / num_spatial_blocks;
 		const int grid_height_border = low_in_border.rows / num_spatial_blocks;
@@ -490,26 +495,25 @@ namespace cp
 		const float r_sigma = 1.f / num_bin;
 
 		dest.create(grid_width_border * grid_height_border, num_range_coeffs * grid_range_border, CV_32FC1);
-		dest.setTo(0);
 
-		//#pragma omp parallel for schedule(dynamic)
+		//each grid row gathers a disjoint band of pixel rows, so rows are accumulated in parallel without reduction.
+#pragma omp parallel for schedule(dynamic)
 		for (int y = 0; y < grid_height_border; y++)
 		{
-			for (int x = 0; x < grid_width_border; x++)
+			float* bgrid_row = dest.ptr<float>(grid_width_border * y);
+			memset(bgrid_row, 0, sizeof(float) * grid_width_border * num_range_coeffs * grid_range_border);
+			for (int i = 0; i < num_spatial_blocks; i++)
 			{
-				float* bgrid_ptr = dest.ptr<float>(grid_width_border * y + x);
+				const int sy = y * num_spatial_blocks + i;
+				const float* clamped_low_in_ptr = low_in_border.ptr<float>(sy);
+				const float* clamped_low_out_ptr = low_out_border.ptr<float>(sy);
 
-				for (int i = 0; i < num_spatial_blocks; i++)
+				for (int x = 0; x < grid_width_border; x++)
 				{
-					const int sy = y * num_spatial_blocks + i;
-					const float* clamped_low_in_ptr = low_in_border.ptr<float>(sy);
-					const float* clamped_low_out_ptr = low_out_border.ptr<float>(sy);
-
+					float* bgrid_ptr = bgrid_row + num_range_coeffs * grid_range_border * x;
 					for (int j = 0; j < num_spatial_blocks; j++)
 					{
 						const int sx = x * num_spatial_blocks + j;
-						const float pos = gray_low_in_border.at<float>(sy, sx);
-						const int zi = (int)(round(pos * (1.0f / r_sigma)));
 
 						// Sum all the terms we need to fit a line relating low-res input to low-res output within this bilateral grid cell
 						const float vb = clamped_low_out_ptr[sx * 3 + 0];
@@ -519,6 +523,10 @@ namespace cp
 						const float sg = clamped_low_in_ptr[sx * 3 + 1];
 						const float sr = clamped_low_in_ptr[sx * 3 + 2];
 
+						//gray of the guide (same as color2gray)
+						const float pos = 0.25f * sb + 0.5f * sg + 0.25f * sr;
+						const int zi = min(max((int)(round(pos * (1.0f / r_sigma))), 0), grid_range_border - 1);
+
 						float* h = &bgrid_ptr[num_range_coeffs * zi];
 						h[0] += sr * sr;
 						h[1] += sr * sg;
@@ -548,10 +556,12 @@ namespace cp
 		}
 	}
 
+	//each grid cell is a contiguous [z][coeff] slice, so all three axes are 7-row weighted sums over contiguous lines.
 	void BilateralGuidedUpsample::blur7tap(Mat& src, Mat& dest, const int grid_width_border, const int grid_height_border, const int grid_range_border)
 	{
 		const int grid_width = grid_width_border - 6;
 		const int grid_height = grid_height_border - 6;
+		const int cell_size = num_range_coeffs * grid_range_border;
 
 		float wr[4];
 		float ws[4];
@@ -565,80 +575,37 @@ namespace cp
 		wr[2] = 1.f / 8.f;
 		wr[3] = 1.f / 1.f;
 
-		/*const float t0 = 1.f / 64.f;
-		const float t1 = 1.f / 27.f;
-		const float t2 = 1.f / 8.f;
-		const float t3 = 1.f;*/
-
 		dest.create(Size(src.size()), CV_32FC1);
 
-		//blur z
+		//blur z (replicated boundary)
 #pragma omp parallel for schedule(dynamic)
 		for (int y = 0; y < grid_height_border; y++)
 		{
-			//Mat seven_tap_filter_buffz = Mat::zeros(1, grid_range + 6, CV_32FC1);
-			Mat seven_tap_filter_buffz(1, grid_range_border + 6, CV_32FC1);
+			const float* p[7];
 			for (int x = 0; x < grid_width_border; x++)
 			{
 				const float* bgrid_ptr = src.ptr<float>(grid_width_border * y + x);
 				float* blurz_ptr = dest.ptr<float>(grid_width_border * y + x);
-
-				for (int c = 0; c < num_range_coeffs; c++)
+				for (int z = 0; z < grid_range_border; z++)
 				{
-					float* tap7_buff = seven_tap_filter_buffz.ptr<float>();
-
-					for (int i = 0; i < grid_range_border; i++)
+					for (int k = 0; k < 7; k++)
 					{
-						tap7_buff[i + 3] = bgrid_ptr[num_range_coeffs * i + c];
-					}
-					tap7_buff[0] = tap7_buff[1] = tap7_buff[2] = tap7_buff[3];
-					tap7_buff[grid_range_border + 5] = tap7_buff[grid_range_border + 4] = tap7_buff[grid_range_border + 3] = tap7_buff[grid_range_border + 2];
-
-					// blur
-					for (int z = 0; z < grid_range_border; z++)
-					{
-						blurz_ptr[num_range_coeffs * z + c] =
-							tap7_buff[z + 3 - 3] * wr[0] +
-							tap7_buff[z + 3 - 2] * wr[1] +
-							tap7_buff[z + 3 - 1] * wr[2] +
-							tap7_buff[z + 3 - 0] * wr[3] +
-							tap7_buff[z + 3 + 1] * wr[2] +
-							tap7_buff[z + 3 + 2] * wr[1] +
-							tap7_buff[z + 3 + 3] * wr[0];
+						p[k] = bgrid_ptr + num_range_coeffs * min(max(z + k - 3, 0), grid_range_border - 1);
 					}
+					weightedSum7(p, blurz_ptr + num_range_coeffs * z, num_range_coeffs, wr);
 				}
 			}
 		}
 
 		//blur y
 #pragma omp parallel for schedule(dynamic)
-		for (int x = 0; x < grid_width_border; x++)
+		for (int y = 0; y < grid_height; y++)
 		{
-			Mat seven_tap_filter_buffy(1, grid_height_border, CV_32FC1);
-			for (int z = 0; z < grid_range_border; z++)
+			const float* p[7];
+			for (int x = 0; x < grid_width_border; x++)
 			{
-				for (int c = 0; c < num_range_coeffs; c++)
-				{
-					float* tap7_buff = seven_tap_filter_buffy.ptr<float>(0);
-
-					for (int i = 0; i < grid_height_border; i++)
-					{
-						tap7_buff[i] = dest.at<float>(grid_width_border * i + x, num_range_coeffs * z + c);
-					}
-
-					// blur
-					for (int y = 0; y < grid_height; y++)
-					{
-						src.at<float>(grid_width_border * y + x, num_range_coeffs * z + c) =
-							tap7_buff[y + 3 - 3] * ws[0] +
-							tap7_buff[y + 3 - 2] * ws[1] +
-							tap7_buff[y + 3 - 1] * ws[2] +
-							tap7_buff[y + 3 - 0] * ws[3] +
-							tap7_buff[y + 3 + 1] * ws[2] +
-							tap7_buff[y + 3 + 2] * ws[1] +
-							tap7_buff[y + 3 + 3] * ws[0];
-					}
-				}
+				for (int k = 0; k < 7; k++) p[k] = dest.ptr<float>(grid_width_border * (y + k) + x);
+				weightedSum7(p, src.ptr<float>(grid_width_border * y + x), cell_size, ws);
 			}
 		}
 
@@ -646,221 +613,257 @@ namespace cp
 #pragma omp parallel for schedule(dynamic)
 		for (int y = 0; y < grid_height; y++)
 		{
-			Mat seven_tap_filter_buffx(1, grid_width_border, CV_32FC1);
-			for (int z = 0; z < grid_range_border; z++)
+			const float* p[7];
+			for (int x = 0; x < grid_width; x++)
 			{
-				for (int c = 0; c < num_range_coeffs; c++)
-				{
-					float* tap7_buff = seven_tap_filter_buffx.ptr<float>(0);
-
-					for (int i = 0; i < grid_width_border; i++)
-					{
-						tap7_buff[i] = src.at<float>(grid_width_border * y + i, num_range_coeffs * z + c);
-					}
-					// blur
-					for (int x = 0; x < grid_width; x++)
-					{
-						dest.at<float>(grid_width_border * y + x, num_range_coeffs * z + c) =
-							tap7_buff[x + 3 - 3] * ws[0] +
-							tap7_buff[x + 3 - 2] * ws[1] +
-							tap7_buff[x + 3 - 1] * ws[2] +
-							tap7_buff[x + 3 - 0] * ws[3] +
-							tap7_buff[x + 3 + 1] * ws[2] +
-							tap7_buff[x + 3 + 2] * ws[1] +
-							tap7_buff[x + 3 + 3] * ws[0];
-					}
-				}
+				for (int k = 0; k < 7; k++) p[k] = src.ptr<float>(grid_width_border * y + x + k);
+				weightedSum7(p, dest.ptr<float>(grid_width_border * y + x), cell_size, ws);
 			}
 		}
 	}
 
+	//closed-form solve of the regularized 4x4 normal equations (Cholesky) for 8 cells at once.
+	//src: 8 cells of 22 coefficients (contiguous), dest: 8 cells of 12 affine coefficients (contiguous), valid: number of cells to write
+	static void solveAffine8(const float* src, float* dest, const int valid, const float lambda, const float epsilon)
+	{
+		const __m256i vindex = _mm256_setr_epi32(0, 22, 44, 66, 88, 110, 132, 154);
+		__m256 bx[22];
+		for (int c = 0; c < 22; c++) bx[c] = _mm256_i32gather_ps(src + c, vindex, 4);
+
+		const __m256 mone = _mm256_set1_ps(1.f);
+		const __m256 mtiny = _mm256_set1_ps(FLT_MIN);
+		const __m256 mN1 = _mm256_add_ps(bx[9], mone);// the bottom right entry of A is a count of the constraints affecting this cell (N).
+		const __m256 meps = _mm256_mul_ps(_mm256_set1_ps(epsilon), mN1);
+
+		// Regularize by pushing the solution towards the average gain
+		// in this cell = (average output luma + eps) / (average input luma + eps).
+		const __m256 output_luma = _mm256_add_ps(_mm256_add_ps(bx[13], _mm256_add_ps(bx[17], bx[17])), _mm256_add_ps(bx[21], meps));
+		const __m256 input_luma = _mm256_add_ps(_mm256_add_ps(bx[3], _mm256_add_ps(bx[6], bx[6])), _mm256_add_ps(bx[8], meps));
+		const __m256 gain = _mm256_div_ps(output_luma, input_luma);
+		const __m256 wl = _mm256_mul_ps(_mm256_set1_ps(lambda), mN1);
+		const __m256 wlgain = _mm256_mul_ps(wl, gain);
+
+		const __m256 a00 = _mm256_add_ps(bx[0], wl);
+		const __m256 a11 = _mm256_add_ps(bx[4], wl);
+		const __m256 a22 = _mm256_add_ps(bx[7], wl);
+		const __m256 a33 = _mm256_add_ps(bx[9], wl);
+
+		//A = LL^T
+		const __m256 l00 = _mm256_sqrt_ps(_mm256_max_ps(a00, mtiny));
+		const __m256 i0 = _mm256_div_ps(mone, l00);
+		const __m256 l10 = _mm256_mul_ps(bx[1], i0);
+		const __m256 l20 = _mm256_mul_ps(bx[2], i0);
+		const __m256 l30 = _mm256_mul_ps(bx[3], i0);
+		const __m256 l11 = _mm256_sqrt_ps(_mm256_max_ps(_mm256_fnmadd_ps(l10, l10, a11), mtiny));
+		const __m256 i1 = _mm256_div_ps(mone, l11);
+		const __m256 l21 = _mm256_mul_ps(_mm256_fnmadd_ps(l20, l10, bx[5]), i1);
+		const __m256 l31 = _mm256_mul_ps(_mm256_fnmadd_ps(l30, l10, bx[6]), i1);
+		const __m256 l22 = _mm256_sqrt_ps(_mm256_max_ps(_mm256_fnmadd_ps(l21, l21, _mm256_fnmadd_ps(l20, l20, a22)), mtiny));
+		const __m256 i2 = _mm256_div_ps(mone, l22);
+		const __m256 l32 = _mm256_mul_ps(_mm256_fnmadd_ps(l31, l21, _mm256_fnmadd_ps(l30, l20, bx[8])), i2);
+		const __m256 l33 = _mm256_sqrt_ps(_mm256_max_ps(_mm256_fnmadd_ps(l32, l32, _mm256_fnmadd_ps(l31, l31, _mm256_fnmadd_ps(l30, l30, a33))), mtiny));
+		const __m256 i3 = _mm256_div_ps(mone, l33);
+
+		__m256 result[12];
+		for (int c = 0; c < 3; c++)
+		{
+			// Pull out the rhs with the regularization on the diagonal
+			__m256 b0 = bx[10 + 4 * c + 0];
+			__m256 b1 = bx[10 + 4 * c + 1];
+			__m256 b2 = bx[10 + 4 * c + 2];
+			const __m256 b3 = bx[10 + 4 * c + 3];
+			if (c == 0) b0 = _mm256_add_ps(b0, wlgain);
+			if (c == 1) b1 = _mm256_add_ps(b1, wlgain);
+			if (c == 2) b2 = _mm256_add_ps(b2, wlgain);
+
+			//Ly = b
+			const __m256 y0 = _mm256_mul_ps(b0, i0);
+			const __m256 y1 = _mm256_mul_ps(_mm256_fnmadd_ps(l10, y0, b1), i1);
+			const __m256 y2 = _mm256_mul_ps(_mm256_fnmadd_ps(l21, y1, _mm256_fnmadd_ps(l20, y0, b2)), i2);
+			const __m256 y3 = _mm256_mul_ps(_mm256_fnmadd_ps(l32, y2, _mm256_fnmadd_ps(l31, y1, _mm256_fnmadd_ps(l30, y0, b3))), i3);
+			//L^T x = y
+			const __m256 x3 = _mm256_mul_ps(y3, i3);
+			const __m256 x2 = _mm256_mul_ps(_mm256_fnmadd_ps(l32, x3, y2), i2);
+			const __m256 x1 = _mm256_mul_ps(_mm256_fnmadd_ps(l31, x3, _mm256_fnmadd_ps(l21, x2, y1)), i1);
+			const __m256 x0 = _mm256_mul_ps(_mm256_fnmadd_ps(l30, x3, _mm256_fnmadd_ps(l20, x2, _mm256_fnmadd_ps(l10, x1, y0))), i0);
+			result[4 * c + 0] = x0;
+			result[4 * c + 1] = x1;
+			result[4 * c + 2] = x2;
+			result[4 * c + 3] = x3;
+		}
+
+		// Pack the resulting matrix into the output.
+		float CV_DECL_ALIGNED(32) buff[12][8];
+		for (int c = 0; c < 12; c++) _mm256_store_ps(buff[c], result[c]);
+		for (int l = 0; l < valid; l++)
+		{
+			for (int c = 0; c < 12; c++) dest[12 * l + c] = buff[c][l];
+		}
+	}
+
 	void BilateralGuidedUpsample::optimize(const Mat& src, Mat& dest, const float lambda, const float epsilon, const int grid_width_border, const int grid_height_border, const int grid_range_border)
 	{
 		const int grid_width = grid_width_border - 6;
 		const int grid_height = grid_height_border - 6;
 		dest.create(grid_width * grid_height, num_optimized_coeffs * grid_range_border, CV_32F);
 
-		// Regularize by pushing the solution towards the average gain
-					// in this cell = (average output luma + eps) / (average input luma + eps).
-		// Regularize by pushing the solution towards the average gain
-					// in this cell = (average output luma + eps) / (average input luma + eps).
-
+		//cells of a grid row (x, z) are strided by num_range_coeffs in src and by num_optimized_coeffs in dest, so they are solved in batches of 8.
+		const int num_cells = grid_width * grid_range_border;
+		const int simd_cells = get_simd_floor(num_cells, 8);
 #pragma omp parallel for schedule(dynamic)
 		for (int y = 0; y < grid_height; y++)
 		{
-			Mat A(4, 4, CV_32F);
-			Mat b(4, 3, CV_32F);
-			Mat result(3, 4, CV_32F);
-			for (int x = 0; x < grid_width; x++)
+			const float* bgrid_ptr = src.ptr<float>(grid_width_border * y);
+			float* dest_ptr = dest.ptr<float>(grid_width * y);
+			for (int i = 0; i < simd_cells; i += 8)
 			{
-				const float* bgrid_ptr = src.ptr<float>(grid_width_border * y + x);
-				float* dest_ptr = dest.ptr<float>(grid_width * y + x);
-
-				for (int z = 0; z < grid_range_border; z++)
+				solveAffine8(bgrid_ptr + num_range_coeffs * i, dest_ptr + num_optimized_coeffs * i, 8, lambda, epsilon);
+			}
+			if (simd_cells != num_cells)
+			{
+				//pad the remaining cells with the last one
+				float tail[22 * 8];
+				const int valid = num_cells - simd_cells;
+				for (int l = 0; l < 8; l++)
 				{
-					// Pull out the 4x4 symmetric matrix from the values we've acuumulated.
-					const float* bx = &bgrid_ptr[num_range_coeffs * z];
-					A.at<float>(0, 0) = bx[0];
-					A.at<float>(0, 1) = bx[1];
-					A.at<float>(0, 2) = bx[2];
-					A.at<float>(0, 3) = bx[3];
-					A.at<float>(1, 0) = A.at<float>(0, 1);
-					A.at<float>(1, 1) = bx[4];
-					A.at<float>(1, 2) = bx[5];
-					A.at<float>(1, 3) = bx[6];
-					A.at<float>(2, 0) = A.at<float>(0, 2);
-					A.at<float>(2, 1) = A.at<float>(1, 2);
-					A.at<float>(2, 2) = bx[7];
-					A.at<float>(2, 3) = bx[8];
-					A.at<float>(3, 0) = A.at<float>(0, 3);
-					A.at<float>(3, 1) = A.at<float>(1, 3);
-					A.at<float>(3, 2) = A.at<float>(2, 3);
-					A.at<float>(3, 3) = bx[9];
-
-					// Pull out the rhs				
-					b.at<float>(0, 0) = bx[10];
-					b.at<float>(1, 0) = bx[11];
-					b.at<float>(2, 0) = bx[12];
-					b.at<float>(3, 0) = bx[13];
-					b.at<float>(0, 1) = bx[14];
-					b.at<float>(1, 1) = bx[15];
-					b.at<float>(2, 1) = bx[16];
-					b.at<float>(3, 1) = bx[17];
-					b.at<float>(0, 2) = bx[18];
-					b.at<float>(1, 2) = bx[19];
-					b.at<float>(2, 2) = bx[20];
-					b.at<float>(3, 2) = bx[21];
-
-					// The bottom right entry of A is a count of the number of
-					// constraints affecting this cell.
-					const float N = A.at<float>(3, 3);
-
-					const float output_luma = b.at<float>(3, 0) + 2.f * b.at<float>(3, 1) + b.at<float>(3, 2) + epsilon * (N + 1);
-					const float input_luma = A.at<float>(3, 0) + 2.f * A.at<float>(3, 1) + A.at<float>(3, 2) + epsilon * (N + 1);
-					const float gain = output_luma / input_luma;
-
-					const float weighted_lambda = lambda * (N + 1.f);
-					A.at<float>(0, 0) += weighted_lambda;
-					A.at<float>(1, 1) += weighted_lambda;
-					A.at<float>(2, 2) += weighted_lambda;
-					A.at<float>(3, 3) += weighted_lambda;
-
-					b.at<float>(0, 0) += weighted_lambda * gain;
-					b.at<float>(1, 1) += weighted_lambda * gain;
-					b.at<float>(2, 2) += weighted_lambda * gain;
-
-					// Now solve Ax = b							
-					cv::solve(A, b, result, DECOMP_LU);
-					//transpose(tmp, result);
-
-					// Pack the resulting matrix into the output Func.
-					float* lp = &dest_ptr[num_optimized_coeffs * z];
-					lp[0] = result.at<float>(0, 0);
-					lp[1] = result.at<float>(1, 0);
-					lp[2] = result.at<float>(2, 0);
-					lp[3] = result.at<float>(3, 0);
-					lp[4] = result.at<float>(0, 1);
-					lp[5] = result.at<float>(1, 1);
-					lp[6] = result.at<float>(2, 1);
-					lp[7] = result.at<float>(3, 1);
-					lp[8] = result.at<float>(0, 2);
-					lp[9] = result.at<float>(1, 2);
-					lp[10] = result.at<float>(2, 2);
-					lp[11] = result.at<float>(3, 2);
+					memcpy(tail + num_range_coeffs * l, bgrid_ptr + num_range_coeffs * (simd_cells + min(l, valid - 1)), sizeof(float) * num_range_coeffs);
 				}
+				solveAffine8(tail, dest_ptr + num_optimized_coeffs * simd_cells, valid, lambda, epsilon);
 			}
 		}
 	}
 
+	template<typename srcType>
+	static inline void loadBGR(const srcType* s, float& b, float& g, float& r)
+	{
+		const float inv = 1.f / 255.f;
+		b = s[0] * inv;
+		g = s[1] * inv;
+		r = s[2] * inv;
+	}
 
+	template<>
+	inline void loadBGR<float>(const float* s, float& b, float& g, float& r)
+	{
+		b = s[0];
+		g = s[1];
+		r = s[2];
+	}
 
-
-
-
-
-
-
-
-
-	void BilateralGuidedUpsample::linearInterpolation(const Mat& high_src, const Mat& high_src_gray, const Mat& opt_bgrid, Mat& dest, const int grid_width, const int grid_height, const int grid_range, const float upsample_size)
+	//slicing: the grid is interpolated in y once per output row, then each pixel takes a bilinear (x, z) interpolation of the 12 affine coefficients with SIMD and applies them.
+	//The guide gray and the 8U conversion are fused.
+	template<typename srcType>
+	static void sliceAffine(const Mat& high_src, const Mat& opt_bgrid, Mat& dest, const int grid_width, const int grid_height, const int grid_range, const float upsample_size)
 	{
 		const int num_bins = grid_range;
-		dest.create(high_src.rows, high_src.cols, CV_32FC3);
-
-#pragma omp parallel for schedule(dynamic)
-		for (int y = 0; y < high_src.rows; y++)
+		const int grid_range_border = grid_range + 1;
+		const int cell_size = 12 * grid_range_border;
+		const int row_size = grid_width * cell_size;
+		const int simd_row_size = get_simd_floor(row_size, 8);
+
+		AutoBuffer<int> xidx(high_src.cols);
+		AutoBuffer<float> xweight(high_src.cols);
+		for (int x = 0; x < high_src.cols; x++)
 		{
-			float interpolated_z[12];
-			float yf = (float)y / upsample_size;
-			const int yi = (int)yf;
-			const int yinext = min(yi + 1, grid_height - 1);
-			yf -= yi;
+			const float xf = (float)x / upsample_size;
+			xidx[x] = min((int)xf, grid_width - 1);
+			xweight[x] = xf - (int)xf;
+		}
 
-			for (int x = 0; x < high_src.cols; x++)
+#pragma omp parallel
+		{
+			AutoBuffer<float> yrowbuff(row_size + 8);
+			float* yrow = yrowbuff.data();
+#pragma omp for schedule(dynamic)
+			for (int y = 0; y < high_src.rows; y++)
 			{
-				float xf = (float)x / upsample_size;
-				const int xi = (int)xf;
-				const int xinext = min(xi + 1, grid_width - 1);
-				xf -= xi;
-
-				float val = high_src_gray.at<float>(y, x);
-				val = clamp(val, 0.0f, 1.0f);
-
-				const float zv = val * num_bins;
-				const int zi = (int)zv;
-				float zf = zv - zi;
-
-				const float* high_in_ptr = high_src.ptr<float>(y) + 3 * x;
-				float* interpolated_ptr = dest.ptr<float>(y) + 3 * x;
-
-				for (int c = 0; c < num_optimized_coeffs; c++)
+				float yf = (float)y / upsample_size;
+				const int yi = min((int)yf, grid_height - 1);
+				const int yinext = min(yi + 1, grid_height - 1);
+				yf -= (int)yf;
+
+				//interpolate y for all cells of the row
+				const float* pre_y = opt_bgrid.ptr<float>(grid_width * yi);
+				const float* next_y = opt_bgrid.ptr<float>(grid_width * yinext);
+				const __m256 myf = _mm256_set1_ps(yf);
+				const __m256 myf1 = _mm256_set1_ps(1.f - yf);
+				for (int i = 0; i < simd_row_size; i += 8)
 				{
-					float pre_y, next_y, pre_x, next_x, pre_z, next_z;
-
-					pre_y = opt_bgrid.at<float>(grid_width * yi + xi, num_optimized_coeffs * zi + c);
-					next_y = opt_bgrid.at<float>(grid_width * yinext + xi, num_optimized_coeffs * zi + c);
-					pre_x = lerp(0.f, pre_y, yf, 1.f, next_y);
-
-					pre_y = opt_bgrid.at<float>(grid_width * yi + xinext, num_optimized_coeffs * zi + c);
-					next_y = opt_bgrid.at<float>(grid_width * yinext + xinext, num_optimized_coeffs * zi + c);
-					next_x = lerp(0.f, pre_y, yf, 1.f, next_y);
-					pre_z = lerp(0.f, pre_x, xf, 1.f, next_x);
-
-					pre_y = opt_bgrid.at<float>(grid_width * yi + xi, num_optimized_coeffs * (zi + 1) + c);
-					next_y = opt_bgrid.at<float>(grid_width * yinext + xi, num_optimized_coeffs * (zi + 1) + c);
-					pre_x = lerp(0.f, pre_y, yf, 1.f, next_y);
-
-					pre_y = opt_bgrid.at<float>(grid_width * yi + xinext, num_optimized_coeffs * (zi + 1) + c);
-					next_y = opt_bgrid.at<float>(grid_width * yinext + xinext, num_optimized_coeffs * (zi + 1) + c);
-					next_x = lerp(0.f, pre_y, yf, 1.f, next_y);
-					next_z = lerp(0.f, pre_x, xf, 1.f, next_x);
-
-					interpolated_z[c] = lerp(0.f, pre_z, zf, 1.f, next_z);
+					_mm256_storeu_ps(yrow + i, _mm256_fmadd_ps(myf, _mm256_loadu_ps(next_y + i), _mm256_mul_ps(myf1, _mm256_loadu_ps(pre_y + i))));
 				}
-				// Multiply by 3x4 by 4x1.
-				for (int c = 0; c < 3; c++)
+				for (int i = simd_row_size; i < row_size; i++)
 				{
-					interpolated_ptr[2 - c] =
-						interpolated_z[4 * c + 0] * high_in_ptr[2] +
-						interpolated_z[4 * c + 1] * high_in_ptr[1] +
-						interpolated_z[4 * c + 2] * high_in_ptr[0] +
-						interpolated_z[4 * c + 3];
+					yrow[i] = (1.f - yf) * pre_y[i] + yf * next_y[i];
 				}
 
-				interpolated_ptr[0] = clamp(interpolated_ptr[0], 0.f, 1.f);
-				interpolated_ptr[1] = clamp(interpolated_ptr[1], 0.f, 1.f);
-				interpolated_ptr[2] = clamp(interpolated_ptr[2], 0.f, 1.f);
+				const srcType* high_in_ptr = high_src.ptr<srcType>(y);
+				uchar* dest_ptr = dest.ptr<uchar>(y);
+				for (int x = 0; x < high_src.cols; x++)
+				{
+					float b, g, r;
+					loadBGR(high_in_ptr + 3 * x, b, g, r);
+
+					const float val = min(max(0.25f * b + 0.5f * g + 0.25f * r, 0.f), 1.f);
+					const float zv = val * num_bins;
+					const int zi = (int)zv;
+					const float zf = zv - zi;
+					const int dz = (zi < grid_range) ? 12 : 0;
+
+					const float xf = xweight[x];
+					const int xi = xidx[x];
+					const int xinext = min(xi + 1, grid_width - 1);
+
+					const float* p00 = yrow + cell_size * xi + 12 * zi;
+					const float* p10 = yrow + cell_size * xinext + 12 * zi;
+					const __m256 w00 = _mm256_set1_ps((1.f - xf) * (1.f - zf));
+					const __m256 w10 = _mm256_set1_ps(xf * (1.f - zf));
+					const __m256 w01 = _mm256_set1_ps((1.f - xf) * zf);
+					const __m256 w11 = _mm256_set1_ps(xf * zf);
+
+					__m256 mc = _mm256_mul_ps(w00, _mm256_loadu_ps(p00));
+					mc = _mm256_fmadd_ps(w10, _mm256_loadu_ps(p10), mc);
+					mc = _mm256_fmadd_ps(w01, _mm256_loadu_ps(p00 + dz), mc);
+					mc = _mm256_fmadd_ps(w11, _mm256_loadu_ps(p10 + dz), mc);
+					__m128 mc4 = _mm_mul_ps(_mm256_castps256_ps128(w00), _mm_loadu_ps(p00 + 8));
+					mc4 = _mm_fmadd_ps(_mm256_castps256_ps128(w10), _mm_loadu_ps(p10 + 8), mc4);
+					mc4 = _mm_fmadd_ps(_mm256_castps256_ps128(w01), _mm_loadu_ps(p00 + dz + 8), mc4);
+					mc4 = _mm_fmadd_ps(_mm256_castps256_ps128(w11), _mm_loadu_ps(p10 + dz + 8), mc4);
+
+					// Multiply by 3x4 by 4x1.
+					const __m128 v = _mm_setr_ps(r, g, b, 1.f);
+					__m256 m8 = _mm256_mul_ps(mc, _mm256_set_m128(v, v));
+					m8 = _mm256_hadd_ps(m8, m8);
+					m8 = _mm256_hadd_ps(m8, m8);
+					__m128 m4 = _mm_mul_ps(mc4, v);
+					m4 = _mm_hadd_ps(m4, m4);
+					m4 = _mm_hadd_ps(m4, m4);
+
+					const float o2 = _mm_cvtss_f32(_mm256_castps256_ps128(m8));
+					const float o1 = _mm_cvtss_f32(_mm256_extractf128_ps(m8, 1));
+					const float o0 = _mm_cvtss_f32(m4);
+					dest_ptr[3 * x + 0] = saturate_cast<uchar>(min(max(o0, 0.f), 1.f) * 255.f);
+					dest_ptr[3 * x + 1] = saturate_cast<uchar>(min(max(o1, 0.f), 1.f) * 255.f);
+					dest_ptr[3 * x + 2] = saturate_cast<uchar>(min(max(o2, 0.f), 1.f) * 255.f);
+				}
 			}
 		}
 	}
 
+	void BilateralGuidedUpsample::linearInterpolation(const Mat& high_src, const Mat& opt_bgrid, Mat& dest, const int grid_width, const int grid_height, const int grid_range, const float upsample_size)
+	{
+		dest.create(high_src.rows, high_src.cols, CV_8UC3);
+		if (high_src.depth() == CV_8U) sliceAffine<uchar>(high_src, opt_bgrid, dest, grid_width, grid_height, grid_range, upsample_size);
+		else sliceAffine<float>(high_src, opt_bgrid, dest, grid_width, grid_height, grid_range, upsample_size);
+	}
+
 	void BilateralGuidedUpsample::upsample(Mat& low_res_in, Mat& low_res_out, Mat& high_res_in, Mat& high_res_out, const int num_spatial_blocks, const int num_bin, float lambda, float epsilon, const int border)
 	{
 		CV_Assert(low_res_in.channels() == 3);
 
 		low_res_in.convertTo(low_in, CV_32FC3, 1.f / 255.f);
 		low_res_out.convertTo(low_out, CV_32FC3, 1.f / 255.f);
-		high_res_in.convertTo(high_in, CV_32FC3, 1.f / 255.f);
+		//8U high-res input is read directly in the slicing
+		if (high_res_in.depth() != CV_8U) high_res_in.convertTo(high_in, CV_32FC3, 1.f / 255.f);
 
 		const int tapSize = 7;
 		const int bb = tapSize * num_spatial_blocks / 2;
@@ -868,8 +871,8 @@ namespace cp
 		copyMakeBorder(low_out, clamped_low_out, bb, bb, bb, bb, border);
 
 		// Figure out how much we're upsampling by. Not relevant if we're just fitting curves.
-		const int upsample_factor_x = (int)ceil(((float)high_in.cols / low_in.cols));// factor = highres / rowres
-		const int upsample_factor_y = (int)ceil(((float)high_in.rows / low_in.rows));
+		const int upsample_factor_x = (int)ceil(((float)high_res_in.cols / low_in.cols));// factor = highres / rowres
+		const int upsample_factor_y = (int)ceil(((float)high_res_in.rows / low_in.rows));
 		const int upsampleFactor = max(upsample_factor_x, upsample_factor_y);
 
 		const int grid_width_border = clamped_low_in.cols / num_spatial_blocks;
@@ -884,8 +887,7 @@ namespace cp
 		//construct bilateral grid
 		//cp::Timer t("", 0, false);
 		//t.start();
-		color2gray(clamped_low_in, gray_low_in);
-		constructBilateralGrid(clamped_low_in, clamped_low_out, gray_low_in, bilateralGrid, num_spatial_blocks, num_bin);
+		constructBilateralGrid(clamped_low_in, clamped_low_out, bilateralGrid, num_spatial_blocks, num_bin);
 		//t.getTime(true);
 
 		//Bluring the grid using a seven-tap filter.
@@ -901,11 +903,8 @@ namespace cp
 
 		//interpolating bilateral grid for full resolution.
 		//t.start();
-		color2gray(high_in, gray_high_in);
 		const float upsampleFactorBG2Highres = float(upsampleFactor * num_spatial_blocks);
-		linearInterpolation(high_in, gray_high_in, bilateralGridOpt, output32f, grid_width, grid_height, grid_range, upsampleFactorBG2Highres);
+		linearInterpolation((high_res_in.depth() == CV_8U) ? high_res_in : high_in, bilateralGridOpt, high_res_out, grid_width, grid_height, grid_range, upsampleFactorBG2Highres);
 		//t.getTime(true);cout << endl;
-
-		output32f.convertTo(high_res_out, CV_8UC3, 255);
 	}
 }
\ No newline at end of file
@@ -7,6 +7,227 @@ using namespace cv;
 
 namespace cp
 {
+#pragma region bit mask engine
+	//single channel engine: for each output pixel, each kernel row is compared with the center in SIMD width chunks and packed into a bit mask by movemask.
+	//The number of taps is the popcount of the masks, and the taps are summed by masked horizontal adds (SAD/madd), so that no float weight is computed per tap.
+	//The kernel shape (rectangle or circle) is a mask LUT of [kernel row][chunk].
+	template<typename T> struct BinaryRangeMask;
+
+	template<> struct BinaryRangeMask<uchar>
+	{
+		enum { lanes = 32 };
+		typedef __m256i vec;
+		typedef __m256i acc;
+		static vec setCenter(const uchar v) { return _mm256_set1_epi8((char)v); }
+		static vec setThreshold(const float th) { return _mm256_set1_epi8((char)saturate_cast<uchar>(std::floor(th))); }
+		static vec loadShape(const uchar* shape) { return _mm256_loadu_si256((const __m256i*)shape); }
+		static vec mask(const uchar* g, const vec c, const vec th, const vec shape)
+		{
+			const __m256i v = _mm256_loadu_si256((const __m256i*)g);
+			const __m256i ad = _mm256_or_si256(_mm256_subs_epu8(v, c), _mm256_subs_epu8(c, v));
+			return _mm256_and_si256(shape, _mm256_cmpeq_epi8(_mm256_subs_epu8(ad, th), _mm256_setzero_si256()));
+		}
+		static int count(const vec m) { return _mm_popcnt_u32(_mm256_movemask_epi8(m)); }
+		static acc zero() { return _mm256_setzero_si256(); }
+		static acc sum(const acc a, const uchar* s, const vec m) { return _mm256_add_epi64(a, _mm256_sad_epu8(_mm256_and_si256(_mm256_loadu_si256((const __m256i*)s), m), _mm256_setzero_si256())); }
+		static double reduce(const acc a)
+		{
+			const __m128i v = _mm_add_epi64(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+			return (double)(_mm_cvtsi128_si64(v) + _mm_extract_epi64(v, 1));
+		}
+		static uchar store(const double s, const int n) { return saturate_cast<uchar>(s / n); }
+	};
+
+	template<> struct BinaryRangeMask<short>
+	{
+		enum { lanes = 16 };
+		typedef __m256i vec;
+		typedef __m256i acc;
+		static vec setCenter(const short v) { return _mm256_set1_epi16(v); }
+		static vec setThreshold(const float th) { return _mm256_set1_epi16((short)saturate_cast<ushort>(std::floor(th))); }
+		static vec loadShape(const uchar* shape) { return _mm256_loadu_si256((const __m256i*)shape); }
+		static vec mask(const short* g, const vec c, const vec th, const vec shape)
+		{
+			const __m256i v = _mm256_loadu_si256((const __m256i*)g);
+			const __m256i ad = _mm256_sub_epi16(_mm256_max_epi16(v, c), _mm256_min_epi16(v, c));//unsigned 16 bit
+			return _mm256_and_si256(shape, _mm256_cmpeq_epi16(_mm256_subs_epu16(ad, th), _mm256_setzero_si256()));
+		}
+		static int count(const vec m) { return _mm_popcnt_u32(_mm256_movemask_epi8(m)) >> 1; }
+		static acc zero() { return _mm256_setzero_si256(); }
+		static acc sum(const acc a, const short* s, const vec m) { return _mm256_add_epi32(a, _mm256_madd_epi16(_mm256_and_si256(_mm256_loadu_si256((const __m256i*)s), m), _mm256_set1_epi16(1))); }
+		static double reduce(const acc a)
+		{
+			__m128i v = _mm_add_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+			v = _mm_hadd_epi32(v, v);
+			v = _mm_hadd_epi32(v, v);
+			return (double)_mm_cvtsi128_si32(v);
+		}
+		static short store(const double s, const int n) { return saturate_cast<short>(s / n); }
+	};
+
+	template<> struct BinaryRangeMask<ushort>
+	{
+		enum { lanes = 16 };
+		typedef __m256i vec;
+		typedef __m256i acc;
+		static vec setCenter(const ushort v) { return _mm256_set1_epi16((short)v); }
+		static vec setThreshold(const float th) { return _mm256_set1_epi16((short)saturate_cast<ushort>(std::floor(th))); }
+		static vec loadShape(const uchar* shape) { return _mm256_loadu_si256((const __m256i*)shape); }
+		static vec mask(const ushort* g, const vec c, const vec th, const vec shape)
+		{
+			const __m256i v = _mm256_loadu_si256((const __m256i*)g);
+			const __m256i ad = _mm256_sub_epi16(_mm256_max_epu16(v, c), _mm256_min_epu16(v, c));
+			return _mm256_and_si256(shape, _mm256_cmpeq_epi16(_mm256_subs_epu16(ad, th), _mm256_setzero_si256()));
+		}
+		static int count(const vec m) { return _mm_popcnt_u32(_mm256_movemask_epi8(m)) >> 1; }
+		static acc zero() { return _mm256_setzero_si256(); }
+		static acc sum(const acc a, const ushort* s, const vec m)
+		{
+			const __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)s), m);
+			return _mm256_add_epi32(a, _mm256_add_epi32(_mm256_unpacklo_epi16(v, _mm256_setzero_si256()), _mm256_unpackhi_epi16(v, _mm256_setzero_si256())));
+		}
+		static double reduce(const acc a)
+		{
+			__m128i v = _mm_add_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+			v = _mm_hadd_epi32(v, v);
+			v = _mm_hadd_epi32(v, v);
+			return (double)(uint)_mm_cvtsi128_si32(v);
+		}
+		static ushort store(const double s, const int n) { return saturate_cast<ushort>(s / n); }
+	};
+
+	template<> struct BinaryRangeMask<float>
+	{
+		enum { lanes = 8 };
+		typedef __m256 vec;
+		typedef __m256 acc;
+		static vec setCenter(const float v) { return _mm256_set1_ps(v); }
+		static vec setThreshold(const float th) { return _mm256_set1_ps(th); }
+		static vec loadShape(const uchar* shape) { return _mm256_loadu_ps((const float*)shape); }
+		static vec mask(const float* g, const vec c, const vec th, const vec shape)
+		{
+			const __m256 ad = _mm256_and_ps(_mm256_sub_ps(_mm256_loadu_ps(g), c), _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff)));
+			return _mm256_and_ps(shape, _mm256_cmp_ps(ad, th, _CMP_LE_OQ));
+		}
+		static int count(const vec m) { return _mm_popcnt_u32(_mm256_movemask_ps(m)); }
+		static acc zero() { return _mm256_setzero_ps(); }
+		static acc sum(const acc a, const float* s, const vec m) { return _mm256_add_ps(a, _mm256_and_ps(_mm256_loadu_ps(s), m)); }
+		static double reduce(const acc a) { return (double)_mm256_reduceadd_ps(a); }
+		static float store(const double s, const int n) { return float(s / n); }
+	};
+
+	template<typename T, bool isJoint>
+	class BinaryWeightedRangeFilterBitMask_Invoker : public cv::ParallelLoopBody
+	{
+	public:
+		BinaryWeightedRangeFilterBitMask_Invoker(Mat& _dest, const Mat& _src, const Mat& _guide, const uchar* _shape, int _radiusH, int _radiusV, int _chunks, float _threshold) :
+			src(&_src), guide(&_guide), dest(&_dest), shape(_shape), radiusH(_radiusH), radiusV(_radiusV), chunks(_chunks), threshold(_threshold)
+		{
+		}
+
+		virtual void operator() (const Range& range) const
+		{
+			typedef BinaryRangeMask<T> M;
+			const int D = 2 * radiusV + 1;
+			const typename M::vec mth = M::setThreshold(threshold);
+			for (int i = range.start; i != range.end; i++)
+			{
+				T* dptr = dest->ptr<T>(i);
+				const T* cptr = guide->ptr<T>(i + radiusV) + radiusH;
+				for (int j = 0; j < dest->cols; j++)
+				{
+					const typename M::vec mc = M::setCenter(cptr[j]);
+					typename M::acc msum = M::zero();
+					int count = 0;
+					const uchar* sh = shape;
+					for (int k = 0; k < D; k++)
+					{
+						const T* gptr = guide->ptr<T>(i + k) + j;
+						const T* sptr = (isJoint) ? src->ptr<T>(i + k) + j : gptr;
+						for (int c = 0; c < chunks; c++, sh += 32)
+						{
+							const typename M::vec m = M::mask(gptr + c * M::lanes, mc, mth, M::loadShape(sh));
+							count += M::count(m);
+							msum = M::sum(msum, sptr + c * M::lanes, m);
+						}
+					}
+					dptr[j] = M::store(M::reduce(msum), count);//count >= 1: the center tap always passes for threshold >= 0
+				}
+			}
+		}
+	private:
+		const Mat* src;
+		const Mat* guide;
+		Mat* dest;
+		const uchar* shape;
+		int radiusH, radiusV, chunks;
+		float threshold;
+	};
+
+	template<typename T>
+	static void binaryWeightedRangeFilterBitMask_(const Mat& src, const Mat& guide, Mat& dst, Size kernelSize, float threshold, int borderType, bool isRectangle)
+	{
+		const int lanes = BinaryRangeMask<T>::lanes;
+		const int radiusH = kernelSize.width >> 1;
+		const int radiusV = kernelSize.height >> 1;
+		const int kw = 2 * radiusH + 1;
+		const int kh = 2 * radiusV + 1;
+		const int chunks = (kw + lanes - 1) / lanes;
+		const int pad = chunks * lanes - kw;//over-read of the last chunk is masked by the shape
+		CV_Assert(sizeof(T) != 2 || kw * kh <= 65536);//16 bit taps are summed in epi32
+
+		//shape LUT: 32 byte mask per chunk of each kernel row
+		AutoBuffer<uchar> shape(kh * chunks * 32);
+		const double rmax = max(radiusV, radiusH);
+		for (int k = 0; k < kh; k++)
+		{
+			for (int l = 0; l < chunks * lanes; l++)
+			{
+				const int dy = k - radiusV;
+				const int dx = l - radiusH;
+				const bool isValid = (l < kw) && (isRectangle || std::sqrt((double)dy * dy + (double)dx * dx) <= rmax);
+				memset(&shape[(k * chunks) * 32 + l * sizeof(T)], isValid ? 0xFF : 0x00, sizeof(T));
+			}
+		}
+
+		const bool isJoint = (guide.data != src.data);
+		Mat srcb, guideb;
+		copyMakeBorder(src, srcb, radiusV, radiusV, radiusH, radiusH + pad, borderType);
+		if (isJoint)
+		{
+			copyMakeBorder(guide, guideb, radiusV, radiusV, radiusH, radiusH + pad, borderType);
+			BinaryWeightedRangeFilterBitMask_Invoker<T, true> body(dst, srcb, guideb, shape.data(), radiusH, radiusV, chunks, threshold);
+			parallel_for_(Range(0, src.rows), body);
+		}
+		else
+		{
+			BinaryWeightedRangeFilterBitMask_Invoker<T, false> body(dst, srcb, srcb, shape.data(), radiusH, radiusV, chunks, threshold);
+			parallel_for_(Range(0, src.rows), body);
+		}
+	}
+
+	static bool isBinaryWeightedRangeFilterBitMaskSupported(const Mat& src, const Mat& guide)
+	{
+		const int depth = src.depth();
+		return src.channels() == 1 && guide.channels() == 1 && src.depth() == guide.depth()
+			&& (depth == CV_8U || depth == CV_16S || depth == CV_16U || depth == CV_32F);
+	}
+
+	//src and guide are single channel images with the same depth; dst is allocated and can be src. threshold >= 0.
+	static void binaryWeightedRangeFilterBitMask(const Mat& src, const Mat& guide, Mat& dst, Size kernelSize, float threshold, int borderType, bool isRectangle)
+	{
+		if (kernelSize.width == 0 || kernelSize.height == 0) { src.copyTo(dst); return; }
+		switch (src.depth())
+		{
+		case CV_8U: binaryWeightedRangeFilterBitMask_<uchar>(src, guide, dst, kernelSize, threshold, borderType, isRectangle); break;
+		case CV_16S: binaryWeightedRangeFilterBitMask_<short>(src, guide, dst, kernelSize, threshold, borderType, isRectangle); break;
+		case CV_16U: binaryWeightedRangeFilterBitMask_<ushort>(src, guide, dst, kernelSize, threshold, borderType, isRectangle); break;
+		case CV_32F: binaryWeightedRangeFilterBitMask_<float>(src, guide, dst, kernelSize, threshold, borderType, isRectangle); break;
+		default: break;
+		}
+	}
+#pragma endregion
+
 #pragma region binaryWeightedRangeFilter
 	//for test, non SSE code for tbb
 	class binaryWeightedRangeFilter_8u_Invoker : public cv::ParallelLoopBody
@@ -1130,6 +1351,7 @@ namespace cp
 		dst_.create(src_.size(), src_.type());
 		Mat src = src_.getMat();
 		Mat dst = dst_.getMat();
+		if (threshold < 0.f) { src.copyTo(dst); return; }//no tap passes
 
 		if (method == FILTER_SLOWEST)
 		{
@@ -1146,6 +1368,10 @@ namespace cp
 				CV_Assert(method != FILTER_SLOWEST);
 			}
 		}
+		else if ((method == FILTER_CIRCLE || method == FILTER_DEFAULT || method == FILTER_RECTANGLE) && isBinaryWeightedRangeFilterBitMaskSupported(src, src))
+		{
+			binaryWeightedRangeFilterBitMask(src, src, dst, kernelSize, threshold, borderType, method == FILTER_RECTANGLE);
+		}
 		else if (method == FILTER_CIRCLE || method == FILTER_DEFAULT)
 		{
 			if (src.depth() == CV_8U)
@@ -2548,8 +2774,13 @@ namespace cp
 
 		CV_Assert(method != FILTER_SLOWEST);
 		CV_Assert(src.depth() == guide.depth());
+		if (threshold < 0.f) { src.copyTo(dst); return; }//no tap passes
 
-		if (method == FILTER_CIRCLE || method == FILTER_DEFAULT)
+		if ((method == FILTER_CIRCLE || method == FILTER_DEFAULT || method == FILTER_RECTANGLE) && isBinaryWeightedRangeFilterBitMaskSupported(src, guide))
+		{
+			binaryWeightedRangeFilterBitMask(src, guide, dst, kernelSize, threshold, borderType, method == FILTER_RECTANGLE);
+		}
+		else if (method == FILTER_CIRCLE || method == FILTER_DEFAULT)
 		{
 			if (src.depth() == CV_8U)
 			{
@@ -1725,4 +1725,466 @@ void CostVolumeRefinement::guidedRefinement(Mat& disp, Mat& guide, Mat& dest, in
 		}
 	}
 }
+
+//////////////////////////////////////////////////////////////////////////////
+//slab engine: the cost of each disparity is generated on small tiles from a 16-bit disparity slab,
+//filtered with guide weights computed once per tile and shared by all disparities, and reduced by inline WTA.
+//No cost volume is stored, so the memory is independent of the disparity range (dsv is not filled).
+//Borders are replicated.
+//////////////////////////////////////////////////////////////////////////////
+
+//disparity slab of a tile with replicated borders: slab(i,j)=disp(y0-halo+i, x0-halo+j)
+static void loadDisparitySlab(const Mat& disp, short* dslab, const int x0, const int y0, const int sw, const int sh, const int halo)
+{
+	for (int i = 0; i < sh; i++)
+	{
+		const short* s = disp.ptr<short>(max(0, min(disp.rows - 1, y0 - halo + i)));
+		short* d = dslab + sw * i;
+		for (int j = 0; j < sw; j++) d[j] = s[max(0, min(disp.cols - 1, x0 - halo + j))];
+	}
+}
+
+//16-bit cost of disparity d: L1 min(|d-D|,trunc), L2 min(|d-D|,trunc)^2, EXP 1-exp(-|d-D|^2/(2trunc^2)) quantized by 4096
+static void buildCostSlab(const short* dslab, ushort* cslab, const int size, const int d, const int metric, const int trunc, const ushort* explut)
+{
+	int i = 0;
+	if (metric == CostVolumeRefinement::EXP)
+	{
+		for (; i < size; i++) cslab[i] = explut[min(abs(dslab[i] - d), 255)];
+		return;
+	}
+
+	const __m256i md = _mm256_set1_epi16((short)d);
+	const __m256i mtrunc = _mm256_set1_epi16((short)trunc);
+	for (; i <= size - 16; i += 16)
+	{
+		__m256i m = _mm256_min_epu16(_mm256_abs_epi16(_mm256_sub_epi16(_mm256_loadu_si256((const __m256i*)(dslab + i)), md)), mtrunc);
+		if (metric == CostVolumeRefinement::L2_NORM) m = _mm256_mullo_epi16(m, m);
+		_mm256_storeu_si256((__m256i*)(cslab + i), m);
+	}
+	for (; i < size; i++)
+	{
+		const int v = min(abs(dslab[i] - d), trunc);
+		cslab[i] = (ushort)((metric == CostVolumeRefinement::L2_NORM) ? v * v : v);
+	}
+}
+
+static void buildExpCostLUT(vector<ushort>& explut, const int dtrunc)
+{
+	explut.resize(256);
+	const double coeff = -0.5 / (dtrunc*dtrunc);
+	for (int i = 0; i < 256; i++)
+	{
+		float w = 1.0f - (float)std::exp(i*i*coeff);
+		if (w < 1.0 / 255.0) w = 0.f;
+		explut[i] = (ushort)cvRound(4096.f * w);
+	}
+}
+
+//inline WTA state of a tile: the best cost and disparity, and the costs at best-1 and best+1 for subpixel interpolation
+struct InlineWTA
+{
+	float* best;
+	float* bestd;
+	float* costm;
+	float* costp;
+	float* prev;
+	int size;//multiple of 8
+
+	void init(float* buf, const int size_, const int minDisparity)
+	{
+		size = size_;
+		best = buf; bestd = best + size; costm = bestd + size; costp = costm + size; prev = costp + size;
+		for (int i = 0; i < size; i++)
+		{
+			best[i] = FLT_MAX;
+			bestd[i] = (float)(minDisparity - 2);
+			costm[i] = 0.f;
+			costp[i] = 0.f;
+			prev[i] = FLT_MAX;
+		}
+	}
+
+	void update(const float* cost, const int d)
+	{
+		const __m256 md = _mm256_set1_ps((float)d);
+		const __m256 mdprev = _mm256_set1_ps((float)(d - 1));
+		for (int i = 0; i < size; i += 8)
+		{
+			const __m256 mc = _mm256_loadu_ps(cost + i);
+			const __m256 mbd = _mm256_loadu_ps(bestd + i);
+			_mm256_storeu_ps(costp + i, _mm256_blendv_ps(_mm256_loadu_ps(costp + i), mc, _mm256_cmp_ps(mbd, mdprev, _CMP_EQ_OQ)));
+			const __m256 upd = _mm256_cmp_ps(mc, _mm256_loadu_ps(best + i), _CMP_LT_OQ);
+			_mm256_storeu_ps(best + i, _mm256_blendv_ps(_mm256_loadu_ps(best + i), mc, upd));
+			_mm256_storeu_ps(costm + i, _mm256_blendv_ps(_mm256_loadu_ps(costm + i), _mm256_loadu_ps(prev + i), upd));
+			_mm256_storeu_ps(bestd + i, _mm256_blendv_ps(mbd, md, upd));
+			_mm256_storeu_ps(prev + i, mc);
+		}
+	}
+
+	//integer disparity to out, subpixel disparity (x16) to dest, as wta() and subpixelInterpolation()
+	void store(Mat& out, Mat& dest, const int x0, const int y0, const int tw, const int minDisparity, const int numDisparity, const int method) const
+	{
+		const int w = min(tw, out.cols - x0);
+		const int h = min(size / tw, out.rows - y0);
+		for (int y = 0; y < h; y++)
+		{
+			short* o = out.ptr<short>(y0 + y) + x0;
+			short* s = dest.ptr<short>(y0 + y) + x0;
+			for (int x = 0; x < w; x++)
+			{
+				const int i = tw * y + x;
+				const int d = (int)bestd[i];
+				const int l = d - minDisparity;
+				o[x] = d;
+				s[x] = 16 * d;
+				if (method == CostVolumeRefinement::SUBPIXEL_NONE || l < 1 || l > numDisparity - 2) continue;
+
+				if (method == CostVolumeRefinement::SUBPIXEL_QUAD)
+				{
+					const float md = ((costp[i] + costm[i] - (best[i] * 2.f))*2.f);
+					if (md != 0) s[x] = (short)(16.f*((float)d - (float)(costp[i] - costm[i]) / md) + 0.5f);
+				}
+				else if (method == CostVolumeRefinement::SUBPIXEL_LINEAR)
+				{
+					const double m1 = best[i];
+					const double m31 = (double)costp[i] - m1;
+					const double m21 = (double)costm[i] - m1;
+					const double md = (costm[i] > costp[i]) ? 0.5 - 0.25*((m31*m31) / (m21*m21) + m31 / m21) : -(0.5 - 0.25*((m21*m21) / (m31*m31) + m21 / m31));
+					s[x] = (short)(16.0*((double)d + md) + 0.5);
+				}
+			}
+		}
+	}
+};
+
+//box mean on a slab without borders: dst is (sw-2r)x(sh-2r)
+static void boxFilterSlab(const float* src, const int sw, const int sh, const int r, float* dst, float* colsum)
+{
+	const int dw = sw - 2 * r;
+	const int dh = sh - 2 * r;
+	const int D = 2 * r + 1;
+	const float div = 1.f / (D * D);
+	const int simdw = sw / 8 * 8;
+
+	for (int x = 0; x < sw; x++) colsum[x] = 0.f;
+	for (int i = 0; i < D; i++)
+	{
+		for (int x = 0; x < sw; x++) colsum[x] += src[sw * i + x];
+	}
+	for (int y = 0; y < dh; y++)
+	{
+		if (y != 0)
+		{
+			const float* sa = src + sw * (y + 2 * r);
+			const float* ss = src + sw * (y - 1);
+			int x = 0;
+			for (; x < simdw; x += 8)
+			{
+				_mm256_storeu_ps(colsum + x, _mm256_add_ps(_mm256_loadu_ps(colsum + x), _mm256_sub_ps(_mm256_loadu_ps(sa + x), _mm256_loadu_ps(ss + x))));
+			}
+			for (; x < sw; x++) colsum[x] += sa[x] - ss[x];
+		}
+
+		float* d = dst + dw * y;
+		float s = 0.f;
+		for (int x = 0; x < D; x++) s += colsum[x];
+		d[0] = s * div;
+		for (int x = 1; x < dw; x++)
+		{
+			s += colsum[x + 2 * r] - colsum[x - 1];
+			d[x] = s * div;
+		}
+	}
+}
+
+void CostVolumeRefinement::jointBilateralRefinementSlab(Mat& disp, Mat& guide, Mat& dest, int data_trunc, int metric, int r, double sigma_c, double sigma_s, int iter)
+{
+	if (iter == 0)disp.convertTo(dest, CV_16S, 16);
+	if (dest.empty())dest.create(disp.size(), CV_16S);
+	CV_Assert(guide.type() == CV_8UC1 || guide.type() == CV_8UC3);
+	CV_Assert(metric != L2_NORM || data_trunc <= 255);
+
+	const int tw = 64;
+	const int th = 16;
+	const int sw = tw + 2 * r;
+	const int sh = th + 2 * r;
+	const int cng = guide.channels();
+	const int width = disp.cols;
+	const int height = disp.rows;
+	const int tilesX = (width + tw - 1) / tw;
+	const int tilesY = (height + th - 1) / th;
+
+	if (sigma_c <= 0) sigma_c = 1;
+	if (sigma_s <= 0) sigma_s = 1;
+	const double gauss_color_coeff = -0.5 / (sigma_c*sigma_c);
+	const double gauss_space_coeff = -0.5 / (sigma_s*sigma_s);
+
+	vector<float> color_weight(256 * cng);
+	for (int i = 0; i < 256 * cng; i++) color_weight[i] = (float)std::exp(i*i*gauss_color_coeff);
+	vector<float> space_weight;
+	vector<int> space_ofs;
+	for (int i = -r; i <= r; i++)
+	{
+		for (int j = -r; j <= r; j++)
+		{
+			const double rr = std::sqrt((double)i*i + (double)j*j);
+			if (rr > r) continue;
+			space_weight.push_back((float)std::exp(rr*rr*gauss_space_coeff));
+			space_ofs.push_back(i*sw + j);
+		}
+	}
+	const int maxk = (int)space_weight.size();
+
+	vector<ushort> explut;
+	if (metric == EXP) buildExpCostLUT(explut, data_trunc);
+
+	Mat in; disp.convertTo(in, CV_16S);
+	Mat out(disp.size(), CV_16S);
+	for (int it = 0; it < iter; it++)
+	{
+#pragma omp parallel
+		{
+			AutoBuffer<float> wbuf(maxk * tw * th + 8);
+			AutoBuffer<float> sbuf(6 * tw * th + 8);
+			AutoBuffer<short> dslab(sw * sh);
+			AutoBuffer<ushort> cslab(sw * sh);
+			AutoBuffer<uchar> gslab(sw * sh * cng);
+			float* weight = (float*)(((size_t)wbuf.data() + 31) & ~(size_t)31);
+			float* cost = (float*)(((size_t)sbuf.data() + 31) & ~(size_t)31);
+			InlineWTA wta;
+
+#pragma omp for schedule(dynamic)
+			for (int t = 0; t < tilesX * tilesY; t++)
+			{
+				const int x0 = tw * (t % tilesX);
+				const int y0 = th * (t / tilesX);
+
+				//guide weights normalized per pixel, shared by all disparities
+				for (int i = 0; i < sh; i++)
+				{
+					const uchar* g = guide.ptr<uchar>(max(0, min(height - 1, y0 - r + i)));
+					for (int j = 0; j < sw; j++)
+					{
+						const int x = max(0, min(width - 1, x0 - r + j));
+						for (int c = 0; c < cng; c++) gslab[cng * (sw * i + j) + c] = g[cng * x + c];
+					}
+				}
+				for (int y = 0; y < th; y++)
+				{
+					for (int x = 0; x < tw; x++)
+					{
+						const int center = sw * (y + r) + x + r;
+						const uchar* gp = &gslab[cng * center];
+						float wsum = 0.f;
+						for (int k = 0; k < maxk; k++)
+						{
+							const uchar* gq = &gslab[cng * (center + space_ofs[k])];
+							int diff = 0;
+							for (int c = 0; c < cng; c++) diff += abs(gp[c] - gq[c]);
+							const float w = space_weight[k] * color_weight[diff];
+							weight[(th * k + y) * tw + x] = w;
+							wsum += w;
+						}
+						const float inv = 1.f / wsum;
+						for (int k = 0; k < maxk; k++) weight[(th * k + y) * tw + x] *= inv;
+					}
+				}
+
+				loadDisparitySlab(in, dslab, x0, y0, sw, sh, r);
+				wta.init(cost + tw * th, tw * th, minDisparity);
+				for (int n = 0; n <= numDisparity; n++)
+				{
+					const int d = minDisparity + n;
+					buildCostSlab(dslab, cslab, sw * sh, d, metric, data_trunc, explut.data());
+					for (int y = 0; y < th; y++)
+					{
+						const ushort* cs = cslab + sw * (y + r) + r;
+						for (int x = 0; x < tw; x += 8)
+						{
+							__m256 macc = _mm256_setzero_ps();
+							const float* w = weight + y * tw + x;
+							for (int k = 0; k < maxk; k++, w += th * tw)
+							{
+								const __m256 mc = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(cs + x + space_ofs[k]))));
+								macc = _mm256_fmadd_ps(_mm256_load_ps(w), mc, macc);
+							}
+							_mm256_store_ps(cost + y * tw + x, macc);
+						}
+					}
+					wta.update(cost, d);
+				}
+				wta.store(out, dest, x0, y0, tw, minDisparity, numDisparity, sub_method);
+			}
+		}
+		out.copyTo(in);
+	}
+}
+
+void CostVolumeRefinement::guidedRefinementSlab(Mat& disp, Mat& guide, Mat& dest, int data_trunc, int metric, int r, double eps, int iter)
+{
+	if (iter == 0)disp.convertTo(dest, CV_16S, 16);
+	if (dest.empty())dest.create(disp.size(), CV_16S);
+	CV_Assert(guide.type() == CV_8UC1 || guide.type() == CV_8UC3);
+	CV_Assert(metric != L2_NORM || data_trunc <= 255);
+
+	//slabs with 2r (p, Ip), r (a, b) and no (output) halo
+	const int tw = 64;
+	const int th = 64;
+	const int sw2 = tw + 4 * r, sh2 = th + 4 * r, s2 = sw2 * sh2;
+	const int sw1 = tw + 2 * r, sh1 = th + 2 * r, s1 = sw1 * sh1;
+	const int s0 = tw * th;
+	const int cng = guide.channels();
+	const int ncov = (cng == 1) ? 1 : 6;
+	const int width = disp.cols;
+	const int height = disp.rows;
+	const int tilesX = (width + tw - 1) / tw;
+	const int tilesY = (height + th - 1) / th;
+	const float e = (float)eps;
+
+	vector<ushort> explut;
+	if (metric == EXP) buildExpCostLUT(explut, data_trunc);
+
+	Mat in; disp.convertTo(in, CV_16S);
+	Mat out(disp.size(), CV_16S);
+	for (int it = 0; it < iter; it++)
+	{
+#pragma omp parallel
+		{
+			AutoBuffer<float> buf((2 * cng + 1) * s2 + (3 * cng + ncov + 2) * s1 + (cng + 7) * s0 + 8);
+			AutoBuffer<float> colsum(sw2);
+			AutoBuffer<short> dslab(s2);
+			AutoBuffer<ushort> cslab(s2);
+			float* I = (float*)(((size_t)buf.data() + 31) & ~(size_t)31);//cng x s2
+			float* Ip = I + cng * s2;//cng x s2
+			float* p = Ip + cng * s2;//s2
+			float* mI = p + s2;//cng x s1
+			float* inv = mI + cng * s1;//ncov x s1
+			float* mIp = inv + ncov * s1;//cng x s1
+			float* a = mIp + cng * s1;//cng x s1
+			float* mp = a + cng * s1;//s1
+			float* b = mp + s1;//s1
+			float* ma = b + s1;//cng x s0
+			float* mb = ma + cng * s0;//s0
+			float* cost = mb + s0;//s0
+			float* state = cost + s0;//5 x s0
+			InlineWTA wta;
+
+#pragma omp for schedule(dynamic)
+			for (int t = 0; t < tilesX * tilesY; t++)
+			{
+				const int x0 = tw * (t % tilesX);
+				const int y0 = th * (t / tilesX);
+
+				//guide statistics shared by all disparities
+				for (int i = 0; i < sh2; i++)
+				{
+					const uchar* g = guide.ptr<uchar>(max(0, min(height - 1, y0 - 2 * r + i)));
+					for (int j = 0; j < sw2; j++)
+					{
+						const int x = max(0, min(width - 1, x0 - 2 * r + j));
+						for (int c = 0; c < cng; c++) I[c * s2 + sw2 * i + j] = g[cng * x + c];
+					}
+				}
+				for (int c = 0; c < cng; c++) boxFilterSlab(I + c * s2, sw2, sh2, r, mI + c * s1, colsum);
+				if (cng == 1)
+				{
+					for (int i = 0; i < s2; i++) p[i] = I[i] * I[i];
+					boxFilterSlab(p, sw2, sh2, r, inv, colsum);
+					for (int i = 0; i < s1; i++) inv[i] = 1.f / (inv[i] - mI[i] * mI[i] + e);
+				}
+				else
+				{
+					//covariance (bb, bg, br, gg, gr, rr) and its inverse
+					const int cc[6][2] = { { 0, 0 }, { 0, 1 }, { 0, 2 }, { 1, 1 }, { 1, 2 }, { 2, 2 } };
+					for (int n = 0; n < 6; n++)
+					{
+						const float* i0 = I + cc[n][0] * s2;
+						const float* i1 = I + cc[n][1] * s2;
+						for (int i = 0; i < s2; i++) p[i] = i0[i] * i1[i];
+						boxFilterSlab(p, sw2, sh2, r, inv + n * s1, colsum);
+						const float* m0 = mI + cc[n][0] * s1;
+						const float* m1 = mI + cc[n][1] * s1;
+						float* v = inv + n * s1;
+						const float diag = (cc[n][0] == cc[n][1]) ? e : 0.f;
+						for (int i = 0; i < s1; i++) v[i] = v[i] - m0[i] * m1[i] + diag;
+					}
+					for (int i = 0; i < s1; i++)
+					{
+						const float bb = inv[i], bg = inv[s1 + i], br = inv[2 * s1 + i], gg = inv[3 * s1 + i], gr = inv[4 * s1 + i], rr = inv[5 * s1 + i];
+						const float c0 = gg * rr - gr * gr;
+						const float c1 = br * gr - bg * rr;
+						const float c2 = bg * gr - br * gg;
+						const float id = 1.f / (bb * c0 + bg * c1 + br * c2);
+						inv[i] = c0 * id;
+						inv[s1 + i] = c1 * id;
+						inv[2 * s1 + i] = c2 * id;
+						inv[3 * s1 + i] = (bb * rr - br * br) * id;
+						inv[4 * s1 + i] = (bg * br - bb * gr) * id;
+						inv[5 * s1 + i] = (bb * gg - bg * bg) * id;
+					}
+				}
+
+				loadDisparitySlab(in, dslab, x0, y0, sw2, sh2, 2 * r);
+				wta.init(state, s0, minDisparity);
+				for (int n = 0; n <= numDisparity; n++)
+				{
+					const int d = minDisparity + n;
+					buildCostSlab(dslab, cslab, s2, d, metric, data_trunc, explut.data());
+					for (int i = 0; i < s2; i++) p[i] = cslab[i];
+					boxFilterSlab(p, sw2, sh2, r, mp, colsum);
+					for (int c = 0; c < cng; c++)
+					{
+						const float* ic = I + c * s2;
+						float* ipc = Ip + c * s2;
+						for (int i = 0; i < s2; i++) ipc[i] = ic[i] * p[i];
+						boxFilterSlab(ipc, sw2, sh2, r, mIp + c * s1, colsum);
+					}
+
+					if (cng == 1)
+					{
+						for (int i = 0; i < s1; i++)
+						{
+							a[i] = (mIp[i] - mI[i] * mp[i]) * inv[i];
+							b[i] = mp[i] - a[i] * mI[i];
+						}
+					}
+					else
+					{
+						for (int i = 0; i < s1; i++)
+						{
+							const float cb = mIp[i] - mI[i] * mp[i];
+							const float cg = mIp[s1 + i] - mI[s1 + i] * mp[i];
+							const float cr = mIp[2 * s1 + i] - mI[2 * s1 + i] * mp[i];
+							const float ab = inv[i] * cb + inv[s1 + i] * cg + inv[2 * s1 + i] * cr;
+							const float ag = inv[s1 + i] * cb + inv[3 * s1 + i] * cg + inv[4 * s1 + i] * cr;
+							const float ar = inv[2 * s1 + i] * cb + inv[4 * s1 + i] * cg + inv[5 * s1 + i] * cr;
+							a[i] = ab;
+							a[s1 + i] = ag;
+							a[2 * s1 + i] = ar;
+							b[i] = mp[i] - ab * mI[i] - ag * mI[s1 + i] - ar * mI[2 * s1 + i];
+						}
+					}
+
+					for (int c = 0; c < cng; c++) boxFilterSlab(a + c * s1, sw1, sh1, r, ma + c * s0, colsum);
+					boxFilterSlab(b, sw1, sh1, r, mb, colsum);
+					for (int y = 0; y < th; y++)
+					{
+						float* q = cost + tw * y;
+						for (int x = 0; x < tw; x++) q[x] = mb[tw * y + x];
+						for (int c = 0; c < cng; c++)
+						{
+							const float* ic = I + c * s2 + sw2 * (y + 2 * r) + 2 * r;
+							const float* mac = ma + c * s0 + tw * y;
+							for (int x = 0; x < tw; x++) q[x] += mac[x] * ic[x];
+						}
+					}
+					wta.update(cost, d);
+				}
+				wta.store(out, dest, x0, y0, tw, minDisparity, numDisparity, sub_method);
+			}
+		}
+		out.copyTo(in);
+	}
+}
 }
\ No newline at end of file
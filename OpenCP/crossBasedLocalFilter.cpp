@@ -1,6 +1,7 @@
 #include "crossBasedLocalFilter.hpp"
 #include "blend.hpp"
 #include "timer.hpp"
+#include "inlineSIMDFunctions.hpp"
 using namespace std;
 using namespace cv;
 
@@ -553,6 +554,77 @@ namespace cp
 	}
 
 
+	//orthogonal integral image filter for a single-channel image with the SoA kernel.
+	//horizontal pass runs on parallel rows, and vertical pass runs on parallel column strips with row-wise prefix sums.
+	//sumType and tmpType follow orthogonalIntegralImageFilterInteger/Float for the same accumulation order.
+	template <class srcType, class sumType, class tmpType>
+	static void orthogonalIntegralImageFilterSoA(const Mat& src, Mat& dest, const Mat& armHP, const Mat& armHM, const Mat& divH, const Mat& armVP, const Mat& armVM, const Mat& divV, const bool isParallel)
+	{
+		const int width = src.cols;
+		const int height = src.rows;
+		Mat hfilter(src.size(), DataType<tmpType>::type);
+
+#pragma omp parallel if(isParallel)
+		{
+			AutoBuffer<sumType> integral(width + 1);
+#pragma omp for schedule(static)
+			for (int j = 0; j < height; j++)
+			{
+				const srcType* s = src.ptr<srcType>(j);
+				const uchar* hp = armHP.ptr<uchar>(j);
+				const uchar* hm = armHM.ptr<uchar>(j);
+				const float* div = divH.ptr<float>(j);
+				tmpType* h = hfilter.ptr<tmpType>(j);
+				sumType* IH = integral.data();
+				IH[0] = 0;
+				for (int i = 0; i < width; i++)
+				{
+					IH[i + 1] = IH[i] + (sumType)s[i];
+				}
+				for (int i = 0; i < width; i++)
+				{
+					h[i] = (tmpType)((IH[i + 1 + hp[i]] - IH[i - hm[i]]) * div[i]);
+				}
+			}
+		}
+
+		const int strip = 64;
+		const int strip_num = (width + strip - 1) / strip;
+#pragma omp parallel if(isParallel)
+		{
+			AutoBuffer<sumType> integral((height + 1) * strip);
+#pragma omp for schedule(static)
+			for (int n = 0; n < strip_num; n++)
+			{
+				const int x0 = n * strip;
+				const int w = min(strip, width - x0);
+				sumType* IV = integral.data();
+				for (int i = 0; i < w; i++) IV[i] = 0;
+				for (int j = 0; j < height; j++)
+				{
+					const tmpType* h = hfilter.ptr<tmpType>(j, x0);
+					const sumType* prev = IV + strip * j;
+					sumType* curr = IV + strip * (j + 1);
+					for (int i = 0; i < w; i++)
+					{
+						curr[i] = prev[i] + h[i];
+					}
+				}
+				for (int j = 0; j < height; j++)
+				{
+					const uchar* vp = armVP.ptr<uchar>(j, x0);
+					const uchar* vm = armVM.ptr<uchar>(j, x0);
+					const float* div = divV.ptr<float>(j, x0);
+					srcType* d = dest.ptr<srcType>(j, x0);
+					for (int i = 0; i < w; i++)
+					{
+						d[i] = saturate_cast<srcType>((IV[strip * (j + 1 + vp[i]) + i] - IV[strip * (j - vm[i]) + i]) * div[i]);
+					}
+				}
+			}
+		}
+	}
+
 	CrossBasedLocalFilter::CrossBasedLocalFilter(Mat& guide, const int r_, const int thresh_)
 	{
 		makeKernel(guide, r_, thresh_);
@@ -574,10 +646,81 @@ namespace cp
 		minSearch = val;
 	}
 
+	//arm search for 32 pixels: g is the padded guide at the 1st pixel, ofs is the step to the arm direction
+	static __m256i crossArm32(const uchar* g, const int ofs, const int r, const __m256i mthreshold)
+	{
+		const __m256i v = _mm256_loadu_si256((const __m256i*)g);
+		__m256i alive = _mm256_set1_epi8(-1);
+		__m256i arm = _mm256_setzero_si256();
+		for (int n = 1; n <= r; n++)
+		{
+			const __m256i s = _mm256_loadu_si256((const __m256i*)(g + n * ofs));
+			const __m256i diff = _mm256_or_si256(_mm256_subs_epu8(v, s), _mm256_subs_epu8(s, v));
+			alive = _mm256_and_si256(alive, _mm256_cmpeq_epi8(_mm256_min_epu8(diff, mthreshold), diff));//diff <= threshold
+			if (_mm256_testz_si256(alive, alive)) break;
+			arm = _mm256_sub_epi8(arm, alive);
+		}
+		return arm;
+	}
+
+	//arm search for 16 pixels of 3 planes (sum of absolute differences); the result is packed into the lower 16 bytes
+	static __m256i crossArm16Cn3(const uchar* g0, const uchar* g1, const uchar* g2, const int ofs, const int r, const __m256i mthreshold)
+	{
+		const __m256i v0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)g0));
+		const __m256i v1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)g1));
+		const __m256i v2 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)g2));
+		__m256i alive = _mm256_set1_epi16(-1);
+		__m256i arm = _mm256_setzero_si256();
+		for (int n = 1; n <= r; n++)
+		{
+			const __m256i s0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(g0 + n * ofs)));
+			const __m256i s1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(g1 + n * ofs)));
+			const __m256i s2 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(g2 + n * ofs)));
+			const __m256i diff = _mm256_add_epi16(_mm256_add_epi16(_mm256_abs_epi16(_mm256_sub_epi16(v0, s0)), _mm256_abs_epi16(_mm256_sub_epi16(v1, s1))), _mm256_abs_epi16(_mm256_sub_epi16(v2, s2)));
+			alive = _mm256_and_si256(alive, _mm256_cmpgt_epi16(mthreshold, diff));//diff < threshold+1
+			if (_mm256_testz_si256(alive, alive)) break;
+			arm = _mm256_sub_epi16(arm, alive);
+		}
+		return _mm256_permute4x64_epi64(_mm256_packus_epi16(arm, arm), _MM_SHUFFLE(3, 1, 2, 0));
+	}
+
+	void CrossBasedLocalFilter::setArmPlanesFromCross()
+	{
+		armHP.create(size, CV_8U);
+		armHM.create(size, CV_8U);
+		armVP.create(size, CV_8U);
+		armVM.create(size, CV_8U);
+		divH.create(size, CV_32F);
+		divV.create(size, CV_32F);
+#pragma omp parallel for schedule(static)
+		for (int j = 0; j < size.height; j++)
+		{
+			const cross* cd = crossdata + size.width * j;
+			uchar* hp = armHP.ptr<uchar>(j);
+			uchar* hm = armHM.ptr<uchar>(j);
+			uchar* vp = armVP.ptr<uchar>(j);
+			uchar* vm = armVM.ptr<uchar>(j);
+			float* dh = divH.ptr<float>(j);
+			float* dv = divV.ptr<float>(j);
+			for (int i = 0; i < size.width; i++)
+			{
+				hp[i] = cd[i].hp;
+				hm[i] = cd[i].hm;
+				vp[i] = cd[i].vp;
+				vm[i] = cd[i].vm;
+				dh[i] = cd[i].divh;
+				dv[i] = cd[i].divv;
+			}
+		}
+	}
+
 	//method 0: CrossBasedLocalFilter::CROSS_BASED_LOCAL_FILTER_ARM_BASIC
 	//method 1: CrossBasedLocalFilter::CROSS_BASED_LOCAL_FILTER_ARM_SAMELENGTH
+	//arms are searched for 32 pixels at once in parallel rows, and are clipped by the image boundary.
 	void CrossBasedLocalFilter::makeKernel(Mat& guide, const int r_, const int thresh_, const int method)
 	{
+		CV_Assert(guide.depth() == CV_8U && (guide.channels() == 1 || guide.channels() == 3));
+		CV_Assert(r_ <= 255);
 		r = r_;
 		thresh = thresh_;
 
@@ -591,248 +734,104 @@ namespace cp
 			delete[]crossdata;
 			crossdata = new cross[guide.size().area()];
 		}
-		const int hw = r;
-		const int c = guide.channels();
+		armHP.create(size, CV_8U);
+		armHM.create(size, CV_8U);
+		armVP.create(size, CV_8U);
+		armVM.create(size, CV_8U);
+		divH.create(size, CV_32F);
+		divV.create(size, CV_32F);
+		if (method != CROSS_BASED_LOCAL_FILTER_ARM_BASIC && method != CROSS_BASED_LOCAL_FILTER_ARM_SAMELENGTH) return;
 
-		Mat gim; copyMakeBorder(guide, gim, r, r, r, r, cv::BORDER_CONSTANT, 0);
-		uchar* g = gim.ptr<uchar>(r); g += r * c;
-		const int gstep = gim.cols * c;
-		cross* cdata = crossdata;
-		const int cstep = guide.cols;
-		int arm_threshold = c * thresh;
-
-		int i, j;
-		if (method == CrossBasedLocalFilter::CROSS_BASED_LOCAL_FILTER_ARM_BASIC)
+		const int c = guide.channels();
+		const int arm_threshold = c * thresh;
+		const int width = guide.cols;
+		const int height = guide.rows;
+		const int simdwidth = get_simd_ceil(width, 32);
+
+		//right side is padded for simd loads over the image width
+		Mat gim; copyMakeBorder(guide, gim, r, r, r, r + 32, cv::BORDER_CONSTANT, 0);
+		vector<Mat> gplane;
+		if (c == 3) split(gim, gplane);
+		const int gstep = gim.cols;
+
+		const __m256i mthreshold = (c == 1) ? _mm256_set1_epi8((char)max(0, min(arm_threshold, 255))) : _mm256_set1_epi16((short)max(0, arm_threshold + 1));
+		const __m256i mminsearch = _mm256_set1_epi8((char)minSearch);
+		const __m256i mzero = _mm256_setzero_si256();
+		const bool isSameLength = (method == CROSS_BASED_LOCAL_FILTER_ARM_SAMELENGTH);
+
+#pragma omp parallel
 		{
-			if (c == 1)
+			AutoBuffer<uchar> buff(simdwidth * 4);
+			uchar* hpline = buff.data();
+			uchar* hmline = hpline + simdwidth;
+			uchar* vpline = hmline + simdwidth;
+			uchar* vmline = vpline + simdwidth;
+#pragma omp for schedule(static)
+			for (int j = 0; j < height; j++)
 			{
-				for (j = 0; j < guide.rows; j++)
+				//vertical arms are clipped by the top and bottom boundary
+				const __m256i mvmmax = _mm256_set1_epi8((char)min(j, 255));
+				const __m256i mvpmax = _mm256_set1_epi8((char)min(height - 1 - j, 255));
+				for (int i = 0; i < simdwidth; i += 32)
 				{
-					for (i = 0; i < guide.cols; i++, g++, cdata++)
+					__m256i hp, hm, vp, vm;
+					if (c == 1)
 					{
-						const uchar v = g[0];
-						cdata->hm = cdata->hp = cdata->vp = cdata->vm = minSearch;
-						for (int n = 1; n <= hw; n++)
-						{
-							if (abs(v - g[-n]) > arm_threshold)
-								break;
-							cdata->hm = n;
-						}
-						for (int n = 1; n <= hw; n++)
-						{
-							if (abs(v - g[n]) > arm_threshold)
-								break;
-							cdata->hp = n;
-						}
-						cdata->divh = 1.0f / (float)(cdata->hp + cdata->hm + 1);
-
-						for (int n = 1; n <= hw; n++)
-						{
-							if (abs(v - g[-n * gstep]) > arm_threshold)
-								break;
-							cdata->vm = n;
-						}
-						for (int n = 1; n <= hw; n++)
-						{
-							if (abs(v - g[n * gstep]) > arm_threshold)
-								break;
-							cdata->vp = n;
-						}
-						cdata->divv = 1.0f / (float)(cdata->vp + cdata->vm + 1);
+						const uchar* g = gim.ptr<uchar>(j + r, i + r);
+						hm = crossArm32(g, -1, r, mthreshold);
+						hp = crossArm32(g, 1, r, mthreshold);
+						vm = crossArm32(g, -gstep, r, mthreshold);
+						vp = crossArm32(g, gstep, r, mthreshold);
 					}
-					g += 2 * r;
-				}
-			}
-			else if (c == 3)
-			{
-				for (j = 0; j < guide.rows; j++)
-				{
-					for (i = 0; i < guide.cols; i++, g += 3, cdata++)
+					else
 					{
-						const uchar rv = g[0];
-						const uchar gv = g[1];
-						const uchar bv = g[2];
-						cdata->hm = cdata->hp = cdata->vp = cdata->vm = minSearch;
-						for (int n = 1; n <= hw; n++)
-						{
-							if (abs(rv - g[-3 * n + 0]) + abs(gv - g[-3 * n + 1]) + abs(bv - g[-3 * n + 2]) > arm_threshold)
-								break;
-							cdata->hm = n;
-						}
-						for (int n = 1; n <= hw; n++)
-						{
-							if (abs(rv - g[3 * n + 0]) + abs(gv - g[3 * n + 1]) + abs(bv - g[3 * n + 2]) > arm_threshold)
-								break;
-							cdata->hp = n;
-						}
-						cdata->divh = 1.0f / (float)(cdata->hp + cdata->hm + 1);
-
-						for (int n = 1; n <= hw; n++)
-						{
-							if (abs(rv - g[-gstep * n + 0]) + abs(gv - g[-gstep * n + 1]) + abs(bv - g[-gstep * n + 2]) > arm_threshold)
-								break;
-							cdata->vm = n;
-						}
-						for (int n = 1; n <= hw; n++)
-						{
-							if (abs(rv - g[gstep * n + 0]) + abs(gv - g[gstep * n + 1]) + abs(bv - g[gstep * n + 2]) > arm_threshold)
-								break;
-							cdata->vp = n;
-						}
-						cdata->divv = 1.0f / (float)(cdata->vp + cdata->vm + 1);
+						const uchar* g0 = gplane[0].ptr<uchar>(j + r, i + r);
+						const uchar* g1 = gplane[1].ptr<uchar>(j + r, i + r);
+						const uchar* g2 = gplane[2].ptr<uchar>(j + r, i + r);
+						hm = _mm256_permute2x128_si256(crossArm16Cn3(g0, g1, g2, -1, r, mthreshold), crossArm16Cn3(g0 + 16, g1 + 16, g2 + 16, -1, r, mthreshold), 0x20);
+						hp = _mm256_permute2x128_si256(crossArm16Cn3(g0, g1, g2, 1, r, mthreshold), crossArm16Cn3(g0 + 16, g1 + 16, g2 + 16, 1, r, mthreshold), 0x20);
+						vm = _mm256_permute2x128_si256(crossArm16Cn3(g0, g1, g2, -gstep, r, mthreshold), crossArm16Cn3(g0 + 16, g1 + 16, g2 + 16, -gstep, r, mthreshold), 0x20);
+						vp = _mm256_permute2x128_si256(crossArm16Cn3(g0, g1, g2, gstep, r, mthreshold), crossArm16Cn3(g0 + 16, g1 + 16, g2 + 16, gstep, r, mthreshold), 0x20);
 					}
-					g += 6 * r;
-				}
-			}
-		}
-		if (method == CrossBasedLocalFilter::CROSS_BASED_LOCAL_FILTER_ARM_SAMELENGTH)
-		{
-			if (c == 1)
-			{
-				for (j = 0; j < guide.rows; j++)
-				{
-					for (i = 0; i < guide.cols; i++, g++, cdata++)
+					//minSearch is used when no arm is found
+					hm = _mm256_blendv_epi8(hm, mminsearch, _mm256_cmpeq_epi8(hm, mzero));
+					hp = _mm256_blendv_epi8(hp, mminsearch, _mm256_cmpeq_epi8(hp, mzero));
+					vm = _mm256_blendv_epi8(vm, mminsearch, _mm256_cmpeq_epi8(vm, mzero));
+					vp = _mm256_blendv_epi8(vp, mminsearch, _mm256_cmpeq_epi8(vp, mzero));
+					if (isSameLength)
 					{
-						const uchar v = g[0];
-						cdata->hm = cdata->hp = cdata->vp = cdata->vm = minSearch;
-						for (int n = 1; n <= hw; n++)
-						{
-							if (abs(v - g[-n]) > arm_threshold)
-								break;
-							cdata->hm = n;
-						}
-						for (int n = 1; n <= hw; n++)
-						{
-							if (abs(v - g[n]) > arm_threshold)
-								break;
-							cdata->hp = n;
-						}
-						cdata->hm = cdata->hp = min(cdata->hm, cdata->hp);
-						cdata->divh = 1.0f / (float)((cdata->hm << 1) + 1);
-
-						for (int n = 1; n <= hw; n++)
-						{
-							if (abs(v - g[-n * gstep]) > arm_threshold)
-								break;
-							cdata->vm = n;
-						}
-						for (int n = 1; n <= hw; n++)
-						{
-							if (abs(v - g[n * gstep]) > arm_threshold)
-								break;
-							cdata->vp = n;
-						}
-						cdata->vm = cdata->vp = min(cdata->vm, cdata->vp);
-						cdata->divv = 1.0f / (float)((cdata->vp << 1) + 1);
+						hm = hp = _mm256_min_epu8(hm, hp);
+						vm = vp = _mm256_min_epu8(vm, vp);
 					}
-					g += 2 * r;
+					_mm256_storeu_si256((__m256i*)(hmline + i), hm);
+					_mm256_storeu_si256((__m256i*)(hpline + i), hp);
+					_mm256_storeu_si256((__m256i*)(vmline + i), _mm256_min_epu8(vm, mvmmax));
+					_mm256_storeu_si256((__m256i*)(vpline + i), _mm256_min_epu8(vp, mvpmax));
 				}
-			}
-			else if (c == 3)
-			{
-				for (j = 0; j < guide.rows; j++)
+				//horizontal arms are clipped by the left and right boundary
+				for (int i = 0; i < min(width, r + 1); i++) hmline[i] = min(hmline[i], (uchar)i);
+				for (int i = max(0, width - 1 - r); i < width; i++) hpline[i] = min(hpline[i], (uchar)(width - 1 - i));
+
+				memcpy(armHP.ptr<uchar>(j), hpline, width);
+				memcpy(armHM.ptr<uchar>(j), hmline, width);
+				memcpy(armVP.ptr<uchar>(j), vpline, width);
+				memcpy(armVM.ptr<uchar>(j), vmline, width);
+				float* dh = divH.ptr<float>(j);
+				float* dv = divV.ptr<float>(j);
+				cross* cd = crossdata + width * j;
+				for (int i = 0; i < width; i++)
 				{
-					for (i = 0; i < guide.cols; i++, g += 3, cdata++)
-					{
-						const uchar rv = g[0];
-						const uchar gv = g[1];
-						const uchar bv = g[2];
-						cdata->hm = cdata->hp = cdata->vp = cdata->vm = minSearch;
-						for (int n = 1; n <= hw; n++)
-						{
-							if (abs(rv - g[-3 * n + 0]) + abs(gv - g[-3 * n + 1]) + abs(bv - g[-3 * n + 2]) > arm_threshold)
-								break;
-							cdata->hm = n;
-						}
-						for (int n = 1; n <= hw; n++)
-						{
-							if (abs(rv - g[3 * n + 0]) + abs(gv - g[3 * n + 1]) + abs(bv - g[3 * n + 2]) > arm_threshold)
-								break;
-							cdata->hp = n;
-						}
-						cdata->hm = cdata->hp = min(cdata->hm, cdata->hp);
-						cdata->divh = 1.0f / (float)((cdata->hm << 1) + 1);
-
-						for (int n = 1; n <= hw; n++)
-						{
-							if (abs(rv - g[-gstep * n + 0]) + abs(gv - g[-gstep * n + 1]) + abs(bv - g[-gstep * n + 2]) > arm_threshold)
-								break;
-							cdata->vm = n;
-						}
-						for (int n = 1; n <= hw; n++)
-						{
-							if (abs(rv - g[gstep * n + 0]) + abs(gv - g[gstep * n + 1]) + abs(bv - g[gstep * n + 2]) > arm_threshold)
-								break;
-							cdata->vp = n;
-						}
-						cdata->vm = cdata->vp = min(cdata->vm, cdata->vp);
-						cdata->divv = 1.0f / (float)((cdata->vp << 1) + 1);
-					}
-					g += 6 * r;
+					dh[i] = 1.0f / (float)(hpline[i] + hmline[i] + 1);
+					dv[i] = 1.0f / (float)(vpline[i] + vmline[i] + 1);
+					cd[i].hp = hpline[i];
+					cd[i].hm = hmline[i];
+					cd[i].divh = dh[i];
+					cd[i].vp = vpline[i];
+					cd[i].vm = vmline[i];
+					cd[i].divv = dv[i];
 				}
 			}
 		}
-
-		//clipping
-		cdata = crossdata;
-		for (j = 0; j <= r; j++)
-		{
-			for (i = 0; i <= r; i++)
-			{
-				cdata[cstep * j + i].hm = min(cdata[cstep * j + i].hm, (uchar)i);
-				cdata[cstep * j + i].vm = min(cdata[cstep * j + i].vm, (uchar)j);
-				cdata->divh = 1.0f / (float)(cdata[cstep * j + i].hp + cdata[cstep * j + i].hm + 1);
-				cdata->divv = 1.0f / (float)(cdata[cstep * j + i].vp + cdata[cstep * j + i].vm + 1);
-			}
-			for (; i < guide.cols - r - 1; i++)
-			{
-				cdata[cstep * j + i].vm = min(cdata[cstep * j + i].vm, (uchar)j);
-				cdata->divv = 1.0f / (float)(cdata[cstep * j + i].vp + cdata[cstep * j + i].vm + 1);
-			}
-			for (; i < guide.cols; i++)
-			{
-				cdata[cstep * j + i].hp = min(cdata[cstep * j + i].hp, (uchar)(guide.cols - 1 - i));
-				cdata[cstep * j + i].vm = min(cdata[cstep * j + i].vm, (uchar)j);
-				cdata->divh = 1.0f / (float)(cdata[cstep * j + i].hp + cdata[cstep * j + i].hm + 1);
-				cdata->divv = 1.0f / (float)(cdata[cstep * j + i].vp + cdata[cstep * j + i].vm + 1);
-			}
-		}
-		for (; j < guide.rows - r - 1; j++)
-		{
-			for (i = 0; i <= r; i++)
-			{
-				cdata[cstep * j + i].hm = min(cdata[cstep * j + i].hm, (uchar)i);
-
-				cdata->divh = 1.0f / (float)(cdata[cstep * j + i].hp + cdata[cstep * j + i].hm + 1);
-			}
-			for (i = guide.cols - r - 1; i < guide.cols; i++)
-			{
-				cdata[cstep * j + i].hp = min(cdata[cstep * j + i].hp, (uchar)(guide.cols - 1 - i));
-				cdata->divh = 1.0f / (float)(cdata[cstep * j + i].hp + cdata[cstep * j + i].hm + 1);
-			}
-		}
-		for (; j < guide.rows; j++)
-		{
-			for (i = 0; i <= r; i++)
-			{
-				cdata[cstep * j + i].hm = min(cdata[cstep * j + i].hm, (uchar)i);
-				cdata[cstep * j + i].vp = min(cdata[cstep * j + i].vp, (uchar)(guide.rows - 1 - j));
-				cdata->divh = 1.0f / (float)(cdata[cstep * j + i].hp + cdata[cstep * j + i].hm + 1);
-				cdata->divv = 1.0f / (float)(cdata[cstep * j + i].vp + cdata[cstep * j + i].vm + 1);
-			}
-			for (; i < guide.cols - r - 1; i++)
-			{
-				cdata[cstep * j + i].vp = min(cdata[cstep * j + i].vp, (uchar)(guide.rows - 1 - j));
-				cdata->divv = 1.0f / (float)(cdata[cstep * j + i].vp + cdata[cstep * j + i].vm + 1);
-			}
-			for (; i < guide.cols; i++)
-			{
-				cdata[cstep * j + i].hp = min(cdata[cstep * j + i].hp, (uchar)(guide.cols - 1 - i));
-				cdata[cstep * j + i].vp = min(cdata[cstep * j + i].vp, (uchar)(guide.rows - 1 - j));
-				cdata->divh = 1.0f / (float)(cdata[cstep * j + i].hp + cdata[cstep * j + i].hm + 1);
-				cdata->divv = 1.0f / (float)(cdata[cstep * j + i].vp + cdata[cstep * j + i].vm + 1);
-			}
-		}
 	}
 
 	/*
@@ -3794,6 +3793,8 @@ namespace cp
 				}
 			}
 		}
+
+		setArmPlanesFromCross();
 	}
 
 	void CrossBasedLocalFilter::visualizeKernel(Mat& dest, Point& pt)
@@ -3956,9 +3957,58 @@ namespace cp
 		}
 	}
 
+	void CrossBasedLocalFilter::filterPlane(const Mat& src, Mat& dest, const bool isParallel)
+	{
+		CV_Assert(src.channels() == 1);
+		CV_Assert(src.size() == size);
+		dest.create(src.size(), src.type());
+
+		//src is only read in the horizontal pass, thus in-place filtering is allowed.
+		if (src.depth() == CV_8U)
+		{
+			orthogonalIntegralImageFilterSoA<uchar, float, float>(src, dest, armHP, armHM, divH, armVP, armVM, divV, isParallel);
+		}
+		else if (src.depth() == CV_16S)
+		{
+			orthogonalIntegralImageFilterSoA<short, float, float>(src, dest, armHP, armHM, divH, armVP, armVM, divV, isParallel);
+		}
+		else if (src.depth() == CV_16U)
+		{
+			orthogonalIntegralImageFilterSoA<ushort, float, float>(src, dest, armHP, armHM, divH, armVP, armVM, divV, isParallel);
+		}
+		else if (src.depth() == CV_32S)
+		{
+			orthogonalIntegralImageFilterSoA<int, float, float>(src, dest, armHP, armHM, divH, armVP, armVM, divV, isParallel);
+		}
+		else if (src.depth() == CV_32F)
+		{
+			orthogonalIntegralImageFilterSoA<float, double, float>(src, dest, armHP, armHM, divH, armVP, armVM, divV, isParallel);
+		}
+		else if (src.depth() == CV_64F)
+		{
+			orthogonalIntegralImageFilterSoA<double, double, double>(src, dest, armHP, armHM, divH, armVP, armVM, divV, isParallel);
+		}
+	}
+
+	void CrossBasedLocalFilter::operator()(std::vector<Mat>& src, std::vector<Mat>& dest)
+	{
+		dest.resize(src.size());
+#pragma omp parallel for schedule(dynamic)
+		for (int i = 0; i < (int)src.size(); i++)
+		{
+			filterPlane(src[i], dest[i], false);
+		}
+	}
+
 	void CrossBasedLocalFilter::operator()(Mat& src, Mat& dest)
 	{
 		const int cn = src.channels();
+		if (cn == 1)
+		{
+			filterPlane(src, dest, true);
+			return;
+		}
+
 		dest.create(src.size(), src.type());
 		if (src.channels() != dest.channels())dest.create(src.size(), src.type());
 		Mat src_ = src;
@@ -1,5 +1,8 @@
 #include "dithering.hpp"
+#include "inlineSIMDFunctions.hpp"
 #include <iostream>
+#include <atomic>
+#include <omp.h>
 #include <opencv2/highgui.hpp>
 
 using namespace cv;
@@ -42,6 +45,7 @@ namespace cp
 		case OUT2IN:				ret = "OUT2IN"; break;
 		case FOURDIRECTION:			ret = "FOURDIRECTION"; break;
 		case FOURDIRECTIONIN2OUT:	ret = "FOURDIRECTIONIN2OUT"; break;
+		case FORWARD_WAVEFRONT:		ret = "FORWARD_WAVEFRONT"; break;
 		default: ret = "no support"; break;
 		}
 		return ret;
@@ -1071,6 +1075,7 @@ namespace cp
 	int ditheringFloydSteinberg(Mat& remap, Mat& dest, int process_order)
 	{
 		CV_Assert(remap.depth() == CV_32F);
+		if (process_order == FORWARD_WAVEFRONT) return ditheringFloydSteinbergWavefront(remap, dest, 0);
 
 		int sample_num = 0;
 
@@ -9008,8 +9013,184 @@ namespace cp
 		return sample_num;
 	}
 
+#pragma region wavefront
+	//one row segment [xstart, xend) of Floyd-Steinberg in FORWARD order. s_next == nullptr for the bottom row.
+	//the arithmetic (mul then add, threshold >0.5) is the same as ditheringFloydSteinberg(FORWARD) for bit-exact output.
+	static int ditheringFloydSteinbergForwardRow(float* s, float* s_next, uchar* d, const int xstart, const int xend, const int cols, const float coeff7_16, const float coeff5_16, const float coeff3_16, const float coeff1_16)
+	{
+		int sample_num = 0;
+		for (int x = xstart; x < xend; x++)
+		{
+			float e;//error
+			if (s[x] > 0.5f)
+			{
+				e = s[x] - 1.f;
+				d[x] = 255;
+				sample_num++;
+			}
+			else
+			{
+				e = s[x];
+				d[x] = 0;
+			}
+
+			if (s_next == nullptr)
+			{
+				if (x != cols - 1) s[x + 1] = s[x + 1] + e * coeff7_16;
+			}
+			else if (x == 0)
+			{
+				s[x + 1] = s[x + 1] + e * coeff7_16;
+				s_next[x] = s_next[x] + e * coeff5_16;
+				s_next[x + 1] = s_next[x + 1] + e * coeff1_16;
+			}
+			else if (x == cols - 1)
+			{
+				s_next[x - 1] = s_next[x - 1] + e * coeff3_16;
+				s_next[x] = s_next[x] + e * coeff5_16;
+			}
+			else
+			{
+				s[x + 1] = s[x + 1] + e * coeff7_16;
+				s_next[x - 1] = s_next[x - 1] + e * coeff3_16;
+				s_next[x] = s_next[x] + e * coeff5_16;
+				s_next[x + 1] = s_next[x + 1] + e * coeff1_16;
+			}
+		}
+		return sample_num;
+	}
+
+	//SIMD version of ditheringFloydSteinbergForwardRow: 4 lanes are 4 color channels (BGRA-padded buffer) that are diffused independently.
+	static int ditheringFloydSteinbergForwardRowCn(float* s, float* s_next, uchar* d, const int channels, const int xstart, const int xend, const int cols, const float coeff7_16, const float coeff5_16, const float coeff3_16, const float coeff1_16)
+	{
+		const __m128 mth = _mm_set1_ps(0.5f);
+		const __m128 mone = _mm_set1_ps(1.f);
+		const __m128 mc7 = _mm_set1_ps(coeff7_16);
+		const __m128 mc5 = _mm_set1_ps(coeff5_16);
+		const __m128 mc3 = _mm_set1_ps(coeff3_16);
+		const __m128 mc1 = _mm_set1_ps(coeff1_16);
+		const int channelMask = (1 << channels) - 1;
+
+		int sample_num = 0;
+		for (int x = xstart; x < xend; x++)
+		{
+			float* sx = s + 4 * x;
+			const __m128 ms = _mm_loadu_ps(sx);
+			const __m128 mask = _mm_cmpgt_ps(ms, mth);
+			const __m128 e = _mm_sub_ps(ms, _mm_and_ps(mask, mone));
+			const int bits = _mm_movemask_ps(mask) & channelMask;
+			for (int c = 0; c < channels; c++)
+			{
+				d[channels * x + c] = (bits & (1 << c)) ? 255 : 0;
+			}
+			sample_num += _mm_popcnt_u32(bits);
+
+			if (s_next == nullptr)
+			{
+				if (x != cols - 1) _mm_storeu_ps(sx + 4, _mm_add_ps(_mm_loadu_ps(sx + 4), _mm_mul_ps(e, mc7)));
+			}
+			else
+			{
+				float* nx = s_next + 4 * x;
+				if (x != cols - 1)
+				{
+					_mm_storeu_ps(sx + 4, _mm_add_ps(_mm_loadu_ps(sx + 4), _mm_mul_ps(e, mc7)));
+					_mm_storeu_ps(nx + 4, _mm_add_ps(_mm_loadu_ps(nx + 4), _mm_mul_ps(e, mc1)));
+				}
+				if (x != 0)
+				{
+					_mm_storeu_ps(nx - 4, _mm_add_ps(_mm_loadu_ps(nx - 4), _mm_mul_ps(e, mc3)));
+				}
+				_mm_storeu_ps(nx, _mm_add_ps(_mm_loadu_ps(nx), _mm_mul_ps(e, mc5)));
+			}
+		}
+		return sample_num;
+	}
+
+	int ditheringFloydSteinbergWavefront(Mat& remap, Mat& dest, const int threads)
+	{
+		CV_Assert(remap.depth() == CV_32F);
+		CV_Assert(remap.channels() <= 4);
+		CV_Assert(remap.cols >= 2);
+
+		const int channels = remap.channels();
+		const int rows = remap.rows;
+		const int cols = remap.cols;
+		dest.create(remap.size(), CV_MAKE_TYPE(CV_8U, channels));
+
+		const float total = 1.f / 16.f;
+		const float coeff7_16 = 7.f * total;
+		const float coeff5_16 = 5.f * total;
+		const float coeff3_16 = 3.f * total;
+		const float coeff1_16 = 1.f * total;
+
+		//color channels are padded to 4 lanes
+		Mat buff;
+		if (channels == 1)
+		{
+			buff = remap;
+		}
+		else
+		{
+			vector<Mat> v;
+			split(remap, v);
+			for (int c = channels; c < 4; c++) v.push_back(Mat::zeros(remap.size(), CV_32F));
+			buff.create(remap.size(), CV_32FC4);
+			merge(v, buff);
+		}
+
+		//pixel (y, x) receives errors from (y-1, x-1), (y-1, x), (y-1, x+1) and (y, x-1).
+		//For the same order of float additions as the raster scan, row y can process x only after row y-1 has finished x+2.
+		const int lag = 3;
+		const int block = 64;
+		std::vector<std::atomic<int>> progress(rows);
+		for (int y = 0; y < rows; y++) progress[y].store(0);
+
+		const int thread_max = (threads <= 0) ? omp_get_max_threads() : threads;
+		AutoBuffer<int> sample_num(thread_max);
+		for (int t = 0; t < thread_max; t++) sample_num[t] = 0;
+
+#pragma omp parallel num_threads(thread_max)
+		{
+			const int tindex = omp_get_thread_num();
+			const int nthreads = omp_get_num_threads();
+			//rows are interleaved among threads, so that successive rows run at the same time with a lag
+			for (int y = tindex; y < rows; y += nthreads)
+			{
+				float* s = buff.ptr<float>(y);
+				float* s_next = (y == rows - 1) ? nullptr : buff.ptr<float>(y + 1);
+				uchar* d = dest.ptr<uchar>(y);
+				for (int x = 0; x < cols; x += block)
+				{
+					const int xend = min(x + block, cols);
+					if (y != 0)
+					{
+						const int required = min(xend - 1 + lag, cols);
+						while (progress[y - 1].load(std::memory_order_acquire) < required)
+						{
+							_mm_pause();
+						}
+					}
+
+					if (channels == 1) sample_num[tindex] += ditheringFloydSteinbergForwardRow(s, s_next, d, x, xend, cols, coeff7_16, coeff5_16, coeff3_16, coeff1_16);
+					else sample_num[tindex] += ditheringFloydSteinbergForwardRowCn(s, s_next, d, channels, x, xend, cols, coeff7_16, coeff5_16, coeff3_16, coeff1_16);
+
+					progress[y].store(xend, std::memory_order_release);
+				}
+			}
+		}
+
+		int ret = 0;
+		for (int t = 0; t < thread_max; t++) ret += sample_num[t];
+		return ret;
+	}
+#pragma endregion
+
 	int ditherDestruction(Mat& src, Mat& dest, const int dithering_method, int process_order)
 	{
+		//wavefront scheduling is only for Floyd-Steinberg; others use the same raster order
+		if (process_order == FORWARD_WAVEFRONT && dithering_method != FLOYD_STEINBERG) process_order = FORWARD;
+
 		int sample_num;
 		if (dithering_method == FLOYD_STEINBERG)
 			sample_num = ditheringFloydSteinberg(src, dest, process_order);
@@ -9035,6 +9216,9 @@ namespace cp
 	{
 		Mat src = src_.clone();
 
+		//wavefront scheduling is only for Floyd-Steinberg; others use the same raster order
+		if (process_order == FORWARD_WAVEFRONT && dithering_method != FLOYD_STEINBERG) process_order = FORWARD;
+
 		int sample_num;
 		if (dithering_method == OSTROMOUKHOW)
 			sample_num = ditheringOstromoukhov(src, dest, process_order);
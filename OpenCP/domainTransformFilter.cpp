@@ -1,5 +1,6 @@
 #include "domainTransformFilter.hpp"
 #include "color.hpp"
+#include "inlineSIMDFunctions.hpp"
 using namespace std;
 using namespace cv;
 
@@ -2795,6 +2796,451 @@ namespace cp
 		domainTransformFilter_RF_Base(src, src, dest, sigma_r, sigma_s, maxiter, norm);
 	}
 
+	///////////////////////////////////////////////////////////////////////////////
+	//planar AVX implementation for RF, NC and IC
+	///////////////////////////////////////////////////////////////////////////////
+
+	//distances of the transformed domain between neighboring pixels for a guide with any channels
+	//dx(y,x) links (x-1,y) and (x,y), dy(y,x) links (x,y-1) and (x,y); the first column of dx and the first row of dy are 0.
+	//L1: 1+ratio*sum|d|, L2: sqrt(l2bias+ratio^2*sum d^2) (l2bias is ratio^2 for RF and 1 for NC/IC as in the base implementations)
+	template<typename T, typename accT>
+	static void buildTransformedDistancePlanar(const Mat& guide, Mat& dx, Mat& dy, const float ratio, const int norm, const float l2bias)
+	{
+		const int width = guide.cols;
+		const int height = guide.rows;
+		const int cn = guide.channels();
+		const float ratio2 = ratio * ratio;
+		dx.create(guide.size(), CV_32F);
+		dy.create(guide.size(), CV_32F);
+
+#pragma omp parallel for schedule(static)
+		for (int y = 0; y < height; y++)
+		{
+			const T* jc = guide.ptr<T>(y);
+			const T* jp = guide.ptr<T>(max(y - 1, 0));
+			float* dxp = dx.ptr<float>(y);
+			float* dyp = dy.ptr<float>(y);
+
+			dxp[0] = 0.f;
+			for (int x = 1; x < width; x++)
+			{
+				accT accum = 0;
+				for (int c = 0; c < cn; c++)
+				{
+					const accT d = (accT)jc[cn * x + c] - (accT)jc[cn * (x - 1) + c];
+					accum += (norm == DTF_L2) ? d * d : abs(d);
+				}
+				dxp[x] = (norm == DTF_L2) ? sqrt(l2bias + ratio2 * accum) : 1.f + ratio * accum;
+			}
+
+			if (y == 0)
+			{
+				memset(dyp, 0, sizeof(float) * width);
+				continue;
+			}
+			for (int x = 0; x < width; x++)
+			{
+				accT accum = 0;
+				for (int c = 0; c < cn; c++)
+				{
+					const accT d = (accT)jc[cn * x + c] - (accT)jp[cn * x + c];
+					accum += (norm == DTF_L2) ? d * d : abs(d);
+				}
+				dyp[x] = (norm == DTF_L2) ? sqrt(l2bias + ratio2 * accum) : 1.f + ratio * accum;
+			}
+		}
+	}
+
+	static void buildTransformedDistancePlanar(const Mat& guide, Mat& dx, Mat& dy, const float ratio, const int norm, const float l2bias)
+	{
+		if (guide.depth() == CV_8U)
+		{
+			buildTransformedDistancePlanar<uchar, int>(guide, dx, dy, ratio, norm, l2bias);
+		}
+		else if (guide.depth() == CV_32F)
+		{
+			buildTransformedDistancePlanar<float, float>(guide, dx, dy, ratio, norm, l2bias);
+		}
+		else
+		{
+			Mat guidef;
+			guide.convertTo(guidef, CV_32F);
+			buildTransformedDistancePlanar<float, float>(guidef, dx, dy, ratio, norm, l2bias);
+		}
+	}
+
+	//dest = exp(lna*src) = a^src
+	static void powPlanarAVX(const float lna, const Mat& src, Mat& dest)
+	{
+		dest.create(src.size(), CV_32F);
+		const int width = src.cols;
+		const int simdwidth = get_simd_floor(width, 8);
+		const __m256 mlna = _mm256_set1_ps(lna);
+#pragma omp parallel for schedule(static)
+		for (int y = 0; y < src.rows; y++)
+		{
+			const float* s = src.ptr<float>(y);
+			float* d = dest.ptr<float>(y);
+			for (int x = 0; x < simdwidth; x += 8)
+			{
+				_mm256_storeu_ps(d + x, _mm256_exp_ps(_mm256_mul_ps(mlna, _mm256_loadu_ps(s + x))));
+			}
+			for (int x = simdwidth; x < width; x++)
+			{
+				d[x] = exp(lna * s[x]);
+			}
+		}
+	}
+
+	//8 rows of a band are interleaved to [x][8]; rows beyond the image repeat the last row
+	static void loadBandTransposed(const Mat& src, const int top, float* dst)
+	{
+		const int width = src.cols;
+		const int simdwidth = get_simd_floor(width, 8);
+		const float* s[8];
+		for (int k = 0; k < 8; k++) s[k] = src.ptr<float>(min(top + k, src.rows - 1));
+
+		__m256 a[8], b[8];
+		for (int x = 0; x < simdwidth; x += 8)
+		{
+			for (int k = 0; k < 8; k++) a[k] = _mm256_loadu_ps(s[k] + x);
+			_mm256_transpose8_ps(a, b);
+			for (int k = 0; k < 8; k++) _mm256_store_ps(dst + 8 * (x + k), b[k]);
+		}
+		for (int x = simdwidth; x < width; x++)
+		{
+			for (int k = 0; k < 8; k++) dst[8 * x + k] = s[k][x];
+		}
+	}
+
+	static void storeBandTransposed(const float* src, const int top, Mat& dst)
+	{
+		const int width = dst.cols;
+		const int simdwidth = get_simd_floor(width, 8);
+		const int rows = min(8, dst.rows - top);
+		float* d[8];
+		for (int k = 0; k < 8; k++) d[k] = dst.ptr<float>(min(top + k, dst.rows - 1));
+
+		__m256 a[8], b[8];
+		for (int x = 0; x < simdwidth; x += 8)
+		{
+			for (int k = 0; k < 8; k++) a[k] = _mm256_load_ps(src + 8 * (x + k));
+			_mm256_transpose8_ps(a, b);
+			for (int k = 0; k < rows; k++) _mm256_storeu_ps(d[k] + x, b[k]);
+		}
+		for (int x = simdwidth; x < width; x++)
+		{
+			for (int k = 0; k < rows; k++) d[k][x] = src[8 * x + k];
+		}
+	}
+
+	//horizontal recursive filter: each step of the recursion updates 8 rows in one register
+	static void recursiveFilterHorizontalPlanarAVX(vector<Mat>& planes, const Mat& V)
+	{
+		const int width = V.cols;
+		const int bands = (V.rows + 7) / 8;
+		const __m256 mones = _mm256_set1_ps(1.f);
+
+#pragma omp parallel
+		{
+			AutoBuffer<float> wbuf(8 * width + 8);
+			AutoBuffer<float> ibuf(8 * width + 8);
+			float* w = (float*)(((size_t)wbuf.data() + 31) & ~(size_t)31);
+			float* t = (float*)(((size_t)ibuf.data() + 31) & ~(size_t)31);
+#pragma omp for schedule(dynamic)
+			for (int b = 0; b < bands; b++)
+			{
+				loadBandTransposed(V, 8 * b, w);
+				for (int c = 0; c < (int)planes.size(); c++)
+				{
+					loadBandTransposed(planes[c], 8 * b, t);
+
+					__m256 mprev = _mm256_load_ps(t);
+					for (int x = 1; x < width; x++)
+					{
+						const __m256 mp = _mm256_load_ps(w + 8 * x);
+						mprev = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(mones, mp), _mm256_load_ps(t + 8 * x)), _mm256_mul_ps(mp, mprev));
+						_mm256_store_ps(t + 8 * x, mprev);
+					}
+					for (int x = width - 2; x >= 0; x--)
+					{
+						const __m256 mp = _mm256_load_ps(w + 8 * (x + 1));
+						mprev = _mm256_add_ps(_mm256_mul_ps(mp, mprev), _mm256_mul_ps(_mm256_sub_ps(mones, mp), _mm256_load_ps(t + 8 * x)));
+						_mm256_store_ps(t + 8 * x, mprev);
+					}
+
+					storeBandTransposed(t, 8 * b, planes[c]);
+				}
+			}
+		}
+	}
+
+	//vertical recursive filter: 8 columns per register on column strips
+	static void recursiveFilterVerticalPlanarAVX(vector<Mat>& planes, const Mat& V)
+	{
+		const int width = V.cols;
+		const int height = V.rows;
+		const int strip = 64;
+		const int strips = (width + strip - 1) / strip;
+		const __m256 mones = _mm256_set1_ps(1.f);
+
+#pragma omp parallel for schedule(dynamic)
+		for (int s = 0; s < strips; s++)
+		{
+			const int xs = s * strip;
+			const int xe = min(xs + strip, width);
+			const int simdend = xs + get_simd_floor(xe - xs, 8);
+			for (int c = 0; c < (int)planes.size(); c++)
+			{
+				Mat& out = planes[c];
+				for (int y = 1; y < height; y++)
+				{
+					const float* p = V.ptr<float>(y);
+					const float* prev = out.ptr<float>(y - 1);
+					float* cur = out.ptr<float>(y);
+					for (int x = xs; x < simdend; x += 8)
+					{
+						const __m256 mp = _mm256_loadu_ps(p + x);
+						_mm256_storeu_ps(cur + x, _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(mones, mp), _mm256_loadu_ps(cur + x)), _mm256_mul_ps(mp, _mm256_loadu_ps(prev + x))));
+					}
+					for (int x = simdend; x < xe; x++)
+					{
+						cur[x] = (1.f - p[x]) * cur[x] + p[x] * prev[x];
+					}
+				}
+				for (int y = height - 2; y >= 0; y--)
+				{
+					const float* p = V.ptr<float>(y + 1);
+					const float* next = out.ptr<float>(y + 1);
+					float* cur = out.ptr<float>(y);
+					for (int x = xs; x < simdend; x += 8)
+					{
+						const __m256 mp = _mm256_loadu_ps(p + x);
+						_mm256_storeu_ps(cur + x, _mm256_add_ps(_mm256_mul_ps(mp, _mm256_loadu_ps(next + x)), _mm256_mul_ps(_mm256_sub_ps(mones, mp), _mm256_loadu_ps(cur + x))));
+					}
+					for (int x = simdend; x < xe; x++)
+					{
+						cur[x] = p[x] * next[x] + (1.f - p[x]) * cur[x];
+					}
+				}
+			}
+		}
+	}
+
+	static void transposePlanarAVX(const Mat& src, Mat& dest)
+	{
+		dest.create(src.cols, src.rows, CV_32F);
+		const int bands = (src.rows + 7) / 8;
+#pragma omp parallel
+		{
+			AutoBuffer<float> buf(8 * src.cols + 8);
+			float* t = (float*)(((size_t)buf.data() + 31) & ~(size_t)31);
+#pragma omp for schedule(static)
+			for (int b = 0; b < bands; b++)
+			{
+				loadBandTransposed(src, 8 * b, t);
+				const int rows = min(8, src.rows - 8 * b);
+				for (int x = 0; x < src.cols; x++)
+				{
+					memcpy(dest.ptr<float>(x) + 8 * b, t + 8 * x, sizeof(float) * rows);
+				}
+			}
+		}
+	}
+
+	//box filtering on the transformed domain along rows; dist is the row-wise distance (dist[0] unused).
+	//The window bounds depend only on the guide, so they are found once per row by two monotone pointers and shared by all planes;
+	//the box sums are taken from double prefix sums (NC) or from the integral of the linear interpolation (IC).
+	static void boxFilterTransformedDomainRowAVX(vector<Mat>& planes, const Mat& dist, const double radius, const int convolutionType)
+	{
+		const int width = dist.cols;
+		const int height = dist.rows;
+		const int simdwidth = get_simd_floor(width, 4);
+		const double pad = 2.0 * radius + 1.0;
+		const double inv2r = 1.0 / (2.0 * radius);
+
+#pragma omp parallel
+		{
+			//ct, s and Q are padded with the samples at x=-1 and x=width (IC)
+			AutoBuffer<double> ctbuf(width + 2);
+			AutoBuffer<double> sbuf(width + 2);
+			AutoBuffer<double> qbuf(width + 2);
+			AutoBuffer<double> coeff(4 * width);
+			AutoBuffer<int> ibuf(2 * width);
+			double* ct = ctbuf.data();
+			double* sp = sbuf.data();
+			double* Q = qbuf.data();
+			double* cA0 = coeff.data();
+			double* cA1 = cA0 + width;
+			double* cB0 = cA1 + width;
+			double* cB1 = cB0 + width;
+			int* jl = ibuf.data();
+			int* jr = jl + width;
+
+#pragma omp for schedule(static)
+			for (int y = 0; y < height; y++)
+			{
+				const float* d = dist.ptr<float>(y);
+				ct[1] = 0.0;
+				for (int x = 1; x < width; x++) ct[x + 1] = ct[x] + d[x];
+				ct[0] = ct[1] - pad;
+				ct[width + 1] = ct[width] + pad;
+
+				if (convolutionType == DTF_NC)
+				{
+					//[jl, jr]: samples with |ct_i-ct_x|<=radius, prefix index Q[j+1]=sum_{i<=j} s_i
+					int l = 0, r = 0;
+					for (int x = 0; x < width; x++)
+					{
+						const double c = ct[x + 1];
+						while (ct[l + 1] < c - radius) l++;
+						while (r + 1 < width && ct[r + 2] <= c + radius) r++;
+						jl[x] = l;
+						jr[x] = r + 1;
+					}
+				}
+				else
+				{
+					//jl, jr: interpolation segments of ct-radius and ct+radius on the padded arrays
+					int l = 0, r = 1;
+					for (int x = 0; x < width; x++)
+					{
+						const double c = ct[x + 1];
+						const double ta = c - radius;
+						const double tb = c + radius;
+						while (ct[l + 1] <= ta) l++;
+						while (ct[r + 1] <= tb) r++;
+						jl[x] = l;
+						jr[x] = r;
+						const double dta = ta - ct[l];
+						const double aa = 0.5 * dta / (ct[l + 1] - ct[l]);
+						cA0[x] = dta * (1.0 - aa);
+						cA1[x] = dta * aa;
+						const double dtb = tb - ct[r];
+						const double ab = 0.5 * dtb / (ct[r + 1] - ct[r]);
+						cB0[x] = dtb * (1.0 - ab);
+						cB1[x] = dtb * ab;
+					}
+				}
+
+				for (int c = 0; c < (int)planes.size(); c++)
+				{
+					float* s = planes[c].ptr<float>(y);
+					if (convolutionType == DTF_NC)
+					{
+						Q[0] = 0.0;
+						for (int x = 0; x < width; x++) Q[x + 1] = Q[x] + s[x];
+
+						for (int x = 0; x < simdwidth; x += 4)
+						{
+							const __m128i ml = _mm_loadu_si128((const __m128i*)(jl + x));
+							const __m128i mr = _mm_loadu_si128((const __m128i*)(jr + x));
+							const __m256d msum = _mm256_sub_pd(_mm256_i32gather_pd(Q, mr, 8), _mm256_i32gather_pd(Q, ml, 8));
+							const __m256d mcount = _mm256_cvtepi32_pd(_mm_sub_epi32(mr, ml));
+							_mm_storeu_ps(s + x, _mm256_cvtpd_ps(_mm256_div_pd(msum, mcount)));
+						}
+						for (int x = simdwidth; x < width; x++)
+						{
+							s[x] = (float)((Q[jr[x]] - Q[jl[x]]) / (jr[x] - jl[x]));
+						}
+					}
+					else
+					{
+						sp[0] = s[0];
+						for (int x = 0; x < width; x++) sp[x + 1] = s[x];
+						sp[width + 1] = s[width - 1];
+						Q[0] = 0.0;
+						for (int j = 0; j <= width; j++) Q[j + 1] = Q[j] + 0.5 * (sp[j] + sp[j + 1]) * (ct[j + 1] - ct[j]);
+
+						const __m256d minv2r = _mm256_set1_pd(inv2r);
+						const __m128i mones = _mm_set1_epi32(1);
+						for (int x = 0; x < simdwidth; x += 4)
+						{
+							const __m128i ml = _mm_loadu_si128((const __m128i*)(jl + x));
+							const __m128i mr = _mm_loadu_si128((const __m128i*)(jr + x));
+							__m256d ma = _mm256_i32gather_pd(Q, ml, 8);
+							ma = _mm256_fmadd_pd(_mm256_loadu_pd(cA0 + x), _mm256_i32gather_pd(sp, ml, 8), ma);
+							ma = _mm256_fmadd_pd(_mm256_loadu_pd(cA1 + x), _mm256_i32gather_pd(sp, _mm_add_epi32(ml, mones), 8), ma);
+							__m256d mb = _mm256_i32gather_pd(Q, mr, 8);
+							mb = _mm256_fmadd_pd(_mm256_loadu_pd(cB0 + x), _mm256_i32gather_pd(sp, mr, 8), mb);
+							mb = _mm256_fmadd_pd(_mm256_loadu_pd(cB1 + x), _mm256_i32gather_pd(sp, _mm_add_epi32(mr, mones), 8), mb);
+							_mm_storeu_ps(s + x, _mm256_cvtpd_ps(_mm256_mul_pd(_mm256_sub_pd(mb, ma), minv2r)));
+						}
+						for (int x = simdwidth; x < width; x++)
+						{
+							const int l = jl[x];
+							const int r = jr[x];
+							const double fa = Q[l] + cA0[x] * sp[l] + cA1[x] * sp[l + 1];
+							const double fb = Q[r] + cB0[x] * sp[r] + cB1[x] * sp[r + 1];
+							s[x] = (float)((fb - fa) * inv2r);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	//planar float implementation for all convolution types and norms.
+	//src and guide can have any (and different) numbers of channels, and no BGRA padding is used.
+	void domainTransformFilter_PLANAR_AVX(const Mat& src, const Mat& guide, Mat& dest, float sigma_r, float sigma_s, int maxiter, int norm, int convolutionType)
+	{
+		const int cn = src.channels();
+		vector<Mat> planes(cn);
+		if (cn == 1)
+		{
+			src.convertTo(planes[0], CV_32F);
+		}
+		else
+		{
+			vector<Mat> srcplanes;
+			split(src, srcplanes);
+#pragma omp parallel for schedule(static)
+			for (int c = 0; c < cn; c++) srcplanes[c].convertTo(planes[c], CV_32F);
+		}
+
+		const float ratio = sigma_s / sigma_r;
+		const float l2bias = (convolutionType == DTF_RF) ? ratio * ratio : 1.f;
+		Mat dx, dy;
+		buildTransformedDistancePlanar(guide, dx, dy, ratio, norm, l2bias);
+
+		if (convolutionType == DTF_RF)
+		{
+			Mat Vh, Vv;
+			int i = maxiter;
+			while (i--)
+			{
+				const float sigma_h = (float)(sigma_s * sqrt(3.0) * pow(2.0, (maxiter - (i + 1))) / sqrt(pow(4.0, maxiter) - 1));
+				const float lna = -sqrt(2.f) / sigma_h;
+				powPlanarAVX(lna, dx, Vh);
+				powPlanarAVX(lna, dy, Vv);
+				recursiveFilterHorizontalPlanarAVX(planes, Vh);
+				recursiveFilterVerticalPlanarAVX(planes, Vv);
+			}
+		}
+		else
+		{
+			Mat dyT;
+			transposePlanarAVX(dy, dyT);
+			vector<Mat> planesT(cn);
+			int i = maxiter;
+			while (i--)
+			{
+				const float sigma_h = (float)(sigma_s * sqrt(3.0) * pow(2.0, (maxiter - (i + 1))) / sqrt(pow(4.0, maxiter) - 1));
+				const float radius = sigma_h * sqrt(3.f);
+
+				boxFilterTransformedDomainRowAVX(planes, dx, radius, convolutionType);
+				for (int c = 0; c < cn; c++) transposePlanarAVX(planes[c], planesT[c]);
+				boxFilterTransformedDomainRowAVX(planesT, dyT, radius, convolutionType);
+				for (int c = 0; c < cn; c++) transposePlanarAVX(planesT[c], planes[c]);
+			}
+		}
+
+		Mat img;
+		if (cn == 1) img = planes[0];
+		else merge(planes, img);
+		img.convertTo(dest, src.depth());
+	}
+
 	void domainTransformFilterRF(const Mat& src, const Mat& guide, Mat& dst, float sigma_r, float sigma_s, int maxiter, int norm, int implementation)
 	{
 		//setNumThreads(4);
@@ -2812,6 +3258,10 @@ namespace cp
 			if (src.channels() == 1) domainTransformFilter_RF_GRAY_SSE_SINGLE(src, guide, dst, sigma_r, sigma_s, maxiter, norm);
 			else domainTransformFilter_RF_BGRA_SSE_PARALLEL(src, guide, dst, sigma_r, sigma_s, maxiter, norm);
 		}
+		else if (implementation == DTF_PLANAR_AVX)
+		{
+			domainTransformFilter_PLANAR_AVX(src, guide, dst, sigma_r, sigma_s, maxiter, norm, DTF_RF);
+		}
 	}
 
 	void domainTransformFilterRF(const Mat& src, Mat& dst, float sigma_r, float sigma_s, int maxiter, int norm, int implementation)
@@ -3606,6 +4056,10 @@ namespace cp
 			std::cout << "no inplimentation" << std::endl;
 			src.copyTo(dst);
 		}
+		else if (implementation == DTF_PLANAR_AVX)
+		{
+			domainTransformFilter_PLANAR_AVX(src, guide, dst, sigma_r, sigma_s, maxiter, norm, DTF_NC);
+		}
 	}
 
 	void domainTransformFilterNC(const Mat& src, Mat& dst, float sigma_r, float sigma_s, int maxiter, int norm, int implementation)
@@ -3697,6 +4151,10 @@ namespace cp
 			std::cout << "no inplimentation" << std::endl;
 			src.copyTo(dst);
 		}
+		else if (implementation == DTF_PLANAR_AVX)
+		{
+			domainTransformFilter_PLANAR_AVX(src, guide, dst, sigma_r, sigma_s, maxiter, norm, DTF_IC);
+		}
 	}
 
 	void domainTransformFilterIC(const Mat& src, Mat& dst, float sigma_r, float sigma_s, int maxiter, int norm, int implementation)
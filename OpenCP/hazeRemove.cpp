@@ -1,6 +1,7 @@
 #include "hazeRemove.hpp" 
 #include "guidedFilter.hpp"
 #include "statisticalFilter.hpp"
+#include "inlineSIMDFunctions.hpp"
 #include <opencv2/ximgproc.hpp>
 #include <opencv2/xphoto.hpp>
 
@@ -13,33 +14,18 @@ namespace cp
 
 	void HazeRemove::darkChannel(Mat& src, int r)
 	{
-		if (dark.empty())dark.create(size, CV_8U);
-
-		vector<Mat> srcv;
-		split(src, srcv);
-
-		for (int i = 0; i < src.channels(); i++)
-		{
-			minFilter(srcv[i], minvalue[i], r);
-		}
-
-		if (src.channels() == 3)
+		Mat minc(size, CV_8U);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < size.height; i++)
 		{
-			//#pragma omp parallel for
-			for (int i = 0; i < size.height; i++)
+			const uchar* s = src.ptr<uchar>(i);
+			uchar* d = minc.ptr<uchar>(i);
+			for (int j = 0; j < size.width; j++)
 			{
-				const uchar* sr = minvalue[0].ptr(i);
-				const uchar* sg = minvalue[0].ptr(i);
-				const uchar* sb = minvalue[0].ptr(i);
-				uchar* dptr = dark.ptr(i);
-
-				for (int j = 0; j < size.width; j++)
-				{
-					uchar minv = min(sr[j], sg[j]);
-					dptr[j] = min(minv, sb[j]);
-				}
+				d[j] = min(min(s[3 * j + 0], s[3 * j + 1]), s[3 * j + 2]);
 			}
 		}
+		minFilter(minc, dark, r);
 	}
 
 	void HazeRemove::getAtmosphericLight(Mat& srcImage, double topPercent)
@@ -47,13 +33,21 @@ namespace cp
 		int hist[256];
 		double icount = 1.0 / (double)dark.size().area();
 		for (int i = 0; i < 256; i++)hist[i] = 0;
-		for (int j = 0; j < srcImage.rows; j++)
+#pragma omp parallel
 		{
-			uchar* s = dark.ptr(j);
-			for (int i = 0; i < srcImage.cols; i++)
+			int lhist[256];
+			for (int i = 0; i < 256; i++)lhist[i] = 0;
+#pragma omp for schedule(static)
+			for (int j = 0; j < dark.rows; j++)
 			{
-				hist[s[i]]++;
+				const uchar* s = dark.ptr(j);
+				for (int i = 0; i < dark.cols; i++)
+				{
+					lhist[s[i]]++;
+				}
 			}
+#pragma omp critical
+			for (int i = 0; i < 256; i++)hist[i] += lhist[i];
 		}
 
 		int thresh = 0;
@@ -67,58 +61,62 @@ namespace cp
 				break;
 			}
 		}
-		Mat map;
-		threshold(dark, map, thresh, 255, THRESH_BINARY);
-		A = CV_RGB(0, 0, 0);
 
-		int maxv = 0;
+		//mean color of the pixels whose dark channel is above the threshold
+		double a0 = 0.0, a1 = 0.0, a2 = 0.0;
 		int count = 0;
+#pragma omp parallel for schedule(static) reduction(+:a0, a1, a2, count)
 		for (int j = 0; j < srcImage.rows; j++)
 		{
-			uchar* m = map.ptr(j);
-			uchar* s = srcImage.ptr(j);
+			const uchar* m = dark.ptr(j);
+			const uchar* s = srcImage.ptr(j);
 			for (int i = 0; i < srcImage.cols; i++)
 			{
-				if (m[i] == 255)
+				if (m[i] > thresh && s[3 * i] + s[3 * i + 1] + s[3 * i + 2] > 0)
 				{
-					if (maxv < s[3 * i] + s[3 * i + 1] + s[3 * i + 2])
-					{
-						A.val[0] += s[3 * i];
-						A.val[1] += s[3 * i + 1];
-						A.val[2] += s[3 * i + 2];
-						count++;
-					}
+					a0 += s[3 * i];
+					a1 += s[3 * i + 1];
+					a2 += s[3 * i + 2];
+					count++;
 				}
-
 			}
 		}
+		A = CV_RGB(0, 0, 0);
 		if (count != 0)
 		{
-			A.val[0] /= (double)count;
-			A.val[1] /= (double)count;
-			A.val[2] /= (double)count;
+			A.val[0] = a0 / (double)count;
+			A.val[1] = a1 / (double)count;
+			A.val[2] = a2 / (double)count;
 		}
 	}
 
-	void HazeRemove::getTransmissionMap(float omega)
+	void HazeRemove::getTransmissionMap(Mat& src, int r, float omega)
 	{
-		tmap = Mat::ones(size, CV_32F);
+		//min over the window of min_c(I_c/A_c): the channel minimum is taken first, so only one min filter is needed
+		Mat minc(size, CV_32F);
 		const float ir = (float)(1.0 / A.val[0]);
 		const float ig = (float)(1.0 / A.val[1]);
 		const float ib = (float)(1.0 / A.val[2]);
-
-		//#pragma omp parallel for
+#pragma omp parallel for schedule(static)
 		for (int i = 0; i < size.height; i++)
 		{
-			uchar* sr = minvalue[0].ptr<uchar>(i);
-			uchar* sg = minvalue[1].ptr<uchar>(i);
-			uchar* sb = minvalue[2].ptr<uchar>(i);
-			float* dptr = tmap.ptr<float>(i);
+			const uchar* s = src.ptr<uchar>(i);
+			float* d = minc.ptr<float>(i);
+			for (int j = 0; j < size.width; j++)
+			{
+				const float minv = min((float)s[3 * j + 0] * ir, (float)s[3 * j + 1] * ig);
+				d[j] = min(minv, (float)s[3 * j + 2] * ib);
+			}
+		}
+		minFilter(minc, tmap, r);
 
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < size.height; i++)
+		{
+			float* d = tmap.ptr<float>(i);
 			for (int j = 0; j < size.width; j++)
 			{
-				float minv = min((float)sr[j] * ir, (float)sg[j] * ig);
-				dptr[j] -= omega*min(minv, (float)sb[j] * ib);
+				d[j] = 1.f - omega * d[j];
 			}
 		}
 	}
@@ -127,6 +125,7 @@ namespace cp
 	{
 		if (dest.empty())dest = Mat::zeros(src.size(), src.type());
 
+#pragma omp parallel for schedule(static)
 		for (int j = 0; j < src.rows; j++)
 		{
 			float* a = trans.ptr<float>(j);
@@ -143,9 +142,137 @@ namespace cp
 		}
 	}
 
+	void HazeRemove::updateGuideStatistics(Mat& guide, const int r, const float eps)
+	{
+		const bool isReset = (guide.size() != prev_guide.size() || r != stat_r || eps != stat_e);
+		if (isReset)
+		{
+			guide_f.create(guide.size(), CV_32F);
+			guide_sq.create(guide.size(), CV_32F);
+			mean_I.create(guide.size(), CV_32F);
+			inv_var_I.create(guide.size(), CV_32F);
+			stat_r = r;
+			stat_e = eps;
+		}
+
+		//a band of the statistics depends only on the guide rows within r, so only bands touching changed rows are recomputed
+		const int band = 32;
+		const int bands = (guide.rows + band - 1) / band;
+		vector<uchar> isChanged(bands, 1);
+#pragma omp parallel for schedule(static)
+		for (int b = 0; b < bands; b++)
+		{
+			const int y0 = b * band;
+			const int y1 = min(y0 + band, guide.rows);
+			if (!isReset)
+			{
+				bool changed = false;
+				for (int y = max(0, y0 - r); y < min(guide.rows, y1 + r) && !changed; y++)
+				{
+					changed = (memcmp(guide.ptr<uchar>(y), prev_guide.ptr<uchar>(y), guide.cols) != 0);
+				}
+				isChanged[b] = changed;
+			}
+			for (int y = y0; y < y1; y++)
+			{
+				const uchar* s = guide.ptr<uchar>(y);
+				float* f = guide_f.ptr<float>(y);
+				float* q = guide_sq.ptr<float>(y);
+				for (int x = 0; x < guide.cols; x++)
+				{
+					f[x] = s[x];
+					q[x] = (float)(s[x] * s[x]);
+				}
+			}
+		}
+
+		const Size ksize(2 * r + 1, 2 * r + 1);
+#pragma omp parallel for schedule(dynamic)
+		for (int b = 0; b < bands; b++)
+		{
+			if (!isChanged[b]) continue;
+			const Rect roi(0, b * band, guide.cols, min(band, guide.rows - b * band));
+			Mat mI = mean_I(roi);
+			Mat iv = inv_var_I(roi);
+			//filtering on ROIs reads the neighboring rows of the parent image, so the result is the same as on the full image
+			boxFilter(guide_f(roi), mI, CV_32F, ksize);
+			boxFilter(guide_sq(roi), iv, CV_32F, ksize);
+			for (int y = 0; y < roi.height; y++)
+			{
+				const float* m = mI.ptr<float>(y);
+				float* v = iv.ptr<float>(y);
+				for (int x = 0; x < roi.width; x++) v[x] = 1.f / (v[x] - m[x] * m[x] + eps);
+			}
+		}
+		guide.copyTo(prev_guide);
+	}
+
+	void HazeRemove::removeHazeGuided(Mat& src, Mat& dest, const int r, const float eps, const float clip)
+	{
+		Mat srcg;
+		cvtColor(src, srcg, COLOR_BGR2GRAY);
+		updateGuideStatistics(srcg, r, eps);
+
+		const Size ksize(2 * r + 1, 2 * r + 1);
+		Mat mean_p, mean_Ip;
+		Mat Ip(size, CV_32F);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < size.height; i++)
+		{
+			const float* I = guide_f.ptr<float>(i);
+			const float* p = tmap.ptr<float>(i);
+			float* d = Ip.ptr<float>(i);
+			for (int j = 0; j < size.width; j++) d[j] = I[j] * p[j];
+		}
+		boxFilter(tmap, mean_p, CV_32F, ksize);
+		boxFilter(Ip, mean_Ip, CV_32F, ksize);
+
+		//a is written to mean_Ip and b to mean_p
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < size.height; i++)
+		{
+			const float* mI = mean_I.ptr<float>(i);
+			const float* iv = inv_var_I.ptr<float>(i);
+			float* mp = mean_p.ptr<float>(i);
+			float* mIp = mean_Ip.ptr<float>(i);
+			for (int j = 0; j < size.width; j++)
+			{
+				const float a = (mIp[j] - mI[j] * mp[j]) * iv[j];
+				mIp[j] = a;
+				mp[j] = mp[j] - a * mI[j];
+			}
+		}
+		boxFilter(mean_Ip, mean_Ip, CV_32F, ksize);
+		boxFilter(mean_p, mean_p, CV_32F, ksize);
+
+		//fused output of the guided filter and haze removal
+		if (dest.empty())dest.create(src.size(), src.type());
+		const float v0 = (float)A.val[0];
+		const float v1 = (float)A.val[1];
+		const float v2 = (float)A.val[2];
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < size.height; i++)
+		{
+			const float* I = guide_f.ptr<float>(i);
+			const float* ma = mean_Ip.ptr<float>(i);
+			const float* mb = mean_p.ptr<float>(i);
+			const uchar* s = src.ptr<uchar>(i);
+			float* t = tmap.ptr<float>(i);
+			uchar* d = dest.ptr<uchar>(i);
+			for (int j = 0; j < size.width; j++)
+			{
+				t[j] = ma[j] * I[j] + mb[j];
+				const float it = 1.f / max(clip, t[j]);
+				d[3 * j + 0] = saturate_cast<uchar>((s[3 * j + 0] - v0) * it + v0);
+				d[3 * j + 1] = saturate_cast<uchar>((s[3 * j + 1] - v1) * it + v1);
+				d[3 * j + 2] = saturate_cast<uchar>((s[3 * j + 2] - v2) * it + v2);
+			}
+		}
+	}
+
 	HazeRemove::HazeRemove()
 	{
-		minvalue.resize(3);
+		;
 	}
 
 	HazeRemove::~HazeRemove()
@@ -179,7 +306,7 @@ namespace cp
 
 		darkChannel(src, r_dark);
 		getAtmosphericLight(src, top_rate);
-		getTransmissionMap();
+		getTransmissionMap(src, r_dark);
 		Mat srcg;
 		cvtColor(src, srcg, COLOR_BGR2GRAY);
 		ximgproc::fastGlobalSmootherFilter(srcg, tmap, tmap, lambda, sigma_color, lambda_attenuation, max(iteration, 1));
@@ -198,11 +325,8 @@ namespace cp
 
 		darkChannel(src, r_dark);
 		getAtmosphericLight(src, toprate);
-		getTransmissionMap();
-		Mat srcg;
-		cvtColor(src, srcg, COLOR_BGR2GRAY);
-		guidedImageFilter(tmap, srcg, tmap, r_joint, (float)e_joint);
-		removeHaze(src, tmap, A, dest);
+		getTransmissionMap(src, r_dark);
+		removeHazeGuided(src, dest, r_joint, (float)e_joint);
 	}
 
 	void HazeRemove::operator() (Mat& src, Mat& dest, const int r_dark, const double top_rate, const int r_joint, const double e_joint)
@@ -7,6 +7,7 @@
 #include "consoleImage.hpp"
 #include "metrics.hpp"
 #include "blend.hpp"
+#include <omp.h>
 
 using namespace cv;
 using namespace std;
@@ -67,21 +68,9 @@ namespace cp
 
 	void LucyRichardsonGauss(const Mat& src, Mat& dest, const Size ksize, const float sigma, const int iteration)
 	{
-		Mat srcf;
+		IterativeDeblurGaussian rl(IterativeDeblurGaussian::Schedule::FIXED);
 		Mat destf;
-		Mat ratio;
-		src.convertTo(srcf, CV_32FC3);
-
-		Mat bdest;
-		srcf.copyTo(destf, CV_32FC3);
-		for (int i = 0; i < iteration; i++)
-		{
-			GaussianBlur(destf, bdest, ksize, sigma);
-			divide(srcf, bdest, ratio);
-			GaussianBlur(ratio, ratio, ksize, sigma);
-
-			multiply(destf, ratio, destf);
-		}
+		rl.deblur(src, destf, ksize, sigma, sigma, 1.f, iteration, IterativeDeblurGaussian::Method::LUCY_RICHARDSON);
 		destf.convertTo(dest, CV_8UC3);
 	}
 
@@ -270,37 +259,8 @@ namespace cp
 
 	void iterativeBackProjectionDeblurGaussian(const Mat& src, Mat& dest, const Size ksize, const float sigma, const float backprojection_sigma, const float lambda, const int iteration, Mat& init)
 	{
-		Mat srcf;
-		Mat destf;
-		Mat subf;
-		src.convertTo(srcf, CV_32FC3);
-
-		if (init.empty()) src.convertTo(destf, CV_32FC3);
-		else init.convertTo(destf, CV_32F);
-		Mat bdest;
-
-		//float lambdaamp = 0.99;
-		//float l = lambda;
-
-		for (int i = 0; i < iteration; i++)
-		{
-			GaussianBlur(destf, bdest, ksize, sigma);
-			subtract(srcf, bdest, subf);
-			//double e = norm(subf);
-
-			if (backprojection_sigma > 0.f)
-				GaussianBlur(subf, subf, ksize, backprojection_sigma);
-
-
-			//destf += lambda*subf;
-			/*if(i==0)fma(subf, 3, destf);
-			else if (i==1)fma(subf, 2, destf);
-			else	fma(subf, lambda, destf);*/
-			fma(subf, lambda, destf);
-
-			//l *= lambdaamp;
-		}
-		destf.convertTo(dest, src.depth());
+		IterativeDeblurGaussian ibp(IterativeDeblurGaussian::Schedule::FIXED);
+		ibp.deblur(src, dest, ksize, sigma, backprojection_sigma, lambda, iteration, IterativeDeblurGaussian::Method::IBP, init);
 	}
 
 	void iterativeBackProjectionDeblurGaussian(const Mat& src, Mat& dest, const Size ksize, const float sigma, const float backprojection_sigma, const float lambda, const int iteration)
@@ -547,6 +507,332 @@ namespace cp
 	}
 
 
+#pragma region IterativeDeblurGaussian
+	struct IterativeDeblurGaussian::Buf
+	{
+		Mat hx;//horizontally blurred rows of the estimate for a band with halo
+		Mat he;//horizontally blurred rows of the residual for a band with halo
+		Mat line;//border padded line
+	};
+
+	static void getDeblurKernel(const Size ksize, const float sigma, Mat& kx, Mat& ky)
+	{
+		//same kernel size rule as cv::GaussianBlur for float images
+		const int w = (ksize.width > 0) ? ksize.width : cvRound(sigma * 4.0 * 2.0 + 1.0) | 1;
+		const int h = (ksize.height > 0) ? ksize.height : cvRound(sigma * 4.0 * 2.0 + 1.0) | 1;
+		kx = getGaussianKernel(w, sigma, CV_32F);
+		ky = getGaussianKernel(h, sigma, CV_32F);
+	}
+
+	//the center of line (cols * cn) has to be filled
+	static void padLineReflect101(float* line, const int cols, const int cn, const int r)
+	{
+		float* lc = line + r * cn;
+		for (int i = 1; i <= r; i++)
+		{
+			const int L = borderInterpolate(-i, cols, BORDER_REFLECT_101);
+			const int R = borderInterpolate(cols - 1 + i, cols, BORDER_REFLECT_101);
+			for (int c = 0; c < cn; c++)
+			{
+				lc[-i * cn + c] = lc[L * cn + c];
+				lc[(cols - 1 + i) * cn + c] = lc[R * cn + c];
+			}
+		}
+	}
+
+	static void hfilterLine(const float* line, float* dest, const float* k, const int r, const int w, const int cn)
+	{
+		const int D = 2 * r + 1;
+		const int simdw = get_simd_floor(w, 8);
+		for (int i = 0; i < simdw; i += 8)
+		{
+			__m256 msum = _mm256_mul_ps(_mm256_set1_ps(k[0]), _mm256_loadu_ps(line + i));
+			for (int n = 1; n < D; n++)
+			{
+				msum = _mm256_fmadd_ps(_mm256_set1_ps(k[n]), _mm256_loadu_ps(line + i + n * cn), msum);
+			}
+			_mm256_storeu_ps(dest + i, msum);
+		}
+		for (int i = simdw; i < w; i++)
+		{
+			float sum = 0.f;
+			for (int n = 0; n < D; n++) sum += k[n] * line[i + n * cn];
+			dest[i] = sum;
+		}
+	}
+
+	IterativeDeblurGaussian::IterativeDeblurGaussian(const Schedule schedule)
+	{
+		setSchedule(schedule);
+	}
+
+	void IterativeDeblurGaussian::setSchedule(const Schedule schedule, const bool isAdaptiveRestart)
+	{
+		this->schedule = schedule;
+		this->isAdaptiveRestart = isAdaptiveRestart;
+	}
+
+	double IterativeDeblurGaussian::getResidual()
+	{
+		return residual;
+	}
+
+	int IterativeDeblurGaussian::getRestartCount()
+	{
+		return restart_count;
+	}
+
+	void IterativeDeblurGaussian::collectGarbage()
+	{
+		buf.clear();
+		srcf.release();
+		z[0].release();
+		z[1].release();
+		x.release();
+	}
+
+	//one iteration as a row-band pass:
+	//estimate rows [y0-bry-ry, y1+bry+ry) are horizontally blurred, vertically blurred to the residual rows [y0-bry, y1+bry),
+	//which are back-projected (horizontal then vertical) and used to update rows [y0, y1).
+	void IterativeDeblurGaussian::iterate(const Method method, const Mat& zin, Mat& zout, const int band, const float lambda, const float beta)
+	{
+		const int rows = srcf.rows;
+		const int cols = srcf.cols;
+		const int cn = srcf.channels();
+		const int w = cols * cn;
+		const int simdw = get_simd_floor(w, 8);
+		const int rx = kx.rows / 2;
+		const int ry = ky.rows / 2;
+		const int brx = bkx.rows / 2;
+		const int bry = bky.rows / 2;
+		const int bandNum = (rows + band - 1) / band;
+		const bool isMomentum = (schedule == Schedule::NESTEROV);
+		const bool isLR = (method == Method::LUCY_RICHARDSON);
+		const float* kxp = kx.ptr<float>();
+		const float* kyp = ky.ptr<float>();
+		const float* bkxp = bkx.ptr<float>();
+		const float* bkyp = bky.ptr<float>();
+
+#pragma omp parallel for schedule(static)
+		for (int b = 0; b < bandNum; b++)
+		{
+			Buf& bf = *buf[omp_get_thread_num()];
+			float* line = bf.line.ptr<float>();
+			AutoBuffer<const float*> vp(max(ky.rows, bky.rows));
+
+			const int y0 = b * band;
+			const int y1 = min(rows, y0 + band);
+			const int elo = max(0, y0 - bry);
+			const int ehi = min(rows, y1 + bry);
+			const int hlo = max(0, elo - ry);
+			const int hhi = min(rows, ehi + ry);
+
+			//horizontal blur of the estimate
+			for (int j = hlo; j < hhi; j++)
+			{
+				memcpy(line + rx * cn, zin.ptr<float>(j), sizeof(float) * w);
+				padLineReflect101(line, cols, cn, rx);
+				hfilterLine(line, bf.hx.ptr<float>(j - hlo), kxp, rx, w, cn);
+			}
+
+			//vertical blur, residual and horizontal back-projection blur
+			double res = 0.0;
+			for (int j = elo; j < ehi; j++)
+			{
+				for (int n = 0; n < ky.rows; n++) vp[n] = bf.hx.ptr<float>(borderInterpolate(j + n - ry, rows, BORDER_REFLECT_101) - hlo);
+				const float* s = srcf.ptr<float>(j);
+				float* e = (brx == 0) ? bf.he.ptr<float>(j - elo) : line + brx * cn;
+
+				__m256 mres = _mm256_setzero_ps();
+				for (int i = 0; i < simdw; i += 8)
+				{
+					__m256 mb = _mm256_mul_ps(_mm256_set1_ps(kyp[0]), _mm256_loadu_ps(vp[0] + i));
+					for (int n = 1; n < ky.rows; n++)
+					{
+						mb = _mm256_fmadd_ps(_mm256_set1_ps(kyp[n]), _mm256_loadu_ps(vp[n] + i), mb);
+					}
+					const __m256 ms = _mm256_loadu_ps(s + i);
+					const __m256 md = _mm256_sub_ps(ms, mb);
+					mres = _mm256_fmadd_ps(md, md, mres);
+					if (isLR)
+					{
+						//same as cv::divide: x/0 = 0
+						const __m256 mask = _mm256_cmp_ps(mb, _mm256_setzero_ps(), _CMP_NEQ_OQ);
+						_mm256_storeu_ps(e + i, _mm256_and_ps(mask, _mm256_div_ps(ms, mb)));
+					}
+					else
+					{
+						_mm256_storeu_ps(e + i, md);
+					}
+				}
+				float resrow = 0.f;
+				for (int i = simdw; i < w; i++)
+				{
+					float v = 0.f;
+					for (int n = 0; n < ky.rows; n++) v += kyp[n] * vp[n][i];
+					const float d = s[i] - v;
+					resrow += d * d;
+					if (isLR) e[i] = (v != 0.f) ? s[i] / v : 0.f;
+					else e[i] = d;
+				}
+				if (y0 <= j && j < y1) res += (double)_mm256_reduceadd_ps(mres) + resrow;
+
+				if (brx != 0)
+				{
+					padLineReflect101(line, cols, cn, brx);
+					hfilterLine(line, bf.he.ptr<float>(j - elo), bkxp, brx, w, cn);
+				}
+			}
+
+			//vertical back-projection blur and update
+			double dot = 0.0;
+			const __m256 mlambda = _mm256_set1_ps(lambda);
+			const __m256 mbeta = _mm256_set1_ps(beta);
+			for (int j = y0; j < y1; j++)
+			{
+				for (int n = 0; n < bky.rows; n++) vp[n] = bf.he.ptr<float>(borderInterpolate(j + n - bry, rows, BORDER_REFLECT_101) - elo);
+				const float* zi = zin.ptr<float>(j);
+				float* zo = zout.ptr<float>(j);
+				float* xp = (isMomentum) ? x.ptr<float>(j) : nullptr;
+
+				__m256 mdot = _mm256_setzero_ps();
+				for (int i = 0; i < simdw; i += 8)
+				{
+					__m256 me = _mm256_mul_ps(_mm256_set1_ps(bkyp[0]), _mm256_loadu_ps(vp[0] + i));
+					for (int n = 1; n < bky.rows; n++)
+					{
+						me = _mm256_fmadd_ps(_mm256_set1_ps(bkyp[n]), _mm256_loadu_ps(vp[n] + i), me);
+					}
+					const __m256 mz = _mm256_loadu_ps(zi + i);
+					const __m256 mx = (isLR) ? _mm256_mul_ps(mz, me) : _mm256_fmadd_ps(mlambda, me, mz);
+					if (isMomentum)
+					{
+						const __m256 mxprev = _mm256_loadu_ps(xp + i);
+						const __m256 mstep = _mm256_sub_ps(mx, mxprev);
+						mdot = _mm256_fmadd_ps(_mm256_sub_ps(mz, mx), mstep, mdot);
+						_mm256_storeu_ps(xp + i, mx);
+						__m256 mnext = _mm256_fmadd_ps(mbeta, mstep, mx);
+						if (isLR) mnext = _mm256_max_ps(mnext, _mm256_setzero_ps());
+						_mm256_storeu_ps(zo + i, mnext);
+					}
+					else
+					{
+						_mm256_storeu_ps(zo + i, mx);
+					}
+				}
+				float dotrow = 0.f;
+				for (int i = simdw; i < w; i++)
+				{
+					float e = 0.f;
+					for (int n = 0; n < bky.rows; n++) e += bkyp[n] * vp[n][i];
+					const float v = (isLR) ? zi[i] * e : zi[i] + lambda * e;
+					if (isMomentum)
+					{
+						const float step = v - xp[i];
+						dotrow += (zi[i] - v) * step;
+						xp[i] = v;
+						const float next = v + beta * step;
+						zo[i] = (isLR) ? max(next, 0.f) : next;
+					}
+					else
+					{
+						zo[i] = v;
+					}
+				}
+				dot += (double)_mm256_reduceadd_ps(mdot) + dotrow;
+			}
+			band_residual[b] = res;
+			band_restart[b] = dot;
+		}
+	}
+
+	void IterativeDeblurGaussian::deblur(const Mat& src, Mat& dest, const Size ksize, const float sigma, const float backprojection_sigma, const float lambda, const int iteration, const Method method, const Mat& init)
+	{
+		src.convertTo(srcf, CV_32F);
+		if (init.empty()) srcf.copyTo(z[0]);
+		else init.convertTo(z[0], CV_32F);
+		CV_Assert(z[0].size() == srcf.size() && z[0].channels() == srcf.channels());
+		z[1].create(srcf.size(), srcf.type());
+		if (schedule == Schedule::NESTEROV) z[0].copyTo(x);
+
+		getDeblurKernel(ksize, sigma, kx, ky);
+		if (backprojection_sigma > 0.f) getDeblurKernel(ksize, backprojection_sigma, bkx, bky);
+		else
+		{
+			bkx = Mat::ones(1, 1, CV_32F);
+			bky = Mat::ones(1, 1, CV_32F);
+		}
+
+		const int rx = kx.rows / 2;
+		const int ry = ky.rows / 2;
+		const int brx = bkx.rows / 2;
+		const int bry = bky.rows / 2;
+		const int w = srcf.cols * srcf.channels();
+		//halo rows are recomputed for each band, so the band is kept several times taller than the halo
+		const int band = max(32, 4 * (ry + bry));
+		const int bandNum = (srcf.rows + band - 1) / band;
+		band_residual.resize(bandNum);
+		band_restart.resize(bandNum);
+
+		const int threads = omp_get_max_threads();
+		if ((int)buf.size() < threads) buf.resize(threads);
+		for (int t = 0; t < threads; t++)
+		{
+			if (buf[t].empty()) buf[t] = makePtr<Buf>();
+			buf[t]->hx.create(band + 2 * (ry + bry), w, CV_32F);
+			buf[t]->he.create(band + 2 * bry, w, CV_32F);
+			buf[t]->line.create(1, w + 2 * max(rx, brx) * srcf.channels(), CV_32F);
+		}
+
+		double t = 1.0;
+		int cur = 0;
+		restart_count = 0;
+		residual = 0.0;
+		for (int i = 0; i < iteration; i++)
+		{
+			float beta = 0.f;
+			if (schedule == Schedule::NESTEROV && i != iteration - 1)
+			{
+				const double tnext = 0.5 * (1.0 + sqrt(1.0 + 4.0 * t * t));
+				beta = float((t - 1.0) / tnext);
+				t = tnext;
+			}
+			iterate(method, z[cur], z[1 - cur], band, lambda, beta);
+			cur = 1 - cur;
+
+			double res = 0.0;
+			double dot = 0.0;
+			for (int b = 0; b < bandNum; b++)
+			{
+				res += band_residual[b];
+				dot += band_restart[b];
+			}
+			residual = sqrt(res / ((double)srcf.size().area() * srcf.channels()));
+
+			//gradient restart (O'Donoghue and Candes): the momentum is dropped when it goes against the update
+			if (schedule == Schedule::NESTEROV && isAdaptiveRestart && beta != 0.f && dot > 0.0)
+			{
+				x.copyTo(z[cur]);
+				t = 1.0;
+				restart_count++;
+			}
+		}
+		z[cur].convertTo(dest, src.depth());
+	}
+
+	void iterativeBackProjectionDeblurGaussianNesterov(const Mat& src, Mat& dest, const Size ksize, const float sigma, const float backprojection_sigma, const float lambda, const int iteration)
+	{
+		IterativeDeblurGaussian ibp(IterativeDeblurGaussian::Schedule::NESTEROV);
+		ibp.deblur(src, dest, ksize, sigma, backprojection_sigma, lambda, iteration, IterativeDeblurGaussian::Method::IBP);
+	}
+
+	void LucyRichardsonGaussNesterov(const Mat& src, Mat& dest, const Size ksize, const float sigma, const int iteration)
+	{
+		IterativeDeblurGaussian rl(IterativeDeblurGaussian::Schedule::NESTEROV);
+		rl.deblur(src, dest, ksize, sigma, sigma, 1.f, iteration, IterativeDeblurGaussian::Method::LUCY_RICHARDSON);
+	}
+#pragma endregion
+
 	void guiIBP(Mat& src, Mat& ref, string wname)
 	{
 		namedWindow(wname);
@@ -653,6 +653,12 @@ namespace cp
 		case JBUSchedule::ALLOC_BORDER_OMP:jointBilateralUpsamplingAllocBorder(s, g, d, r, sigma_r, sigma_s); break;
 		case JBUSchedule::COMPUTE_BORDER_OMP:jointBilateralUpsamplingComputeBorder(s, g, d, r, sigma_r, sigma_s); break;
 		case JBUSchedule::COMPUTE_BORDER_NODOWNSAMPLE_OMP:jointBilateralUpsamplingComputeBorderNoGuideDownsample(s, g, d, r, sigma_r, sigma_s); break;
+		case JBUSchedule::CLASS_CASCADE:
+		{
+			JointBilateralUpsample jbu;
+			jbu.upsampleCascade(src, guide, dest, r, sigma_r, sigma_s);
+		}
+		break;
 
 		}
 		return;
@@ -1177,4 +1183,306 @@ namespace cp
 		}
 	}
 #pragma endregion
+
+#pragma region batch and cascade
+	//the range weight is the product of the per-channel weights of the guide, i.e., Gaussian of L2 color distance,
+	//so that one weight vector is shared by all channels of all maps.
+	template<typename GT, int gcn>
+	class JointBilateralUpsampleBatch_ParallelBody : public cv::ParallelLoopBody
+	{
+	private:
+		const std::vector<cv::Mat>* slow_b;
+		const cv::Mat* glow_b;
+		const cv::Mat* guide;
+		const cv::Mat* weightmap;
+		std::vector<cv::Mat>* dest;
+
+		const int scale;
+		const int r;
+		const float* range_weight;
+	public:
+		JointBilateralUpsampleBatch_ParallelBody(const std::vector<cv::Mat>& src, const cv::Mat& guide_low, const cv::Mat& guide_high, const cv::Mat& weightmap, std::vector<cv::Mat>& dst, const int scale, const int r, const float* rweight)
+			: slow_b(&src), glow_b(&guide_low), guide(&guide_high), weightmap(&weightmap), dest(&dst), scale(scale), r(r), range_weight(rweight)
+		{
+		}
+
+		void operator() (const cv::Range& range) const
+		{
+			const int d = 2 * r + 1;
+			const int ksize = d * d;
+			const int kstep = get_simd_ceil(ksize, 8);
+			const int maps = (int)slow_b->size();
+			int planes = 0;
+			for (int i = 0; i < maps; i++) planes += (*slow_b)[i].channels();
+
+			float* gneighbor = (float*)_mm_malloc(sizeof(float) * kstep * gcn, AVX_ALIGN);
+			float* neighbor = (float*)_mm_malloc(sizeof(float) * kstep * planes, AVX_ALIGN);
+			float* weight = (float*)_mm_malloc(sizeof(float) * kstep, AVX_ALIGN);
+			//zero padding for the tail of the kernel (weightmap is also zero padded)
+			for (int k = ksize; k < kstep; k++)
+			{
+				for (int c = 0; c < gcn; c++) gneighbor[kstep * c + k] = 0.f;
+				for (int p = 0; p < planes; p++) neighbor[kstep * p + k] = 0.f;
+			}
+
+			const __m256 v32f_absmask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+			const __m256i mlutmax = _mm256_set1_epi32(255);
+			const int lowwidth = glow_b->cols - 2 * r;
+			for (int y0 = range.start; y0 < range.end; y0++)
+			{
+				for (int x0 = 0; x0 < lowwidth; x0++)
+				{
+					//gather the low resolution window once for scale x scale output pixels
+					for (int n = 0; n < d; n++)
+					{
+						const GT* gb = glow_b->ptr<GT>(y0 + n) + gcn * x0;
+						for (int m = 0; m < d; m++)
+						{
+							for (int c = 0; c < gcn; c++) gneighbor[kstep * c + d * n + m] = (float)gb[gcn * m + c];
+						}
+					}
+					for (int i = 0, p = 0; i < maps; i++)
+					{
+						const Mat& s = (*slow_b)[i];
+						const int cn = s.channels();
+						for (int n = 0; n < d; n++)
+						{
+							if (s.depth() == CV_8U)
+							{
+								const uchar* sb = s.ptr<uchar>(y0 + n) + cn * x0;
+								for (int m = 0; m < d; m++)
+								{
+									for (int c = 0; c < cn; c++) neighbor[kstep * (p + c) + d * n + m] = (float)sb[cn * m + c];
+								}
+							}
+							else
+							{
+								const float* sb = s.ptr<float>(y0 + n) + cn * x0;
+								for (int m = 0; m < d; m++)
+								{
+									for (int c = 0; c < cn; c++) neighbor[kstep * (p + c) + d * n + m] = sb[cn * m + c];
+								}
+							}
+						}
+						p += cn;
+					}
+
+					for (int n = 0; n < scale; n++)
+					{
+						const int y = y0 * scale + n;
+						const GT* guide_ptr = guide->ptr<GT>(y); // reference
+						for (int m = 0; m < scale; m++)
+						{
+							const int x = x0 * scale + m;
+							const float* weightmap_ptr = weightmap->ptr<float>(n * scale + m);
+
+							//shared weight computation
+							__m256 mg[gcn];
+							for (int c = 0; c < gcn; c++) mg[c] = _mm256_set1_ps((float)guide_ptr[gcn * x + c]);
+							__m256 mwsum = _mm256_setzero_ps();
+							for (int k = 0; k < kstep; k += 8)
+							{
+								__m256 mw = _mm256_load_ps(weightmap_ptr + k);
+								for (int c = 0; c < gcn; c++)
+								{
+									const __m256i midx = _mm256_min_epi32(_mm256_cvtps_epi32(_mm256_and_ps(_mm256_sub_ps(mg[c], _mm256_load_ps(gneighbor + kstep * c + k)), v32f_absmask)), mlutmax);
+									mw = _mm256_mul_ps(mw, _mm256_i32gather_ps(range_weight, midx, sizeof(float)));
+								}
+								_mm256_store_ps(weight + k, mw);
+								mwsum = _mm256_add_ps(mw, mwsum);
+							}
+							const float wsum = _mm256_reduceadd_ps(mwsum);
+							const bool isValid = wsum > 0.f;
+							const float normal = (isValid) ? 1.f / wsum : 0.f;
+
+							for (int i = 0, p = 0; i < maps; i++)
+							{
+								Mat& dst = (*dest)[i];
+								const int cn = dst.channels();
+								for (int c = 0; c < cn; c++, p++)
+								{
+									const float* nb = neighbor + kstep * p;
+									float v;
+									if (isValid)
+									{
+										__m256 mv = _mm256_setzero_ps();
+										for (int k = 0; k < kstep; k += 8)
+										{
+											mv = _mm256_fmadd_ps(_mm256_load_ps(weight + k), _mm256_load_ps(nb + k), mv);
+										}
+										v = _mm256_reduceadd_ps(mv) * normal;
+									}
+									else
+									{
+										v = nb[ksize / 2];//all weights are underflowed: nearest value
+									}
+
+									if (dst.depth() == CV_8U) dst.ptr<uchar>(y)[cn * x + c] = saturate_cast<uchar>(v);
+									else dst.ptr<float>(y)[cn * x + c] = v;
+								}
+							}
+						}
+					}
+				}
+			}
+
+			_mm_free(gneighbor);
+			_mm_free(neighbor);
+			_mm_free(weight);
+		}
+	};
+
+	void JointBilateralUpsample::computeBatchWeight(const int scale, const int r, const double sigma_r, const double sigma_s, const int guide_channels)
+	{
+		//weights are kept across frames as long as the parameters are the same
+		if (scale == scale_weight && r == r_weight && sigma_r == sigma_r_weight && sigma_s == sigma_s_weight && guide_channels == guide_channels_weight
+			&& !weightmap_batch.empty() && !range_weight_batch.empty()) return;
+
+		const int d = 2 * r + 1;
+		const int kstep = get_simd_ceil(d * d, 8);
+		weightmap_batch.create(scale * scale, kstep, CV_32F);
+		weightmap_batch.setTo(0.f);
+		const float spaceCoeff = float(1.0 / (-2.0 * sigma_s * sigma_s * scale * scale));
+		float space_w_min = FLT_MAX;
+		for (int j = 0; j < scale; j++)
+		{
+			for (int i = 0; i < scale; i++)
+			{
+				float* wmap = weightmap_batch.ptr<float>(j * scale + i);
+				int count = 0;
+				float wsum = 0.f;
+				for (int n = 0; n < d; n++)
+				{
+					for (int m = 0; m < d; m++)
+					{
+						float xf = abs(m - r) + (float)i / scale;
+						float yf = abs(n - r) + (float)j / scale;
+						float dist = hypot(xf, yf);
+						float w = fmath::exp(dist * dist * spaceCoeff);
+						wsum += w;
+						wmap[count++] = w;
+					}
+				}
+				wsum = 1.f / wsum;
+				for (int n = 0; n < d * d; n++)
+				{
+					float v = wmap[n] * wsum;
+					v = (v < FLT_MIN) ? 0.f : v;
+					wmap[n] = v;
+					space_w_min = min(v, space_w_min);
+				}
+			}
+		}
+
+		range_weight_batch.create(1, 256, CV_32F);
+		float* range_weight = range_weight_batch.ptr<float>();
+		for (int i = 0; i < 256; i++)
+		{
+			float v = fmath::exp(i * i / (-2.f * float(sigma_r * sigma_r)));
+			range_weight[i] = float(v * space_w_min < FLT_MIN) ? 0.f : v;
+		}
+
+		scale_weight = scale;
+		r_weight = r;
+		sigma_r_weight = sigma_r;
+		sigma_s_weight = sigma_s;
+		guide_channels_weight = guide_channels;
+	}
+
+	void JointBilateralUpsample::upsampleBatchScale(const std::vector<cv::Mat>& src, const cv::Mat& guide, std::vector<cv::Mat>& dest, const std::vector<int>& ddepth, const int scale, const int r, const double sigma_r, const double sigma_s)
+	{
+		CV_Assert(!src.empty());
+		CV_Assert(guide.depth() == CV_8U || guide.depth() == CV_32F);
+		CV_Assert(guide.channels() == 1 || guide.channels() == 3);
+		CV_Assert(ddepth.empty() || ddepth.size() == src.size());
+		const Size lowsize = src[0].size();
+		CV_Assert(guide.size() == lowsize * scale);
+
+		const int maps = (int)src.size();
+		const int border = BORDER_REPLICATE;
+		srcs_b.resize(maps);
+		for (int i = 0; i < maps; i++)
+		{
+			CV_Assert(src[i].size() == lowsize);
+			CV_Assert(src[i].depth() == CV_8U || src[i].depth() == CV_32F);
+			copyMakeBorder(src[i], srcs_b[i], r, r, r, r, border);
+		}
+		cp::downsample(guide, guide_low, scale, cp::Downsample(INTER_NEAREST), 0);
+		copyMakeBorder(guide_low, guide_low_b, r, r, r, r, border);
+
+		computeBatchWeight(scale, r, sigma_r, sigma_s, guide.channels());
+
+		//src is not accessed after here, so that dest can be src
+		dest.resize(maps);
+		for (int i = 0; i < maps; i++)
+		{
+			const int depth = (ddepth.empty()) ? srcs_b[i].depth() : ddepth[i];
+			CV_Assert(depth == CV_8U || depth == CV_32F);
+			dest[i].create(guide.size(), CV_MAKETYPE(depth, srcs_b[i].channels()));
+		}
+
+		const float* range_weight = range_weight_batch.ptr<float>();
+		const Range range(0, lowsize.height);
+		const double nstripes = lowsize.height;
+		if (guide.type() == CV_8UC1) cv::parallel_for_(range, JointBilateralUpsampleBatch_ParallelBody<uchar, 1>(srcs_b, guide_low_b, guide, weightmap_batch, dest, scale, r, range_weight), nstripes);
+		else if (guide.type() == CV_8UC3) cv::parallel_for_(range, JointBilateralUpsampleBatch_ParallelBody<uchar, 3>(srcs_b, guide_low_b, guide, weightmap_batch, dest, scale, r, range_weight), nstripes);
+		else if (guide.type() == CV_32FC1) cv::parallel_for_(range, JointBilateralUpsampleBatch_ParallelBody<float, 1>(srcs_b, guide_low_b, guide, weightmap_batch, dest, scale, r, range_weight), nstripes);
+		else if (guide.type() == CV_32FC3) cv::parallel_for_(range, JointBilateralUpsampleBatch_ParallelBody<float, 3>(srcs_b, guide_low_b, guide, weightmap_batch, dest, scale, r, range_weight), nstripes);
+	}
+
+	void JointBilateralUpsample::upsampleBatch(const std::vector<cv::Mat>& src, cv::InputArray guide, std::vector<cv::Mat>& dest, const int r, const double sigma_r, const double sigma_s)
+	{
+		CV_Assert(!src.empty());
+		const int scale = guide.size().width / src[0].cols;
+		upsampleBatchScale(src, guide.getMat(), dest, std::vector<int>(), scale, r, sigma_r, sigma_s);
+	}
+
+	void JointBilateralUpsample::upsampleCascade(const std::vector<cv::Mat>& src, cv::InputArray guide, std::vector<cv::Mat>& dest, const int r, const double sigma_r, const double sigma_s)
+	{
+		CV_Assert(!src.empty());
+		const int scale = guide.size().width / src[0].cols;
+		CV_Assert(scale >= 1 && (scale & (scale - 1)) == 0);
+		CV_Assert(guide.size() == src[0].size() * scale);
+		int level = 0;
+		while ((1 << level) < scale) level++;
+
+		const int maps = (int)src.size();
+		if (level == 0)
+		{
+			dest.resize(maps);
+			for (int i = 0; i < maps; i++) src[i].copyTo(dest[i]);
+			return;
+		}
+
+		//guide pyramid: guide_pyramid[k] is 1/2^k of the guide
+		guide_pyramid.resize(level);
+		guide_pyramid[0] = guide.getMat();
+		for (int k = 1; k < level; k++)
+		{
+			cp::downsample(guide_pyramid[k - 1], guide_pyramid[k], 2, cp::Downsample::INTER_AREA);
+		}
+
+		//intermediate stages are computed in 32F, and the last stage outputs the source depth
+		cascade_depth.resize(maps);
+		for (int i = 0; i < maps; i++) cascade_depth[i] = src[i].depth();
+		const std::vector<int> depth32f(maps, CV_32F);
+
+		const std::vector<cv::Mat>* in = &src;
+		for (int k = level - 1; k >= 0; k--)
+		{
+			std::vector<cv::Mat>* out = (k == 0) ? &dest : &cascade_buffer[k & 1];
+			upsampleBatchScale(*in, guide_pyramid[k], *out, (k == 0) ? cascade_depth : depth32f, 2, r, sigma_r, sigma_s);
+			in = out;
+		}
+		guide_pyramid[0].release();//do not hold the input guide
+	}
+
+	void JointBilateralUpsample::upsampleCascade(cv::InputArray src, cv::InputArray guide, cv::OutputArray dest, const int r, const double sigma_r, const double sigma_s)
+	{
+		std::vector<cv::Mat> s(1, src.getMat());
+		dest.create(guide.size(), src.type());
+		std::vector<cv::Mat> d(1, dest.getMat());//written in place
+		upsampleCascade(s, guide, d, r, sigma_r, sigma_s);
+	}
+#pragma endregion
 }
\ No newline at end of file
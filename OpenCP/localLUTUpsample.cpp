@@ -1470,6 +1470,7 @@ namespace cp
 			Mat lutmap(lut_num, lut_num, CV_8UC3);
 			for (int x = 0; x < lowres_size.width; x++)
 			{
+				if (!lut_update_mask.empty() && lut_update_mask.at<uchar>(y, x) == 0) continue;//incremental mode: keep the cached LUT
 				//px̏Wv
 				uchar* lutb = LUT_TensorAoS_B.ptr<uchar>(y) + lut_num * x;//LUT_B.channels()=lut_num
 				uchar* lutg = LUT_TensorAoS_G.ptr<uchar>(y) + lut_num * x;
@@ -2089,6 +2090,7 @@ namespace cp
 				uchar* lut_buff = (uchar*)_mm_malloc(lut_num + 2 * lut_filter_radius, 32);
 				for (int x = 0; x < lowres_size.width; x++)
 				{
+					if (!lut_update_mask.empty() && lut_update_mask.at<uchar>(y, x) == 0) continue;//incremental mode: keep the cached LUT
 					uchar* lutb = LUT_TensorAoS_B.ptr<uchar>(y) + lut_num * x;//LUT_B.channels()=lut_num
 					memset(lutb, 0, sizeof(uchar) * lut_num);
 
@@ -2218,6 +2220,7 @@ namespace cp
 
 				for (int x = 0; x < lowres_size.width; x++)
 				{
+					if (!lut_update_mask.empty() && lut_update_mask.at<uchar>(y, x) == 0) continue;//incremental mode: keep the cached LUT
 					if constexpr (!isSoA)
 					{
 						lutb = LUT_TensorAoS_B.ptr<uchar>(y) + lut_num * x;//LUT_B.channels()=lut_num
@@ -2508,6 +2511,7 @@ namespace cp
 			Mat from(lut_num, lut_num, CV_8UC3);//DP map (left top: 0, left: 1, up: 2)	
 			for (int x = 0; x < lowres_size.width; x++)
 			{
+				if (!lut_update_mask.empty() && lut_update_mask.at<uchar>(y, x) == 0) continue;//incremental mode: keep the cached LUT
 				lutmap.setTo(0);
 				from.setTo(0);
 
@@ -2973,6 +2977,7 @@ namespace cp
 				uchar* lutbptr = LUT_TensorAoS_B.ptr<uchar>(y0);
 				for (int x = 0; x < src_highres.cols; x += scale)
 				{
+					if (isReuseBlock(x, y)) continue;
 					const int x0 = (int)(x / up_sampling_ratio_resolution);
 
 					uchar* lutb = lutbptr + lut_num * x0;
@@ -3037,6 +3042,7 @@ namespace cp
 
 				for (int x = 0; x < src_highres.cols; x += scale)
 				{
+					if (isReuseBlock(x, y)) continue;
 					const int x0 = (int)(x / up_sampling_ratio_resolution);
 
 					uchar* lutb = lutbptr + lut_num * x0;
@@ -3169,6 +3175,7 @@ namespace cp
 
 				for (int x = 0; x < src_highres.cols; x += scale)
 				{
+					if (isReuseBlock(x, y)) continue;
 					const int x0 = (int)(x / up_sampling_ratio_resolution);
 					const int x1 = min(x0 + 1, swidth - 1);
 
@@ -3255,6 +3262,7 @@ namespace cp
 
 				for (int x = 0; x < src_highres.cols; x += scale)
 				{
+					if (isReuseBlock(x, y)) continue;
 					const int x0 = (int)(x / up_sampling_ratio_resolution);
 					const int x1 = min(x0 + 1, swidth - 1);
 					const int X0 = x0 * lut_num;
@@ -3498,6 +3506,7 @@ namespace cp
 
 				for (int x = 0; x < src_highres.cols; x += scale)
 				{
+					if (isReuseBlock(x, y)) continue;
 					const int x_ = (int)(x / up_sampling_ratio_resolution);
 					const int x0 = max(0, x_ - 1);
 					const int x1 = x_;
@@ -3613,6 +3622,7 @@ namespace cp
 				const __m256i mtwo = _mm256_set1_epi32(2);
 				for (int x = 0; x < src_highres.cols; x += scale)
 				{
+					if (isReuseBlock(x, y)) continue;
 					const int x_ = (int)(x / up_sampling_ratio_resolution);
 					const __m128i mx = _mm_min_epi32(mxmax, _mm_max_epi32(_mm_setzero_si128(), _mm_add_epi32(_mm_set1_epi32(x_), mxstep)));
 					const __m128i mxlut = _mm_mullo_epi32(mlut_num, mx);
@@ -3805,6 +3815,7 @@ namespace cp
 				const int OY3 = y3 * offset_map.cols;
 				for (int x = 0; x < src_highres.cols; x += scale)
 				{
+					if (isReuseBlock(x, y)) continue;
 					const int x_ = (int)(x / up_sampling_ratio_resolution);
 					const int x0 = max(0, x_ - 1);
 					const int x1 = x_;
@@ -3937,6 +3948,7 @@ namespace cp
 				const int OY3 = y3 * offset_map.cols;
 				for (int x = 0; x < src_highres.cols; x += scale)
 				{
+					if (isReuseBlock(x, y)) continue;
 					const int x_ = (int)(x / up_sampling_ratio_resolution);
 					const int x0 = max(0, x_ - 1);
 					const int x1 = x_;
@@ -4196,6 +4208,7 @@ namespace cp
 				const int OY7 = y3 * offset_map.cols;
 				for (int x = 0; x < src_highres.cols; x += scale)
 				{
+					if (isReuseBlock(x, y)) continue;
 					const int x_ = (int)(x / up_sampling_ratio_resolution);
 					const int x0 = max(0, x_ - 3);
 					const int x1 = max(0, x_ - 2);
@@ -4400,6 +4413,7 @@ namespace cp
 				const __m256i mtwo = _mm256_set1_epi32(2);
 				for (int x = 0; x < src_highres.cols; x += scale)
 				{
+					if (isReuseBlock(x, y)) continue;
 					const int x_ = (int)(x / up_sampling_ratio_resolution);
 					const __m256i mx = _mm256_min_epi32(mxmax, _mm256_max_epi32(_mm256_setzero_si256(), _mm256_add_epi32(_mm256_set1_epi32(x_), mxstep)));
 					const __m256i mlutidxX = _mm256_mullo_epi32(mlut_num, mx);
@@ -6898,6 +6912,107 @@ namespace cp
 
 #pragma endregion
 
+#pragma endregion
+
+#pragma region incremental
+	void LocalLUTUpsample::clearIncrementalCache()
+	{
+		cache_key.clear();
+		ref_src_low.release();
+		ref_prc_low.release();
+		ref_src_high.release();
+		cache_prc_high.release();
+		lut_update_mask.release();
+		tensor_skip_mask.release();
+	}
+
+	//mark the low resolution pixels whose input or output moved more than the threshold from the reference and update the reference there.
+	//Smaller drifts are kept in the reference, so that they accumulate until they exceed the threshold.
+	static void updateChangedPixels(const Mat& src, Mat& ref, Mat& changed, const int threshold)
+	{
+		const int cn = src.channels();
+#pragma omp parallel for schedule(static)
+		for (int y = 0; y < src.rows; y++)
+		{
+			const uchar* s = src.ptr<uchar>(y);
+			uchar* r = ref.ptr<uchar>(y);
+			uchar* c = changed.ptr<uchar>(y);
+			for (int x = 0; x < src.cols; x++)
+			{
+				int diff = 0;
+				for (int k = cn * x; k < cn * (x + 1); k++) diff = max(diff, abs(s[k] - r[k]));
+				if (diff > threshold)
+				{
+					c[x] = 255;
+					memcpy(r + cn * x, s + cn * x, cn);
+				}
+			}
+		}
+	}
+
+	void LocalLUTUpsample::updateIncrementalMask(const Mat& src_low, const Mat& prc_low, const Mat& src_high, const int r, const vector<double>& key)
+	{
+		lut_update_mask.release();
+		tensor_skip_mask.release();
+		lut_update_ratio = 1.0;
+		if (!isIncremental) return;
+
+		const bool isFull = key != cache_key || cache_prc_high.empty()
+			|| ref_src_low.size() != src_low.size() || ref_src_low.type() != src_low.type() || ref_prc_low.type() != prc_low.type()
+			|| ref_src_high.size() != src_high.size() || ref_src_high.type() != src_high.type();
+		if (isFull)
+		{
+			cache_key = key;
+			src_low.copyTo(ref_src_low);
+			prc_low.copyTo(ref_prc_low);
+			src_high.copyTo(ref_src_high);
+			return;
+		}
+
+		Mat changed = Mat::zeros(src_low.size(), CV_8U);
+		updateChangedPixels(src_low, ref_src_low, changed, incremental_threshold);
+		updateChangedPixels(prc_low, ref_prc_low, changed, incremental_threshold);
+
+		//a LUT is built from the (2r+1)x(2r+1) window
+		dilate(changed, lut_update_mask, Mat::ones(2 * r + 1, 2 * r + 1, CV_8U));
+		lut_update_ratio = countNonZero(lut_update_mask) / (double)lut_update_mask.size().area();
+
+		//an output block reads up to 8x8 LUTs (4 on each side) and its own high resolution source block
+		Mat stale;
+		dilate(lut_update_mask, stale, Mat::ones(9, 9, CV_8U));
+		const int scale = int(up_sampling_ratio_resolution);
+		const int bw = (src_high.cols + scale - 1) / scale;
+		const int bh = (src_high.rows + scale - 1) / scale;
+		const int esize = (int)src_high.elemSize();
+		tensor_skip_mask.create(bh, bw, CV_8U);
+#pragma omp parallel for schedule(static)
+		for (int by = 0; by < bh; by++)
+		{
+			const int ys = by * scale;
+			const int ye = min(ys + scale, src_high.rows);
+			const uchar* st = stale.ptr<uchar>(min(by, stale.rows - 1));
+			uchar* skip = tensor_skip_mask.ptr<uchar>(by);
+			for (int bx = 0; bx < bw; bx++)
+			{
+				const int xs = esize * bx * scale;
+				const int w = esize * (min((bx + 1) * scale, src_high.cols) - bx * scale);
+				bool isSame = true;
+				for (int y = ys; y < ye; y++)
+				{
+					if (memcmp(src_high.ptr<uchar>(y) + xs, ref_src_high.ptr<uchar>(y) + xs, w) != 0)
+					{
+						isSame = false;
+						break;
+					}
+				}
+				if (!isSame)
+				{
+					for (int y = ys; y < ye; y++) memcpy(ref_src_high.ptr<uchar>(y) + xs, src_high.ptr<uchar>(y) + xs, w);
+				}
+				skip[bx] = (isSame && st[min(bx, stale.cols - 1)] == 0) ? 1 : 0;
+			}
+		}
+	}
 #pragma endregion
 
 	void LocalLUTUpsample::upsample(InputArray src_low, InputArray prc_low, InputArray src_high, OutputArray prc_high, const int r, const int lut_num, const int lut_filter_radius, const BUILD_LUT build_lut_method, const UPTENSOR tensorup_method, const BOUNDARY lut_boundary_method, const bool isUseOffsetMap)
@@ -6919,6 +7034,20 @@ namespace cp
 		lowres_size = src_low.size();
 		createLUTTensor(lowres_size.width, lowres_size.height, lut_num);
 
+		//incremental mode: LUTs to rebuild and output blocks to reuse
+		const vector<double> key =
+		{
+			double(r), double(lut_num), double(lut_filter_radius), double(int(build_lut_method)), double(int(tensorup_method)), double(int(lut_boundary_method)), double(isUseOffsetMap),
+			double(tensor_up_kernel_size), tensor_up_sigma_space, tensor_up_sigma_range, tensor_up_cubic_alpha, double(boundary_replicate_offset)
+		};
+		updateIncrementalMask(src_low.getMat(), prc_low.getMat(), src, r, key);
+		Mat dst = dest;
+		if (isIncremental)
+		{
+			cache_prc_high.create(src.size(), dest.type());
+			dst = cache_prc_high;
+		}
+
 		copyMakeBorder(src_low, src_low_border, r, r, r, r, border);
 		cp::bitshiftRight(src_low_border, src_low_border, shift);//if shift==0, there is no processing
 		if (shift == 0)
@@ -6959,35 +7088,36 @@ namespace cp
 			switch (tensorup_method)
 			{
 			case UPTENSOR::NEAREST:
-				tensorUpNearestLinear(src, dest, lut_num, isUseOffsetMap); break;
+				tensorUpNearestLinear(src, dst, lut_num, isUseOffsetMap); break;
 			case UPTENSOR::BOX4:
-				tensorUpBox4Linear(src, dest, lut_num, isUseOffsetMap); break;
+				tensorUpBox4Linear(src, dst, lut_num, isUseOffsetMap); break;
 			case UPTENSOR::BOX16:
-				tensorUpBox16Linear(src, dest, lut_num, isUseOffsetMap); break;
+				tensorUpBox16Linear(src, dst, lut_num, isUseOffsetMap); break;
 			case UPTENSOR::BOX64:
-				tensorUpBox64Linear(src, dest, lut_num, isUseOffsetMap); break;
+				tensorUpBox64Linear(src, dst, lut_num, isUseOffsetMap); break;
 			case UPTENSOR::GAUSS4:
-				tensorUpGauss4Linear(src, dest, lut_num, tensor_up_sigma_space, isUseOffsetMap); break;
+				tensorUpGauss4Linear(src, dst, lut_num, tensor_up_sigma_space, isUseOffsetMap); break;
 			case UPTENSOR::GAUSS16:
 			default:
-				tensorUpGauss16Linear(src, dest, lut_num, tensor_up_sigma_space, isUseOffsetMap); break;
+				tensorUpGauss16Linear(src, dst, lut_num, tensor_up_sigma_space, isUseOffsetMap); break;
 			case UPTENSOR::GAUSS64:
-				tensorUpGauss64Linear(src, dest, lut_num, tensor_up_sigma_space, isUseOffsetMap); break;
+				tensorUpGauss64Linear(src, dst, lut_num, tensor_up_sigma_space, isUseOffsetMap); break;
 			case UPTENSOR::LINEAR:
-				tensorUpTriLinear(src, dest, lut_num, isUseOffsetMap); break;
+				tensorUpTriLinear(src, dst, lut_num, isUseOffsetMap); break;
 			case UPTENSOR::CUBIC:
-				tensorUpBiCubicLinear(src, dest, lut_num, tensor_up_cubic_alpha, isUseOffsetMap); break;
+				tensorUpBiCubicLinear(src, dst, lut_num, tensor_up_cubic_alpha, isUseOffsetMap); break;
 			case UPTENSOR::BILATERAL16:
-				tensorUpBilateral16Linear(src, dest, lut_num, tensor_up_sigma_space, tensor_up_sigma_range, isUseOffsetMap); break;
+				tensorUpBilateral16Linear(src, dst, lut_num, tensor_up_sigma_space, tensor_up_sigma_range, isUseOffsetMap); break;
 			case UPTENSOR::BILATERAL64:
-				tensorUpBilateral64Linear(src, dest, lut_num, tensor_up_sigma_space, tensor_up_sigma_range, isUseOffsetMap); break;
+				tensorUpBilateral64Linear(src, dst, lut_num, tensor_up_sigma_space, tensor_up_sigma_range, isUseOffsetMap); break;
 			case UPTENSOR::BoxNxN:
-				tensorUpBoxNxNLinear(src, dest, tensor_up_kernel_size); break;
+				tensorUpBoxNxNLinear(src, dst, tensor_up_kernel_size); break;
 			case UPTENSOR::GaussNxN:
-				tensorUpGaussNxNLinear(src, dest, tensor_up_kernel_size, tensor_up_sigma_space); break;
+				tensorUpGaussNxNLinear(src, dst, tensor_up_kernel_size, tensor_up_sigma_space); break;
 			case UPTENSOR::LaplaceNxN:
-				tensorUpLaplaceNxNLinear(src, dest, tensor_up_kernel_size, tensor_up_sigma_space); break;
+				tensorUpLaplaceNxNLinear(src, dst, tensor_up_kernel_size, tensor_up_sigma_space); break;
 			}
 		}
+		if (isIncremental) cache_prc_high.copyTo(dest);
 	}
 }
\ No newline at end of file
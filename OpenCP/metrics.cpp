@@ -7,6 +7,7 @@
 #include "color.hpp"
 #include "debugcp.hpp"
 #include "statistic.hpp"
+#include <omp.h>
 
 using namespace std;
 using namespace cv;
@@ -1693,4 +1694,266 @@ namespace cp
 		return cp::average(ssim_map, r, r, r, r);
 	}
 #pragma endregion
+
+#pragma region QualityMetricsAccumulator
+	void QualityMetricsAccumulator::Moments::clear()
+	{
+		mse_count = 0.0;
+		mse_sum = 0.0;
+		ssim_count = 0.0;
+		ssim_sum = 0.0;
+		gmsd_count = 0.0;
+		gmsd_sum = 0.0;
+		gmsd_sum2 = 0.0;
+	}
+
+	void QualityMetricsAccumulator::Moments::merge(const Moments& src)
+	{
+		mse_count += src.mse_count;
+		mse_sum += src.mse_sum;
+		ssim_count += src.ssim_count;
+		ssim_sum += src.ssim_sum;
+		gmsd_count += src.gmsd_count;
+		gmsd_sum += src.gmsd_sum;
+		gmsd_sum2 += src.gmsd_sum2;
+	}
+
+	QualityMetricsAccumulator::QualityMetricsAccumulator(const int metrics, const double ssim_sigma, const double gmsd_c, const bool isDownsample)
+		: metrics(metrics), ssim_sigma(ssim_sigma), gmsd_c(gmsd_c), isDownsample(isDownsample)
+	{
+		;
+	}
+
+	void QualityMetricsAccumulator::clear()
+	{
+		frames = 0;
+		moments.clear();
+	}
+
+	void QualityMetricsAccumulator::merge(const QualityMetricsAccumulator& src)
+	{
+		frames += src.frames;
+		moments.merge(src.moments);
+	}
+
+	void QualityMetricsAccumulator::merge(const Moments& src)
+	{
+		moments.merge(src);
+	}
+
+	const QualityMetricsAccumulator::Moments& QualityMetricsAccumulator::getMoments() const
+	{
+		return moments;
+	}
+
+	int QualityMetricsAccumulator::getNumFrames() const
+	{
+		return frames;
+	}
+
+	double QualityMetricsAccumulator::getMSE() const
+	{
+		if (moments.mse_count == 0.0) return 0.0;
+		return moments.mse_sum / moments.mse_count;
+	}
+
+	double QualityMetricsAccumulator::getPSNR() const
+	{
+		return MSEtoPSNR(getMSE());
+	}
+
+	double QualityMetricsAccumulator::getSSIM() const
+	{
+		if (moments.ssim_count == 0.0) return 0.0;
+		return moments.ssim_sum / moments.ssim_count;
+	}
+
+	double QualityMetricsAccumulator::getGMSD() const
+	{
+		if (moments.gmsd_count == 0.0) return 0.0;
+		const double mean = moments.gmsd_sum / moments.gmsd_count;
+		return sqrt(max(0.0, moments.gmsd_sum2 / moments.gmsd_count - mean * mean));
+	}
+
+	void QualityMetricsAccumulator::convertGray(const Mat& src, Mat& dest)
+	{
+		Mat temp;
+		src.convertTo(temp, CV_32F);
+		if (temp.channels() == 3) cvtColor(temp, temp, COLOR_BGR2GRAY);
+		if (isDownsample) resize(temp, dest, Size(), 0.5, 0.5, INTER_AREA);
+		else temp.copyTo(dest);
+	}
+
+	void QualityMetricsAccumulator::accumulateMSE(const Mat& src, const Mat& ref, const int ystart, const int yend, Moments& dest)
+	{
+		if (ystart >= yend) return;
+		const Rect roi(0, ystart, src.cols, yend - ystart);
+		dest.mse_sum += cv::norm(src(roi), ref(roi), NORM_L2SQR);
+		dest.mse_count += (double)roi.area() * src.channels();
+	}
+
+	//SSIM with valid pooling: rows are extended by r for the Gaussian window, so that band results are identical to the full image one.
+	void QualityMetricsAccumulator::accumulateSSIM(const Mat& I1, const Mat& I2, const int ystart, const int yend, Moments& dest)
+	{
+		const int D = (int)ceil(ssim_sigma * 3.0) * 2 + 1;
+		const int r = D / 2;
+		const Size kernelSize = Size(D, D);
+		constexpr float C1 = 6.5025f, C2 = 58.5225f;
+
+		const int ys = max(ystart, r);
+		const int ye = min(yend, I1.rows - r);
+		if (ys >= ye || I1.cols <= 2 * r) return;
+
+		const Rect roi(0, ys - r, I1.cols, ye - ys + 2 * r);
+		const Mat i1 = I1(roi);
+		const Mat i2 = I2(roi);
+
+		//blurred moments are shared for all SSIM terms
+		Mat mu1, mu2, s11, s22, s12;
+		GaussianBlur(i1, mu1, kernelSize, ssim_sigma);
+		GaussianBlur(i2, mu2, kernelSize, ssim_sigma);
+		GaussianBlur(i1.mul(i1), s11, kernelSize, ssim_sigma);
+		GaussianBlur(i2.mul(i2), s22, kernelSize, ssim_sigma);
+		GaussianBlur(i1.mul(i2), s12, kernelSize, ssim_sigma);
+
+		const int xend = I1.cols - r;
+		const int simdend = r + get_simd_floor(xend - r, 8);
+		const __m256 mC1 = _mm256_set1_ps(C1);
+		const __m256 mC2 = _mm256_set1_ps(C2);
+		const __m256 m2 = _mm256_set1_ps(2.f);
+		double sum = 0.0;
+		for (int j = r; j < r + ye - ys; j++)
+		{
+			const float* m1 = mu1.ptr<float>(j);
+			const float* m2p = mu2.ptr<float>(j);
+			const float* v1 = s11.ptr<float>(j);
+			const float* v2 = s22.ptr<float>(j);
+			const float* v12 = s12.ptr<float>(j);
+			__m256 msum = _mm256_setzero_ps();
+			for (int i = r; i < simdend; i += 8)
+			{
+				const __m256 a = _mm256_loadu_ps(m1 + i);
+				const __m256 b = _mm256_loadu_ps(m2p + i);
+				const __m256 ab = _mm256_mul_ps(a, b);
+				const __m256 aa = _mm256_mul_ps(a, a);
+				const __m256 bb = _mm256_mul_ps(b, b);
+				const __m256 cov = _mm256_sub_ps(_mm256_loadu_ps(v12 + i), ab);
+				const __m256 var = _mm256_sub_ps(_mm256_add_ps(_mm256_loadu_ps(v1 + i), _mm256_loadu_ps(v2 + i)), _mm256_add_ps(aa, bb));
+				const __m256 n = _mm256_mul_ps(_mm256_fmadd_ps(m2, ab, mC1), _mm256_fmadd_ps(m2, cov, mC2));
+				const __m256 d = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(aa, bb), mC1), _mm256_add_ps(var, mC2));
+				msum = _mm256_add_ps(msum, _mm256_div_ps(n, d));
+			}
+			double rowsum = _mm256_reduceadd_pspd(msum);
+			for (int i = simdend; i < xend; i++)
+			{
+				const float ab = m1[i] * m2p[i];
+				const float aa = m1[i] * m1[i];
+				const float bb = m2p[i] * m2p[i];
+				const float n = (2.f * ab + C1) * (2.f * (v12[i] - ab) + C2);
+				const float d = (aa + bb + C1) * (v1[i] + v2[i] - aa - bb + C2);
+				rowsum += n / d;
+			}
+			sum += rowsum;
+		}
+		dest.ssim_sum += sum;
+		dest.ssim_count += (double)(ye - ys) * (xend - r);
+	}
+
+	//GMSD: rows are extended by 1 for the Prewitt gradient, so that band results are identical to the full image one.
+	void QualityMetricsAccumulator::accumulateGMSD(const Mat& ref, const Mat& src, const int ystart, const int yend, Moments& dest)
+	{
+		if (ystart >= yend) return;
+		const float alpha = 0.5f;
+		const int top = (ystart == 0) ? 0 : 1;
+		const int bottom = (yend == ref.rows) ? 0 : 1;
+		const Rect roi(0, ystart - top, ref.cols, yend - ystart + top + bottom);
+
+		Mat gradientRef, gradientSrc;
+		gradientSquarePrewitt32F(ref(roi).clone(), gradientRef);
+		gradientSquarePrewitt32F(src(roi).clone(), gradientSrc);
+
+		const int width = ref.cols;
+		const int simdsize = get_simd_floor(width, 8);
+		const float c = (float)max(gmsd_c, (double)FLT_MIN);
+		const __m256 m2a = _mm256_set1_ps(2.f - alpha);
+		const __m256 ma = _mm256_set1_ps(-alpha);
+		const __m256 mc = _mm256_set1_ps(c);
+		double sum = 0.0;
+		double sum2 = 0.0;
+		for (int j = top; j < roi.height - bottom; j++)
+		{
+			const float* r = gradientRef.ptr<float>(j);
+			const float* s = gradientSrc.ptr<float>(j);
+			__m256 msum = _mm256_setzero_ps();
+			__m256 msum2 = _mm256_setzero_ps();
+			for (int i = 0; i < simdsize; i += 8)
+			{
+				const __m256 mr = _mm256_loadu_ps(r + i);
+				const __m256 ms = _mm256_loadu_ps(s + i);
+				const __m256 mv = _mm256_sqrt_ps(_mm256_mul_ps(mr, ms));
+				const __m256 mn = _mm256_fmadd_ps(m2a, mv, mc);
+				const __m256 md = _mm256_add_ps(_mm256_add_ps(mr, ms), _mm256_fmadd_ps(ma, mv, mc));
+				const __m256 mq = _mm256_div_ps(mn, md);
+				msum = _mm256_add_ps(msum, mq);
+				msum2 = _mm256_fmadd_ps(mq, mq, msum2);
+			}
+			sum += _mm256_reduceadd_pspd(msum);
+			sum2 += _mm256_reduceadd_pspd(msum2);
+			for (int i = simdsize; i < width; i++)
+			{
+				const float v = sqrt(r[i] * s[i]);
+				const float q = ((2.f - alpha) * v + c) / (r[i] + s[i] - alpha * v + c);
+				sum += q;
+				sum2 += q * q;
+			}
+		}
+		dest.gmsd_sum += sum;
+		dest.gmsd_sum2 += sum2;
+		dest.gmsd_count += (double)(yend - ystart) * width;
+	}
+
+	void QualityMetricsAccumulator::accumulate(InputArray src_, InputArray ref_, const int numBands)
+	{
+		CV_Assert(src_.size() == ref_.size());
+		CV_Assert(src_.channels() == ref_.channels());
+
+		const Mat src = src_.getMat();
+		const Mat ref = ref_.getMat();
+		const bool isGray = (metrics & (METRIC_SSIM | METRIC_GMSD)) != 0;
+		if (isGray)
+		{
+			convertGray(src, gsrc);
+			convertGray(ref, gref);
+		}
+
+		const int bands = max(1, min(src.rows, (numBands <= 0) ? omp_get_max_threads() * 4 : numBands));
+		bandMoments.resize(bands);
+
+#pragma omp parallel for schedule(dynamic)
+		for (int b = 0; b < bands; b++)
+		{
+			Moments& m = bandMoments[b];
+			m.clear();
+			if (metrics & METRIC_MSE)
+			{
+				accumulateMSE(src, ref, src.rows * b / bands, src.rows * (b + 1) / bands, m);
+			}
+			if (metrics & METRIC_SSIM)
+			{
+				accumulateSSIM(gsrc, gref, gsrc.rows * b / bands, gsrc.rows * (b + 1) / bands, m);
+			}
+			if (metrics & METRIC_GMSD)
+			{
+				accumulateGMSD(gref, gsrc, gsrc.rows * b / bands, gsrc.rows * (b + 1) / bands, m);
+			}
+		}
+
+		//merge in fixed order for deterministic results
+		for (int b = 0; b < bands; b++)
+		{
+			moments.merge(bandMoments[b]);
+		}
+		frames++;
+	}
+#pragma endregion
 }
\ No newline at end of file
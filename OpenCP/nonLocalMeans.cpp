@@ -14,6 +14,7 @@ namespace cp
 		return _mm_castps_si128(_mm_movelh_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b)));
 	}
 #define _mm256_fastsqrt_ps _mm256_sqrt_ps
+#define USE_NLM_SEARCH_SPECIALIZATION
 	
 #pragma region NLM no optimization
 	template <class srcType>
@@ -198,6 +199,50 @@ namespace cp
 	}
 #pragma endregion
 
+#pragma region kernel dispatch table
+	//member function table of the compile-time specialized kernels (unroll4_) for NLM/PBF invokers.
+	//square patch {3, 5, 7} x square search {7, 9, ..., 21}: patch and search loops have constant bounds,
+	//patch {3, 5, 7} with other search sizes: constant patch loops, others: runtime sizes (unroll4).
+	//Channels are branched once per range, and depth and norm are the template of each invoker.
+	template<class Invoker>
+	using NLMKernel = void (Invoker::*)(const cv::Range&) const;
+
+	template<class Invoker, int patch>
+	static NLMKernel<Invoker> getNLMKernelSearch(const int search)
+	{
+#ifdef USE_NLM_SEARCH_SPECIALIZATION
+		switch (search)
+		{
+		case 7: return &Invoker::template unroll4_<patch, patch, 7, 7>;
+		case 9: return &Invoker::template unroll4_<patch, patch, 9, 9>;
+		case 11: return &Invoker::template unroll4_<patch, patch, 11, 11>;
+		case 13: return &Invoker::template unroll4_<patch, patch, 13, 13>;
+		case 15: return &Invoker::template unroll4_<patch, patch, 15, 15>;
+		case 17: return &Invoker::template unroll4_<patch, patch, 17, 17>;
+		case 19: return &Invoker::template unroll4_<patch, patch, 19, 19>;
+		case 21: return &Invoker::template unroll4_<patch, patch, 21, 21>;
+		default: break;
+		}
+#endif
+		return &Invoker::template unroll4_<patch, patch>;
+	}
+
+	template<class Invoker>
+	static NLMKernel<Invoker> getNLMKernel(const int patchX, const int patchY, const int searchX, const int searchY)
+	{
+		if (patchX != patchY) return &Invoker::unroll4;
+
+		const int search = (searchX == searchY) ? searchX : 0;
+		switch (patchX)
+		{
+		case 3: return getNLMKernelSearch<Invoker, 3>(search);
+		case 5: return getNLMKernelSearch<Invoker, 5>(search);
+		case 7: return getNLMKernelSearch<Invoker, 7>(search);
+		default: return &Invoker::unroll4;
+		}
+	}
+#pragma endregion
+
 #pragma region NLM
 	template<int norm>
 	class NonlocalMeansFilterInvorker8u_AVX : public cv::ParallelLoopBody
@@ -219,9 +264,12 @@ namespace cp
 			;
 		}
 
-		template<int patchWindowSizeX, int patchWindowSizeY>
+		template<int patchWindowSizeX, int patchWindowSizeY, int searchWindowSizeX = 0, int searchWindowSizeY = 0>
 		void unroll4_(const cv::Range& r) const
 		{
+			//search window is a compile time constant for the specialized kernels (0: runtime size)
+			const int kernelWindowSizeX = (searchWindowSizeX == 0) ? this->kernelWindowSizeX : searchWindowSizeX;
+			const int kernelWindowSizeY = (searchWindowSizeY == 0) ? this->kernelWindowSizeY : searchWindowSizeY;
 			const int tr_x = patchWindowSizeX >> 1;
 			const int sr_x = kernelWindowSizeX >> 1;
 			const int tr_y = patchWindowSizeY >> 1;
@@ -920,12 +968,7 @@ namespace cp
 
 		virtual void operator()(const cv::Range& r) const
 		{
-			//unroll1(r);
-			//unroll2(r);
-			if (patchWindowSizeX == 3 && patchWindowSizeY == 3) unroll4_<3, 3>(r);
-			else if (patchWindowSizeX == 5 && patchWindowSizeY == 5) unroll4_<5, 5>(r);
-			else if (patchWindowSizeX == 7 && patchWindowSizeY == 7) unroll4_<7, 7>(r);
-			else unroll4(r);
+			(this->*getNLMKernel<NonlocalMeansFilterInvorker8u_AVX>(patchWindowSizeX, patchWindowSizeY, kernelWindowSizeX, kernelWindowSizeY))(r);
 		}
 	};
 
@@ -949,9 +992,12 @@ namespace cp
 			;
 		}
 
-		template<int patchWindowSizeX, int patchWindowSizeY>
+		template<int patchWindowSizeX, int patchWindowSizeY, int searchWindowSizeX = 0, int searchWindowSizeY = 0>
 		void unroll4_(const cv::Range& r) const
 		{
+			//search window is a compile time constant for the specialized kernels (0: runtime size)
+			const int kernelWindowSizeX = (searchWindowSizeX == 0) ? this->kernelWindowSizeX : searchWindowSizeX;
+			const int kernelWindowSizeY = (searchWindowSizeY == 0) ? this->kernelWindowSizeY : searchWindowSizeY;
 			const int tr_x = patchWindowSizeX >> 1;
 			const int sr_x = kernelWindowSizeX >> 1;
 			const int tr_y = patchWindowSizeY >> 1;
@@ -1583,13 +1629,7 @@ namespace cp
 
 		virtual void operator()(const cv::Range& r) const
 		{
-			if (patchWindowSizeX == 3 && patchWindowSizeY == 3)
-			{
-				unroll4_<3, 3>(r);
-			}
-			else if (patchWindowSizeX == 5 && patchWindowSizeY == 5) unroll4_<5, 5>(r);
-			else if (patchWindowSizeX == 7 && patchWindowSizeY == 7) unroll4_<7, 7>(r);
-			else unroll4(r);
+			(this->*getNLMKernel<NonlocalMeansFilterInvorker32f_AVX>(patchWindowSizeX, patchWindowSizeY, kernelWindowSizeX, kernelWindowSizeY))(r);
 		}
 	};
 
@@ -1718,9 +1758,12 @@ namespace cp
 			;
 		}
 
-		template<int patchWindowSizeX, int patchWindowSizeY>
+		template<int patchWindowSizeX, int patchWindowSizeY, int searchWindowSizeX = 0, int searchWindowSizeY = 0>
 		void unroll4_(const cv::Range& r) const
 		{
+			//search window is a compile time constant for the specialized kernels (0: runtime size)
+			const int kernelWindowSizeX = (searchWindowSizeX == 0) ? this->kernelWindowSizeX : searchWindowSizeX;
+			const int kernelWindowSizeY = (searchWindowSizeY == 0) ? this->kernelWindowSizeY : searchWindowSizeY;
 			const int tr_x = patchWindowSizeX >> 1;
 			const int sr_x = kernelWindowSizeX >> 1;
 			const int tr_y = patchWindowSizeY >> 1;
@@ -2427,12 +2470,7 @@ namespace cp
 
 		virtual void operator()(const cv::Range& r) const
 		{
-			//unroll1(r);
-			//unroll2(r);
-			if (patchWindowSizeX == 3 && patchWindowSizeY == 3) unroll4_<3, 3>(r);
-			else if (patchWindowSizeX == 5 && patchWindowSizeY == 5) unroll4_<5, 5>(r);
-			else if (patchWindowSizeX == 7 && patchWindowSizeY == 7) unroll4_<7, 7>(r);
-			else unroll4(r);
+			(this->*getNLMKernel<JointNonlocalMeansFilterInvorker8u_AVX>(patchWindowSizeX, patchWindowSizeY, kernelWindowSizeX, kernelWindowSizeY))(r);
 		}
 	};
 
@@ -2457,9 +2495,12 @@ namespace cp
 			;
 		}
 
-		template<int patchWindowSizeX, int patchWindowSizeY>
+		template<int patchWindowSizeX, int patchWindowSizeY, int searchWindowSizeX = 0, int searchWindowSizeY = 0>
 		void unroll4_(const cv::Range& r) const
 		{
+			//search window is a compile time constant for the specialized kernels (0: runtime size)
+			const int kernelWindowSizeX = (searchWindowSizeX == 0) ? this->kernelWindowSizeX : searchWindowSizeX;
+			const int kernelWindowSizeY = (searchWindowSizeY == 0) ? this->kernelWindowSizeY : searchWindowSizeY;
 			const int tr_x = patchWindowSizeX >> 1;
 			const int sr_x = kernelWindowSizeX >> 1;
 			const int tr_y = patchWindowSizeY >> 1;
@@ -3100,10 +3141,7 @@ namespace cp
 
 		virtual void operator()(const cv::Range& r) const
 		{
-			if (patchWindowSizeX == 3 && patchWindowSizeY == 3) unroll4_<3, 3>(r);
-			else if (patchWindowSizeX == 5 && patchWindowSizeY == 5) unroll4_<5, 5>(r);
-			else if (patchWindowSizeX == 7 && patchWindowSizeY == 7) unroll4_<7, 7>(r);
-			else unroll4(r);
+			(this->*getNLMKernel<JointNonlocalMeansFilterInvorker32f_AVX>(patchWindowSizeX, patchWindowSizeY, kernelWindowSizeX, kernelWindowSizeY))(r);
 		}
 	};
 
@@ -3242,9 +3280,12 @@ namespace cp
 			;
 		}
 
-		template<int patchWindowSizeX, int patchWindowSizeY>
+		template<int patchWindowSizeX, int patchWindowSizeY, int searchWindowSizeX = 0, int searchWindowSizeY = 0>
 		void unroll4_(const cv::Range& r) const
 		{
+			//search window is a compile time constant for the specialized kernels (0: runtime size)
+			const int kernelWindowSizeX = (searchWindowSizeX == 0) ? this->kernelWindowSizeX : searchWindowSizeX;
+			const int kernelWindowSizeY = (searchWindowSizeY == 0) ? this->kernelWindowSizeY : searchWindowSizeY;
 			const int tr_x = patchWindowSizeX >> 1;
 			const int sr_x = kernelWindowSizeX >> 1;
 			const int tr_y = patchWindowSizeY >> 1;
@@ -3973,12 +4014,7 @@ namespace cp
 
 		virtual void operator()(const cv::Range& r) const
 		{
-			//unroll1(r);
-			//unroll2(r);
-			if (patchWindowSizeX == 3 && patchWindowSizeY == 3) unroll4_<3, 3>(r);
-			else if (patchWindowSizeX == 5 && patchWindowSizeY == 5) unroll4_<5, 5>(r);
-			else if (patchWindowSizeX == 7 && patchWindowSizeY == 7) unroll4_<7, 7>(r);
-			else unroll4(r);
+			(this->*getNLMKernel<PatchBilateralFilterInvorker8u_AVX>(patchWindowSizeX, patchWindowSizeY, kernelWindowSizeX, kernelWindowSizeY))(r);
 		}
 	};
 
@@ -4003,9 +4039,12 @@ namespace cp
 			;
 		}
 
-		template<int patchWindowSizeX, int patchWindowSizeY>
+		template<int patchWindowSizeX, int patchWindowSizeY, int searchWindowSizeX = 0, int searchWindowSizeY = 0>
 		void unroll4_(const cv::Range& r) const
 		{
+			//search window is a compile time constant for the specialized kernels (0: runtime size)
+			const int kernelWindowSizeX = (searchWindowSizeX == 0) ? this->kernelWindowSizeX : searchWindowSizeX;
+			const int kernelWindowSizeY = (searchWindowSizeY == 0) ? this->kernelWindowSizeY : searchWindowSizeY;
 			const int tr_x = patchWindowSizeX >> 1;
 			const int sr_x = kernelWindowSizeX >> 1;
 			const int tr_y = patchWindowSizeY >> 1;
@@ -4652,10 +4691,7 @@ namespace cp
 
 		virtual void operator()(const cv::Range& r) const
 		{
-			if (patchWindowSizeX == 3 && patchWindowSizeY == 3) unroll4_<3, 3>(r);
-			else if (patchWindowSizeX == 5 && patchWindowSizeY == 5) unroll4_<5, 5>(r);
-			else if (patchWindowSizeX == 7 && patchWindowSizeY == 7) unroll4_<7, 7>(r);
-			else unroll4(r);
+			(this->*getNLMKernel<PatchBilateralFilterInvorker32f_AVX>(patchWindowSizeX, patchWindowSizeY, kernelWindowSizeX, kernelWindowSizeY))(r);
 		}
 	};
 
@@ -4815,9 +4851,12 @@ namespace cp
 			;
 		}
 
-		template<int patchWindowSizeX, int patchWindowSizeY>
+		template<int patchWindowSizeX, int patchWindowSizeY, int searchWindowSizeX = 0, int searchWindowSizeY = 0>
 		void unroll4_(const cv::Range& r) const
 		{
+			//search window is a compile time constant for the specialized kernels (0: runtime size)
+			const int kernelWindowSizeX = (searchWindowSizeX == 0) ? this->kernelWindowSizeX : searchWindowSizeX;
+			const int kernelWindowSizeY = (searchWindowSizeY == 0) ? this->kernelWindowSizeY : searchWindowSizeY;
 			const int tr_x = patchWindowSizeX >> 1;
 			const int sr_x = kernelWindowSizeX >> 1;
 			const int tr_y = patchWindowSizeY >> 1;
@@ -5546,12 +5585,7 @@ namespace cp
 
 		virtual void operator()(const cv::Range& r) const
 		{
-			//unroll1(r);
-			//unroll2(r);
-			if (patchWindowSizeX == 3 && patchWindowSizeY == 3) unroll4_<3, 3>(r);
-			else if (patchWindowSizeX == 5 && patchWindowSizeY == 5) unroll4_<5, 5>(r);
-			else if (patchWindowSizeX == 7 && patchWindowSizeY == 7) unroll4_<7, 7>(r);
-			else unroll4(r);
+			(this->*getNLMKernel<JointPatchBilateralFilterInvorker8u_AVX>(patchWindowSizeX, patchWindowSizeY, kernelWindowSizeX, kernelWindowSizeY))(r);
 		}
 	};
 
@@ -5577,9 +5611,12 @@ namespace cp
 			;
 		}
 
-		template<int patchWindowSizeX, int patchWindowSizeY>
+		template<int patchWindowSizeX, int patchWindowSizeY, int searchWindowSizeX = 0, int searchWindowSizeY = 0>
 		void unroll4_(const cv::Range& r) const
 		{
+			//search window is a compile time constant for the specialized kernels (0: runtime size)
+			const int kernelWindowSizeX = (searchWindowSizeX == 0) ? this->kernelWindowSizeX : searchWindowSizeX;
+			const int kernelWindowSizeY = (searchWindowSizeY == 0) ? this->kernelWindowSizeY : searchWindowSizeY;
 			const int tr_x = patchWindowSizeX >> 1;
 			const int sr_x = kernelWindowSizeX >> 1;
 			const int tr_y = patchWindowSizeY >> 1;
@@ -6396,10 +6433,7 @@ namespace cp
 		virtual void operator()(const cv::Range& r) const
 		{
 			if (patchWindowSizeX == 1 && patchWindowSizeY == 1) unroll4_<1, 1>(r);
-			else if (patchWindowSizeX == 3 && patchWindowSizeY == 3) unroll4_<3, 3>(r);
-			else if (patchWindowSizeX == 5 && patchWindowSizeY == 5) unroll4_<5, 5>(r);
-			else if (patchWindowSizeX == 7 && patchWindowSizeY == 7) unroll4_<7, 7>(r);
-			else unroll4(r);
+			else (this->*getNLMKernel<JointPatchBilateralFilterInvorker32f_AVX>(patchWindowSizeX, patchWindowSizeY, kernelWindowSizeX, kernelWindowSizeY))(r);
 		}
 	};
 
@@ -296,6 +296,7 @@ inline bool is32F(const DRIM2COLType method)
 	case DRIM2COLType::FULL_SUB_FULL_32F:
 	case DRIM2COLType::FULL_SUB_HALF_32F:
 	case DRIM2COLType::FULL_SUB_REP_32F:
+	case DRIM2COLType::FULL_SUB_STREAM_32F:
 
 	case DRIM2COLType::MEAN_SUB_HALF_32F:
 	case DRIM2COLType::MEAN_SUB_REP_32F:
@@ -357,6 +358,12 @@ inline bool isSepCov(DRIM2COLType type, bool isSVD)
 	return ret;
 }
 
+//methods that compute the patch covariance matrix without the im2col buffer and project with DRIM2COLEigenVec
+inline bool isCovProject(const DRIM2COLType method)
+{
+	return ((int)method < (int)DRIM2COLType::OPENCV_PCA || method == DRIM2COLType::FULL_SUB_STREAM_32F);
+}
+
 string getDRIM2COLName(const DRIM2COLType method)
 {
 	string ret = "";
@@ -429,6 +436,8 @@ string getDRIM2COLName(const DRIM2COLType method)
 	case DRIM2COLType::NO_SUB_SEPCOVXXt:		   ret = "NO_SUB_SEPCOVXXt";	break;
 	case DRIM2COLType::CONST_SUB_SEPCOVXXt:		   ret = "CONST_SUB_SEPCOVXXt"; break;
 
+	case DRIM2COLType::FULL_SUB_STREAM_32F:		   ret = "FULL_SUB_STREAM_32F"; break;
+
 	default:
 		break;
 	}
@@ -567,6 +576,7 @@ CalcPatchCovarMatrix::CenterMethod CalcPatchCovarMatrix::getCenterMethod(const D
 	case DRIM2COLType::FULL_SUB_HALF_64F:
 	case DRIM2COLType::FULL_SUB_REP_32F:
 	case DRIM2COLType::FULL_SUB_REP_64F:
+	case DRIM2COLType::FULL_SUB_STREAM_32F:
 		cm = CalcPatchCovarMatrix::CenterMethod::FULL; break;
 
 	default:
@@ -637,6 +647,14 @@ void CalcPatchCovarMatrix::computeCov(const vector<Mat>& src, const int patch_ra
 		return;
 	}
 
+	if (method == DRIM2COLType::FULL_SUB_STREAM_32F)
+	{
+		if (!isParallel) omp_set_num_threads(1);
+		streamCovFullCenter32F(src, cov, border);
+		if (!isParallel) omp_set_num_threads(omp_get_num_procs());
+		return;
+	}
+
 	if (method == DRIM2COLType::OPENCV_PCA || method == DRIM2COLType::OPENCV_COV)
 	{
 		Mat highDimGuide(src[0].size(), CV_MAKE_TYPE(CV_32F, dim));
@@ -3447,6 +3465,160 @@ void CalcPatchCovarMatrix::simdOMPCovFullCenterHalfElementTEST32F(const vector<M
 }
 #pragma endregion
 
+#pragma region full mean streaming
+//fused version of simdOMPCovFullCenterFullElement32F: shifted images are not materialized.
+//raw moments and per-element sums are accumulated from shifted reads of the bordered image, and per-element means are removed after accumulation.
+//working memory is O(dim^2) per thread plus one bordered copy of each channel.
+void CalcPatchCovarMatrix::streamCovFullCenter32F(const vector<Mat>& src_, Mat& destCovarianceMatrix, const int border)
+{
+	const int simd_step = 8;
+	dataBorder.resize(color_channels);
+
+	const int thread_max = omp_get_max_threads();
+	const int DD = D * D;
+	const int computeElementSize = getComputeHalfCovElementSize(dim);
+
+	//pre-centering by the channel mean keeps the float accumulators stable
+	for (int c = 0; c < color_channels; c++)
+	{
+		Mat temp;
+		src_[c].convertTo(temp, CV_32F, 1.0, -cp::average(src_[c]));
+		copyMakeBorder(temp, dataBorder[c], patch_rad, patch_rad, patch_rad, patch_rad, border);
+	}
+
+	int* scan = (int*)_mm_malloc(sizeof(int) * DD, AVX_ALIGN);
+	getScanorderBorder(scan, dataBorder[0].cols, 1);
+
+	//offset of the (y, y) element in the upper triangle storage
+	AutoBuffer<int> rowOffset(dim);
+	for (int y = 0, offset = 0; y < dim; y++)
+	{
+		rowOffset[y] = offset;
+		offset += dim - y;
+	}
+
+	const int width = src_[0].cols;
+	const int height = src_[0].rows;
+	const int simd_end = get_simd_floor(width, simd_step);
+	const __m256i mask = get_simd_residualmask_epi32(width);
+	const bool isRem = (width == simd_end) ? false : true;
+
+	//row accumulators are float (SIMD), and they are flushed into double per row
+	__m256* mbuff = (__m256*)_mm_malloc(sizeof(__m256) * (computeElementSize + dim) * thread_max, AVX_ALIGN);
+	double* dbuff = (double*)_mm_malloc(sizeof(double) * (computeElementSize + dim) * thread_max, AVX_ALIGN);
+	for (int i = 0; i < (computeElementSize + dim) * thread_max; i++) dbuff[i] = 0.0;
+
+#pragma omp parallel for SCHEDULE
+	for (int j = 0; j < height; j++)
+	{
+		const int tindex = omp_get_thread_num();
+		__m256* mcov_local = &mbuff[(computeElementSize + dim) * tindex];
+		__m256* msum_local = mcov_local + computeElementSize;
+		double* dcov_local = &dbuff[(computeElementSize + dim) * tindex];
+		for (int i = 0; i < computeElementSize + dim; i++) mcov_local[i] = _mm256_setzero_ps();
+
+		AutoBuffer<__m256> msrc_local(dim);
+		AutoBuffer<const float*> sptr(color_channels);
+		for (int c = 0; c < color_channels; c++)
+		{
+			sptr[c] = dataBorder[c].ptr<float>(j);
+		}
+
+		const int loop_end = (isRem) ? simd_end + simd_step : simd_end;
+		for (int i = 0; i < loop_end; i += simd_step)
+		{
+			//load shifted data to register or L1 cache (masked lanes are zero, so that they do not contribute)
+			__m256* msrcptr = &msrc_local[0];
+			if (i < simd_end)
+			{
+				for (int k = 0; k < DD; k++)
+				{
+					for (int c = 0; c < color_channels; c++)
+					{
+						*msrcptr++ = _mm256_loadu_ps(sptr[c] + scan[k]);
+					}
+				}
+			}
+			else
+			{
+				for (int k = 0; k < DD; k++)
+				{
+					for (int c = 0; c < color_channels; c++)
+					{
+						*msrcptr++ = _mm256_maskload_ps(sptr[c] + scan[k], mask);
+					}
+				}
+			}
+
+			for (int d = 0; d < dim; d++)
+			{
+				msum_local[d] = _mm256_add_ps(msum_local[d], msrc_local[d]);
+			}
+
+			//outer product blocked by 2 rows: each loaded column element is used for two FMAs
+			int y = 0;
+			for (; y < dim - 1; y += 2)
+			{
+				const __m256 my0 = msrc_local[y + 0];
+				const __m256 my1 = msrc_local[y + 1];
+				__m256* c0 = mcov_local + rowOffset[y + 0] - (y + 0);
+				__m256* c1 = mcov_local + rowOffset[y + 1] - (y + 1);
+				c0[y] = _mm256_fmadd_ps(my0, my0, c0[y]);
+				for (int x = y + 1; x < dim; x++)
+				{
+					const __m256 mx = msrc_local[x];
+					c0[x] = _mm256_fmadd_ps(mx, my0, c0[x]);
+					c1[x] = _mm256_fmadd_ps(mx, my1, c1[x]);
+				}
+			}
+			if (y < dim)
+			{
+				__m256* c0 = mcov_local + rowOffset[y] - y;
+				c0[y] = _mm256_fmadd_ps(msrc_local[y], msrc_local[y], c0[y]);
+			}
+
+			for (int c = 0; c < color_channels; c++)
+			{
+				sptr[c] += simd_step;
+			}
+		}
+
+		for (int i = 0; i < computeElementSize + dim; i++)
+		{
+			dcov_local[i] += _mm256_reduceadd_pspd(mcov_local[i]);
+		}
+	}
+
+	//reduction
+	vector<double> covElem(computeElementSize + dim, 0.0);
+	for (int t = 0; t < thread_max; t++)
+	{
+		const double* dcov = &dbuff[(computeElementSize + dim) * t];
+		for (int i = 0; i < computeElementSize + dim; i++)
+		{
+			covElem[i] += dcov[i];
+		}
+	}
+
+	//cov(a, b) = E[x_a x_b] - E[x_a] E[x_b]
+	const double normalSize = 1.0 / ((double)height * width);
+	const double* sumElem = &covElem[computeElementSize];
+	for (int y = 0, idx = 0; y < dim; y++)
+	{
+		const double my = sumElem[y] * normalSize;
+		for (int x = y; x < dim; x++)
+		{
+			const double mx = sumElem[x] * normalSize;
+			destCovarianceMatrix.at<double>(y, x) = destCovarianceMatrix.at<double>(x, y) = covElem[idx++] * normalSize - mx * my;
+		}
+	}
+
+	_mm_free(scan);
+	_mm_free(mbuff);
+	_mm_free(dbuff);
+}
+#pragma endregion
+
 #pragma region dir_conv_FFT
 
 vector<Point> dir2cov(const int dx, const int dy, const int D)
@@ -9259,7 +9431,7 @@ void DRIM2COL(const Mat& src, Mat& dst, const int neighborhood_r, const int dest
 		cout << "overflow in float" << endl;
 	}
 
-	if (method < (int)DRIM2COLType::OPENCV_PCA)
+	if (isCovProject((DRIM2COLType)method))
 	{
 		Mat cov, eval, evec;
 		CalcPatchCovarMatrix pcov; pcov.computeCov(src, neighborhood_r, cov, (DRIM2COLType)method, 1, isParallel);
@@ -9344,7 +9516,7 @@ void DRIM2COL(const vector<Mat>& vsrc, vector<Mat>& vdst, const int neighborhood
 		cout << "overflow in float" << endl;
 	}
 
-	if (method < (int)DRIM2COLType::OPENCV_PCA)
+	if (isCovProject((DRIM2COLType)method))
 	{
 		Mat cov;
 		CalcPatchCovarMatrix pcov;
@@ -9835,7 +10007,7 @@ void reprojectDRIM2COL(const vector<Mat>& vsrc, vector<Mat>& dest, const int nei
 		cout << "overflow in float" << endl;
 	}
 
-	if ((int)type < (int)DRIM2COLType::OPENCV_PCA)
+	if (isCovProject(type))
 	{
 		Mat cov;
 		CalcPatchCovarMatrix pcov;
@@ -10241,7 +10413,7 @@ double getPSNRReprojectDRIM2COL(const vector<Mat>& vsrc, const int neighborhood_
 		cout << "overflow in float" << endl;
 	}
 
-	if ((int)type < (int)DRIM2COLType::OPENCV_PCA)
+	if (isCovProject(type))
 	{
 		//cout << "Reproject for PSNR" << endl;
 		Mat cov;
@@ -10505,7 +10677,7 @@ void patchPCADenoise(const vector<Mat>& vsrc, vector<Mat>& dest, const int neigh
 		cout << "overflow in float" << endl;
 	}
 
-	if (method < (int)DRIM2COLType::OPENCV_PCA)
+	if (isCovProject((DRIM2COLType)method))
 	{
 		Mat cov, eval, evec;
 		CalcPatchCovarMatrix pcov;
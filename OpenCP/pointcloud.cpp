@@ -4,6 +4,8 @@
 #include "depth2disparity.hpp"
 #include "timer.hpp"
 #include "blend.hpp"
+#include "inlineSIMDFunctions.hpp"
+#include <atomic>
 using namespace std;
 using namespace cv;
 
@@ -277,6 +279,132 @@ namespace cp
 		}
 	}
 
+#pragma region SIMD point cloud
+	static inline __m256 _mm256_loadu_cvtdepth_ps(const uchar* src) { return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)src))); }
+	static inline __m256 _mm256_loadu_cvtdepth_ps(const short* src) { return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)src))); }
+	static inline __m256 _mm256_loadu_cvtdepth_ps(const ushort* src) { return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)src))); }
+	static inline __m256 _mm256_loadu_cvtdepth_ps(const int* src) { return _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)src)); }
+	static inline __m256 _mm256_loadu_cvtdepth_ps(const float* src) { return _mm256_loadu_ps(src); }
+	static inline __m256 _mm256_loadu_cvtdepth_ps(const double* src) { return _mm256_cvtpdx2_ps(_mm256_loadu_pd(src), _mm256_loadu_pd(src + 4)); }
+
+	//float or packed half (CV_16F) plane access
+	static inline __m256 _mm256_loadu_plane_ps(const float* src) { return _mm256_loadu_ps(src); }
+	static inline __m256 _mm256_loadu_plane_ps(const short* src) { return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)src)); }
+	static inline void _mm256_storeu_plane_ps(float* dst, const __m256 v) { _mm256_storeu_ps(dst, v); }
+	static inline void _mm256_storeu_plane_ps(short* dst, const __m256 v) { _mm_storeu_si128((__m128i*)dst, _mm256_cvtps_ph(v, 0)); }
+	static inline float loadPlane(const float* src) { return *src; }
+	static inline float loadPlane(const short* src) { return _mm_cvtss_f32(_mm_cvtph_ps(_mm_cvtsi32_si128(*(const ushort*)src))); }
+	static inline void storePlane(float* dst, const float v) { *dst = v; }
+	static inline void storePlane(short* dst, const float v) { *dst = (short)_mm_extract_epi16(_mm_cvtps_ph(_mm_set_ss(v), 0), 0); }
+
+	//output of reprojectXYZRow_: interleaved xyz (AoS) or x, y, z planes (SoA)
+	struct XYZInterleaveStore
+	{
+		float* xyz;
+		XYZInterleaveStore(Mat& dest, const int row, const int width) : xyz(dest.ptr<float>(0) + 3 * width * row) {}
+		void store(const int i, const __m256 x, const __m256 y, const __m256 z) { _mm256_storeu_ps_color(xyz + 3 * i, x, y, z); }
+		void store(const int i, const float x, const float y, const float z)
+		{
+			xyz[3 * i + 0] = x;
+			xyz[3 * i + 1] = y;
+			xyz[3 * i + 2] = z;
+		}
+	};
+
+	template <class T>
+	struct XYZPlanarStore
+	{
+		T* x;
+		T* y;
+		T* z;
+		XYZPlanarStore(vector<Mat>& dest, const int row, const int width) : x(dest[0].ptr<T>(row)), y(dest[1].ptr<T>(row)), z(dest[2].ptr<T>(row)) {}
+		void store(const int i, const __m256 mx, const __m256 my, const __m256 mz)
+		{
+			_mm256_storeu_plane_ps(x + i, mx);
+			_mm256_storeu_plane_ps(y + i, my);
+			_mm256_storeu_plane_ps(z + i, mz);
+		}
+		void store(const int i, const float vx, const float vy, const float vz)
+		{
+			storePlane(x + i, vx);
+			storePlane(y + i, vy);
+			storePlane(z + i, vz);
+		}
+	};
+
+	//rays of row j: rayx is 1 x width or height x width, rayy is height x 1 or height x width (see createReprojectionRayMap)
+	static inline void getRayRow(const Mat& rayx, const Mat& rayy, const int j, const float*& rx, const float*& ry, float& ryc)
+	{
+		rx = rayx.ptr<float>((rayx.rows == 1) ? 0 : j);
+		ry = (rayy.cols == 1) ? nullptr : rayy.ptr<float>(j);
+		ryc = (rayy.cols == 1) ? rayy.at<float>(j) : 0.f;
+	}
+
+	//(rx*z, ry*z, z) of a row; depth 0 is set to bigZ
+	template <class srcType, class Store>
+	static void reprojectXYZRow_(const srcType* dep, const float* rx, const float* ry, const float ryc, const float bigZ, const int width, Store& dst)
+	{
+		const int simdend = get_simd_floor(width, 8);
+		const __m256 mbigZ = _mm256_set1_ps(bigZ);
+		const __m256 mryc = _mm256_set1_ps(ryc);
+		for (int i = 0; i < simdend; i += 8)
+		{
+			const __m256 mz = _mm256_loadu_cvtdepth_ps(dep + i);
+			const __m256 mx = _mm256_mul_ps(_mm256_loadu_ps(rx + i), mz);
+			const __m256 my = _mm256_mul_ps((ry == nullptr) ? mryc : _mm256_loadu_ps(ry + i), mz);
+			dst.store(i, mx, my, _mm256_blendv_ps(mz, mbigZ, _mm256_cmp_ps(mz, _mm256_setzero_ps(), _CMP_EQ_OQ)));
+		}
+		for (int i = simdend; i < width; i++)
+		{
+			const float z = (float)dep[i];
+			dst.store(i, rx[i] * z, ((ry == nullptr) ? ryc : ry[i]) * z, (z == 0.f) ? bigZ : z);
+		}
+	}
+
+	template <class srcType, class Store, class Dest>
+	static void reprojectXYZ_(const Mat& depth, const Mat& rayx, const Mat& rayy, const float bigZ, Dest& dest)
+	{
+#pragma omp parallel for schedule(static)
+		for (int j = 0; j < depth.rows; j++)
+		{
+			const float* rx; const float* ry; float ryc;
+			getRayRow(rayx, rayy, j, rx, ry, ryc);
+			Store dst(dest, j, depth.cols);
+			reprojectXYZRow_<srcType, Store>(depth.ptr<srcType>(j), rx, ry, ryc, bigZ, depth.cols, dst);
+		}
+	}
+
+	template <class Store, class Dest>
+	static void reprojectXYZ_(const Mat& depth, const Mat& rayx, const Mat& rayy, const float bigZ, Dest& dest)
+	{
+		switch (depth.depth())
+		{
+		case CV_8U: reprojectXYZ_<uchar, Store>(depth, rayx, rayy, bigZ, dest); break;
+		case CV_16S: reprojectXYZ_<short, Store>(depth, rayx, rayy, bigZ, dest); break;
+		case CV_16U: reprojectXYZ_<ushort, Store>(depth, rayx, rayy, bigZ, dest); break;
+		case CV_32S: reprojectXYZ_<int, Store>(depth, rayx, rayy, bigZ, dest); break;
+		case CV_32F: reprojectXYZ_<float, Store>(depth, rayx, rayy, bigZ, dest); break;
+		case CV_64F: reprojectXYZ_<double, Store>(depth, rayx, rayy, bigZ, dest); break;
+		default: CV_Error(Error::StsUnsupportedFormat, "unsupported depth type"); break;
+		}
+	}
+
+	//3x4 projection matrix of K[R|t] (isRotationThenTranspose) or KR[I|t]
+	static void getProjectionMatrix(const Mat& K_, const Mat& R_, const Mat& t_, const bool isRotationThenTranspose, float* p)
+	{
+		Mat K, R, t;
+		K_.convertTo(K, CV_64F);
+		R_.convertTo(R, CV_64F);
+		t_.reshape(1, 3).convertTo(t, CV_64F);
+		Mat P(3, 4, CV_64F);
+		Mat KR = K * R;
+		KR.copyTo(P(Rect(0, 0, 3, 3)));
+		Mat kt = (isRotationThenTranspose) ? Mat(K * t) : Mat(KR * t);
+		kt.copyTo(P.col(3));
+		for (int i = 0; i < 12; i++) p[i] = (float)P.at<double>(i);
+	}
+#pragma endregion
+
 	void moveXYZ(cv::InputArray xyz_, cv::OutputArray dest_, cv::InputArray R_, cv::InputArray t_, const bool isRotationThenTranspose)
 	{
 		if (dest_.empty() || xyz_.type() != dest_.type() || xyz_.size() != dest_.size()) dest_.create(xyz_.size(), xyz_.type());
@@ -290,65 +418,161 @@ namespace cp
 		else if (R.depth() == CV_64F)R.copyTo(kr);
 		else CV_Assert(R.depth() != CV_32F || R.depth() != CV_64F);
 
-		const float r0 = (float)kr.at<double>(0);
-		const float r1 = (float)kr.at<double>(1);
-		const float r2 = (float)kr.at<double>(2);
-		const float r3 = (float)kr.at<double>(3);
-		const float r4 = (float)kr.at<double>(4);
-		const float r5 = (float)kr.at<double>(5);
-		const float r6 = (float)kr.at<double>(6);
-		const float r7 = (float)kr.at<double>(7);
-		const float r8 = (float)kr.at<double>(8);
+		float r[9];
+		for (int i = 0; i < 9; i++) r[i] = (float)kr.at<double>(i);
 
 		float tt[3];
 		if (t.depth() == CV_64F)
 		{
-			tt[0] = (float)t.at<double>(0, 0);
-			tt[1] = (float)t.at<double>(1, 0);
-			tt[2] = (float)t.at<double>(2, 0);
+			tt[0] = (float)t.at<double>(0);
+			tt[1] = (float)t.at<double>(1);
+			tt[2] = (float)t.at<double>(2);
 		}
 		else if (t.depth() == CV_32F)
 		{
-			tt[0] = t.at<float>(0, 0);
-			tt[1] = t.at<float>(1, 0);
-			tt[2] = t.at<float>(2, 0);
+			tt[0] = t.at<float>(0);
+			tt[1] = t.at<float>(1);
+			tt[2] = t.at<float>(2);
 		}
 
-		float* data = (float*)xyz.ptr<float>(0);
-		float* dst = (float*)dest.ptr<float>(0);
-
-		int size2 = xyz.size().area();
+		//x' = R x + t (isRotationThenTranspose) or x' = R (x + t)
+		float pre[3], post[3];
+		for (int i = 0; i < 3; i++)
+		{
+			pre[i] = (isRotationThenTranspose) ? 0.f : tt[i];
+			post[i] = (isRotationThenTranspose) ? tt[i] : 0.f;
+		}
 
-		int i;
+		const float* data = xyz.ptr<float>(0);
+		float* dst = dest.ptr<float>(0);
+		const int size2 = xyz.size().area();
+		const int BLOCK = 4096;
 
-		if (isRotationThenTranspose)
+#pragma omp parallel for schedule(static)
+		for (int b = 0; b < size2; b += BLOCK)
 		{
-			for (i = 0; i < size2; i++)
-			{
-				const float x = data[0];
-				const float y = data[1];
-				const float z = data[2];
+			const int end = min(b + BLOCK, size2);
+			const int simdend = b + get_simd_floor(end - b, 8);
+			const __m256 mr0 = _mm256_set1_ps(r[0]), mr1 = _mm256_set1_ps(r[1]), mr2 = _mm256_set1_ps(r[2]);
+			const __m256 mr3 = _mm256_set1_ps(r[3]), mr4 = _mm256_set1_ps(r[4]), mr5 = _mm256_set1_ps(r[5]);
+			const __m256 mr6 = _mm256_set1_ps(r[6]), mr7 = _mm256_set1_ps(r[7]), mr8 = _mm256_set1_ps(r[8]);
+			for (int i = b; i < simdend; i += 8)
+			{
+				__m256 x, y, z;
+				_mm256_loadu_cvtps_bgr2planar_ps(data + 3 * i, x, y, z);
+				x = _mm256_add_ps(x, _mm256_set1_ps(pre[0]));
+				y = _mm256_add_ps(y, _mm256_set1_ps(pre[1]));
+				z = _mm256_add_ps(z, _mm256_set1_ps(pre[2]));
+				const __m256 dx = _mm256_fmadd_ps(mr0, x, _mm256_fmadd_ps(mr1, y, _mm256_fmadd_ps(mr2, z, _mm256_set1_ps(post[0]))));
+				const __m256 dy = _mm256_fmadd_ps(mr3, x, _mm256_fmadd_ps(mr4, y, _mm256_fmadd_ps(mr5, z, _mm256_set1_ps(post[1]))));
+				const __m256 dz = _mm256_fmadd_ps(mr6, x, _mm256_fmadd_ps(mr7, y, _mm256_fmadd_ps(mr8, z, _mm256_set1_ps(post[2]))));
+				_mm256_storeu_ps_color(dst + 3 * i, dx, dy, dz);
+			}
+			for (int i = simdend; i < end; i++)
+			{
+				const float x = data[3 * i + 0] + pre[0];
+				const float y = data[3 * i + 1] + pre[1];
+				const float z = data[3 * i + 2] + pre[2];
+
+				dst[3 * i + 0] = (r[0] * x + r[1] * y + r[2] * z) + post[0];
+				dst[3 * i + 1] = (r[3] * x + r[4] * y + r[5] * z) + post[1];
+				dst[3 * i + 2] = (r[6] * x + r[7] * y + r[8] * z) + post[2];
+			}
+		}
+	}
 
-				dst[0] = (r0 * x + r1 * y + r2 * z) + tt[0];
-				dst[1] = (r3 * x + r4 * y + r5 * z) + tt[1];
-				dst[2] = (r6 * x + r7 * y + r8 * z) + tt[2];
-				data += 3;
-				dst += 3;
+	template <class T>
+	static void moveXYZPlanar_(const vector<Mat>& xyz, vector<Mat>& dest, const float* r, const float* pre, const float* post)
+	{
+		const int width = xyz[0].cols;
+		const int simdend = get_simd_floor(width, 8);
+#pragma omp parallel for schedule(static)
+		for (int j = 0; j < xyz[0].rows; j++)
+		{
+			const T* sx = xyz[0].ptr<T>(j);
+			const T* sy = xyz[1].ptr<T>(j);
+			const T* sz = xyz[2].ptr<T>(j);
+			T* dx = dest[0].ptr<T>(j);
+			T* dy = dest[1].ptr<T>(j);
+			T* dz = dest[2].ptr<T>(j);
+			for (int i = 0; i < simdend; i += 8)
+			{
+				const __m256 x = _mm256_add_ps(_mm256_loadu_plane_ps(sx + i), _mm256_set1_ps(pre[0]));
+				const __m256 y = _mm256_add_ps(_mm256_loadu_plane_ps(sy + i), _mm256_set1_ps(pre[1]));
+				const __m256 z = _mm256_add_ps(_mm256_loadu_plane_ps(sz + i), _mm256_set1_ps(pre[2]));
+				_mm256_storeu_plane_ps(dx + i, _mm256_fmadd_ps(_mm256_set1_ps(r[0]), x, _mm256_fmadd_ps(_mm256_set1_ps(r[1]), y, _mm256_fmadd_ps(_mm256_set1_ps(r[2]), z, _mm256_set1_ps(post[0])))));
+				_mm256_storeu_plane_ps(dy + i, _mm256_fmadd_ps(_mm256_set1_ps(r[3]), x, _mm256_fmadd_ps(_mm256_set1_ps(r[4]), y, _mm256_fmadd_ps(_mm256_set1_ps(r[5]), z, _mm256_set1_ps(post[1])))));
+				_mm256_storeu_plane_ps(dz + i, _mm256_fmadd_ps(_mm256_set1_ps(r[6]), x, _mm256_fmadd_ps(_mm256_set1_ps(r[7]), y, _mm256_fmadd_ps(_mm256_set1_ps(r[8]), z, _mm256_set1_ps(post[2])))));
+			}
+			for (int i = simdend; i < width; i++)
+			{
+				const float x = loadPlane(sx + i) + pre[0];
+				const float y = loadPlane(sy + i) + pre[1];
+				const float z = loadPlane(sz + i) + pre[2];
+				storePlane(dx + i, (r[0] * x + r[1] * y + r[2] * z) + post[0]);
+				storePlane(dy + i, (r[3] * x + r[4] * y + r[5] * z) + post[1]);
+				storePlane(dz + i, (r[6] * x + r[7] * y + r[8] * z) + post[2]);
 			}
 		}
-		else
+	}
+
+	void moveXYZPlanar(const vector<Mat>& xyz, vector<Mat>& dest, cv::InputArray R_, cv::InputArray t_, const bool isRotationThenTranspose)
+	{
+		CV_Assert(xyz.size() == 3);
+		CV_Assert(xyz[0].depth() == CV_32F || xyz[0].depth() == CV_16F);
+		dest.resize(3);
+		for (int c = 0; c < 3; c++) dest[c].create(xyz[0].size(), xyz[0].type());
+
+		Mat R, t;
+		R_.getMat().convertTo(R, CV_64F);
+		t_.getMat().reshape(1, 3).convertTo(t, CV_64F);
+		float r[9], pre[3], post[3];
+		for (int i = 0; i < 9; i++) r[i] = (float)R.at<double>(i);
+		for (int i = 0; i < 3; i++)
 		{
-			for (i = 0; i < size2; i++)
-			{
-				const float x = data[0] + tt[0];
-				const float y = data[1] + tt[1];
-				const float z = data[2] + tt[2];
+			pre[i] = (isRotationThenTranspose) ? 0.f : (float)t.at<double>(i);
+			post[i] = (isRotationThenTranspose) ? (float)t.at<double>(i) : 0.f;
+		}
 
-				dst[0] = (r0 * x + r1 * y + r2 * z);
-				dst[1] = (r3 * x + r4 * y + r5 * z);
-				dst[2] = (r6 * x + r7 * y + r8 * z);
-				data += 3;
-				dst += 3;
+		if (xyz[0].depth() == CV_32F) moveXYZPlanar_<float>(xyz, dest, r, pre, post);
+		else moveXYZPlanar_<short>(xyz, dest, r, pre, post);
+	}
+
+	//AVX and parallel version of myProjectPoint_BF
+	void myProjectPoint_AVX(const Mat& xyz, const Mat& R, const Mat& t, const Mat& K, vector<Point2f>& dest, const bool isRotationThenTranspose)
+	{
+		float p[12];
+		getProjectionMatrix(K, R, t, isRotationThenTranspose, p);
+
+		const float* data = xyz.ptr<float>(0);
+		float* dst = (float*)&dest[0];
+		const int size2 = xyz.size().area();
+		const int BLOCK = 4096;
+
+#pragma omp parallel for schedule(static)
+		for (int b = 0; b < size2; b += BLOCK)
+		{
+			const int end = min(b + BLOCK, size2);
+			const int simdend = b + get_simd_floor(end - b, 8);
+			__m256 mp[12];
+			for (int n = 0; n < 12; n++) mp[n] = _mm256_set1_ps(p[n]);
+			for (int i = b; i < simdend; i += 8)
+			{
+				__m256 x, y, z;
+				_mm256_loadu_cvtps_bgr2planar_ps(data + 3 * i, x, y, z);
+				const __m256 pu = _mm256_fmadd_ps(mp[0], x, _mm256_fmadd_ps(mp[1], y, _mm256_fmadd_ps(mp[2], z, mp[3])));
+				const __m256 pv = _mm256_fmadd_ps(mp[4], x, _mm256_fmadd_ps(mp[5], y, _mm256_fmadd_ps(mp[6], z, mp[7])));
+				const __m256 div = _mm256_div_ps(_mm256_set1_ps(1.f), _mm256_fmadd_ps(mp[8], x, _mm256_fmadd_ps(mp[9], y, _mm256_fmadd_ps(mp[10], z, mp[11]))));
+				_mm256_storeu_interleave_ps(dst + 2 * i, _mm256_mul_ps(pu, div), _mm256_mul_ps(pv, div));
+			}
+			for (int i = simdend; i < end; i++)
+			{
+				const float x = data[3 * i + 0];
+				const float y = data[3 * i + 1];
+				const float z = data[3 * i + 2];
+				const float div = 1.f / (p[8] * x + p[9] * y + p[10] * z + p[11]);
+				dst[2 * i + 0] = (p[0] * x + p[1] * y + p[2] * z + p[3]) * div;
+				dst[2 * i + 1] = (p[4] * x + p[5] * y + p[6] * z + p[7]) * div;
 			}
 		}
 	}
@@ -356,7 +580,8 @@ namespace cp
 	void projectPointsSimple(const Mat& xyz, const Mat& R, const Mat& t, const Mat& K, vector<Point2f>& dest, bool isRotationThenTranspose)
 	{
 		//myProjectPoint_SSE(xyz, R, t, K, dest);//SSE implimentation
-		myProjectPoint_BF(xyz, R, t, K, dest, isRotationThenTranspose);//normal implementation
+		//myProjectPoint_BF(xyz, R, t, K, dest, isRotationThenTranspose);//normal implementation
+		myProjectPoint_AVX(xyz, R, t, K, dest, isRotationThenTranspose);
 		//myProjectPoint_BF(xyz, R, t, K, dest);//normal implementation
 	}
 
@@ -970,68 +1195,25 @@ namespace cp
 		projectImagefromXYZ(image, destimage, xyz, R, t, K, dist, mask, isSub, pt, depth, isRotationThenTranspose);
 	}
 
-	template <class srcType>
-	void reprojectXYZ_(const Mat& depth, Mat& xyz, double f)
+	void reprojectXYZ(cv::InputArray depth_, cv::OutputArray xyz_, const double focalLength)
 	{
+		Mat depth = depth_.getMat();
+		xyz_.create(depth_.size().area(), 1, CV_32FC3);
+		Mat xyz = xyz_.getMat();
+
 		const float bigZ = 10000.f;
-		const float fxinv = (float)(1.0 / f);
-		const float fyinv = (float)(1.0 / f);
+		const float fxinv = (float)(1.0 / focalLength);
+		const float fyinv = (float)(1.0 / focalLength);
 		const float cw = (depth.cols - 1) * 0.5f;
 		const float ch = (depth.rows - 1) * 0.5f;
 
-		srcType* dep = (srcType*)depth.ptr<srcType>(0);
-		float* data = xyz.ptr<float>(0);
-		//#pragma omp parallel for
-		for (int j = 0; j < depth.rows; j++)
-		{
-			// add 1
-			float b = (float)(j - ch + 1);
-			const float y = b * fyinv;
-			//add 1
-			float x = (-cw + 1) * fxinv;
-			for (int i = 0; i < depth.cols; i++)
-			{
-				float z = (float)*dep;
-				data[0] = x * z;
-				data[1] = y * z;
-				data[2] = (z == 0) ? bigZ : z;
-
-				data += 3, dep++;
-				x += fxinv;
-			}
-		}
-	}
-
-	void reprojectXYZ(cv::InputArray depth_, cv::OutputArray xyz_, const double focalLength)
-	{
-		Mat depth = depth_.getMat();
-		if (xyz_.empty())xyz_.create(depth_.size().area(), 1, CV_32FC3);
-		Mat xyz = xyz_.getMat();
+		// add 1
+		Mat rayx(1, depth.cols, CV_32F);
+		Mat rayy(depth.rows, 1, CV_32F);
+		for (int i = 0; i < depth.cols; i++) rayx.at<float>(i) = (i - cw + 1) * fxinv;
+		for (int j = 0; j < depth.rows; j++) rayy.at<float>(j) = (j - ch + 1) * fyinv;
 
-		if (depth.type() == CV_8U)
-		{
-			reprojectXYZ_<uchar>(depth, xyz, focalLength);
-		}
-		else if (depth.type() == CV_16S)
-		{
-			reprojectXYZ_<short>(depth, xyz, focalLength);
-		}
-		else if (depth.type() == CV_16U)
-		{
-			reprojectXYZ_<unsigned short>(depth, xyz, focalLength);
-		}
-		else if (depth.type() == CV_32S)
-		{
-			reprojectXYZ_<int>(depth, xyz, focalLength);
-		}
-		else if (depth.type() == CV_32F)
-		{
-			reprojectXYZ_<float>(depth, xyz, focalLength);
-		}
-		else if (depth.type() == CV_64F)
-		{
-			reprojectXYZ_<double>(depth, xyz, focalLength);
-		}
+		reprojectXYZ_<XYZInterleaveStore>(depth, rayx, rayy, bigZ, xyz);
 	}
 
 	//template <class T>
@@ -1069,19 +1251,9 @@ namespace cp
 	//	}
 	//}
 
-	template <class srcType>
-	void reprojectXYZ_(InputArray depth_, OutputArray xyz_, InputArray intrinsic_, InputArray distortion_)
+	void createReprojectionRayMap(const Size size, InputArray intrinsic_, InputArray distortion_, Mat& rayx, Mat& rayy)
 	{
-		if (xyz_.empty())xyz_.create(depth_.size().area(), 1, CV_32FC3);
-		Mat depth = depth_.getMat();
-		Mat xyz = xyz_.getMat();
-		Mat intrinsic = intrinsic_.getMat();
-		Mat distortion = distortion_.getMat();
-
-		const float bigZ = 100000.f;
-
-		const float fx = (float)(intrinsic.at<double>(0, 0));
-		const float fy = (float)(intrinsic.at<double>(1, 1));
+		Mat intrinsic; intrinsic_.getMat().convertTo(intrinsic, CV_64F);
 		const float fxinv = (float)(1.0 / intrinsic.at<double>(0, 0));
 		const float fyinv = (float)(1.0 / intrinsic.at<double>(1, 1));
 		const float cw = (float)intrinsic.at<double>(0, 2);
@@ -1089,64 +1261,39 @@ namespace cp
 
 		if (distortion_.empty())
 		{
-			//#pragma omp parallel for
-			for (int j = 0; j < depth.rows; j++)
-			{
-				srcType* dep = (srcType*)depth.ptr<srcType>(j);
-				float* data = xyz.ptr<float>(j * depth.cols);
-				for (int i = 0; i < depth.cols; i++, dep++, data += 3)
-				{
-					float z = (float)*dep;
-					data[0] = (i - cw + 1) * fxinv * z;
-					data[1] = (j - ch + 1) * fyinv * z;
-					data[2] = (z == 0) ? bigZ : z;
-				}
-			}
+			rayx.create(1, size.width, CV_32F);
+			rayy.create(size.height, 1, CV_32F);
+			for (int i = 0; i < size.width; i++) rayx.at<float>(i) = (i - cw + 1) * fxinv;
+			for (int j = 0; j < size.height; j++) rayy.at<float>(j) = (j - ch + 1) * fyinv;
 		}
 		else
 		{
-			CV_Assert(distortion.size() == Size(1, 4) || distortion.size() == Size(4, 1) ||
-				distortion.size() == Size(1, 5) || distortion.size() == Size(5, 1) ||
-				distortion.size() == Size(1, 8) || distortion.size() == Size(8, 1));
+			CV_Assert(distortion_.size() == Size(1, 4) || distortion_.size() == Size(4, 1) ||
+				distortion_.size() == Size(1, 5) || distortion_.size() == Size(5, 1) ||
+				distortion_.size() == Size(1, 8) || distortion_.size() == Size(8, 1));
+			Mat distortion; distortion_.getMat().convertTo(distortion, CV_64F);
 
 			const float k1 = (float)distortion.at<double>(0);
 			const float k2 = (float)distortion.at<double>(1);
-			const float k3 = (distortion.size().area() > 3) ? (float)distortion.at<double>(4) : 0.f;
+			const float k3 = (distortion.size().area() > 4) ? (float)distortion.at<double>(4) : 0.f;
 
-			//#pragma omp parallel for
-			for (int j = 0; j < depth.rows; j++)
+			rayx.create(size, CV_32F);
+			rayy.create(size, CV_32F);
+#pragma omp parallel for schedule(static)
+			for (int j = 0; j < size.height; j++)
 			{
 				const float y = (j - ch) * fyinv;
 				const float yy = y * y;
-
-				srcType* dep = (srcType*)depth.ptr<srcType>(j);
-				float* data = xyz.ptr<float>(j * depth.cols);
-				for (int i = 0; i < depth.cols; i++, dep++, data += 3)
+				float* rx = rayx.ptr<float>(j);
+				float* ry = rayy.ptr<float>(j);
+				for (int i = 0; i < size.width; i++)
 				{
 					const float x = (i - cw) * fxinv;
 					const float rr = x * x + yy;//r^2
 
 					const float kr = 1.f + (k1 + (k2 + k3 * rr) * rr) * rr;
-
-					float z = (float)*dep;
-
-					data[0] = x / kr * z;
-					data[1] = y / kr * z;
-					data[2] = (z == 0) ? bigZ : z;
-
-					/*
-					const float x = (i-cw+1)*fxinv;
-					const float rr = x*x+yy;//r^2
-
-					const float kr = 1.f+(k1 + (k2 + k3*rr)*rr)*rr;
-					float i2= kr*i;
-					float j2= kr*j;
-
-					float z = (float)*dep;
-					data[0]=(i2-cw+1)*fxinv*z;
-					data[1]=(j2-ch+1)*fyinv*z;
-					data[2]= (z==0) ?bigZ:z;
-					*/
+					rx[i] = x / kr;
+					ry[i] = y / kr;
 				}
 			}
 		}
@@ -1191,31 +1338,194 @@ namespace cp
 	}
 	}
 	*/
-	void reprojectXYZ(InputArray depth, OutputArray xyz, InputArray intrinsic, InputArray distortion)
+	void reprojectXYZ(InputArray depth_, OutputArray xyz_, InputArray intrinsic, InputArray distortion)
 	{
-		if (depth.depth() == CV_8U)
-		{
-			reprojectXYZ_<uchar>(depth, xyz, intrinsic, distortion);
-		}
-		else if (depth.depth() == CV_16S)
-		{
-			reprojectXYZ_<short>(depth, xyz, intrinsic, distortion);
-		}
-		else if (depth.depth() == CV_16U)
+		Mat depth = depth_.getMat();
+		xyz_.create(depth.size().area(), 1, CV_32FC3);
+		Mat xyz = xyz_.getMat();
+
+		const float bigZ = 100000.f;
+		Mat rayx, rayy;
+		createReprojectionRayMap(depth.size(), intrinsic, distortion, rayx, rayy);
+		reprojectXYZ_<XYZInterleaveStore>(depth, rayx, rayy, bigZ, xyz);
+	}
+
+	struct DepthReprojector::ZBuffer
+	{
+		//upper 32 bits: z (positive float bits keep the order), lower 32 bits: source pixel index
+		std::unique_ptr<std::atomic<uint64>[]> key;
+		int size = 0;
+
+		void allocate(const int n)
 		{
-			reprojectXYZ_<unsigned short>(depth, xyz, intrinsic, distortion);
+			if (n == size) return;
+			key.reset(new std::atomic<uint64>[n]);
+			size = n;
+#pragma omp parallel for schedule(static)
+			for (int i = 0; i < n; i++) key[i].store(UINT64_MAX, std::memory_order_relaxed);
 		}
-		else if (depth.depth() == CV_32S)
+	};
+
+	static inline void atomicMinZBuffer(std::atomic<uint64>& key, const float z, const int index)
+	{
+		uint32_t zbits;
+		memcpy(&zbits, &z, sizeof(float));
+		const uint64 v = ((uint64)zbits << 32) | (uint32_t)index;
+		uint64 cur = key.load(std::memory_order_relaxed);
+		while (v < cur && !key.compare_exchange_weak(cur, v, std::memory_order_relaxed));
+	}
+
+	template <class srcType>
+	static void scatterDepthToZBuffer_(const Mat& depth, const Mat& rayx, const Mat& rayy, const float* p, std::atomic<uint64>* key)
+	{
+		const int width = depth.cols;
+		const int height = depth.rows;
+		const int simdend = get_simd_floor(width, 8);
+
+#pragma omp parallel for schedule(static)
+		for (int j = 0; j < height; j++)
 		{
-			reprojectXYZ_<int>(depth, xyz, intrinsic, distortion);
+			const srcType* dep = depth.ptr<srcType>(j);
+			const float* rx; const float* ry; float ryc;
+			getRayRow(rayx, rayy, j, rx, ry, ryc);
+
+			__m256 mp[12];
+			for (int n = 0; n < 12; n++) mp[n] = _mm256_set1_ps(p[n]);
+			const __m256 mryc = _mm256_set1_ps(ryc);
+			const __m256 mwidth = _mm256_set1_ps((float)width);
+			const __m256 mheight = _mm256_set1_ps((float)height);
+			const __m256i mstep = _mm256_set1_epi32(width);
+			int CV_DECL_ALIGNED(32) buffidx[8];
+			float CV_DECL_ALIGNED(32) buffz[8];
+			for (int i = 0; i < simdend; i += 8)
+			{
+				const __m256 z = _mm256_loadu_cvtdepth_ps(dep + i);
+				const __m256 x = _mm256_mul_ps(_mm256_loadu_ps(rx + i), z);
+				const __m256 y = _mm256_mul_ps((ry == nullptr) ? mryc : _mm256_loadu_ps(ry + i), z);
+				const __m256 pw = _mm256_fmadd_ps(mp[8], x, _mm256_fmadd_ps(mp[9], y, _mm256_fmadd_ps(mp[10], z, mp[11])));
+				const __m256 div = _mm256_div_ps(_mm256_set1_ps(1.f), pw);
+				const __m256 u = _mm256_mul_ps(_mm256_fmadd_ps(mp[0], x, _mm256_fmadd_ps(mp[1], y, _mm256_fmadd_ps(mp[2], z, mp[3]))), div);
+				const __m256 v = _mm256_mul_ps(_mm256_fmadd_ps(mp[4], x, _mm256_fmadd_ps(mp[5], y, _mm256_fmadd_ps(mp[6], z, mp[7]))), div);
+
+				__m256 valid = _mm256_and_ps(_mm256_cmp_ps(z, _mm256_setzero_ps(), _CMP_GT_OQ), _mm256_cmp_ps(pw, _mm256_setzero_ps(), _CMP_GT_OQ));
+				valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(u, _mm256_setzero_ps(), _CMP_GE_OQ), _mm256_cmp_ps(u, mwidth, _CMP_LT_OQ)));
+				valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(v, _mm256_setzero_ps(), _CMP_GE_OQ), _mm256_cmp_ps(v, mheight, _CMP_LT_OQ)));
+				const int mask = _mm256_movemask_ps(valid);
+				if (mask == 0) continue;
+
+				_mm256_store_si256((__m256i*)buffidx, _mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvttps_epi32(v), mstep), _mm256_cvttps_epi32(u)));
+				_mm256_store_ps(buffz, pw);
+				for (int k = 0; k < 8; k++)
+				{
+					if (mask & (1 << k)) atomicMinZBuffer(key[buffidx[k]], buffz[k], width * j + i + k);
+				}
+			}
+			for (int i = simdend; i < width; i++)
+			{
+				const float z = (float)dep[i];
+				const float x = rx[i] * z;
+				const float y = ((ry == nullptr) ? ryc : ry[i]) * z;
+				const float pw = p[8] * x + p[9] * y + p[10] * z + p[11];
+				if (z <= 0.f || pw <= 0.f) continue;
+				const float u = (p[0] * x + p[1] * y + p[2] * z + p[3]) / pw;
+				const float v = (p[4] * x + p[5] * y + p[6] * z + p[7]) / pw;
+				if (u >= 0.f && u < width && v >= 0.f && v < height)
+				{
+					atomicMinZBuffer(key[width * (int)v + (int)u], pw, width * j + i);
+				}
+			}
 		}
-		else if (depth.depth() == CV_32F)
+	}
+
+	DepthReprojector::DepthReprojector()
+	{
+		zbuffer = makePtr<ZBuffer>();
+	}
+
+	void DepthReprojector::setCamera(const Size size, InputArray intrinsic, InputArray distortion)
+	{
+		createReprojectionRayMap(size, intrinsic, distortion, rayx, rayy);
+	}
+
+	void DepthReprojector::toXYZ(InputArray depth_, OutputArray xyz_)
+	{
+		CV_Assert(!rayx.empty() && depth_.rows() == rayy.rows && depth_.cols() == rayx.cols);
+		Mat depth = depth_.getMat();
+		xyz_.create(depth.size().area(), 1, CV_32FC3);
+		Mat xyz = xyz_.getMat();
+		reprojectXYZ_<XYZInterleaveStore>(depth, rayx, rayy, 100000.f, xyz);
+	}
+
+	void DepthReprojector::toXYZPlanar(InputArray depth_, vector<Mat>& xyz, const int depth_type)
+	{
+		CV_Assert(!rayx.empty() && depth_.rows() == rayy.rows && depth_.cols() == rayx.cols);
+		CV_Assert(depth_type == CV_32F || depth_type == CV_16F);
+		Mat depth = depth_.getMat();
+		xyz.resize(3);
+		for (int c = 0; c < 3; c++) xyz[c].create(depth.size(), depth_type);
+
+		if (depth_type == CV_32F) reprojectXYZ_<XYZPlanarStore<float>>(depth, rayx, rayy, 100000.f, xyz);
+		else reprojectXYZ_<XYZPlanarStore<short>>(depth, rayx, rayy, 100000.f, xyz);
+	}
+
+	void DepthReprojector::render(InputArray image_, InputArray depth_, InputArray R, InputArray t, InputArray destK, OutputArray dest_, OutputArray destDepth_, const bool isRotationThenTranspose)
+	{
+		CV_Assert(!rayx.empty() && depth_.rows() == rayy.rows && depth_.cols() == rayx.cols);
+		CV_Assert(image_.size() == depth_.size());
+		Mat image = image_.getMat();
+		Mat depth = depth_.getMat();
+		const int width = depth.cols;
+		const int height = depth.rows;
+
+		float p[12];
+		getProjectionMatrix(destK.getMat(), R.getMat(), t.getMat(), isRotationThenTranspose, p);
+
+		zbuffer->allocate(width * height);
+		std::atomic<uint64>* key = zbuffer->key.get();
+		switch (depth.depth())
 		{
-			reprojectXYZ_<float>(depth, xyz, intrinsic, distortion);
+		case CV_8U: scatterDepthToZBuffer_<uchar>(depth, rayx, rayy, p, key); break;
+		case CV_16S: scatterDepthToZBuffer_<short>(depth, rayx, rayy, p, key); break;
+		case CV_16U: scatterDepthToZBuffer_<ushort>(depth, rayx, rayy, p, key); break;
+		case CV_32S: scatterDepthToZBuffer_<int>(depth, rayx, rayy, p, key); break;
+		case CV_32F: scatterDepthToZBuffer_<float>(depth, rayx, rayy, p, key); break;
+		case CV_64F: scatterDepthToZBuffer_<double>(depth, rayx, rayy, p, key); break;
+		default: CV_Error(Error::StsUnsupportedFormat, "unsupported depth type"); break;
 		}
-		else if (depth.depth() == CV_64F)
+
+		//resolve: fetch the nearest source pixel and clear the z-buffer for the next call
+		dest_.create(image.size(), image.type());
+		Mat dest = dest_.getMat();
+		const bool isDepth = destDepth_.needed();
+		if (isDepth) destDepth_.create(image.size(), CV_32F);
+		Mat destDepth = (isDepth) ? destDepth_.getMat() : Mat();
+		const int esize = (int)image.elemSize();
+
+#pragma omp parallel for schedule(static)
+		for (int j = 0; j < height; j++)
 		{
-			reprojectXYZ_<double>(depth, xyz, intrinsic, distortion);
+			uchar* d = dest.ptr<uchar>(j);
+			float* dz = (isDepth) ? destDepth.ptr<float>(j) : nullptr;
+			std::atomic<uint64>* k = key + width * j;
+			for (int i = 0; i < width; i++)
+			{
+				const uint64 v = k[i].load(std::memory_order_relaxed);
+				if (v == UINT64_MAX)
+				{
+					memset(d + esize * i, 0, esize);
+					if (isDepth) dz[i] = 0.f;
+					continue;
+				}
+				k[i].store(UINT64_MAX, std::memory_order_relaxed);
+
+				const int index = (int)(v & 0xffffffff);
+				memcpy(d + esize * i, image.ptr<uchar>(index / width) + esize * (index % width), esize);
+				if (isDepth)
+				{
+					const uint32_t zbits = (uint32_t)(v >> 32);
+					memcpy(dz + i, &zbits, sizeof(float));
+				}
+			}
 		}
 	}
 
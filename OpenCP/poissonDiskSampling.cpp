@@ -206,4 +206,96 @@ namespace cp
 
 		return ret;
 	}
+
+	inline bool PoissonDiskSampling::inTile(const cv::Point pt, const cv::Rect& grid_tile)
+	{
+		if (!inImage(pt)) return false;
+		return grid_tile.contains(imageToGrid(pt));
+	}
+
+	void PoissonDiskSampling::generateTile(std::vector<cv::Point>& samples, cv::RNG& rng, const cv::Rect& grid_tile)
+	{
+		const float cell_size = 1.f / cell_size_inv;
+		const int x0 = (int)(grid_tile.x * cell_size);
+		const int y0 = (int)(grid_tile.y * cell_size);
+		const int x1 = min(imageSize.width, (int)ceil(grid_tile.br().x * cell_size) + 1);
+		const int y1 = min(imageSize.height, (int)ceil(grid_tile.br().y * cell_size) + 1);
+		if (x0 >= x1 || y0 >= y1) return;
+
+		cp::RandomizedQueue proc((int64)rng.state);
+		//a tile can be partially covered by the samples of the previous phases, so try k seeds to fill the remaining free regions.
+		for (int s = 0; s < k; s++)
+		{
+			const cv::Point start(rng.uniform(x0, x1), rng.uniform(y0, y1));
+			if (!inTile(start, grid_tile) || !isAvailable(start)) continue;
+
+			proc.push(start);
+			samples.push_back(start);
+			set(start);
+			while (!proc.empty())
+			{
+				cv::Point pt = proc.pop();
+				for (int i = 0; i < k; i++)
+				{
+					cv::Point newpt = generateRandomPointAround(pt, rng);
+					if (inTile(newpt, grid_tile) && isAvailable(newpt))
+					{
+						proc.push(newpt);
+						samples.push_back(newpt);
+						set(newpt);
+					}
+				}
+			}
+		}
+	}
+
+	int PoissonDiskSampling::generateParallel(std::vector<cv::Point>& samples, cv::RNG& rng, const int tile_cells)
+	{
+		//inNeibourhood reads +-2 cells around a sample, thus same phase tiles must be separated by at least 2 cells.
+		CV_Assert(tile_cells >= 2);
+		background_grid_pt.setTo(-1);
+
+		const int tiles_x = (grid_width + tile_cells - 1) / tile_cells;
+		const int tiles_y = (grid_height + tile_cells - 1) / tile_cells;
+		std::vector<std::vector<cv::Point>> tile_samples(tiles_x * tiles_y);
+		const uint64 seed = rng.next();
+
+		for (int phase = 0; phase < 4; phase++)
+		{
+			const int px = phase & 1;
+			const int py = phase >> 1;
+			const int nx = (tiles_x - px + 1) / 2;
+			const int ny = (tiles_y - py + 1) / 2;
+#pragma omp parallel for schedule(dynamic)
+			for (int i = 0; i < nx * ny; i++)
+			{
+				const int tx = 2 * (i % nx) + px;
+				const int ty = 2 * (i / nx) + py;
+				const int index = tiles_x * ty + tx;
+				const cv::Rect grid_tile = cv::Rect(tx * tile_cells, ty * tile_cells, tile_cells, tile_cells) & cv::Rect(0, 0, grid_width, grid_height);
+				cv::RNG trng(seed ^ (0x9E3779B97F4A7C15ULL * (uint64)(index + 1)));
+				generateTile(tile_samples[index], trng, grid_tile);
+			}
+		}
+
+		size_t size = 0;
+		for (auto& t : tile_samples) size += t.size();
+		samples.clear();
+		samples.reserve(size);
+		for (auto& t : tile_samples) samples.insert(samples.end(), t.begin(), t.end());
+
+		return (int)samples.size();
+	}
+
+	int PoissonDiskSampling::generateParallel(cv::Mat& mask, cv::RNG& rng, const int tile_cells)
+	{
+		std::vector<cv::Point> samples;
+		const int ret = generateParallel(samples, rng, tile_cells);
+
+		mask.create(imageSize, CV_8U);
+		mask.setTo(0);
+		for (const cv::Point& pt : samples) mask.at<uchar>(pt) = 255;
+
+		return ret;
+	}
 }
\ No newline at end of file
@@ -1981,11 +1981,10 @@ namespace cp
 	void  RecursiveBilateralFilter::alloc(Size size_)
 	{
 		size = size_;
-		bgra = Mat::zeros(size, CV_8U);
-
 		texture = Mat::zeros(size, CV_32FC4);
 		destf = Mat::zeros(size, CV_32FC4);
 		temp = Mat::zeros(size, CV_32FC4);
+		weight = Mat::zeros(size, CV_32F);
 		tempw = Mat::zeros(Size(size.width, 2), CV_32FC4);
 	}
 
@@ -2004,9 +2003,59 @@ namespace cp
 		;
 	}
 
+	//range weights alpha*LUT[round(|t0-t1|/3)] of 8 BGRA pixels; the sums of integer-valued diffs are exact, so the order of the additions does not matter
+	STATIC_INLINE __m256 _mm256_rbf_range_weight_ps(const float* t0, const float* t1, const float* lut, const __m256 malpha)
+	{
+		const __m256 absmask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+		const __m256 d01 = _mm256_and_ps(_mm256_sub_ps(_mm256_loadu_ps(t0 + 0), _mm256_loadu_ps(t1 + 0)), absmask);
+		const __m256 d23 = _mm256_and_ps(_mm256_sub_ps(_mm256_loadu_ps(t0 + 8), _mm256_loadu_ps(t1 + 8)), absmask);
+		const __m256 d45 = _mm256_and_ps(_mm256_sub_ps(_mm256_loadu_ps(t0 + 16), _mm256_loadu_ps(t1 + 16)), absmask);
+		const __m256 d67 = _mm256_and_ps(_mm256_sub_ps(_mm256_loadu_ps(t0 + 24), _mm256_loadu_ps(t1 + 24)), absmask);
+		//p0 p2 p4 p6 | p1 p3 p5 p7
+		const __m256 s = _mm256_hadd_ps(_mm256_hadd_ps(d01, d23), _mm256_hadd_ps(d45, d67));
+		const __m256 sum = _mm256_permutevar8x32_ps(s, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+		const __m256i idx = _mm256_cvtps_epi32(_mm256_mul_ps(sum, _mm256_set1_ps(0.3333f)));
+		return _mm256_mul_ps(malpha, _mm256_i32gather_ps(lut, idx, 4));
+	}
+
+	//range weights from link x-1 to x of a row of w BGRA pixels, weight[0] is not used
+	static void setRangeWeightRow(const float* t, float* weight, const int w, const float* lut, const float alpha)
+	{
+		const __m256 malpha = _mm256_set1_ps(alpha);
+		const int simdend = get_simd_floor(w - 1, 8) + 1;
+		weight[0] = alpha;
+		int x = 1;
+		for (; x < simdend; x += 8)
+		{
+			_mm256_storeu_ps(weight + x, _mm256_rbf_range_weight_ps(t + 4 * x, t + 4 * (x - 1), lut, malpha));
+		}
+		for (; x < w; x++)
+		{
+			const __m128 a = _mm_andnot_ps(_mm_set1_ps(-0.f), _mm_sub_ps(_mm_loadu_ps(t + 4 * x), _mm_loadu_ps(t + 4 * (x - 1))));
+			weight[x] = alpha * lut[cvRound(_mm_reduceadd_ps(a) * 0.3333f)];
+		}
+	}
+
+	//range weights from link y-1 to y of two rows of w BGRA pixels
+	static void setRangeWeightColumn(const float* tc, const float* tp, float* weight, const int w, const float* lut, const float alpha)
+	{
+		const __m256 malpha = _mm256_set1_ps(alpha);
+		const int simdend = get_simd_floor(w, 8);
+		int x = 0;
+		for (; x < simdend; x += 8)
+		{
+			_mm256_storeu_ps(weight + x, _mm256_rbf_range_weight_ps(tc + 4 * x, tp + 4 * x, lut, malpha));
+		}
+		for (; x < w; x++)
+		{
+			const __m128 a = _mm_andnot_ps(_mm_set1_ps(-0.f), _mm_sub_ps(_mm_loadu_ps(tc + 4 * x), _mm_loadu_ps(tp + 4 * x)));
+			weight[x] = alpha * lut[cvRound(_mm_reduceadd_ps(a) * 0.3333f)];
+		}
+	}
+
 	void RecursiveBilateralFilter::operator()(const Mat& src, const Mat& guide, Mat& dest, float sigma_range, float sigma_spatial)
 	{
-		if (src.size().area() != size.area()) alloc(src.size());
+		if (src.size() != size) alloc(src.size());
 
 		if (src.channels() == 1)
 		{
@@ -2016,53 +2065,59 @@ namespace cp
 		const int w = src.cols;
 		const int h = src.rows;
 
-		cvtColorBGR2BGRA(src, bgra, 1);
-		bgra.convertTo(destf, CV_32F);
-		if (src.data == guide.data)
-		{
-			destf.copyTo(texture);
-		}
-		else
+		const bool isJoint = src.data != guide.data;
+#pragma omp parallel for schedule(static)
+		for (int y = 0; y < h; y++)
 		{
-			cvtColorBGR2BGRA(guide, bgra, 1);
-			bgra.convertTo(texture, CV_32F);
+			const uchar* s = src.ptr<uchar>(y);
+			float* d = destf.ptr<float>(y);
+			for (int x = 0; x < w; x++)
+			{
+				d[4 * x + 0] = s[3 * x + 0];
+				d[4 * x + 1] = s[3 * x + 1];
+				d[4 * x + 2] = s[3 * x + 2];
+				d[4 * x + 3] = 1.f;
+			}
+			if (isJoint)
+			{
+				const uchar* g = guide.ptr<uchar>(y);
+				float* t = texture.ptr<float>(y);
+				for (int x = 0; x < w; x++)
+				{
+					t[4 * x + 0] = g[3 * x + 0];
+					t[4 * x + 1] = g[3 * x + 1];
+					t[4 * x + 2] = g[3 * x + 2];
+					t[4 * x + 3] = 1.f;
+				}
+			}
 		}
+		const Mat& tex = isJoint ? texture : destf;
 
-		float CV_DECL_ALIGNED(16) range_table[UCHAR_MAX + 1];//compute a lookup table
+		float CV_DECL_ALIGNED(32) range_table[UCHAR_MAX + 1];//compute a lookup table
 		setColorLUTGaussian(range_table, sigma_range);
 
-		float alpha = exp(-sqrt(2.f) / (sigma_spatial));//filter kernel size
-		float inv_alpha_ = 1.f - alpha;
-
-		const int CV_DECL_ALIGNED(16) v32f_absmask[] = { 0x7fffffff, 0x7fffffff, 0x7fffffff, 0x7fffffff };
+		const float alpha = exp(-sqrt(2.f) / (sigma_spatial));//filter kernel size
+		const float inv_alpha_ = 1.f - alpha;
 
-		const __m128 color_normal_factor = _mm_set1_ps(0.33333f);//0.3333f
 		const __m128 m05mul = _mm_set1_ps(0.5f);//0.5f
-		const __m128 ones = _mm_set1_ps(1.f);//1.f
-		const __m128 mspace = _mm_set1_ps(alpha);
 		const __m128 minvalpha = _mm_set1_ps(inv_alpha_);
 
-		//horizontal filtering
+		//horizontal filtering: rows are independent, and the range weights of a row are shared by the causal and anticausal passes
+#pragma omp parallel for schedule(static)
 		for (int j = 0; j < h; j++)
 		{
 			float* in_x = destf.ptr<float>(j);//destf is now copy (float) of src;
 			float* dest_x = temp.ptr<float>(j);//dest
-			float* texture_x = texture.ptr<float>(j);
+			float* weight_x = weight.ptr<float>(j);
+			setRangeWeightRow(tex.ptr<float>(j), weight_x, w, range_table, alpha);
 
 			//from left to right
-			__m128 mjp = _mm_set_ps(1.f, in_x[2], in_x[1], in_x[0]);//y previous
+			__m128 mjp = _mm_loadu_ps(in_x);//y previous
 			_mm_storeu_ps(dest_x, mjp);//set first pixel;
-			__m128 mtp = _mm_load_ps(texture_x);//texture previous
-			for (int i = 1; i < w; i++) 
+			for (int i = 1; i < w; i++)
 			{
 				const int i4 = i * 4;
-				__m128 mtc = _mm_loadu_ps(texture_x + i4);
-				__m128 a = _mm_and_ps(_mm_sub_ps(mtc, mtp), *(const __m128*)v32f_absmask);
-				mtp = mtc;
-				const float alpha_ = alpha * range_table[cvRound(_mm_reduceadd_ps(a) * 0.3333f)];
-				
-				const __m128 malpha = _mm_set1_ps(alpha_);
-
+				const __m128 malpha = _mm_set1_ps(weight_x[i]);
 				__m128 myc = _mm_add_ps(_mm_mul_ps(minvalpha, _mm_loadu_ps(in_x + i4)), _mm_mul_ps(malpha, mjp));
 				_mm_storeu_ps(dest_x + i4, myc);
 				mjp = myc;
@@ -2071,99 +2126,117 @@ namespace cp
 			//from right to left
 			_mm_storeu_ps(dest_x + 4 * (w - 1), _mm_mul_ps(m05mul, _mm_add_ps(_mm_loadu_ps(dest_x + 4 * (w - 1)), _mm_loadu_ps(in_x + 4 * (w - 1)))));
 
-			mtp = _mm_load_ps(texture_x + 4 * (w - 1));
-			mjp = _mm_load_ps(in_x + 4 * (w - 1));
-			for (int x = w - 2; x >= 0; x--) 
+			mjp = _mm_loadu_ps(in_x + 4 * (w - 1));
+			for (int x = w - 2; x >= 0; x--)
 			{
-				__m128 mtc = _mm_loadu_ps(texture_x + 4 * x);
-				__m128 a = _mm_and_ps(_mm_sub_ps(mtc, mtp), *(const __m128*)v32f_absmask);
-				mtp = mtc;
-				const float alpha_ = alpha * range_table[cvRound(_mm_reduceadd_ps(a) * 0.3333f)];
-				
-				__m128 malpha = _mm_set1_ps(alpha_);
+				const __m128 malpha = _mm_set1_ps(weight_x[x + 1]);
 				__m128 myc = _mm_fmadd_ps(minvalpha, _mm_loadu_ps(in_x + 4 * x), _mm_mul_ps(malpha, mjp));
 
-				_mm_storeu_ps(dest_x + 4 * x, _mm_mul_ps(m05mul, _mm_add_ps(_mm_load_ps(dest_x + 4 * x), myc)));
+				_mm_storeu_ps(dest_x + 4 * x, _mm_mul_ps(m05mul, _mm_add_ps(_mm_loadu_ps(dest_x + 4 * x), myc)));
 				mjp = myc;//update value
 			}
 		}
 
 		//horizontal filter is end.
-		//now, filtering target is Mat temp and dividing factor is temp_factor
+		//now, filtering target is Mat temp, and the vertical range weights overwrite the horizontal ones
 
-		alpha = exp(-sqrt(2.f) / (sigma_spatial));//filter kernel size virtical
-		inv_alpha_ = 1.f - alpha;
-
-		memcpy(destf.ptr<float>(0), temp.ptr<float>(0), w * 4);//copy from top buffer
+#pragma omp parallel for schedule(static)
 		for (int y = 1; y < h; y++)
 		{
-			float* tpy = texture.ptr<float>(y - 1);
-			float* tcy = texture.ptr<float>(y);
+			setRangeWeightColumn(tex.ptr<float>(y), tex.ptr<float>(y - 1), weight.ptr<float>(y), w, range_table, alpha);
+		}
 
-			float* xcy = temp.ptr<float>(y);
-			float* ypy = destf.ptr<float>(y - 1);
-			float* ycy = destf.ptr<float>(y);
+		//vertical filtering: columns are processed in strips, and each step updates 2 BGRA pixels per AVX register
+		//the anticausal state of a strip alternates between the two rows of tempw
+		const __m256 mm05mul = _mm256_set1_ps(0.5f);
+		const __m256 mminvalpha = _mm256_set1_ps(inv_alpha_);
+		const int STRIP = 64;
+		const int strips = (w + STRIP - 1) / STRIP;
+		const int h1 = h - 1;
+#pragma omp parallel for schedule(static)
+		for (int s = 0; s < strips; s++)
+		{
+			const int xs = s * STRIP;
+			const int xe = min(xs + STRIP, w);
+			const int simdend = xs + get_simd_floor(xe - xs, 2);
 
-			for (int x = 0; x < w; x++)
+			memcpy(destf.ptr<float>(0) + 4 * xs, temp.ptr<float>(0) + 4 * xs, sizeof(float) * 4 * (xe - xs));//copy from top buffer
+			for (int y = 1; y < h; y++)
 			{
-				__m128 mtcy = _mm_loadu_ps(tcy + 4 * x);
-				__m128 mtpy = _mm_loadu_ps(tpy + 4 * x);
-				__m128 a = _mm_and_ps(_mm_sub_ps(mtcy, mtpy), *(const __m128*)v32f_absmask);
-				const float alpha_ = alpha * range_table[cvRound(_mm_reduceadd_ps(a) * 0.3333f)];
-				__m128 malpha = _mm_set1_ps(alpha_);
+				const float* xcy = temp.ptr<float>(y);
+				const float* ypy = destf.ptr<float>(y - 1);
+				float* ycy = destf.ptr<float>(y);
+				const float* wy = weight.ptr<float>(y);
 
-				_mm_store_ps(ycy + 4 * x, _mm_fmadd_ps(minvalpha, _mm_loadu_ps(xcy + 4 * x), _mm_mul_ps(malpha, _mm_loadu_ps(ypy + 4 * x))));
+				int x = xs;
+				for (; x < simdend; x += 2)
+				{
+					const __m256 malpha = _mm256_set_m128(_mm_set1_ps(wy[x + 1]), _mm_set1_ps(wy[x]));
+					_mm256_storeu_ps(ycy + 4 * x, _mm256_fmadd_ps(mminvalpha, _mm256_loadu_ps(xcy + 4 * x), _mm256_mul_ps(malpha, _mm256_loadu_ps(ypy + 4 * x))));
+				}
+				for (; x < xe; x++)
+				{
+					const __m128 malpha = _mm_set1_ps(wy[x]);
+					_mm_storeu_ps(ycy + 4 * x, _mm_fmadd_ps(minvalpha, _mm_loadu_ps(xcy + 4 * x), _mm_mul_ps(malpha, _mm_loadu_ps(ypy + 4 * x))));
+				}
 			}
-		}
-
-		int h1 = h - 1;
 
-		float* ycy = tempw.ptr<float>(0);
-		float* ypy = tempw.ptr<float>(1);
-
-		//output final line
-		memcpy(ypy, temp.ptr<float>(h1), w * 4);
-		{
-			float* out_h1 = destf.ptr<float>(h1);
-			for (int x = 0; x < w; x++)
+			//output final line
+			float* ypy = tempw.ptr<float>(h1 & 1);
+			memcpy(ypy + 4 * xs, temp.ptr<float>(h1) + 4 * xs, sizeof(float) * 4 * (xe - xs));
 			{
-				__m128 mv = _mm_mul_ps(m05mul, _mm_add_ps(_mm_loadu_ps(out_h1 + 4 * x), _mm_loadu_ps(ypy + 4 * x)));
-				__m128  mdiv = _mm_shuffle_ps(mv, mv, 0xFF);
+				float* out_h1 = destf.ptr<float>(h1);
+				for (int x = xs; x < xe; x++)
+				{
+					__m128 mv = _mm_mul_ps(m05mul, _mm_add_ps(_mm_loadu_ps(out_h1 + 4 * x), _mm_loadu_ps(ypy + 4 * x)));
+					__m128 mdiv = _mm_shuffle_ps(mv, mv, 0xFF);
+					_mm_storeu_ps(out_h1 + 4 * x, _mm_div_ps(mv, mdiv));
+				}
+			}
 
-				_mm_storeu_ps(out_h1 + 4 * x, _mm_div_ps(mv, mdiv));
+			for (int y = h1 - 1; y >= 0; y--)
+			{
+				const float* xcy = temp.ptr<float>(y);
+				const float* ypy_ = tempw.ptr<float>((y + 1) & 1);
+				float* ycy_ = tempw.ptr<float>(y & 1);
+				float* out_ = destf.ptr<float>(y);
+				const float* wy = weight.ptr<float>(y + 1);
+
+				int x = xs;
+				for (; x < simdend; x += 2)
+				{
+					const int x4 = 4 * x;
+					const __m256 malpha = _mm256_set_m128(_mm_set1_ps(wy[x + 1]), _mm_set1_ps(wy[x]));
+					__m256 mv = _mm256_fmadd_ps(mminvalpha, _mm256_loadu_ps(xcy + x4), _mm256_mul_ps(malpha, _mm256_loadu_ps(ypy_ + x4)));
+					_mm256_storeu_ps(ycy_ + x4, mv);
+					mv = _mm256_mul_ps(mm05mul, _mm256_add_ps(mv, _mm256_loadu_ps(out_ + x4)));
+					_mm256_storeu_ps(out_ + x4, _mm256_div_ps(mv, _mm256_shuffle_ps(mv, mv, 0xFF)));
+				}
+				for (; x < xe; x++)
+				{
+					const int x4 = 4 * x;
+					const __m128 malpha = _mm_set1_ps(wy[x]);
+					__m128 mv = _mm_fmadd_ps(minvalpha, _mm_loadu_ps(xcy + x4), _mm_mul_ps(malpha, _mm_loadu_ps(ypy_ + x4)));
+					_mm_storeu_ps(ycy_ + x4, mv);
+					mv = _mm_mul_ps(m05mul, _mm_add_ps(mv, _mm_loadu_ps(out_ + x4)));
+					_mm_storeu_ps(out_ + x4, _mm_div_ps(mv, _mm_shuffle_ps(mv, mv, 0xFF)));
+				}
 			}
 		}
-		//
-		for (int y = h1 - 1; y >= 0; y--)
-		{
-			float* tpy = texture.ptr<float>(y + 1);
-			float* tcy = texture.ptr<float>(y);
-			float* xcy = temp.ptr<float>(y);
-			float* ycy_ = ycy;
-			float* ypy_ = ypy;
-			float* out_ = destf.ptr<float>(y);
 
+		dest.create(src.size(), src.type());
+#pragma omp parallel for schedule(static)
+		for (int y = 0; y < h; y++)
+		{
+			const float* s = destf.ptr<float>(y);
+			uchar* d = dest.ptr<uchar>(y);
 			for (int x = 0; x < w; x++)
 			{
-				const int x4 = 4 * x;
-				__m128 mtcy = _mm_loadu_ps(tcy + x4);
-				__m128 mtpy = _mm_loadu_ps(tpy + x4);
-				__m128 a = _mm_and_ps(_mm_sub_ps(mtcy, mtpy), *(const __m128*)v32f_absmask);
-				const float alpha_ = alpha * range_table[cvRound(_mm_reduceadd_ps(a) * 0.3333f)];
-
-				const __m128 malpha = _mm_set1_ps(alpha_);
-
-				__m128  mv = _mm_fmadd_ps(minvalpha, _mm_loadu_ps(xcy + x4), _mm_mul_ps(malpha, _mm_loadu_ps(ypy_ + x4)));
-				_mm_storeu_ps(ycy_ + x4, mv);
-				mv = _mm_mul_ps(m05mul, _mm_add_ps(mv, _mm_loadu_ps(out_ + x4)));
-				__m128  mdiv = _mm_shuffle_ps(mv, mv, 0xFF);
-				_mm_storeu_ps(out_ + x4, _mm_div_ps(mv, mdiv));
+				d[3 * x + 0] = saturate_cast<uchar>(s[4 * x + 0]);
+				d[3 * x + 1] = saturate_cast<uchar>(s[4 * x + 1]);
+				d[3 * x + 2] = saturate_cast<uchar>(s[4 * x + 2]);
 			}
-			memcpy(ypy, ycy, w * 4);
 		}
-
-		destf.convertTo(bgra, src.type());
-		cvtColorBGRA2BGR(bgra, dest);
 	}
 
 	void RecursiveBilateralFilter::operator()(const Mat& src, Mat& dest, float sigma_range, float sigma_spatial)
@@ -123,8 +123,9 @@ namespace cp
 		const float* src_ptr = src.ptr<float>();
 		float* dest_ptr = dest.ptr<float>();
 		const int simd_n = get_simd_floor(n, 8);
-		__m256 ms = _mm256_set1_ps(scale);
-		__m256 ones = _mm256_set1_ps(1.f);
+		const __m256 ms = _mm256_set1_ps(scale);
+		const __m256 ones = _mm256_set1_ps(1.f);
+#pragma omp parallel for schedule(static) if(n >= 256 * 256)
 		for (int i = 0; i < simd_n; i += 8)
 		{
 			_mm256_store_ps(dest_ptr + i, _mm256_min_ps(_mm256_mul_ps(_mm256_load_ps(src_ptr + i), ms), ones));
@@ -191,12 +192,80 @@ namespace cp
 		return body(src, dest);
 	}
 
+	int IntensityRemappedDither::generate(const Mat& src, std::vector<cv::Point>& destPoints, const float ratio)
+	{
+		maskbuff.create(src.size(), CV_8U);
+		generate(src, maskbuff, ratio);
+		return convertSamplingMaskToPoints(maskbuff, destPoints);
+	}
+
+	int convertSamplingMaskToPoints(const cv::Mat& mask, std::vector<cv::Point>& dest)
+	{
+		CV_Assert(mask.depth() == CV_8U && mask.channels() == 1);
+
+		const int width = mask.cols;
+		const int height = mask.rows;
+		const int simd_width = get_simd_floor(width, 32);
+		const __m256i mzero = _mm256_setzero_si256();
+
+		//1st pass: count samples for each row
+		AutoBuffer<int> rowoffset(height + 1);
+#pragma omp parallel for schedule(static)
+		for (int j = 0; j < height; j++)
+		{
+			const uchar* m = mask.ptr<uchar>(j);
+			int count = 0;
+			for (int i = 0; i < simd_width; i += 32)
+			{
+				const unsigned int bits = ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(m + i)), mzero));
+				count += _mm_popcnt_u32(bits);
+			}
+			for (int i = simd_width; i < width; i++)
+			{
+				if (m[i] != 0) count++;
+			}
+			rowoffset[j + 1] = count;
+		}
+		rowoffset[0] = 0;
+		for (int j = 0; j < height; j++) rowoffset[j + 1] += rowoffset[j];
+
+		//2nd pass: each row writes its own range, so the output is raster order for any number of threads
+		dest.resize(rowoffset[height]);
+#pragma omp parallel for schedule(static)
+		for (int j = 0; j < height; j++)
+		{
+			const uchar* m = mask.ptr<uchar>(j);
+			cv::Point* d = dest.data() + rowoffset[j];
+			for (int i = 0; i < simd_width; i += 32)
+			{
+				unsigned int bits = ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(m + i)), mzero));
+				while (bits != 0)
+				{
+					*d++ = cv::Point(i + (int)_tzcnt_u32(bits), j);
+					bits &= bits - 1;
+				}
+			}
+			for (int i = simd_width; i < width; i++)
+			{
+				if (m[i] != 0) *d++ = cv::Point(i, j);
+			}
+		}
+
+		return rowoffset[height];
+	}
+
 	int generateSamplingMaskRemappedDitherWeight(const cv::Mat& weight, cv::Mat& dest, const float sampling_ratio, const int dithering_method, const int dithering_order, const float bin_ratio, const int maskOption)
 	{
 		IntensityRemappedDither dither(weight.size(), sampling_ratio, dithering_method, dithering_order, maskOption);
 		return dither.generate(weight, dest, sampling_ratio);
 	}
 
+	int generateSamplingPointsRemappedDitherWeight(const cv::Mat& weight, std::vector<cv::Point>& dest, const float sampling_ratio, const int dithering_method, const int dithering_order, const float bin_ratio, const int maskOption)
+	{
+		IntensityRemappedDither dither(weight.size(), sampling_ratio, dithering_method, dithering_order, maskOption);
+		return dither.generate(weight, dest, sampling_ratio);
+	}
+
 	void Swap(cv::Mat& importanceMap, int px, int py, int qx, int qy)
 	{
 		float tmp = importanceMap.at<float>(py, px);
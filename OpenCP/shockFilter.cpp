@@ -1,53 +1,301 @@
 #include "shockFilter.hpp"
+#include <omp.h>
 
 using namespace std;
 using namespace cv;
 
 namespace cp
 {
+	static void padLineReflect101(const float* src, float* dst, const int width, const int r)
+	{
+		memcpy(dst + r, src, sizeof(float) * width);
+		for (int i = 1; i <= r; i++)
+		{
+			dst[r - i] = src[borderInterpolate(-i, width, BORDER_REFLECT_101)];
+			dst[r + width - 1 + i] = src[borderInterpolate(width - 1 + i, width, BORDER_REFLECT_101)];
+		}
+	}
+
+	//gradient products of the structure tensor at row y (3x3 Sobel, BORDER_REFLECT_101), same as cornerEigenValsAndVecs
+	static void structureTensorLine(const Mat& gray, const int y, const float scale, float* pad, float* a, float* b, float* c)
+	{
+		const int width = gray.cols;
+		const int height = gray.rows;
+		float* p0 = pad;
+		float* p1 = pad + (width + 2);
+		float* p2 = pad + 2 * (width + 2);
+		padLineReflect101(gray.ptr<float>(borderInterpolate(y - 1, height, BORDER_REFLECT_101)), p0, width, 1);
+		padLineReflect101(gray.ptr<float>(borderInterpolate(y + 0, height, BORDER_REFLECT_101)), p1, width, 1);
+		padLineReflect101(gray.ptr<float>(borderInterpolate(y + 1, height, BORDER_REFLECT_101)), p2, width, 1);
+		for (int x = 0; x < width; x++)
+		{
+			const int i = x + 1;
+			const float dx = scale * ((p0[i + 1] - p0[i - 1]) + 2.f * (p1[i + 1] - p1[i - 1]) + (p2[i + 1] - p2[i - 1]));
+			const float dy = scale * ((p2[i - 1] + 2.f * p2[i] + p2[i + 1]) - (p0[i - 1] + 2.f * p0[i] + p0[i + 1]));
+			a[x] = dx * dx;
+			b[x] = dx * dy;
+			c[x] = dy * dy;
+		}
+	}
 
-	void coherenceEnhancingShockFilter(cv::InputArray src, cv::OutputArray dest_, const int sigma, const int str_sigma_, const double blend, const int iter)
+	//unnormalized horizontal box of the column sums (BORDER_REFLECT_101)
+	static void boxLineReflect101(const double* col, double* pad, float* dest, const int width, const int ksize)
 	{
-		Mat dest = src.getMat();
-		const int str_sigma = min(31, str_sigma_);
+		const int left = ksize / 2;
+		const int right = ksize - 1 - left;
+		memcpy(pad + left, col, sizeof(double) * width);
+		for (int i = 1; i <= left; i++) pad[left - i] = col[borderInterpolate(-i, width, BORDER_REFLECT_101)];
+		for (int i = 1; i <= right; i++) pad[left + width - 1 + i] = col[borderInterpolate(width - 1 + i, width, BORDER_REFLECT_101)];
 
-		for (int i = 0; i < iter; i++)
+		double s = 0.0;
+		for (int k = 0; k < ksize; k++) s += pad[k];
+		dest[0] = (float)s;
+		for (int x = 1; x < width; x++)
 		{
-			Mat gray;
-			if (src.channels() == 3)cvtColor(dest, gray, COLOR_BGR2GRAY);
-			else gray = dest;
-
-			Mat eigen;
-			if (gray.type() == CV_8U || gray.type() == CV_32F || gray.type() == CV_64F)
-				cornerEigenValsAndVecs(gray, eigen, str_sigma, 3);
-			else
+			s += pad[x + ksize - 1] - pad[x - 1];
+			dest[x] = (float)s;
+		}
+	}
+
+	//fused implementation: each row band computes the structure tensor (box of gradient products) with sliding column sums,
+	//the second derivatives with a ring buffer of horizontally filtered rows, and the shock update in one sweep.
+	//The iterations run inside one parallel region, so that per-thread buffers are kept across iterations.
+	void coherenceEnhancingShockFilter(cv::InputArray src_, cv::OutputArray dest_, const int sigma, const int str_sigma_, const double blend, const int iter)
+	{
+		CV_Assert(src_.channels() == 1 || src_.channels() == 3);
+		const int str_sigma = max(1, min(31, str_sigma_));
+		Mat src = src_.getMat();
+		if (iter <= 0)
+		{
+			src.copyTo(dest_);
+			return;
+		}
+
+		const int width = src.cols;
+		const int height = src.rows;
+		const int cn = src.channels();
+
+		Mat image[2];//ping-pong
+		src.convertTo(image[0], CV_32F);
+		image[1].create(src.size(), image[0].type());
+		Mat gray[2];
+		if (cn == 3)
+		{
+			cvtColor(image[0], gray[0], COLOR_BGR2GRAY);
+			gray[1].create(src.size(), CV_32F);
+		}
+
+		//Sobel kernels of the second derivatives (gxx, gyy, gxy), zero padded to the same length
+		Mat kx[3], ky[3];
+		getDerivKernels(kx[0], ky[0], 2, 0, sigma, false, CV_32F);
+		getDerivKernels(kx[1], ky[1], 0, 2, sigma, false, CV_32F);
+		getDerivKernels(kx[2], ky[2], 1, 1, sigma, false, CV_32F);
+		int klen = 1;
+		for (int i = 0; i < 3; i++) klen = max(klen, max((int)kx[i].total(), (int)ky[i].total()));
+		const int kr = klen / 2;
+		AutoBuffer<float> hkernel(3 * klen);
+		AutoBuffer<float> vkernel(3 * klen);
+		for (int i = 0; i < 3 * klen; i++) hkernel[i] = vkernel[i] = 0.f;
+		for (int i = 0; i < 3; i++)
+		{
+			const int hl = (int)kx[i].total();
+			const int vl = (int)ky[i].total();
+			for (int k = 0; k < hl; k++) hkernel[klen * i + kr - hl / 2 + k] = kx[i].ptr<float>()[k];
+			for (int k = 0; k < vl; k++) vkernel[klen * i + kr - vl / 2 + k] = ky[i].ptr<float>()[k];
+		}
+
+		//derivative scale of cornerEigenValsAndVecs (aperture 3)
+		const float scale = float(1.0 / (4.0 * str_sigma * ((src.depth() == CV_8U) ? 255.0 : 1.0)));
+		const int box_anchor = str_sigma / 2;
+		const float b0 = (float)blend;
+		const float b1 = (float)(1.0 - blend);
+
+		const int threads = omp_get_max_threads();
+		const int band_height = max(16, (height + 4 * threads - 1) / (4 * threads));
+		const int bands = (height + band_height - 1) / band_height;
+		const int wstep = width * cn;
+
+#pragma omp parallel
+		{
+			//per-thread buffers, kept across iterations
+			AutoBuffer<float> pad(3 * (width + 2));
+			AutoBuffer<float> tensor(3 * width);
+			AutoBuffer<double> colsum(3 * width);
+			AutoBuffer<double> boxpad(width + str_sigma);
+			AutoBuffer<float> box(3 * width);
+			AutoBuffer<float> graypad(width + 2 * kr);
+			AutoBuffer<float> ring(3 * klen * width);
+			AutoBuffer<float> deriv(3 * width);
+			AutoBuffer<float> vmin(wstep);
+			AutoBuffer<float> vmax(wstep);
+			AutoBuffer<const float*> vptr(klen);
+			float* ta = &tensor[0];
+			float* tb = &tensor[width];
+			float* tc = &tensor[2 * width];
+			double* ca = &colsum[0];
+			double* cb = &colsum[width];
+			double* cc = &colsum[2 * width];
+
+			for (int it = 0; it < iter; it++)
 			{
-				Mat grayf; gray.convertTo(grayf, CV_32F);
-				cornerEigenValsAndVecs(grayf, eigen, str_sigma, 3);
-			}
+				const Mat& cur = image[it & 1];
+				Mat& next = image[(it + 1) & 1];
+				const Mat& g = (cn == 1) ? cur : gray[it & 1];
+				Mat& gnext = gray[(it + 1) & 1];
 
-			vector<Mat> esplit(6);
-			split(eigen, esplit);
-			Mat x = esplit[2];
-			Mat y = esplit[3];
-			Mat gxx;
-			Mat gyy;
-			Mat gxy;
-			Sobel(gray, gxx, CV_32F, 2, 0, sigma);
-			Sobel(gray, gyy, CV_32F, 0, 2, sigma);
-			Sobel(gray, gxy, CV_32F, 1, 1, sigma);
-
-			Mat gvv = x.mul(x).mul(gxx) + 2 * x.mul(y).mul(gxy) + y.mul(y).mul(gyy);
-
-			Mat mask;
-			compare(gvv, 0, mask, cv::CMP_LT);
-
-			Mat di, ero;
-			erode(dest, ero, Mat());
-			dilate(dest, di, Mat());
-			di.copyTo(ero, mask);
-			addWeighted(dest, blend, ero, 1.0 - blend, 0.0, dest);
+#pragma omp for schedule(dynamic)
+				for (int band = 0; band < bands; band++)
+				{
+					const int y0 = band * band_height;
+					const int y1 = min(height, y0 + band_height);
+
+					//horizontally filtered gray row yy into the ring slot of the band
+					auto hfilter = [&](const int yy)
+					{
+						padLineReflect101(g.ptr<float>(borderInterpolate(yy, height, BORDER_REFLECT_101)), &graypad[0], width, kr);
+						const int slot = (yy - y0 + kr) % klen;
+						for (int i = 0; i < 3; i++)
+						{
+							const float* hk = &hkernel[klen * i];
+							float* dst = &ring[(klen * i + slot) * width];
+							for (int x = 0; x < width; x++) dst[x] = 0.f;
+							for (int k = 0; k < klen; k++)
+							{
+								if (hk[k] == 0.f) continue;
+								const float w = hk[k];
+								const float* s = &graypad[k];
+								for (int x = 0; x < width; x++) dst[x] += w * s[x];
+							}
+						}
+					};
+
+					//initialize column sums of the box window and the ring
+					for (int x = 0; x < width; x++) ca[x] = cb[x] = cc[x] = 0.0;
+					for (int yy = y0 - box_anchor; yy < y0 - box_anchor + str_sigma; yy++)
+					{
+						structureTensorLine(g, borderInterpolate(yy, height, BORDER_REFLECT_101), scale, &pad[0], ta, tb, tc);
+						for (int x = 0; x < width; x++)
+						{
+							ca[x] += ta[x];
+							cb[x] += tb[x];
+							cc[x] += tc[x];
+						}
+					}
+					for (int yy = y0 - kr; yy < y0 + kr; yy++) hfilter(yy);
+
+					for (int y = y0; y < y1; y++)
+					{
+						//structure tensor
+						boxLineReflect101(ca, &boxpad[0], &box[0], width, str_sigma);
+						boxLineReflect101(cb, &boxpad[0], &box[width], width, str_sigma);
+						boxLineReflect101(cc, &boxpad[0], &box[2 * width], width, str_sigma);
+
+						//second derivatives
+						hfilter(y + kr);
+						for (int i = 0; i < 3; i++)
+						{
+							const float* vk = &vkernel[klen * i];
+							for (int k = 0; k < klen; k++) vptr[k] = &ring[(klen * i + (y - y0 + k) % klen) * width];
+							float* dst = &deriv[i * width];
+							for (int x = 0; x < width; x++) dst[x] = 0.f;
+							for (int k = 0; k < klen; k++)
+							{
+								if (vk[k] == 0.f) continue;
+								const float w = vk[k];
+								const float* s = vptr[k];
+								for (int x = 0; x < width; x++) dst[x] += w * s[x];
+							}
+						}
+
+						//vertical 3 tap min/max for erosion and dilation
+						const float* cu = cur.ptr<float>(max(y - 1, 0));
+						const float* cm = cur.ptr<float>(y);
+						const float* cd = cur.ptr<float>(min(y + 1, height - 1));
+						for (int x = 0; x < wstep; x++)
+						{
+							vmin[x] = min(cm[x], min(cu[x], cd[x]));
+							vmax[x] = max(cm[x], max(cu[x], cd[x]));
+						}
+
+						float* dptr = next.ptr<float>(y);
+						const float* gxx = &deriv[0];
+						const float* gyy = &deriv[width];
+						const float* gxy = &deriv[2 * width];
+						for (int x = 0; x < width; x++)
+						{
+							//eigenvector of the largest eigenvalue, same as cornerEigenValsAndVecs
+							const float a = box[x];
+							const float b = box[width + x];
+							const float c = box[2 * width + x];
+							const float u = (a + c) * 0.5f;
+							const float v = std::sqrt((a - c) * (a - c) * 0.25f + b * b);
+							const float l1 = u + v;
+							float ex = b;
+							float ey = l1 - a;
+							if (abs(ex) + abs(ey) < 1e-4f)
+							{
+								ey = b;
+								ex = l1 - c;
+								if (abs(ex) + abs(ey) < 1e-4f)
+								{
+									const float e = 1.f / (abs(ex) + abs(ey) + FLT_EPSILON);
+									ex *= e;
+									ey *= e;
+								}
+							}
+							const float d = 1.f / std::sqrt(ex * ex + ey * ey + FLT_MIN);
+							ex *= d;
+							ey *= d;
+
+							const float gvv = ex * ex * gxx[x] + 2.f * ex * ey * gxy[x] + ey * ey * gyy[x];
+							const int xl = cn * max(x - 1, 0);
+							const int xc = cn * x;
+							const int xr = cn * min(x + 1, width - 1);
+							if (gvv < 0.f)//dilate
+							{
+								for (int ch = 0; ch < cn; ch++)
+								{
+									const float m = max(vmax[xc + ch], max(vmax[xl + ch], vmax[xr + ch]));
+									dptr[xc + ch] = b0 * cm[xc + ch] + b1 * m;
+								}
+							}
+							else//erode
+							{
+								for (int ch = 0; ch < cn; ch++)
+								{
+									const float m = min(vmin[xc + ch], min(vmin[xl + ch], vmin[xr + ch]));
+									dptr[xc + ch] = b0 * cm[xc + ch] + b1 * m;
+								}
+							}
+						}
+						if (cn == 3)
+						{
+							float* gptr = gnext.ptr<float>(y);
+							for (int x = 0; x < width; x++) gptr[x] = 0.114f * dptr[3 * x + 0] + 0.587f * dptr[3 * x + 1] + 0.299f * dptr[3 * x + 2];
+						}
+
+						//slide the box window
+						if (y + 1 < y1)
+						{
+							structureTensorLine(g, borderInterpolate(y - box_anchor, height, BORDER_REFLECT_101), scale, &pad[0], ta, tb, tc);
+							for (int x = 0; x < width; x++)
+							{
+								ca[x] -= ta[x];
+								cb[x] -= tb[x];
+								cc[x] -= tc[x];
+							}
+							structureTensorLine(g, borderInterpolate(y - box_anchor + str_sigma, height, BORDER_REFLECT_101), scale, &pad[0], ta, tb, tc);
+							for (int x = 0; x < width; x++)
+							{
+								ca[x] += ta[x];
+								cb[x] += tb[x];
+								cc[x] += tc[x];
+							}
+						}
+					}
+				}
+			}
 		}
-		dest.copyTo(dest_);
+		image[iter & 1].convertTo(dest_, src.depth());
 	}
 }
\ No newline at end of file
@@ -124,6 +124,11 @@ namespace cp
 		data.push_back(val);
 	}
 
+	void Stat::merge(const Stat& stat)
+	{
+		data.insert(data.end(), stat.data.begin(), stat.data.end());
+	}
+
 	void Stat::clear()
 	{
 		data.clear();
@@ -1,200 +1,697 @@
 #include "statisticalFilter.hpp"
+#include "inlineSIMDFunctions.hpp"
 
 using namespace std;
 using namespace cv;
 
 namespace cp
 {
+#pragma region local statistics
+	template<typename T>
+	static inline void minLine(const T* a, const T* b, T* d, const int n)
+	{
+		for (int x = 0; x < n; x++) d[x] = min(a[x], b[x]);
+	}
 
-	void maxFilter(InputArray src, OutputArray dest, Size kernelSize, int shape)
+	template<typename T>
+	static inline void maxLine(const T* a, const T* b, T* d, const int n)
 	{
-		Mat element = getStructuringElement(shape, kernelSize);
-		dilate(src, dest, element);
+		for (int x = 0; x < n; x++) d[x] = max(a[x], b[x]);
 	}
 
-	void minFilter(InputArray src, OutputArray dest, Size kernelSize, int shape)
+	template<>
+	inline void minLine<uchar>(const uchar* a, const uchar* b, uchar* d, const int n)
 	{
-		Mat element = getStructuringElement(shape, kernelSize);
-		erode(src, dest, element);
+		int x = 0;
+		for (; x <= n - 32; x += 32)
+		{
+			_mm256_storeu_si256((__m256i*)(d + x), _mm256_min_epu8(_mm256_loadu_si256((const __m256i*)(a + x)), _mm256_loadu_si256((const __m256i*)(b + x))));
+		}
+		for (; x < n; x++) d[x] = min(a[x], b[x]);
 	}
 
-	void minFilter(InputArray src, OutputArray dest, int radius)
+	template<>
+	inline void maxLine<uchar>(const uchar* a, const uchar* b, uchar* d, const int n)
 	{
-		minFilter(src, dest, Size(2 * radius + 1, 2 * radius + 1));
+		int x = 0;
+		for (; x <= n - 32; x += 32)
+		{
+			_mm256_storeu_si256((__m256i*)(d + x), _mm256_max_epu8(_mm256_loadu_si256((const __m256i*)(a + x)), _mm256_loadu_si256((const __m256i*)(b + x))));
+		}
+		for (; x < n; x++) d[x] = max(a[x], b[x]);
 	}
 
-	void maxFilter(InputArray src, OutputArray dest, int radius)
+	template<>
+	inline void minLine<short>(const short* a, const short* b, short* d, const int n)
 	{
-		maxFilter(src, dest, Size(2 * radius + 1, 2 * radius + 1));
+		int x = 0;
+		for (; x <= n - 16; x += 16)
+		{
+			_mm256_storeu_si256((__m256i*)(d + x), _mm256_min_epi16(_mm256_loadu_si256((const __m256i*)(a + x)), _mm256_loadu_si256((const __m256i*)(b + x))));
+		}
+		for (; x < n; x++) d[x] = min(a[x], b[x]);
 	}
 
-	template<class srcType>
-	void blurRemoveMinMax_(const Mat& src, Mat& dest, const int r)
+	template<>
+	inline void maxLine<short>(const short* a, const short* b, short* d, const int n)
 	{
-		const Size ksize = Size(2 * r + 1, 2 * r + 1);
-		if (src.data != dest.data)src.copyTo(dest);
+		int x = 0;
+		for (; x <= n - 16; x += 16)
+		{
+			_mm256_storeu_si256((__m256i*)(d + x), _mm256_max_epi16(_mm256_loadu_si256((const __m256i*)(a + x)), _mm256_loadu_si256((const __m256i*)(b + x))));
+		}
+		for (; x < n; x++) d[x] = max(a[x], b[x]);
+	}
 
-		Mat xv;
-		Mat nv;
-		Mat element = Mat::ones(2 * r + 1, 2 * r + 1, CV_8U);
-		dilate(src, xv, element);
-		erode(src, nv, element);
+	template<>
+	inline void minLine<ushort>(const ushort* a, const ushort* b, ushort* d, const int n)
+	{
+		int x = 0;
+		for (; x <= n - 16; x += 16)
+		{
+			_mm256_storeu_si256((__m256i*)(d + x), _mm256_min_epu16(_mm256_loadu_si256((const __m256i*)(a + x)), _mm256_loadu_si256((const __m256i*)(b + x))));
+		}
+		for (; x < n; x++) d[x] = min(a[x], b[x]);
+	}
 
-		Mat mind;
-		Mat maxd;
-		Mat mask;
-		absdiff(src, nv, mind);//can move to loop
-		absdiff(src, xv, maxd);//
-		min(mind, maxd, mask);//
+	template<>
+	inline void maxLine<ushort>(const ushort* a, const ushort* b, ushort* d, const int n)
+	{
+		int x = 0;
+		for (; x <= n - 16; x += 16)
+		{
+			_mm256_storeu_si256((__m256i*)(d + x), _mm256_max_epu16(_mm256_loadu_si256((const __m256i*)(a + x)), _mm256_loadu_si256((const __m256i*)(b + x))));
+		}
+		for (; x < n; x++) d[x] = max(a[x], b[x]);
+	}
 
-		srcType* n = nv.ptr<srcType>(0);
-		srcType* x = xv.ptr<srcType>(0);
-		srcType* d = dest.ptr<srcType>(0);
-		srcType* nd = mind.ptr<srcType>(0);
-		srcType* mk = mask.ptr<srcType>(0);
+	template<>
+	inline void minLine<float>(const float* a, const float* b, float* d, const int n)
+	{
+		int x = 0;
+		for (; x <= n - 8; x += 8)
+		{
+			_mm256_storeu_ps(d + x, _mm256_min_ps(_mm256_loadu_ps(a + x), _mm256_loadu_ps(b + x)));
+		}
+		for (; x < n; x++) d[x] = min(a[x], b[x]);
+	}
 
-		int remsize = src.size().area();
+	template<>
+	inline void maxLine<float>(const float* a, const float* b, float* d, const int n)
+	{
+		int x = 0;
+		for (; x <= n - 8; x += 8)
+		{
+			_mm256_storeu_ps(d + x, _mm256_max_ps(_mm256_loadu_ps(a + x), _mm256_loadu_ps(b + x)));
+		}
+		for (; x < n; x++) d[x] = max(a[x], b[x]);
+	}
 
-#if CV_SSE4_1
-		if (src.depth() == CV_8U)
+	//van Herk/Gil-Werman vertical pass for the rows [y0, y1) and the element columns [xs, xs + n):
+	//the lines [y0 - ay, y1 + kh - 1 - ay) are cut into blocks of kh, and the window is min(suffix of its first block, prefix of its last block).
+	template<typename T, bool isMax>
+	static void vhgwVertical(const Mat& src, Mat& dest, const int y0, const int y1, const int xs, const int n, const int kh, const int ay, T* g, T* h, const T* border)
+	{
+		const int strip = n;
+		const int lines = (y1 - y0 + kh - 1 + kh - 1) / kh * kh;
+		auto line = [&](const int i)->const T* { const int y = y0 - ay + i; return (y < 0 || y >= src.rows) ? border : src.ptr<T>(y) + xs; };
+		for (int i = 0; i < lines; i++)
+		{
+			if (i % kh == 0) memcpy(g + strip * i, line(i), sizeof(T) * n);
+			else if (isMax) maxLine(g + strip * (i - 1), line(i), g + strip * i, n);
+			else minLine(g + strip * (i - 1), line(i), g + strip * i, n);
+		}
+		for (int i = lines - 1; i >= 0; i--)
+		{
+			if (i % kh == kh - 1) memcpy(h + strip * i, line(i), sizeof(T) * n);
+			else if (isMax) maxLine(h + strip * (i + 1), line(i), h + strip * i, n);
+			else minLine(h + strip * (i + 1), line(i), h + strip * i, n);
+		}
+		for (int y = y0; y < y1; y++)
 		{
+			const int j = y - y0;
+			if (isMax) maxLine(h + strip * j, g + strip * (j + kh - 1), dest.ptr<T>(y) + xs, n);
+			else minLine(h + strip * j, g + strip * (j + kh - 1), dest.ptr<T>(y) + xs, n);
+		}
+	}
 
-			const int ssesize = src.size().area() / 16;
-			remsize = src.size().area() - ssesize * 16;
-			for (int i = 0; i < ssesize; i++)
-			{
-				__m128i mmk = _mm_load_si128((__m128i*)mk);
-				__m128i mnd = _mm_load_si128((__m128i*)nd);
-
-				__m128i mmn = _mm_load_si128((__m128i*)n);
-				__m128i mmx = _mm_load_si128((__m128i*)x);
-				__m128i msk = _mm_cmpeq_epi8(mnd, mmk);
-				_mm_stream_si128((__m128i*)d, _mm_blendv_epi8(mmx, mmn, msk));
-				nd += 16;
-				mk += 16;
-				d += 16;
-				n += 16;
-				x += 16;
-			}
+	//van Herk/Gil-Werman horizontal pass for an interleaved row (pixel blocks of kw, channel stride cn)
+	template<typename T, bool isMax>
+	static void vhgwHorizontal(const T* s, T* d, const int width, const int cn, const int kw, const int ax, T* l, T* g, T* h, const T borderval)
+	{
+		const int len = (width + kw - 1 + kw - 1) / kw * kw * cn;
+		for (int i = 0; i < ax * cn; i++) l[i] = borderval;
+		memcpy(l + ax * cn, s, sizeof(T) * width * cn);
+		for (int i = (ax + width) * cn; i < len; i++) l[i] = borderval;
+
+		for (int i = 0; i < len; i++)
+		{
+			if ((i / cn) % kw == 0) g[i] = l[i];
+			else g[i] = (isMax) ? max(g[i - cn], l[i]) : min(g[i - cn], l[i]);
+		}
+		for (int i = len - 1; i >= 0; i--)
+		{
+			if ((i / cn) % kw == kw - 1) h[i] = l[i];
+			else h[i] = (isMax) ? max(h[i + cn], l[i]) : min(h[i + cn], l[i]);
 		}
-		else if (src.depth() == CV_16S || src.depth() == CV_16U)
+		const int offset = (kw - 1) * cn;
+		for (int i = 0; i < width * cn; i++)
 		{
+			d[i] = (isMax) ? max(h[i], g[i + offset]) : min(h[i], g[i + offset]);
+		}
+	}
+
+	//moments are accumulated as planar column sums of x and x^2 (AT: uint for 8U with a small kernel, double otherwise),
+	//and the horizontal window sums are differences of row prefix sums over the reflect-101 padded row.
+	template<typename T, typename AT>
+	static void momentAddLine(const T* s, AT* sum, AT* sq, const int n)
+	{
+		for (int x = 0; x < n; x++)
+		{
+			const AT v = (AT)s[x];
+			sum[x] += v;
+			sq[x] += v * v;
+		}
+	}
+
+	//sum += a - b, sq += a^2 - b^2
+	template<typename T, typename AT>
+	static void momentSlideLine(const T* a, const T* b, AT* sum, AT* sq, const int n)
+	{
+		for (int x = 0; x < n; x++)
+		{
+			const AT va = (AT)a[x];
+			const AT vb = (AT)b[x];
+			sum[x] += va - vb;
+			sq[x] += va * va - vb * vb;
+		}
+	}
 
-			const int ssesize = src.size().area() / 8;
-			remsize = src.size().area() - ssesize * 8;
-			for (int i = 0; i < ssesize; i++)
+	template<>
+	void momentAddLine<uchar, uint>(const uchar* s, uint* sum, uint* sq, const int n)
+	{
+		int x = 0;
+		for (; x <= n - 8; x += 8)
+		{
+			const __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(s + x)));
+			_mm256_storeu_si256((__m256i*)(sum + x), _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(sum + x)), v));
+			_mm256_storeu_si256((__m256i*)(sq + x), _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(sq + x)), _mm256_madd_epi16(v, v)));//v < 256: madd of (v, 0) pairs is v^2
+		}
+		for (; x < n; x++)
+		{
+			sum[x] += s[x];
+			sq[x] += s[x] * s[x];
+		}
+	}
+
+	template<>
+	void momentSlideLine<uchar, uint>(const uchar* a, const uchar* b, uint* sum, uint* sq, const int n)
+	{
+		int x = 0;
+		for (; x <= n - 8; x += 8)
+		{
+			const __m256i va = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(a + x)));
+			const __m256i vb = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(b + x)));
+			_mm256_storeu_si256((__m256i*)(sum + x), _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(sum + x)), _mm256_sub_epi32(va, vb)));
+			_mm256_storeu_si256((__m256i*)(sq + x), _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(sq + x)), _mm256_sub_epi32(_mm256_madd_epi16(va, va), _mm256_madd_epi16(vb, vb))));
+		}
+		for (; x < n; x++)
+		{
+			sum[x] += a[x] - b[x];
+			sq[x] += a[x] * a[x] - b[x] * b[x];
+		}
+	}
+
+	template<>
+	void momentAddLine<float, double>(const float* s, double* sum, double* sq, const int n)
+	{
+		int x = 0;
+		for (; x <= n - 4; x += 4)
+		{
+			const __m256d v = _mm256_cvtps_pd(_mm_loadu_ps(s + x));
+			_mm256_storeu_pd(sum + x, _mm256_add_pd(_mm256_loadu_pd(sum + x), v));
+			_mm256_storeu_pd(sq + x, _mm256_add_pd(_mm256_loadu_pd(sq + x), _mm256_mul_pd(v, v)));
+		}
+		for (; x < n; x++)
+		{
+			const double v = (double)s[x];
+			sum[x] += v;
+			sq[x] += v * v;
+		}
+	}
+
+	template<>
+	void momentSlideLine<float, double>(const float* a, const float* b, double* sum, double* sq, const int n)
+	{
+		int x = 0;
+		for (; x <= n - 4; x += 4)
+		{
+			const __m256d va = _mm256_cvtps_pd(_mm_loadu_ps(a + x));
+			const __m256d vb = _mm256_cvtps_pd(_mm_loadu_ps(b + x));
+			_mm256_storeu_pd(sum + x, _mm256_add_pd(_mm256_loadu_pd(sum + x), _mm256_sub_pd(va, vb)));
+			_mm256_storeu_pd(sq + x, _mm256_add_pd(_mm256_loadu_pd(sq + x), _mm256_sub_pd(_mm256_mul_pd(va, va), _mm256_mul_pd(vb, vb))));
+		}
+		for (; x < n; x++)
+		{
+			const double va = (double)a[x];
+			const double vb = (double)b[x];
+			sum[x] += va - vb;
+			sq[x] += va * va - vb * vb;
+		}
+	}
+
+	//prefix sums of the column sums along the padded row of width + kw - 1 pixels (xofs: reflect-101 element offsets of the padded pixels).
+	//The window sum of element i is p[i + kw * cn] - p[i]; uint prefix sums wrap, and the difference is still exact.
+	//[start, end): element range of the padded row that is computed here
+	template<typename AT>
+	static void momentPrefixScalar(const AT* sum, const AT* sq, AT* psum, AT* psq, const int* xofs, const int cn, const int start, const int end)
+	{
+		for (int i = start; i < end; i++)
+		{
+			const int c = i % cn;
+			psum[i + cn] = psum[i] + sum[xofs[i / cn] + c];
+			psq[i + cn] = psq[i] + sq[xofs[i / cn] + c];
+		}
+	}
+
+	template<typename AT>
+	static void momentPrefix(const AT* sum, const AT* sq, AT* psum, AT* psq, const int* xofs, const int width, const int kw, const int cn)
+	{
+		for (int c = 0; c < cn; c++)
+		{
+			psum[c] = 0;
+			psq[c] = 0;
+		}
+		momentPrefixScalar(sum, sq, psum, psq, xofs, cn, 0, (width + kw - 1) * cn);
+	}
+
+	//in the interior of the padded row, the column sums are contiguous: each SIMD block is scanned in register with stride cn
+	//(log2(lanes / cn) shifted adds), and the prefix of the same channel before the block is added as the carry.
+	template<>
+	void momentPrefix<uint>(const uint* sum, const uint* sq, uint* psum, uint* psq, const int* xofs, const int width, const int kw, const int cn)
+	{
+		const int ax = kw / 2;
+		const int istart = ax * cn;
+		const int iend = (ax + width) * cn;
+		for (int c = 0; c < cn; c++)
+		{
+			psum[c] = 0;
+			psq[c] = 0;
+		}
+		momentPrefixScalar(sum, sq, psum, psq, xofs, cn, 0, istart);
+
+		const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+		__m256i sidx[3], smask[3];
+		int scans = 0;
+		for (int sh = cn; sh < 8; sh *= 2, scans++)
+		{
+			const __m256i msh = _mm256_set1_epi32(sh);
+			sidx[scans] = _mm256_sub_epi32(lane, msh);
+			smask[scans] = _mm256_cmpgt_epi32(msh, lane);//lanes below the shift are not added
+		}
+		int cbuf[8];
+		for (int l = 0; l < 8; l++) cbuf[l] = l % cn;
+		const __m256i cidx = _mm256_loadu_si256((const __m256i*)cbuf);
+
+		int i = istart;
+		for (; i <= iend - 8; i += 8)
+		{
+			__m256i ms = _mm256_loadu_si256((const __m256i*)(sum + i - istart));
+			__m256i mq = _mm256_loadu_si256((const __m256i*)(sq + i - istart));
+			for (int k = 0; k < scans; k++)
 			{
-				__m128i mmk = _mm_load_si128((__m128i*)mk);
-				__m128i mnd = _mm_load_si128((__m128i*)nd);
-
-				__m128i mmn = _mm_load_si128((__m128i*)n);
-				__m128i mmx = _mm_load_si128((__m128i*)x);
-				__m128i msk = _mm_cmpeq_epi16(mnd, mmk);
-				_mm_stream_si128((__m128i*)d, _mm_blendv_epi8(mmx, mmn, msk));
-				nd += 8;
-				mk += 8;
-				d += 8;
-				n += 8;
-				x += 8;
+				ms = _mm256_add_epi32(ms, _mm256_andnot_si256(smask[k], _mm256_permutevar8x32_epi32(ms, sidx[k])));
+				mq = _mm256_add_epi32(mq, _mm256_andnot_si256(smask[k], _mm256_permutevar8x32_epi32(mq, sidx[k])));
 			}
+			//psum[i, i + cn) is the prefix up to the previous pixel
+			ms = _mm256_add_epi32(ms, _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(psum + i)), cidx));
+			mq = _mm256_add_epi32(mq, _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(psq + i)), cidx));
+			_mm256_storeu_si256((__m256i*)(psum + i + cn), ms);
+			_mm256_storeu_si256((__m256i*)(psq + i + cn), mq);
 		}
-		else if (src.depth() == CV_32F)
+		momentPrefixScalar(sum, sq, psum, psq, xofs, cn, i, (width + kw - 1) * cn);
+	}
+
+	template<>
+	void momentPrefix<double>(const double* sum, const double* sq, double* psum, double* psq, const int* xofs, const int width, const int kw, const int cn)
+	{
+		const int ax = kw / 2;
+		const int istart = ax * cn;
+		const int iend = (ax + width) * cn;
+		for (int c = 0; c < cn; c++)
 		{
+			psum[c] = 0.0;
+			psq[c] = 0.0;
+		}
+		momentPrefixScalar(sum, sq, psum, psq, xofs, cn, 0, istart);
 
-			const int ssesize = src.size().area() / 4;
-			remsize = src.size().area() - ssesize * 4;
-			for (int i = 0; i < ssesize; i++)
+		//doubles are permuted as pairs of 32 bit lanes
+		int ibuf[8 * 4];
+		int scans = 0;
+		for (int sh = cn; sh < 4; sh *= 2, scans++)
+		{
+			for (int l = 0; l < 4; l++)
 			{
-				__m128 mmk = _mm_load_ps((float*)mk);
-				__m128 mnd = _mm_load_ps((float*)nd);
-
-				__m128 mmn = _mm_load_ps((float*)n);
-				__m128 mmx = _mm_load_ps((float*)x);
-				__m128 msk = _mm_cmpeq_ps(mnd, mmk);
-				_mm_stream_ps((float*)d, _mm_blendv_ps(mmx, mmn, msk));
-				nd += 4;
-				mk += 4;
-				d += 4;
-				n += 4;
-				x += 4;
+				ibuf[8 * scans + 2 * l + 0] = 2 * (l - sh) + 0;
+				ibuf[8 * scans + 2 * l + 1] = 2 * (l - sh) + 1;
 			}
 		}
-		else if (src.depth() == CV_64F)
+		for (int l = 0; l < 4; l++)
+		{
+			ibuf[8 * 3 + 2 * l + 0] = 2 * (l % cn) + 0;
+			ibuf[8 * 3 + 2 * l + 1] = 2 * (l % cn) + 1;
+		}
+		__m256i sidx[2];
+		for (int k = 0; k < scans; k++) sidx[k] = _mm256_loadu_si256((const __m256i*)&ibuf[8 * k]);
+		const __m256i cidx = _mm256_loadu_si256((const __m256i*)&ibuf[8 * 3]);
+
+		int i = istart;
+		for (; i <= iend - 4; i += 4)
 		{
-			const int ssesize = src.size().area() / 2;
-			remsize = src.size().area() - ssesize * 2;
-			for (int i = 0; i < ssesize; i++)
+			__m256d ms = _mm256_loadu_pd(sum + i - istart);
+			__m256d mq = _mm256_loadu_pd(sq + i - istart);
+			for (int k = 0; k < scans; k++)
 			{
-				__m128d mmk = _mm_load_pd((double*)mk);
-				__m128d mnd = _mm_load_pd((double*)nd);
-
-				__m128d mmn = _mm_load_pd((double*)n);
-				__m128d mmx = _mm_load_pd((double*)x);
-				__m128d msk = _mm_cmpeq_pd(mnd, mmk);
-				_mm_stream_pd((double*)d, _mm_blendv_pd(mmx, mmn, msk));
-				nd += 2;
-				mk += 2;
-				d += 2;
-				n += 2;
-				x += 2;
+				//negative indices mark the lanes below the shift, which are not added
+				const __m256d mask = _mm256_castsi256_pd(_mm256_cmpgt_epi32(_mm256_setzero_si256(), sidx[k]));
+				ms = _mm256_add_pd(ms, _mm256_andnot_pd(mask, _mm256_castps_pd(_mm256_permutevar8x32_ps(_mm256_castpd_ps(ms), sidx[k]))));
+				mq = _mm256_add_pd(mq, _mm256_andnot_pd(mask, _mm256_castps_pd(_mm256_permutevar8x32_ps(_mm256_castpd_ps(mq), sidx[k]))));
 			}
+			ms = _mm256_add_pd(ms, _mm256_castps_pd(_mm256_permutevar8x32_ps(_mm256_castpd_ps(_mm256_loadu_pd(psum + i)), cidx)));
+			mq = _mm256_add_pd(mq, _mm256_castps_pd(_mm256_permutevar8x32_ps(_mm256_castpd_ps(_mm256_loadu_pd(psq + i)), cidx)));
+			_mm256_storeu_pd(psum + i + cn, ms);
+			_mm256_storeu_pd(psq + i + cn, mq);
+		}
+		momentPrefixScalar(sum, sq, psum, psq, xofs, cn, i, (width + kw - 1) * cn);
+	}
+
+	template<typename T, typename AT, typename OT>
+	static void momentOutputScalar(const AT* psum, const AT* psq, const int offset, const T* rmin, const T* rmax, const double n, OT* mean, OT* var, OT* stdv, OT* trim, const int start, const int end)
+	{
+		const double invn = 1.0 / n;
+		const double invtrim = (n > 2.0) ? 1.0 / (n - 2.0) : invn;
+		for (int i = start; i < end; i++)
+		{
+			const double s = (double)(AT)(psum[i + offset] - psum[i]);
+			const double sq = (double)(AT)(psq[i + offset] - psq[i]);
+			const double mu = s * invn;
+			const double v = max(sq * invn - mu * mu, 0.0);
+			if (mean != nullptr) mean[i] = (OT)mu;
+			if (var != nullptr) var[i] = (OT)v;
+			if (stdv != nullptr) stdv[i] = (OT)sqrt(v);
+			if (trim != nullptr) trim[i] = (OT)((n > 2.0) ? (s - ((double)rmin[i] + (double)rmax[i])) * invtrim : mu);
 		}
-#endif
-		for (int i = 0; i < remsize; i++)
+	}
+
+	template<typename T, typename AT, typename OT>
+	static void momentOutput(const AT* psum, const AT* psq, const int offset, const T* rmin, const T* rmax, const double n, OT* mean, OT* var, OT* stdv, OT* trim, const int w)
+	{
+		momentOutputScalar(psum, psq, offset, rmin, rmax, n, mean, var, stdv, trim, 0, w);
+	}
+
+	//4 outputs from the window sums s, sq and rmm = rmin + rmax (same operation order as momentOutputScalar)
+	static inline void momentStore4(const __m256d s, const __m256d sq, const __m256d rmm, const double n, float* mean, float* var, float* stdv, float* trim, const int i)
+	{
+		const __m256d invn = _mm256_set1_pd(1.0 / n);
+		const __m256d mu = _mm256_mul_pd(s, invn);
+		if (mean != nullptr) _mm_storeu_ps(mean + i, _mm256_cvtpd_ps(mu));
+		if (var != nullptr || stdv != nullptr)
+		{
+			const __m256d v = _mm256_max_pd(_mm256_sub_pd(_mm256_mul_pd(sq, invn), _mm256_mul_pd(mu, mu)), _mm256_setzero_pd());
+			if (var != nullptr) _mm_storeu_ps(var + i, _mm256_cvtpd_ps(v));
+			if (stdv != nullptr) _mm_storeu_ps(stdv + i, _mm256_cvtpd_ps(_mm256_sqrt_pd(v)));
+		}
+		if (trim != nullptr)
+		{
+			if (n > 2.0) _mm_storeu_ps(trim + i, _mm256_cvtpd_ps(_mm256_mul_pd(_mm256_sub_pd(s, rmm), _mm256_set1_pd(1.0 / (n - 2.0)))));
+			else _mm_storeu_ps(trim + i, _mm256_cvtpd_ps(mu));
+		}
+	}
+
+	template<>
+	void momentOutput<uchar, uint, float>(const uint* psum, const uint* psq, const int offset, const uchar* rmin, const uchar* rmax, const double n, float* mean, float* var, float* stdv, float* trim, const int w)
+	{
+		int i = 0;
+		for (; i <= w - 8; i += 8)
+		{
+			//window sums are below 2^31, so the wrapped differences are valid signed 32 bit values
+			const __m256i s = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(psum + i + offset)), _mm256_loadu_si256((const __m256i*)(psum + i)));
+			const __m256i sq = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(psq + i + offset)), _mm256_loadu_si256((const __m256i*)(psq + i)));
+			__m256i rmm = _mm256_setzero_si256();
+			if (trim != nullptr) rmm = _mm256_add_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(rmin + i))), _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(rmax + i))));
+			momentStore4(_mm256_cvtepi32_pd(_mm256_castsi256_si128(s)), _mm256_cvtepi32_pd(_mm256_castsi256_si128(sq)), _mm256_cvtepi32_pd(_mm256_castsi256_si128(rmm)), n, mean, var, stdv, trim, i);
+			momentStore4(_mm256_cvtepi32_pd(_mm256_extracti128_si256(s, 1)), _mm256_cvtepi32_pd(_mm256_extracti128_si256(sq, 1)), _mm256_cvtepi32_pd(_mm256_extracti128_si256(rmm, 1)), n, mean, var, stdv, trim, i + 4);
+		}
+		momentOutputScalar(psum, psq, offset, rmin, rmax, n, mean, var, stdv, trim, i, w);
+	}
+
+	template<>
+	void momentOutput<float, double, float>(const double* psum, const double* psq, const int offset, const float* rmin, const float* rmax, const double n, float* mean, float* var, float* stdv, float* trim, const int w)
+	{
+		int i = 0;
+		for (; i <= w - 4; i += 4)
+		{
+			const __m256d s = _mm256_sub_pd(_mm256_loadu_pd(psum + i + offset), _mm256_loadu_pd(psum + i));
+			const __m256d sq = _mm256_sub_pd(_mm256_loadu_pd(psq + i + offset), _mm256_loadu_pd(psq + i));
+			__m256d rmm = _mm256_setzero_pd();
+			if (trim != nullptr) rmm = _mm256_add_pd(_mm256_cvtps_pd(_mm_loadu_ps(rmin + i)), _mm256_cvtps_pd(_mm_loadu_ps(rmax + i)));
+			momentStore4(s, sq, rmm, n, mean, var, stdv, trim, i);
+		}
+		momentOutputScalar(psum, psq, offset, rmin, rmax, n, mean, var, stdv, trim, i, w);
+	}
+
+	//rows are processed in bands: per band, the vertical van Herk/Gil-Werman passes run on column strips, and then each row takes
+	//the sliding column sums (sum and sum of squares), the horizontal passes and all requested outputs while the row is in cache.
+	template<typename T, typename AT, typename OT>
+	static void localStatistics_(const Mat& src, const Size ksize, Mat* dmin, Mat* dmax, Mat* dmean, Mat* dvar, Mat* dstd, Mat* dtrim)
+	{
+		const int width = src.cols;
+		const int height = src.rows;
+		const int cn = src.channels();
+		const int w = width * cn;
+		const int kw = ksize.width;
+		const int kh = ksize.height;
+		const int ax = kw / 2;
+		const int ay = kh / 2;
+		const bool isMin = dmin != nullptr || dtrim != nullptr;
+		const bool isMax = dmax != nullptr || dtrim != nullptr;
+		const bool isMoment = dmean != nullptr || dvar != nullptr || dstd != nullptr || dtrim != nullptr;
+		const T maxval = std::numeric_limits<T>::max();
+		const T minval = std::numeric_limits<T>::lowest();
+
+		//vertical min/max (full image so that the bands do not need halo buffers)
+		Mat vmin, vmax;
+		if (isMin) vmin.create(src.size(), src.type());
+		if (isMax) vmax.create(src.size(), src.type());
+
+		const int band = max(32, 2 * kh);
+		const int bands = (height + band - 1) / band;
+		const int strip = 256;//elements
+		const int lv = (band + kh - 1 + kh - 1) / kh * kh;
+		const int lh = (width + kw - 1 + kw - 1) / kw * kw * cn;
+		const double n = (double)kw * kh;
+
+		//reflect-101 element offsets of the padded row for the sums
+		AutoBuffer<int> xofs(width + kw);
+		for (int p = 0; p < width + kw - 1; p++) xofs[p] = cn * borderInterpolate(p - ax, width, BORDER_REFLECT_101);
+
+#pragma omp parallel
 		{
+			AutoBuffer<T> gbuf(lv * strip);
+			AutoBuffer<T> hbuf(lv * strip);
+			AutoBuffer<T> maxline(strip);
+			AutoBuffer<T> minline(strip);
+			AutoBuffer<T> lbuf(lh);
+			AutoBuffer<T> hgbuf(lh);
+			AutoBuffer<T> hhbuf(lh);
+			AutoBuffer<T> rminbuf(w);
+			AutoBuffer<T> rmaxbuf(w);
+			AutoBuffer<AT> colsum(w);
+			AutoBuffer<AT> colsq(w);
+			AutoBuffer<AT> prefixsum((width + kw) * cn);
+			AutoBuffer<AT> prefixsq((width + kw) * cn);
+			for (int x = 0; x < strip; x++)
 			{
-				if (nd[i] == mk[i])
+				maxline[x] = maxval;
+				minline[x] = minval;
+			}
+
+#pragma omp for schedule(dynamic)
+			for (int b = 0; b < bands; b++)
+			{
+				const int y0 = b * band;
+				const int y1 = min(height, y0 + band);
+
+				for (int xs = 0; xs < w; xs += strip)
+				{
+					const int nx = min(strip, w - xs);
+					if (isMin) vhgwVertical<T, false>(src, vmin, y0, y1, xs, nx, kh, ay, gbuf.data(), hbuf.data(), maxline.data());
+					if (isMax) vhgwVertical<T, true>(src, vmax, y0, y1, xs, nx, kh, ay, gbuf.data(), hbuf.data(), minline.data());
+				}
+
+				if (isMoment)
 				{
-					d[i] = n[i];
+					for (int x = 0; x < w; x++)
+					{
+						colsum[x] = 0;
+						colsq[x] = 0;
+					}
+					for (int i = 0; i < kh; i++)
+					{
+						momentAddLine(src.ptr<T>(borderInterpolate(y0 - ay + i, height, BORDER_REFLECT_101)), colsum.data(), colsq.data(), w);
+					}
 				}
-				else
+
+				for (int y = y0; y < y1; y++)
 				{
-					d[i] = x[i];
+					T* rmin = (dmin != nullptr) ? dmin->ptr<T>(y) : rminbuf.data();
+					T* rmax = (dmax != nullptr) ? dmax->ptr<T>(y) : rmaxbuf.data();
+					if (isMin) vhgwHorizontal<T, false>(vmin.ptr<T>(y), rmin, width, cn, kw, ax, lbuf.data(), hgbuf.data(), hhbuf.data(), maxval);
+					if (isMax) vhgwHorizontal<T, true>(vmax.ptr<T>(y), rmax, width, cn, kw, ax, lbuf.data(), hgbuf.data(), hhbuf.data(), minval);
+					if (!isMoment) continue;
+
+					if (y != y0)
+					{
+						momentSlideLine(src.ptr<T>(borderInterpolate(y + kh - 1 - ay, height, BORDER_REFLECT_101)), src.ptr<T>(borderInterpolate(y - 1 - ay, height, BORDER_REFLECT_101)), colsum.data(), colsq.data(), w);
+					}
+					momentPrefix(colsum.data(), colsq.data(), prefixsum.data(), prefixsq.data(), xofs.data(), width, kw, cn);
+
+					OT* mean = (dmean != nullptr) ? dmean->ptr<OT>(y) : nullptr;
+					OT* var = (dvar != nullptr) ? dvar->ptr<OT>(y) : nullptr;
+					OT* stdv = (dstd != nullptr) ? dstd->ptr<OT>(y) : nullptr;
+					OT* trim = (dtrim != nullptr) ? dtrim->ptr<OT>(y) : nullptr;
+					momentOutput(prefixsum.data(), prefixsq.data(), kw * cn, rmin, rmax, n, mean, var, stdv, trim, w);
 				}
 			}
 		}
 	}
 
-	void blurRemoveMinMax(const Mat& src, Mat& dest, const int r)
+	template<typename T>
+	static void localStatisticsDispatch(const Mat& src, const Size ksize, Mat* dmin, Mat* dmax, Mat* dmean, Mat* dvar, Mat* dstd, Mat* dtrim)
+	{
+		if (src.depth() == CV_64F) localStatistics_<T, double, double>(src, ksize, dmin, dmax, dmean, dvar, dstd, dtrim);
+		else localStatistics_<T, double, float>(src, ksize, dmin, dmax, dmean, dvar, dstd, dtrim);
+	}
+
+	static bool isLocalStatisticsSupported(const int depth)
+	{
+		return depth == CV_8U || depth == CV_8S || depth == CV_16U || depth == CV_16S || depth == CV_32S || depth == CV_32F || depth == CV_64F;
+	}
+
+	void localStatisticsFilter(InputArray src_, const Size kernelSize, OutputArray minv, OutputArray maxv, OutputArray mean, OutputArray variance, OutputArray std, OutputArray trimmedMean)
+	{
+		CV_Assert(isLocalStatisticsSupported(src_.depth()));
+		CV_Assert(kernelSize.width > 0 && kernelSize.height > 0);
+
+		Mat src = src_.getMat();
+		//for inplace
+		auto isAlias = [&](OutputArray o) { return o.needed() && !o.empty() && o.getMat().data == src.data; };
+		if (isAlias(minv) || isAlias(maxv) || isAlias(mean) || isAlias(variance) || isAlias(std) || isAlias(trimmedMean)) src = src.clone();
+
+		const int mtype = CV_MAKETYPE((src.depth() == CV_64F) ? CV_64F : CV_32F, src.channels());
+		Mat dmin, dmax, dmean, dvar, dstd, dtrim;
+		if (minv.needed()) { minv.create(src.size(), src.type()); dmin = minv.getMat(); }
+		if (maxv.needed()) { maxv.create(src.size(), src.type()); dmax = maxv.getMat(); }
+		if (mean.needed()) { mean.create(src.size(), mtype); dmean = mean.getMat(); }
+		if (variance.needed()) { variance.create(src.size(), mtype); dvar = variance.getMat(); }
+		if (std.needed()) { std.create(src.size(), mtype); dstd = std.getMat(); }
+		if (trimmedMean.needed()) { trimmedMean.create(src.size(), mtype); dtrim = trimmedMean.getMat(); }
+
+		Mat* pmin = (minv.needed()) ? &dmin : nullptr;
+		Mat* pmax = (maxv.needed()) ? &dmax : nullptr;
+		Mat* pmean = (mean.needed()) ? &dmean : nullptr;
+		Mat* pvar = (variance.needed()) ? &dvar : nullptr;
+		Mat* pstd = (std.needed()) ? &dstd : nullptr;
+		Mat* ptrim = (trimmedMean.needed()) ? &dtrim : nullptr;
+
+		switch (src.depth())
+		{
+		case CV_8U:
+			//the window sum of squares fits in 31 bits up to 33025 taps, so that the moments are summed in uint
+			if (kernelSize.area() <= 33025) localStatistics_<uchar, uint, float>(src, kernelSize, pmin, pmax, pmean, pvar, pstd, ptrim);
+			else localStatisticsDispatch<uchar>(src, kernelSize, pmin, pmax, pmean, pvar, pstd, ptrim);
+			break;
+		case CV_8S: localStatisticsDispatch<schar>(src, kernelSize, pmin, pmax, pmean, pvar, pstd, ptrim); break;
+		case CV_16U: localStatisticsDispatch<ushort>(src, kernelSize, pmin, pmax, pmean, pvar, pstd, ptrim); break;
+		case CV_16S: localStatisticsDispatch<short>(src, kernelSize, pmin, pmax, pmean, pvar, pstd, ptrim); break;
+		case CV_32S: localStatisticsDispatch<int>(src, kernelSize, pmin, pmax, pmean, pvar, pstd, ptrim); break;
+		case CV_32F: localStatisticsDispatch<float>(src, kernelSize, pmin, pmax, pmean, pvar, pstd, ptrim); break;
+		case CV_64F: localStatisticsDispatch<double>(src, kernelSize, pmin, pmax, pmean, pvar, pstd, ptrim); break;
+		default: break;
+		}
+	}
+#pragma endregion
+
+	void maxFilter(InputArray src, OutputArray dest, Size kernelSize, int shape)
 	{
-		if (src.channels() == 1)
+		if (shape == MORPH_RECT && isLocalStatisticsSupported(src.depth()))
 		{
-			if (src.depth() == CV_8U)
-				blurRemoveMinMax_<uchar>(src, dest, r);
-			else if (src.depth() == CV_16S)
-				blurRemoveMinMax_<short>(src, dest, r);
-			else if (src.depth() == CV_16U)
-				blurRemoveMinMax_<ushort>(src, dest, r);
-			else if (src.depth() == CV_32F)
-				blurRemoveMinMax_<float>(src, dest, r);
-			else if (src.depth() == CV_64F)
-				blurRemoveMinMax_<double>(src, dest, r);
+			localStatisticsFilter(src, kernelSize, noArray(), dest, noArray());
 		}
 		else
 		{
-			vector<Mat> v;
-			split(src, v);
+			Mat element = getStructuringElement(shape, kernelSize);
+			dilate(src, dest, element);
+		}
+	}
 
-			if (src.depth() == CV_8U)
-				for (int i = 0; i < (int)v.size(); i++)
-					blurRemoveMinMax_<uchar>(v[i], v[i], r);
-			else if (src.depth() == CV_16S)
-				for (int i = 0; i < (int)v.size(); i++)
-					blurRemoveMinMax_<short>(v[i], v[i], r);
-			else if (src.depth() == CV_16U)
-				for (int i = 0; i < (int)v.size(); i++)
-					blurRemoveMinMax_<ushort>(v[i], v[i], r);
-			else if (src.depth() == CV_32F)
-				for (int i = 0; i < (int)v.size(); i++)
-					blurRemoveMinMax_<float>(v[i], v[i], r);
-			else if (src.depth() == CV_64F)
-				for (int i = 0; i < (int)v.size(); i++)
-					blurRemoveMinMax_<double>(v[i], v[i], r);
+	void minFilter(InputArray src, OutputArray dest, Size kernelSize, int shape)
+	{
+		if (shape == MORPH_RECT && isLocalStatisticsSupported(src.depth()))
+		{
+			localStatisticsFilter(src, kernelSize, dest, noArray(), noArray());
+		}
+		else
+		{
+			Mat element = getStructuringElement(shape, kernelSize);
+			erode(src, dest, element);
+		}
+	}
 
-			merge(v, dest);
+	void minFilter(InputArray src, OutputArray dest, int radius)
+	{
+		minFilter(src, dest, Size(2 * radius + 1, 2 * radius + 1));
+	}
+
+	void maxFilter(InputArray src, OutputArray dest, int radius)
+	{
+		maxFilter(src, dest, Size(2 * radius + 1, 2 * radius + 1));
+	}
+
+	template<class srcType>
+	static void blurRemoveMinMax_(const Mat& src, const Mat& nv, const Mat& xv, Mat& dest)
+	{
+#pragma omp parallel for schedule(static)
+		for (int j = 0; j < src.rows; j++)
+		{
+			const int w = src.cols * src.channels();
+			const srcType* s = src.ptr<srcType>(j);
+			const srcType* n = nv.ptr<srcType>(j);
+			const srcType* x = xv.ptr<srcType>(j);
+			srcType* d = dest.ptr<srcType>(j);
+			for (int i = 0; i < w; i++)
+			{
+				//replaced by the nearer one of the local min and max (min for tie)
+				d[i] = (abs((double)s[i] - (double)n[i]) <= abs((double)s[i] - (double)x[i])) ? n[i] : x[i];
+			}
 		}
 	}
 
+	void blurRemoveMinMax(const Mat& src_, Mat& dest, const int r)
+	{
+		Mat src = (src_.data == dest.data) ? src_.clone() : src_;
+		Mat nv, xv;
+		localStatisticsFilter(src, Size(2 * r + 1, 2 * r + 1), nv, xv, noArray());
+		dest.create(src.size(), src.type());
+
+		if (src.depth() == CV_8U) blurRemoveMinMax_<uchar>(src, nv, xv, dest);
+		else if (src.depth() == CV_8S) blurRemoveMinMax_<schar>(src, nv, xv, dest);
+		else if (src.depth() == CV_16S) blurRemoveMinMax_<short>(src, nv, xv, dest);
+		else if (src.depth() == CV_16U) blurRemoveMinMax_<ushort>(src, nv, xv, dest);
+		else if (src.depth() == CV_32S) blurRemoveMinMax_<int>(src, nv, xv, dest);
+		else if (src.depth() == CV_32F) blurRemoveMinMax_<float>(src, nv, xv, dest);
+		else if (src.depth() == CV_64F) blurRemoveMinMax_<double>(src, nv, xv, dest);
+	}
 
 	void varianceFilter(InputArray src, OutputArray dest, const cv::Size kernelSize)
 	{
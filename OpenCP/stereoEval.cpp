@@ -1,6 +1,7 @@
 #include "stereoEval.hpp"
 #include "depthfilter.hpp"
 #include "metrics.hpp"
+#include <omp.h>
 using namespace std;
 using namespace cv;
 
@@ -156,6 +157,7 @@ namespace cp
 		state_all = Mat::zeros(ground_truth.size(), CV_8UC3);
 		state_nonocc = Mat::zeros(ground_truth.size(), CV_8UC3);
 		state_disc = Mat::zeros(ground_truth.size(), CV_8UC3);
+		precomputeEvaluation();
 	}
 
 	void StereoEval::init(Mat& ground_truth, const double amp, const int ignoreLeftBoundary, const int boundingBox)
@@ -341,4 +343,171 @@ namespace cp
 		}
 		//
 	}
+
+#pragma region histogram evaluation
+	void StereoEval::precomputeEvaluation()
+	{
+		ground_truth.convertTo(ground_truth_32s, CV_32S);
+		mask_code = Mat::zeros(ground_truth.size(), CV_8U);
+
+		Mat m;
+		if (!mask_nonocc.empty())
+		{
+			cv::compare(mask_nonocc, 0, m, CMP_NE);
+			mask_code.setTo(1, m);
+		}
+		if (!mask_all.empty())
+		{
+			cv::compare(mask_all, 0, m, CMP_NE);
+			cv::add(mask_code, 2, mask_code, m);
+		}
+		if (!skip_disc && !mask_disc.empty())
+		{
+			cv::compare(mask_disc, 0, m, CMP_NE);
+			cv::add(mask_code, 4, mask_code, m);
+		}
+	}
+
+	template<typename T, typename W>
+	static void errorHistogramRow_(const T* src, const int* gt, const uchar* code, const int width, const W scale, const int binmax, int* hist)
+	{
+		int* hist_nonocc = hist;
+		int* hist_all = hist + binmax + 1;
+		int* hist_disc = hist + 2 * (binmax + 1);
+		for (int i = 0; i < width; i++)
+		{
+			const uchar c = code[i];
+			if (c == 0) continue;
+
+			const int e = min(abs(saturate_cast<int>(src[i] * scale) - gt[i]), binmax);
+			if (c & 1) hist_nonocc[e]++;
+			if (c & 2) hist_all[e]++;
+			if (c & 4) hist_disc[e]++;
+		}
+	}
+
+	template<typename T, typename W>
+	static void errorHistogram_(const Mat& src, const Mat& gt, const Mat& code, const W scale, const int histsize, int* hist, const bool isParallel)
+	{
+		const int hsize = 3 * histsize;
+		memset(hist, 0, sizeof(int) * hsize);
+		if (isParallel)
+		{
+#pragma omp parallel
+			{
+				AutoBuffer<int> local(hsize);
+				int* lhist = &local[0];
+				memset(lhist, 0, sizeof(int) * hsize);
+#pragma omp for schedule(static)
+				for (int j = 0; j < src.rows; j++)
+				{
+					errorHistogramRow_<T, W>(src.ptr<T>(j), gt.ptr<int>(j), code.ptr<uchar>(j), src.cols, scale, histsize - 1, lhist);
+				}
+#pragma omp critical
+				{
+					for (int i = 0; i < hsize; i++) hist[i] += lhist[i];
+				}
+			}
+		}
+		else
+		{
+			for (int j = 0; j < src.rows; j++)
+			{
+				errorHistogramRow_<T, W>(src.ptr<T>(j), gt.ptr<int>(j), code.ptr<uchar>(j), src.cols, scale, histsize - 1, hist);
+			}
+		}
+	}
+
+	void StereoEval::computeErrorHistogram(const Mat& src, const int disparity_scale, int* histogram, const bool isParallel)
+	{
+		CV_Assert(src.channels() == 1);
+		CV_Assert(src.size() == ground_truth_32s.size());
+		CV_Assert(errorHistogramSize >= 2);
+
+		//same rounding as src.convertTo(CV_32S, amp / disparity_scale) in operator()
+		const double scale = amp / disparity_scale;
+		switch (src.depth())
+		{
+		case CV_8U: errorHistogram_<uchar, float>(src, ground_truth_32s, mask_code, (float)scale, errorHistogramSize, histogram, isParallel); break;
+		case CV_16S: errorHistogram_<short, float>(src, ground_truth_32s, mask_code, (float)scale, errorHistogramSize, histogram, isParallel); break;
+		case CV_16U: errorHistogram_<ushort, float>(src, ground_truth_32s, mask_code, (float)scale, errorHistogramSize, histogram, isParallel); break;
+		case CV_32S: errorHistogram_<int, double>(src, ground_truth_32s, mask_code, scale, errorHistogramSize, histogram, isParallel); break;
+		case CV_32F: errorHistogram_<float, float>(src, ground_truth_32s, mask_code, (float)scale, errorHistogramSize, histogram, isParallel); break;
+		case CV_64F: errorHistogram_<double, double>(src, ground_truth_32s, mask_code, scale, errorHistogramSize, histogram, isParallel); break;
+		default: CV_Error(Error::StsUnsupportedFormat, "unsupported depth in StereoEval"); break;
+		}
+	}
+
+	void StereoEval::getErrorHistogram(InputArray src, vector<int>& histogram, const int disparity_scale)
+	{
+		histogram.resize(3 * errorHistogramSize);
+		computeErrorHistogram(src.getMat(), disparity_scale, &histogram[0], true);
+	}
+
+	void StereoEval::getBadPixelFromHistogram(const vector<int>& histogram, const vector<double>& thresholds, vector<Vec3d>& dest)
+	{
+		CV_Assert((int)histogram.size() == 3 * errorHistogramSize);
+		dest.resize(thresholds.size());
+
+		//suffix sums: cum[k][b] = number of pixels with error >= b
+		const int histsize = errorHistogramSize;
+		AutoBuffer<int64> cumbuf(3 * (histsize + 1));
+		for (int k = 0; k < 3; k++)
+		{
+			const int* h = &histogram[k * histsize];
+			int64* cum = &cumbuf[k * (histsize + 1)];
+			cum[histsize] = 0;
+			for (int b = histsize - 1; b >= 0; b--) cum[b] = cum[b + 1] + h[b];
+		}
+
+		for (size_t t = 0; t < thresholds.size(); t++)
+		{
+			//integer error e is bad when e > threshold*amp
+			const int b = (int)min((double)histsize - 1, floor(thresholds[t] * amp) + 1.0);
+			for (int k = 0; k < 3; k++)
+			{
+				const int64* cum = &cumbuf[k * (histsize + 1)];
+				dest[t][k] = ((double)cum[max(b, 0)] / cum[0]) * 100.0;
+			}
+			if (skip_disc) dest[t][2] = 0.0;
+		}
+	}
+
+	void StereoEval::getBadPixel(InputArray src, const vector<double>& thresholds, vector<Vec3d>& dest, const int disparity_scale)
+	{
+		vector<int> histogram;
+		getErrorHistogram(src, histogram, disparity_scale);
+		getBadPixelFromHistogram(histogram, thresholds, dest);
+	}
+
+	void StereoEval::getBadPixelBatch(const vector<Mat>& src, const vector<double>& thresholds, vector<vector<Vec3d>>& dest, const int disparity_scale)
+	{
+		const int num = (int)src.size();
+		dest.resize(num);
+		const int hsize = 3 * errorHistogramSize;
+		if (num >= omp_get_max_threads())
+		{
+			//one map per thread
+#pragma omp parallel
+			{
+				vector<int> histogram(hsize);
+#pragma omp for schedule(dynamic)
+				for (int n = 0; n < num; n++)
+				{
+					computeErrorHistogram(src[n], disparity_scale, &histogram[0], false);
+					getBadPixelFromHistogram(histogram, thresholds, dest[n]);
+				}
+			}
+		}
+		else
+		{
+			vector<int> histogram(hsize);
+			for (int n = 0; n < num; n++)
+			{
+				computeErrorHistogram(src[n], disparity_scale, &histogram[0], true);
+				getBadPixelFromHistogram(histogram, thresholds, dest[n]);
+			}
+		}
+	}
+#pragma endregion
 }
\ No newline at end of file
@@ -4602,124 +4602,96 @@ namespace cp
 		maxFilter(boundaryMask, boundaryMask, Size(3, 3));
 	}
 
-	//#define VIS_SYNTH_INFO 0
+	//forward warping of a disparity map into several views in one sweep (same as shiftDisp without mask for each view).
+	//Each source pixel is read once and scattered to the line buffers of all views that warp in the same direction.
 	template <class srcType>
-	void StereoViewSynthesis::viewsynth(const Mat& srcL, const Mat& srcR, const Mat& dispL, const Mat& dispR, Mat& dest, Mat& destdisp, double alpha, int invalidvalue, double disp_amp, int disptype)
+	static void shiftDispBatch_(const Mat& srcdisp, vector<Mat>& destdisp, const vector<float>& amp, const int large_jump, const int sub_gap)
 	{
-		Mat disp8Ubuff;
-		Mat edge;
-
-		double sub_gap = (warpSputtering) ? disp_amp : -1.0;
+		const int width = srcdisp.cols;
+		const int offset = 256;
+		const int lstep = width + 2 * offset;
+		const int views = (int)amp.size();
+		const int ljump = max(large_jump, 1);
 
-		if (alpha == 0.0)
+		Mat dsp; copyMakeBorder(srcdisp, dsp, 0, 0, 1, 2, BORDER_REPLICATE);
+		vector<int> fwd, bwd;
+		for (int n = 0; n < views; n++)
 		{
-			srcL.copyTo(dest);
-			dispL.copyTo(destdisp);
-			return;
+			if (amp[n] > 0) fwd.push_back(n);
+			else if (amp[n] < 0) bwd.push_back(n);
+			else srcdisp.copyTo(destdisp[n]);
 		}
-		else if (alpha == 1.0)
+
+#pragma omp parallel
 		{
-			srcR.copyTo(dest);
-			dispR.copyTo(destdisp);
-			return;
-		}
+			AutoBuffer<srcType> buff(lstep * views);
+			srcType* buf = buff.data();
+#pragma omp for schedule(static)
+			for (int j = 0; j < srcdisp.rows; j++)
+			{
+				memset(buf, 0, sizeof(srcType) * lstep * views);
+				const srcType* s = dsp.ptr<srcType>(j) + 1;
 
-		if (dest.empty())dest.create(srcL.size(), CV_8UC3);
-		else dest.setTo(0);
+				if (!fwd.empty())
+				{
+					for (int i = width; i >= 0; i--)
+					{
+						const srcType disp = s[i];
+						const int sub = (int)(abs(disp - s[i - 1]));
+						if (large_jump != 0 && (sub > ljump || abs(disp - s[i + 1]) > ljump)) continue;
+						const bool issub = (sub <= sub_gap && sub > 0);
 
-		if (destdisp.empty() || destdisp.type() != disptype)destdisp.create(srcL.size(), disptype);
-		else destdisp.setTo(0);
+						for (int n : fwd)
+						{
+							srcType* d = buf + lstep * n + offset;
+							const int x = i - (int)(disp * amp[n]);
+							if (disp > d[x])
+							{
+								d[x] = disp;
+								if (issub && disp > d[x - 1]) d[x - 1] = (srcType)((disp + s[i - 1]) * 0.5);
+							}
+						}
+					}
+				}
+				if (!bwd.empty())
+				{
+					for (int i = 0; i < width; i++)
+					{
+						const srcType disp = s[i];
+						const int sub = (int)(abs(disp - s[i + 1]));
+						if (large_jump != 0 && (abs(disp - s[i - 1]) > ljump || sub > ljump)) continue;
+						const bool issub = (sub <= sub_gap && sub > 0);
 
-		/*Mat maskL(srcL.size(),CV_8U,Scalar(0));
-		Mat maskR(srcL.size(),CV_8U,Scalar(0));
+						for (int n : bwd)
+						{
+							srcType* d = buf + lstep * n + offset;
+							const int x = i + (int)(-amp[n] * disp);
+							if (disp > d[x])
+							{
+								d[x] = disp;
+								if (issub && disp > d[x + 1]) d[x + 1] = (srcType)((disp + s[i + 1]) * 0.5);
+							}
+						}
+					}
+				}
 
-		Mat maskTemp(srcL.size(),CV_8U,Scalar(0));*/
+				for (int n : fwd) memcpy(destdisp[n].ptr<srcType>(j), buf + lstep * n + offset, sizeof(srcType) * width);
+				for (int n : bwd) memcpy(destdisp[n].ptr<srcType>(j), buf + lstep * n + offset, sizeof(srcType) * width);
+			}
+		}
+	}
 
-		Mat destR(srcL.size(), CV_8UC3);
-		Mat destdispR(srcL.size(), disptype);
-		Mat temp(srcL.size(), disptype);
+	//#define VIS_SYNTH_INFO 0
+	//blending of the views warped from the left and right, and occlusion filling and boundary smoothing; the result is written to dest and destdisp
+	template <class srcType>
+	void StereoViewSynthesis::blendAndPostFilter(Mat& dest, Mat& destR, Mat& destdisp, Mat& destdispR, double alpha, int invalidvalue, double disp_amp)
+	{
+		Mat disp8Ubuff;
+		Mat edge;
 		Mat m;
-
 #ifdef VIS_SYNTH_INFO
 		Mat vis = Mat::zeros(dest.size(), CV_8UC3);
 #endif
-		if (warpMethod == WAPR_IMG_FWD_SUB_INV)
-		{
-			/*
-
-			#ifdef VIS_SYNTH_INFO
-			CalcTime t("warp");
-			#endif
-			shiftImDisp<T>(srcL,dispL,dest,temp,alpha/disp_amp,sub_gap,(int)(large_jump*disp_amp),maskL,warpInterpolationMethod);
-			depthfilter(temp,destdisp,maskTemp,cvRound(abs(alpha)),disp_amp);
-			compare(destdisp,0,m,cv::CMP_EQ);
-			dest.setTo(0,m);
-			maskL.setTo(0,m);
-			maskTemp.setTo(0,m);
-			shiftImInv_<T>(srcL,destdisp,dest,-alpha/disp_amp,maskTemp,0,warpInterpolationMethod);
-			bitwise_or(maskL,maskTemp,maskL);
-
-			temp.setTo(0);
-			shiftImDisp<T>(srcR,dispR,destR,temp,(alpha-1.0)/disp_amp,sub_gap,(int)(large_jump*disp_amp),maskR,warpInterpolationMethod);
-			depthfilter(temp,destdispR,maskTemp,cvRound(abs(alpha)),disp_amp);
-			compare(destdispR,0,m,cv::CMP_EQ);
-			destR.setTo(0,m);
-			maskR.setTo(0,m);
-			maskTemp.setTo(0,m);
-			shiftImInv_<T>(srcR,destdispR,destR,(1.0-alpha)/disp_amp,maskTemp,0,warpInterpolationMethod);
-			bitwise_or(maskR,maskTemp,maskR);
-			*/
-		}
-		else if (warpMethod == WAPR_IMG_INV)
-		{
-#ifdef VIS_SYNTH_INFO
-			CalcTime t("warp");
-#endif
-			Mat maskdummy;
-			shiftDisp(dispL, temp, (float)(alpha / disp_amp), (float)sub_gap, (int)(large_jump * disp_amp), maskdummy);
-			depthfilter(temp, destdisp, maskdummy, cvRound(abs(alpha)), disp_amp);
-			shiftImInv(srcL, destdisp, dest, (float)(-alpha / disp_amp), 0, warpInterpolationMethod);
-
-
-			{
-				//	CalcTime t("shift");
-				shiftDisp(dispR, temp, (float)((alpha - 1.0) / disp_amp), (float)sub_gap, (int)(large_jump * disp_amp), maskdummy);
-			}
-			{
-				//	CalcTime t("filter");
-				depthfilter(temp, destdispR, maskdummy, cvRound(abs(alpha)), disp_amp);
-			}
-			{
-				//CalcTime t("inter");
-				//shiftImInv_<T>(srcR,destdispR,destR,(1.0-alpha)/disp_amp,maskR,0,warpInterpolationMethod);
-				shiftImInv(srcR, destdispR, destR, (float)((1.0 - alpha) / disp_amp), 0, warpInterpolationMethod);
-			}
-
-			//with mask
-			/*
-			//	shiftDisp<T>(dispL,temp,alpha/disp_amp,sub_gap,large_jump*disp_amp,maskL);
-			shiftDisp<T>(dispL,temp,alpha/disp_amp,sub_gap,(int)(large_jump*disp_amp));
-
-			depthfilter(temp,destdisp,maskTemp,cvRound(abs(alpha)),disp_amp);
-
-			compare(destdisp,0,maskL,cv::CMP_NE);
-			dest.setTo(0);
-
-			shiftImInv_<T>(srcL,destdisp,dest,-alpha/disp_amp,maskL,0,warpInterpolationMethod);
-
-			//shiftDisp<T>(dispR,temp,(alpha-1.0)/disp_amp,sub_gap,large_jump*disp_amp,maskR);
-			shiftDisp<T>(dispR,temp,(alpha-1.0)/disp_amp,sub_gap,large_jump*disp_amp);
-
-
-			depthfilter(temp,destdispR,maskTemp,cvRound(abs(alpha)),disp_amp);
-			compare(destdispR,0,maskR,cv::CMP_NE);
-
-			destR.setTo(0);
-
-			shiftImInv_<T>(srcR,destdispR,destR,(1.0-alpha)/disp_amp,maskR,0,warpInterpolationMethod);
-			*/
-		}
-
 		{
 #ifdef VIS_SYNTH_INFO
 			CalcTime t("blend");
@@ -4834,6 +4806,178 @@ namespace cp
 #endif
 	}
 
+	template <class srcType>
+	void StereoViewSynthesis::viewsynth(const Mat& srcL, const Mat& srcR, const Mat& dispL, const Mat& dispR, Mat& dest, Mat& destdisp, double alpha, int invalidvalue, double disp_amp, int disptype)
+	{
+		double sub_gap = (warpSputtering) ? disp_amp : -1.0;
+
+		if (alpha == 0.0)
+		{
+			srcL.copyTo(dest);
+			dispL.copyTo(destdisp);
+			return;
+		}
+		else if (alpha == 1.0)
+		{
+			srcR.copyTo(dest);
+			dispR.copyTo(destdisp);
+			return;
+		}
+
+		if (dest.empty())dest.create(srcL.size(), CV_8UC3);
+		else dest.setTo(0);
+
+		if (destdisp.empty() || destdisp.type() != disptype)destdisp.create(srcL.size(), disptype);
+		else destdisp.setTo(0);
+
+		/*Mat maskL(srcL.size(),CV_8U,Scalar(0));
+		Mat maskR(srcL.size(),CV_8U,Scalar(0));
+
+		Mat maskTemp(srcL.size(),CV_8U,Scalar(0));*/
+
+		Mat destR(srcL.size(), CV_8UC3);
+		Mat destdispR(srcL.size(), disptype);
+		Mat temp(srcL.size(), disptype);
+
+		if (warpMethod == WAPR_IMG_FWD_SUB_INV)
+		{
+			/*
+
+			#ifdef VIS_SYNTH_INFO
+			CalcTime t("warp");
+			#endif
+			shiftImDisp<T>(srcL,dispL,dest,temp,alpha/disp_amp,sub_gap,(int)(large_jump*disp_amp),maskL,warpInterpolationMethod);
+			depthfilter(temp,destdisp,maskTemp,cvRound(abs(alpha)),disp_amp);
+			compare(destdisp,0,m,cv::CMP_EQ);
+			dest.setTo(0,m);
+			maskL.setTo(0,m);
+			maskTemp.setTo(0,m);
+			shiftImInv_<T>(srcL,destdisp,dest,-alpha/disp_amp,maskTemp,0,warpInterpolationMethod);
+			bitwise_or(maskL,maskTemp,maskL);
+
+			temp.setTo(0);
+			shiftImDisp<T>(srcR,dispR,destR,temp,(alpha-1.0)/disp_amp,sub_gap,(int)(large_jump*disp_amp),maskR,warpInterpolationMethod);
+			depthfilter(temp,destdispR,maskTemp,cvRound(abs(alpha)),disp_amp);
+			compare(destdispR,0,m,cv::CMP_EQ);
+			destR.setTo(0,m);
+			maskR.setTo(0,m);
+			maskTemp.setTo(0,m);
+			shiftImInv_<T>(srcR,destdispR,destR,(1.0-alpha)/disp_amp,maskTemp,0,warpInterpolationMethod);
+			bitwise_or(maskR,maskTemp,maskR);
+			*/
+		}
+		else if (warpMethod == WAPR_IMG_INV)
+		{
+#ifdef VIS_SYNTH_INFO
+			CalcTime t("warp");
+#endif
+			Mat maskdummy;
+			shiftDisp(dispL, temp, (float)(alpha / disp_amp), (float)sub_gap, (int)(large_jump * disp_amp), maskdummy);
+			depthfilter(temp, destdisp, maskdummy, cvRound(abs(alpha)), disp_amp);
+			shiftImInv(srcL, destdisp, dest, (float)(-alpha / disp_amp), 0, warpInterpolationMethod);
+
+
+			{
+				//	CalcTime t("shift");
+				shiftDisp(dispR, temp, (float)((alpha - 1.0) / disp_amp), (float)sub_gap, (int)(large_jump * disp_amp), maskdummy);
+			}
+			{
+				//	CalcTime t("filter");
+				depthfilter(temp, destdispR, maskdummy, cvRound(abs(alpha)), disp_amp);
+			}
+			{
+				//CalcTime t("inter");
+				//shiftImInv_<T>(srcR,destdispR,destR,(1.0-alpha)/disp_amp,maskR,0,warpInterpolationMethod);
+				shiftImInv(srcR, destdispR, destR, (float)((1.0 - alpha) / disp_amp), 0, warpInterpolationMethod);
+			}
+
+			//with mask
+			/*
+			//	shiftDisp<T>(dispL,temp,alpha/disp_amp,sub_gap,large_jump*disp_amp,maskL);
+			shiftDisp<T>(dispL,temp,alpha/disp_amp,sub_gap,(int)(large_jump*disp_amp));
+
+			depthfilter(temp,destdisp,maskTemp,cvRound(abs(alpha)),disp_amp);
+
+			compare(destdisp,0,maskL,cv::CMP_NE);
+			dest.setTo(0);
+
+			shiftImInv_<T>(srcL,destdisp,dest,-alpha/disp_amp,maskL,0,warpInterpolationMethod);
+
+			//shiftDisp<T>(dispR,temp,(alpha-1.0)/disp_amp,sub_gap,large_jump*disp_amp,maskR);
+			shiftDisp<T>(dispR,temp,(alpha-1.0)/disp_amp,sub_gap,large_jump*disp_amp);
+
+
+			depthfilter(temp,destdispR,maskTemp,cvRound(abs(alpha)),disp_amp);
+			compare(destdispR,0,maskR,cv::CMP_NE);
+
+			destR.setTo(0);
+
+			shiftImInv_<T>(srcR,destdispR,destR,(1.0-alpha)/disp_amp,maskR,0,warpInterpolationMethod);
+			*/
+		}
+
+		blendAndPostFilter<srcType>(dest, destR, destdisp, destdispR, alpha, invalidvalue, disp_amp);
+	}
+
+
+	template <class srcType>
+	void StereoViewSynthesis::viewsynthBatch(const Mat& srcL, const Mat& srcR, const Mat& dispL, const Mat& dispR, vector<Mat>& dest, vector<Mat>& destdisp, const vector<double>& alpha, int invalidvalue, double disp_amp, int disptype)
+	{
+		const int views = (int)alpha.size();
+		dest.resize(views);
+		destdisp.resize(views);
+		if (warpMethod != WAPR_IMG_INV)
+		{
+			for (int n = 0; n < views; n++) viewsynth<srcType>(srcL, srcR, dispL, dispR, dest[n], destdisp[n], alpha[n], invalidvalue, disp_amp, disptype);
+			return;
+		}
+
+		const double sub_gap = (warpSputtering) ? disp_amp : -1.0;
+		vector<float> ampL(views);
+		vector<float> ampR(views);
+		batchWarpedDispL.resize(views);
+		batchWarpedDispR.resize(views);
+		for (int n = 0; n < views; n++)
+		{
+			ampL[n] = (float)(alpha[n] / disp_amp);
+			ampR[n] = (float)((alpha[n] - 1.0) / disp_amp);
+			batchWarpedDispL[n].create(srcL.size(), disptype);
+			batchWarpedDispR[n].create(srcL.size(), disptype);
+		}
+		shiftDispBatch_<srcType>(dispL, batchWarpedDispL, ampL, (int)(large_jump * disp_amp), (int)sub_gap);
+		shiftDispBatch_<srcType>(dispR, batchWarpedDispR, ampR, (int)(large_jump * disp_amp), (int)sub_gap);
+
+#pragma omp parallel for schedule(dynamic)
+		for (int n = 0; n < views; n++)
+		{
+			if (alpha[n] == 0.0)
+			{
+				srcL.copyTo(dest[n]);
+				dispL.copyTo(destdisp[n]);
+				continue;
+			}
+			else if (alpha[n] == 1.0)
+			{
+				srcR.copyTo(dest[n]);
+				dispR.copyTo(destdisp[n]);
+				continue;
+			}
+
+			dest[n].create(srcL.size(), CV_8UC3);
+			dest[n].setTo(0);
+			destdisp[n].create(srcL.size(), disptype);
+			Mat destR(srcL.size(), CV_8UC3);
+			Mat destdispR(srcL.size(), disptype);
+
+			Mat maskL, maskR;
+			depthfilter(batchWarpedDispL[n], destdisp[n], maskL, cvRound(abs(alpha[n])), disp_amp);
+			shiftImInv(srcL, destdisp[n], dest[n], (float)(-alpha[n] / disp_amp), 0, warpInterpolationMethod);
+			depthfilter(batchWarpedDispR[n], destdispR, maskR, cvRound(abs(alpha[n])), disp_amp);
+			shiftImInv(srcR, destdispR, destR, (float)((1.0 - alpha[n]) / disp_amp), 0, warpInterpolationMethod);
+
+			blendAndPostFilter<srcType>(dest[n], destR, destdisp[n], destdispR, alpha[n], invalidvalue, disp_amp);
+		}
+	}
 
 	template <class srcType>
 	void shiftImDispNN3_(const Mat& srcim, const Mat& srcdisp, Mat& destim, Mat& destdisp, double amp, Mat& mask, const int large_jump, const int sub_gap)
@@ -5097,6 +5241,27 @@ namespace cp
 		}
 	}
 
+	void StereoViewSynthesis::operator()(const Mat& srcL, const Mat& srcR, const Mat& dispL, const Mat& dispR, vector<Mat>& dest, vector<Mat>& destdisp, const vector<double>& alpha, int invalidvalue, double disp_amp)
+	{
+		int type = dispL.depth();
+		if (type == CV_8U)
+		{
+			viewsynthBatch<uchar>(srcL, srcR, dispL, dispR, dest, destdisp, alpha, invalidvalue, disp_amp, CV_8U);
+		}
+		else if (type == CV_16S)
+		{
+			viewsynthBatch<short>(srcL, srcR, dispL, dispR, dest, destdisp, alpha, invalidvalue, disp_amp, CV_16S);
+		}
+		else if (type == CV_16U)
+		{
+			viewsynthBatch<ushort>(srcL, srcR, dispL, dispR, dest, destdisp, alpha, invalidvalue, disp_amp, CV_16U);
+		}
+		else
+		{
+			cout << "not support" << endl;
+		}
+	}
+
 	void StereoViewSynthesis::operator()(Mat& src, Mat& disp, Mat& dest, Mat& destdisp, double alpha, int invalidvalue, double disp_amp)
 	{
 		int type = disp.depth();
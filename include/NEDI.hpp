@@ -11,6 +11,9 @@ namespace cp
 	{
 		void upsampleGrayDoubleLUOpt(const cv::Mat& sim, cv::Mat& dim, const float threshold, const int window_size, const float eps);
 		void upsampleGrayDoubleLU(const cv::Mat& sim, cv::Mat& dim, const float threshold, const int window_size, const float eps);
+		//band-fused and AVX version of upsampleGrayDoubleLU: the 4x4 normal equations of 8 pixels are solved by Cholesky decomposition at once
+		//window_size must be even; then the output does not depend on the thread count
+		void upsampleGrayDoubleLUFused(const cv::Mat& sim, cv::Mat& dim, const float threshold, const int window_size, const float eps);
 		void upsampleGrayDoubleQR(const cv::Mat& sim, cv::Mat& dim, const float threshold, const int window_size);
 
 		std::vector<cv::Mat> dest_border;
@@ -19,7 +22,7 @@ namespace cp
 		
 		//threshold if(var>threshold) computeNEDI
 		//windowSize
-		//method 0: LU, 1 LUOpt
+		//method 0: LU, 1 LUOpt, 2 LU fused (parallel row-band, SIMD)
 		void upsample(cv::InputArray src, cv::OutputArray dest, const int scale, const float threshold, const int WindowSize, int method);
 	};
 }
\ No newline at end of file
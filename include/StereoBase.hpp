@@ -140,6 +140,52 @@ namespace cp
 		//body
 		void matching(cv::Mat& leftim, cv::Mat& rightim, cv::Mat& dest, const bool isFeedback = false);
 		void operator()(cv::Mat& leftim, cv::Mat& rightim, cv::Mat& dest);
+
+		//parameter set for matchingSweep (same meaning as the members of the same name)
+		struct Parameter
+		{
+			//pre filter and pixel matching
+			int preFilterCap = 31;
+			int pixelMatchingMethod = Cost::SDEdgeBlend;
+			int color_distance = 2;
+			int pixelMatchErrorCap = 31;
+			int costAlphaImageSobel = 10;
+			//aggregation
+			int aggregationMethod = Aggregation::Guided;
+			int aggregationRadiusH = 4;
+			int aggregationRadiusV = 4;
+			double aggregationGuidedfilterEps = 0.1;
+			double aggregationSigmaSpace = 255.0;
+			//optimization
+			int P1 = 0;
+			int P2 = 0;
+			//post filter
+			bool isUniquenessFilter = true;
+			int uniquenessRatio = 0;
+			int subpixelInterpolationMethod = (int)SUBPIXEL::QUAD;
+			bool isRangeFilterSubpix = true;
+			int LRCheckMethod = 1;//LRCHECK::WITH_MINCOST
+			bool isMinCostFilter = false;
+			bool isSpeckleFilter = true;
+			int holeFillingMethod = HOLE_FILL::NEAREST_MIN_SCANLINE;
+			int refinementMethod = (int)REFINEMENT::WGIF_GAUSS_JNF;
+			int refinementR = 9;
+			float refinementSigmaRange = 1.f;
+			float refinementSigmaSpace = 255.f;
+			int jointNearestR = 2;
+		};
+		Parameter getParameter();//current parameters, e.g., as the base of a sweep grid
+		void setParameter(const Parameter& param);
+		//matching for each parameter set (without feedback). The configurations are visited as a tree, so that pre filtering and pixel matching costs are computed once per cost setting,
+		//aggregated costs once per aggregation setting, and scanline optimization once per P1/P2; dest[i] is the disparity map of parameters[i]. Member parameters are restored after the sweep.
+		void matchingSweep(cv::Mat& leftim, cv::Mat& rightim, const std::vector<Parameter>& parameters, std::vector<cv::Mat>& dest);
+
+		//stereo video with one frame latency: prefiltering of the input frame overlaps with cost computation and aggregation of the previous frame, whose disparity map is returned in dest.
+		//Returns false while no frame is complete; call with empty images to flush the last frame.
+		//Between key frames the disparity search is narrowed to the previous disparity map +-searchMargin (per pixel and for the plane range), with a full search when the valid ratio drops below fallbackRatio times that of the last full search.
+		bool matchingStream(cv::Mat& leftim, cv::Mat& rightim, cv::Mat& dest);
+		void setTemporalParameter(const int searchMargin = 4, const int keyFrameInterval = 30, const double fallbackRatio = 0.9);
+		void resetStream();
 		void gui(cv::Mat& leftim, cv::Mat& rightim, cv::Mat& dest, StereoEval& eval);
 		void gui(cv::Mat& leftim, cv::Mat& rightim, cv::Mat& dest, StereoEval& eval, cv::Mat& dmapC);
 
@@ -161,12 +207,31 @@ namespace cp
 		int numberOfDisparities;
 		int minDisparity;
 		std::vector<cv::Mat> DSI;
+		std::vector<cv::Mat> DSICost;//memoized pixel matching cost for matchingSweep
+		std::vector<cv::Mat> DSIAggregation;//memoized aggregated cost for matchingSweep
 		cv::Mat minCostMap;
 
 		//pre filter
 		int preFilterCap;//cap for prefilter
 		void computeGuideImageForAggregation(cv::Mat& input);
+		void computeGuideImageForAggregation(cv::Mat& input, cv::Mat& dest);
 		void computePrefilter(cv::Mat& targetImage, cv::Mat& referenceImage);
+		void computePrefilter(cv::Mat& targetImage, cv::Mat& referenceImage, std::vector<cv::Mat>& targetDest, std::vector<cv::Mat>& referenceDest);
+
+		//stream
+		std::vector<cv::Mat> targetNext;//prefiltered next frame
+		std::vector<cv::Mat> referenceNext;
+		cv::Mat guideImageNext;
+		cv::Mat leftNext;
+		cv::Mat leftStream;//current frame for post filtering
+		cv::Mat prevDisparity;
+		bool isStreamPending = false;
+		bool isTemporalLost = true;
+		int streamFrameCount = 0;
+		double keyFrameValidRatio = 0.0;
+		int temporalSearchMargin = 4;
+		int temporalKeyFrameInterval = 30;
+		double temporalFallbackRatio = 0.9;
 
 		//pixel matching
 		int pixelMatchingMethod = Cost::SDEdgeBlend;
@@ -204,6 +269,7 @@ namespace cp
 		void computeOptimizeScanline();
 
 		//post filters
+		void postFiltering(cv::Mat& leftim, cv::Mat& destDisparityMap);
 		bool isUniquenessFilter = true;
 		int uniquenessRatio;
 		void uniquenessFilter(cv::Mat& costMap, cv::Mat& dest);
@@ -241,6 +307,12 @@ namespace cp
 		void computeValidRatio(const cv::Mat& disparityMap);
 		double valid_ratio = 0.0;
 
+		//LR check, min cost, speckle, valid ratio and NEAREST_MIN_SCANLINE hole filling fused into band-parallel passes
+		bool isFusedPostFilter = true;
+		cv::Mat postFilterLabel;//union-find parent for speckle segments
+		cv::Mat postFilterArea;//segment area at the root
+		void fusedPostFilter(cv::Mat& costMap, cv::Mat& dest);
+
 		int refinementMethod = (int)REFINEMENT::WGIF_GAUSS_JNF;
 		int refinementR = 9;
 		float refinementSigmaRange = 1.f;
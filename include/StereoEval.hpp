@@ -15,6 +15,11 @@ namespace cp
 	{
 		void threshmap_init();
 		bool skip_disc = false;
+
+		cv::Mat ground_truth_32s;//cached ground truth for histogram evaluation
+		cv::Mat mask_code;//bit 0: nonocc, 1: all, 2: disc
+		void precomputeEvaluation();
+		void computeErrorHistogram(const cv::Mat& src, const int disparity_scale, int* histogram, const bool isParallel);
 	public:
 		int ignoreLeftBoundary;
 		int boundingBox;
@@ -39,6 +44,10 @@ namespace cp
 		double nonoccMSE;
 		double discMSE;
 
+		//number of bins for the error histogram in the ground-truth scale; the last bin accumulates larger errors,
+		//so bad pixel rates are exact for threshold*amp < errorHistogramSize-1
+		int errorHistogramSize = 1024;
+
 		void init(cv::Mat& groundtruth, cv::Mat& maskNonocc, cv::Mat& maskAll, cv::Mat& maskDisc, double amp);
 		void init(cv::Mat& groundtruth, const double amp, const int ignoreLeftBoundary, const int boundingBox);
 
@@ -51,5 +60,15 @@ namespace cp
 		std::string getMSE(cv::Mat& src, const int disparity_scale = 1, const bool isPrint = true);
 		std::string operator() (cv::InputArray src, const double threshold = 1.0, const int disparity_scale = 1, const bool isPrint = true);
 		void compare(cv::Mat& before, cv::Mat& after, double threshold = 1.0, bool isPrint = true);
+
+		//histogram of |src-gt| in one parallel pass over the precomputed masks and ground truth.
+		//histogram: 3*errorHistogramSize bins, ordered as nonocc, all, disc
+		void getErrorHistogram(cv::InputArray src, std::vector<int>& histogram, const int disparity_scale = 1);
+		//bad pixel rates (nonocc, all, disc) for every threshold from an error histogram
+		void getBadPixelFromHistogram(const std::vector<int>& histogram, const std::vector<double>& thresholds, std::vector<cv::Vec3d>& dest);
+		//bad pixel rates (nonocc, all, disc) for every threshold with one pass over src
+		void getBadPixel(cv::InputArray src, const std::vector<double>& thresholds, std::vector<cv::Vec3d>& dest, const int disparity_scale = 1);
+		//batched evaluation of many disparity maps against the same ground truth for parameter sweeps
+		void getBadPixelBatch(const std::vector<cv::Mat>& src, const std::vector<double>& thresholds, std::vector<std::vector<cv::Vec3d>>& dest, const int disparity_scale = 1);
 	};
 }
\ No newline at end of file
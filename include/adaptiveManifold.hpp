@@ -0,0 +1,36 @@
+#pragma once
+
+#include "common.hpp"
+
+namespace cp
+{
+	//Adaptive manifolds for real-time high-dimensional filtering (E. S. L. Gastal and M. M. Oliveira, SIGGRAPH 2012)
+	//src, guide: CV_8UC3, sigma_r: range sigma (0-255 scale), tree_height<=0: computed from sigma_s and sigma_r
+	//The two child manifolds of each tree level are filtered as parallel tasks, and the working buffers are kept per thread across calls, so keep one instance for video.
+	class CP_EXPORT AdaptiveManifoldFilter
+	{
+		struct Buf;
+		std::vector<cv::Ptr<Buf>> buf;//per-thread arena
+
+		cv::Mat_<cv::Point3f> src_f;
+		cv::Mat_<cv::Point3f> src_joint_f;
+		cv::Mat_<cv::Point3f> eta_1;
+		cv::Mat_<uchar> cluster_1;
+
+		double sigma_s;
+		double sigma_r;
+		int num_pca_iterations;
+		int cur_tree_height;
+		float sigma_r_over_sqrt_2;
+		double df;
+		uint64 seed;
+
+		void buildManifoldsAndPerformFiltering(const cv::Mat_<cv::Point3f>& eta_k, const cv::Mat_<uchar>& cluster_k, const int current_tree_level, const uint64 node_index);
+	public:
+		AdaptiveManifoldFilter();
+		void filter(cv::InputArray src, cv::InputArray guide, cv::OutputArray dest, const float sigma_r, const float sigma_s, const int tree_height = -1, const int num_pca_iterations = 1);
+		void collectGarbage();
+	};
+
+	CP_EXPORT void adaptiveManifoldFilter(cv::InputArray src, cv::InputArray guide, cv::OutputArray dest, const float sigma_r, const float sigma_s, const int tree_height = -1, const int num_pca_iterations = 1);
+}
@@ -69,5 +69,10 @@ namespace cp
 
 		void guidedRefinement(cv::Mat& disp, cv::Mat& guide, cv::Mat& dest, int data_trunc, int metric, int r, double eps, int iter = 1);
 		void weightedGuidedRefinement(cv::Mat& disp, cv::Mat& weight, cv::Mat& guide, cv::Mat& dest, int data_trunc, int metric, int r, double eps, int iter = 1);
+
+		//slab engine: costs are generated per disparity on small tiles as 16-bit values, filtered with guide weights (bilateral kernels or guided covariances) computed once per tile, and reduced by inline WTA,
+		//so that no cost volume is stored (dsv is not filled). guide: CV_8UC1 or CV_8UC3, borders are replicated.
+		void jointBilateralRefinementSlab(cv::Mat& disp, cv::Mat& guide, cv::Mat& dest, int data_trunc, int metric, int r, double sigma_c, double sigma_s, int iter = 1);
+		void guidedRefinementSlab(cv::Mat& disp, cv::Mat& guide, cv::Mat& dest, int data_trunc, int metric, int r, double eps, int iter = 1);
 	};
 }
\ No newline at end of file
@@ -4,10 +4,12 @@
 
 namespace cp
 {
-	//not parallel processing
+	//makeKernel (basic and same-length arms) and filtering of single-channel images run in parallel.
+	//3-channel filtering and the smoothing-rate kernel are not parallel processing.
 	class CP_EXPORT CrossBasedLocalFilter
 	{
-		//private:
+		void setArmPlanesFromCross();
+		void filterPlane(const cv::Mat& src, cv::Mat& dest, const bool isParallel);
 	public:
 		int minSearch = 0;
 
@@ -25,6 +27,9 @@ namespace cp
 			float divv;
 		};
 		cross* crossdata = nullptr;
+		//SoA copy of crossdata: arm lengths (CV_8U) and normalization factors (CV_32F)
+		cv::Mat armHP, armHM, armVP, armVM;
+		cv::Mat divH, divV;
 
 		enum
 		{
@@ -49,6 +54,8 @@ namespace cp
 		void operator()(cv::Mat& src, cv::Mat& dest);
 		void operator()(cv::Mat& src, cv::Mat& weight, cv::Mat& guide, cv::Mat& dest, const int r, int thresh, int iteration = 1);
 		void operator()(cv::Mat& src, cv::Mat& weight, cv::Mat& dest);
+		//filtering many single-channel planes (e.g., cost volume) with the same kernel; planes are processed in parallel.
+		void operator()(std::vector<cv::Mat>& src, std::vector<cv::Mat>& dest);
 
 	};
 
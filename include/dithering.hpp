@@ -29,6 +29,7 @@ namespace cp
 		OUT2IN, //for kernel sampling
 		FOURDIRECTION, //for kernel sampling
 		FOURDIRECTIONIN2OUT,
+		FORWARD_WAVEFRONT, //same output as FORWARD, but rows are processed in parallel with a fixed lag (Floyd-Steinberg only; other methods fall back to FORWARD)
 
 		DITHERING_NUMBER_OF_ORDER,
 	};
@@ -39,6 +40,8 @@ namespace cp
 	CP_EXPORT int dither(const cv::Mat& src, cv::Mat& dest, const int dithering_method, int process_order = MEANDERING);
 
 	CP_EXPORT int ditheringFloydSteinberg(cv::Mat& remap, cv::Mat& dest, int process_order);
+	//wavefront parallel Floyd-Steinberg (bit-exact to FORWARD order). remap: CV_32FC1-CV_32FC4 (destructive), dest: CV_8UC(remap.channels()), threads = 0: max threads
+	CP_EXPORT int ditheringFloydSteinbergWavefront(cv::Mat& remap, cv::Mat& dest, const int threads = 0);
 
 	//visualize dithering order for debug
 	CP_EXPORT void ditheringOrderViz(cv::Mat& src, int process_order);
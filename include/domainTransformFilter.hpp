@@ -22,7 +22,8 @@ namespace cp
 	{
 		DTF_BGRA_SSE = 0,
 		DTF_BGRA_SSE_PARALLEL,
-		DTF_SLOWEST
+		DTF_SLOWEST,
+		DTF_PLANAR_AVX//planar float with AVX2 and OpenMP: all convolution types, any channels of src and guide
 	}DTF_IMPLEMENTATION;
 
 	//convolutionType (0: DTF_RF, 1: DTF_NC, 2: DTF_IC)
@@ -9,14 +9,25 @@ namespace cp
 	
 		cv::Size size;
 		cv::Mat dark;
-		std::vector<cv::Mat> minvalue;
 		cv::Mat tmap;
 		cv::Scalar A;
 
+		//guide statistics of the guided refinement; bands are reused while their guide rows, r_joint and e_joint are unchanged (video with static regions)
+		cv::Mat prev_guide;
+		cv::Mat guide_f;
+		cv::Mat guide_sq;
+		cv::Mat mean_I;
+		cv::Mat inv_var_I;
+		int stat_r = -1;
+		float stat_e = -1.f;
+
 		void darkChannel(cv::Mat& src, int r);
 		void getAtmosphericLight(cv::Mat& srcImage, double topPercent = 0.1);
-		void getTransmissionMap(float omega = 0.95f);
+		void getTransmissionMap(cv::Mat& src, int r, float omega = 0.95f);
 		void removeHaze(cv::Mat& src, cv::Mat& trans, cv::Scalar v, cv::Mat& dest, float clip = 0.3f);
+		void updateGuideStatistics(cv::Mat& guide, const int r, const float eps);
+		//guided refinement of the transmission map fused with haze removal
+		void removeHazeGuided(cv::Mat& src, cv::Mat& dest, const int r, const float eps, const float clip = 0.3f);
 		
 	public:
 		HazeRemove();
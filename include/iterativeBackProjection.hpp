@@ -23,6 +23,52 @@ namespace cp
 	CP_EXPORT void iterativeBackProjectionDeblurBilateral(const cv::Mat& src, cv::Mat& dest, const cv::Size ksize, const float sigma, const float backprojection_sigma_space, const float backprojection_sigma_color, const float lambda, const int iteration);
 	CP_EXPORT void iterativeBackProjectionDeblurBilateral(const cv::Mat& src, cv::Mat& dest, const cv::Size ksize, const float sigma, const float backprojection_sigma_space, const float backprojection_sigma_color, const float lambda, const int iteration, cv::Mat& init);
 
+	//fused iterative deblurring for Gaussian blur (iterative back projection and Lucy-Richardson)
+	//Each iteration is a single row-band pass of blur -> residual -> back-projection blur -> update, and the working buffers are kept across iterations and calls.
+	//Schedule::NESTEROV adds FISTA-style momentum with gradient-based adaptive restart, which reaches the residual of the fixed schedule in far fewer iterations.
+	class CP_EXPORT IterativeDeblurGaussian
+	{
+	public:
+		enum class Method
+		{
+			IBP,
+			LUCY_RICHARDSON
+		};
+		enum class Schedule
+		{
+			FIXED,
+			NESTEROV
+		};
+	private:
+		struct Buf;
+		std::vector<cv::Ptr<Buf>> buf;//per-thread arena
+
+		cv::Mat srcf;
+		cv::Mat z[2];//estimate where the residual is evaluated (ping-pong)
+		cv::Mat x;//previous iterate for momentum
+		cv::Mat kx, ky, bkx, bky;//blur and back-projection kernels
+		std::vector<double> band_residual;
+		std::vector<double> band_restart;
+
+		Schedule schedule = Schedule::FIXED;
+		bool isAdaptiveRestart = true;
+		double residual = 0.0;
+		int restart_count = 0;
+
+		void iterate(const Method method, const cv::Mat& zin, cv::Mat& zout, const int band, const float lambda, const float beta);
+	public:
+		IterativeDeblurGaussian(const Schedule schedule = Schedule::FIXED);
+		void setSchedule(const Schedule schedule, const bool isAdaptiveRestart = true);
+		//lambda is used only for IBP. backprojection_sigma<=0: without back-projection blur
+		void deblur(const cv::Mat& src, cv::Mat& dest, const cv::Size ksize, const float sigma, const float backprojection_sigma, const float lambda, const int iteration, const Method method = Method::IBP, const cv::Mat& init = cv::Mat());
+		double getResidual();//RMS of src - G*estimate at the last iteration
+		int getRestartCount();
+		void collectGarbage();
+	};
+
+	CP_EXPORT void iterativeBackProjectionDeblurGaussianNesterov(const cv::Mat& src, cv::Mat& dest, const cv::Size ksize, const float sigma, const float backprojection_sigma, const float lambda, const int iteration);
+	CP_EXPORT void LucyRichardsonGaussNesterov(const cv::Mat& src, cv::Mat& dest, const cv::Size ksize, const float sigma, const int iteration);
+
 	CP_EXPORT void iterativeBackProjectionDeblurGuidedImageFilter(const cv::Mat& src, cv::Mat& dest, const cv::Size ksize, const double eps, const double sigma_space, const double lambda, const int iteration);
 
 	CP_EXPORT void guiIBP(cv::Mat& src, cv::Mat& ref, std::string wname = "IBP");
@@ -9,6 +9,7 @@ namespace cp
 		ALLOC_BORDER_OMP,
 		COMPUTE_BORDER_OMP,
 		COMPUTE_BORDER_NODOWNSAMPLE_OMP,
+		CLASS_CASCADE,
 
 		SIZE
 	};
@@ -20,8 +21,31 @@ namespace cp
 		cv::Mat guide_low_b;
 		cv::Mat guide_low;
 		cv::Mat weightmap;
+
+		std::vector<cv::Mat> srcs_b;//bordered low resolution maps for batch processing
+		std::vector<cv::Mat> guide_pyramid;//guide_pyramid[k]: 1/2^k guide for cascade
+		std::vector<cv::Mat> cascade_buffer[2];//ping-pong buffers of the intermediate 2x stages (CV_32F)
+		std::vector<int> cascade_depth;
+		cv::Mat weightmap_batch;
+		cv::Mat range_weight_batch;
+		int r_weight = -1;
+		int scale_weight = -1;
+		double sigma_r_weight = -1.0;
+		double sigma_s_weight = -1.0;
+		int guide_channels_weight = -1;
+		void computeBatchWeight(const int scale, const int r, const double sigma_r, const double sigma_s, const int guide_channels);
+		void upsampleBatchScale(const std::vector<cv::Mat>& src, const cv::Mat& guide, std::vector<cv::Mat>& dest, const std::vector<int>& ddepth, const int scale, const int r, const double sigma_r, const double sigma_s);
 	public:
 		void upsample(cv::InputArray src, cv::InputArray guide, cv::OutputArray dest, const int r, const double sigma_r, const double sigma_s);
 		void upsample64F(cv::InputArray src, cv::InputArray guide, cv::OutputArray dest, const int r, const double sigma_r, const double sigma_s);
+
+		//upsample several low resolution maps (e.g., depth, confidence, normal) with one guide in a single sweep.
+		//src: CV_8U or CV_32F with any channels, guide: CV_8UC1/C3 or CV_32FC1/C3 (0-255 range)
+		//the guide weight of each output pixel is computed once and shared by all channels of all maps.
+		void upsampleBatch(const std::vector<cv::Mat>& src, cv::InputArray guide, std::vector<cv::Mat>& dest, const int r, const double sigma_r, const double sigma_s);
+		//cascaded upsampling: repeated 2x joint bilateral stages against a guide pyramid (guide.size() == src.size() * 2^n).
+		//r and sigma_s are parameters of each 2x stage.
+		void upsampleCascade(cv::InputArray src, cv::InputArray guide, cv::OutputArray dest, const int r, const double sigma_r, const double sigma_s);
+		void upsampleCascade(const std::vector<cv::Mat>& src, cv::InputArray guide, std::vector<cv::Mat>& dest, const int r, const double sigma_r, const double sigma_s);
 	};
 }
\ No newline at end of file
@@ -58,6 +58,13 @@ namespace cp
 		void setTensorUpSigmaRange(const float sigma) { tensor_up_sigma_range = sigma; }
 		void setTensorUpCubic(const float alpha) { tensor_up_cubic_alpha = alpha; }
 		void setTensorUpKernelSize(const int d) { tensor_up_kernel_size = d; }
+		/// <summary>
+		/// incremental mode for video: LUTs are rebuilt only around low resolution pixels whose input or output changed more than threshold,
+		/// and output blocks whose LUTs and high resolution source are unchanged are reused from the previous call.
+		/// </summary>
+		void setIncrementalMode(const bool flag, const int threshold = 2) { isIncremental = flag; incremental_threshold = threshold; }
+		void clearIncrementalCache();
+		double getLUTUpdateRatio() { return lut_update_ratio; }//ratio of LUTs rebuilt in the last call
 
 		std::string getBuildingLUTMethod(const BUILD_LUT method);
 		std::string getTensorUpsamplingMethod(const UPTENSOR method);
@@ -117,6 +124,23 @@ namespace cp
 		float up_sampling_ratio_resolution = 0.f;//up_sampling_ratio
 		int boundary_replicate_offset = 0;
 
+		//incremental mode
+		bool isIncremental = false;
+		int incremental_threshold = 2;
+		double lut_update_ratio = 1.0;
+		std::vector<double> cache_key;//parameters of the cached tensor and output
+		cv::Mat ref_src_low;//low resolution pair the cached LUTs were built from
+		cv::Mat ref_prc_low;
+		cv::Mat ref_src_high;
+		cv::Mat cache_prc_high;
+		cv::Mat lut_update_mask;//low resolution; 0: keep the cached LUT (empty: build all)
+		cv::Mat tensor_skip_mask;//per upsampling block; 1: keep the cached output (empty: compute all)
+		void updateIncrementalMask(const cv::Mat& src_low, const cv::Mat& prc_low, const cv::Mat& src_high, const int r, const std::vector<double>& key);
+		bool isReuseBlock(const int x, const int y) const
+		{
+			return !tensor_skip_mask.empty() && tensor_skip_mask.at<uchar>(int(y / up_sampling_ratio_resolution), int(x / up_sampling_ratio_resolution)) != 0;
+		}
+
 		void createLUTTensor(const int width, const int height, const int lut_num);
 
 		template<int lut_boundary_method, bool isSoA> void buildLocalLUTTensorDistanceMINInvoker(const int distance, const int lut_num, const int r, const int range_div, const int lut_filter_radius);
@@ -143,4 +143,74 @@ namespace cp
 	CP_EXPORT double getGMSD(cv::InputArray ref, cv::InputArray src, const double c = 170.0, const bool isDownsample = true);
 	//Mean Deviation Similarity Index
 	CP_EXPORT double getMDSI(cv::InputArray ref, cv::InputArray deg, const bool isDownsample = true);
+
+	/// <summary>
+	/// Streaming accumulator of MSE/PSNR, SSIM and GMSD.
+	/// All metrics are computed from one pass over row bands (parallel), and gray conversion/downsampling is shared between SSIM and GMSD.
+	/// Partial sums are pooled over all accumulated frames (call clear() for per-frame values), and they can be merged across threads or tiles.
+	/// </summary>
+	class CP_EXPORT QualityMetricsAccumulator
+	{
+	public:
+		enum METRIC
+		{
+			METRIC_MSE = 1,
+			METRIC_SSIM = 2,
+			METRIC_GMSD = 4,
+			METRIC_ALL = METRIC_MSE | METRIC_SSIM | METRIC_GMSD
+		};
+
+		/// <summary>
+		/// Partial sums for each metric. MSE: sum of squared errors, SSIM: sum of SSIM map (valid pooling), GMSD: sum and square sum of GMS map.
+		/// </summary>
+		struct Moments
+		{
+			double mse_count = 0.0;
+			double mse_sum = 0.0;
+			double ssim_count = 0.0;
+			double ssim_sum = 0.0;
+			double gmsd_count = 0.0;
+			double gmsd_sum = 0.0;
+			double gmsd_sum2 = 0.0;
+
+			void clear();
+			void merge(const Moments& src);
+		};
+
+		/// <param name="metrics">OR of METRIC flags</param>
+		/// <param name="ssim_sigma">Gaussian sigma for SSIM (same as getSSIM)</param>
+		/// <param name="gmsd_c">stability constant for GMSD (same as getGMSD)</param>
+		/// <param name="isDownsample">half size downsampling for SSIM and GMSD (same as getSSIM and getGMSD)</param>
+		QualityMetricsAccumulator(const int metrics = METRIC_ALL, const double ssim_sigma = 1.5, const double gmsd_c = 170.0, const bool isDownsample = true);
+
+		void clear();
+		//accumulate a frame. numBands = 0: number of threads x 4
+		void accumulate(cv::InputArray src, cv::InputArray ref, const int numBands = 0);
+		void merge(const QualityMetricsAccumulator& src);
+		void merge(const Moments& src);
+		const Moments& getMoments() const;
+		int getNumFrames() const;
+
+		double getMSE() const;
+		double getPSNR() const;
+		double getSSIM() const;
+		double getGMSD() const;
+
+	private:
+		int metrics;
+		double ssim_sigma;
+		double gmsd_c;
+		bool isDownsample;
+		int frames = 0;
+		Moments moments;
+
+		//buffers kept across frames
+		cv::Mat gsrc, gref;
+		std::vector<Moments> bandMoments;
+
+		void convertGray(const cv::Mat& src, cv::Mat& dest);
+		void accumulateMSE(const cv::Mat& src, const cv::Mat& ref, const int ystart, const int yend, Moments& dest);
+		void accumulateSSIM(const cv::Mat& gsrc, const cv::Mat& gref, const int ystart, const int yend, Moments& dest);
+		void accumulateGMSD(const cv::Mat& gref, const cv::Mat& gsrc, const int ystart, const int yend, Moments& dest);
+	};
 }
\ No newline at end of file
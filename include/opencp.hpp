@@ -83,6 +83,7 @@
 /*************************************************************
  filter
 *************************************************************/
+#include "adaptiveManifold.hpp"
 #include "bilateralFilter.hpp"
 #include "binaryWeightedRangeFilter.hpp"
 #include "boundaryReconstructionFilter.hpp"
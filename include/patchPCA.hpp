@@ -75,6 +75,8 @@ namespace cp
 		NO_SUB_SEPCOVXXt,
 		CONST_SUB_SEPCOVXXt,
 
+		//full centering (same as FULL_SUB_FULL_32F and OPENCV_COV) by fused streaming accumulation without shifted image buffers
+		FULL_SUB_STREAM_32F,
 
 		SIZE
 	};
@@ -135,6 +137,7 @@ namespace cp
 		void simdOMPCovFullCenterRepElement32F(const std::vector<cv::Mat>& src, cv::Mat& cov, const int border);
 
 		void simdOMPCovFullCenterHalfElementTEST32F(const std::vector<cv::Mat>& src, cv::Mat& cov, const int border);
+		void streamCovFullCenter32F(const std::vector<cv::Mat>& src, cv::Mat& cov, const int border);
 
 		template<int color_channels, int patch_rad>
 		void simdOMPCov_RepCenterHalfElement32F(const std::vector<cv::Mat>& src_, cv::Mat& cov, const CenterMethod method, const float constant_sub = 127.5f);
@@ -7,6 +7,31 @@ namespace cp
 	CP_EXPORT void moveXYZ(cv::InputArray xyz, cv::OutputArray dest, cv::InputArray R, cv::InputArray t, const bool isRotationThenTranspose = true);
 	CP_EXPORT void reprojectXYZ(cv::InputArray depth, cv::OutputArray xyz, const double focalLength);
 	CP_EXPORT void reprojectXYZ(cv::InputArray depth, cv::OutputArray xyz, cv::InputArray intrinsic, cv::InputArray distortion = cv::noArray());
+	//x, y, z planes (SoA) of CV_32F or CV_16F (packed half precision); dest has the same depth as xyz
+	CP_EXPORT void moveXYZPlanar(const std::vector<cv::Mat>& xyz, std::vector<cv::Mat>& dest, cv::InputArray R, cv::InputArray t, const bool isRotationThenTranspose = true);
+	//precomputed undistortion map: ray (x/z, y/z) of each pixel for distortion (k1, k2, p1, p2[, k3]).
+	//Without distortion, the map is separable: rayx is 1 x width and rayy is height x 1.
+	CP_EXPORT void createReprojectionRayMap(const cv::Size size, cv::InputArray intrinsic, cv::InputArray distortion, cv::Mat& rayx, cv::Mat& rayy);
+
+	//depth map to point cloud and rendering to other viewpoints for a fixed depth camera.
+	//The ray map and the z-buffer are kept across calls, so keep one instance for video or interactive viewing.
+	class CP_EXPORT DepthReprojector
+	{
+		struct ZBuffer;
+		cv::Ptr<ZBuffer> zbuffer;
+		cv::Mat rayx;
+		cv::Mat rayy;
+	public:
+		DepthReprojector();
+		void setCamera(const cv::Size size, cv::InputArray intrinsic, cv::InputArray distortion = cv::noArray());
+		//interleaved point cloud (size.area() x 1, CV_32FC3) as reprojectXYZ
+		void toXYZ(cv::InputArray depth, cv::OutputArray xyz);
+		//planar point cloud: xyz[0], xyz[1], xyz[2]; depth_type: CV_32F or CV_16F (packed half precision)
+		void toXYZPlanar(cv::InputArray depth, std::vector<cv::Mat>& xyz, const int depth_type = CV_32F);
+		//fused depth->XYZ->R|t->projection with z-buffer; the point cloud is never materialized. Pixels of depth 0 are skipped.
+		//dest: image warped to the camera destK (same size), destDepth: z in the destination camera (0: hole)
+		void render(cv::InputArray image, cv::InputArray depth, cv::InputArray R, cv::InputArray t, cv::InputArray destK, cv::OutputArray dest, cv::OutputArray destDepth = cv::noArray(), const bool isRotationThenTranspose = true);
+	};
 
 	class CP_EXPORT PointCloudShow
 	{
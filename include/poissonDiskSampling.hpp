@@ -21,6 +21,8 @@ namespace cp
 		inline cv::Point imageToGrid(cv::Point pt);
 		inline float getDistance(const cv::Point pt1, const cv::Point pt2);
 		inline cv::Point generateRandomPointAround(const cv::Point pt, cv::RNG& rng);
+		inline bool inTile(const cv::Point pt, const cv::Rect& grid_tile);
+		void generateTile(std::vector<cv::Point>& samples, cv::RNG& rng, const cv::Rect& grid_tile);
 
 		virtual bool isAvailable(const cv::Point pt);
 		virtual cv::Point initializeStart(cv::RNG& rng);
@@ -33,5 +35,10 @@ namespace cp
 	public:
 		PoissonDiskSampling(const float min_d, const cv::Size imageSize);
 		virtual int generate(cv::Mat& mask, cv::RNG& rng, const cv::Point start = cv::Point(-1, -1), const int max_sample = -1);		
+		//tile-parallel generation: grid tiles are processed in 4 phases (2x2 coloring), so that tiles in the same phase never touch each other's grid cells.
+		//each tile has own RNG seeded by rng and the tile index, so the output does not depend on the number of threads.
+		//tile_cells: tile size in grid cells (>=2)
+		int generateParallel(std::vector<cv::Point>& samples, cv::RNG& rng, const int tile_cells = 16);
+		int generateParallel(cv::Mat& mask, cv::RNG& rng, const int tile_cells = 16);
 	};
 }
\ No newline at end of file
@@ -9,11 +9,11 @@ namespace cp
 	class CP_EXPORT RecursiveBilateralFilter
 	{
 	private:
-		cv::Mat bgra; //src signal of BGRA
 		cv::Mat texture; //texture is joint signal of BGRA
 		cv::Mat destf;
 		cv::Mat temp;
 		cv::Mat tempw;
+		cv::Mat weight; //range weights of the current pass
 
 		cv::Size size;
 	public:
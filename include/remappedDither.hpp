@@ -56,13 +56,20 @@ namespace cp
 		float compute_s(const cv::Mat& src);
 		int body(const cv::Mat& src, cv::Mat& dest);
 		cv::Mat imagebuff;
+		cv::Mat maskbuff;
 	public:
 		void remap(const cv::Mat& src, cv::Mat& dest);
 		IntensityRemappedDither(cv::Size image_size, const float sampling_ratio, const int dither_method = cp::DITHER_METHOD::OSTROMOUKHOW, const int dither_scanorder = cp::DITHER_SCANORDER::MEANDERING, const int dither_postprocess = DITHER_POSTPROCESS::RANDOM_ROTATION);
 		int generate(const cv::Mat& src, cv::Mat& destMask, const float ratio);
+		//output compact sample-coordinate list (raster order) instead of mask
+		int generate(const cv::Mat& src, std::vector<cv::Point>& destPoints, const float ratio);
 	};
 
+	//convert a 8U sampling mask into a sample-coordinate list (raster order) by row-band parallel scan
+	CP_EXPORT int convertSamplingMaskToPoints(const cv::Mat& mask, std::vector<cv::Point>& dest);
+
 	CP_EXPORT int generateSamplingMaskRemappedDitherWeight(const cv::Mat& weight, cv::Mat& dest, const float sampling_ratio, const int dithering_method, const int dithering_order, const float bin_ratio = 0.1f, const int maskOption = FlipBottomCopy);
+	CP_EXPORT int generateSamplingPointsRemappedDitherWeight(const cv::Mat& weight, std::vector<cv::Point>& dest, const float sampling_ratio, const int dithering_method = cp::DITHER_METHOD::FLOYD_STEINBERG, const int dithering_order = cp::DITHER_SCANORDER::FORWARD_WAVEFRONT, const float bin_ratio = 0.1f, const int maskOption = NO_POSTPROCESS);
 
 	CP_EXPORT void generateSamplingMaskRemappedDitherFlat(cv::RNG& rng, cv::Mat& mask, int& sample_num, const float sampling_ratio, int dithering_method, const bool isCircle);
 	CP_EXPORT void generateSamplingMaskRemappedDitherGaussian(cv::RNG& rng, cv::Mat& mask, int& sample_num, const float sampling_ratio, int dithering_method, int dithering_order, const float sigma);
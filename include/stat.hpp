@@ -24,6 +24,8 @@ namespace cp
 
 		void pop_back();
 		void push_back(double val);
+		//append data of other Stat (e.g., per-thread or per-tile Stat)
+		void merge(const Stat& stat);
 
 		void clear();//clear data
 		void print();//print all stat
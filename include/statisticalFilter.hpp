@@ -4,6 +4,23 @@
 
 namespace cp
 {
+	/// <summary>
+	/// computing local statistics in a rectangle kernel with a single sweep: only the requested outputs are computed (cv::noArray() for the others), and all channels are processed at once.
+	/// min/max: van Herk/Gil-Werman with the kernel clipped by the image (same as erode/dilate), src type.
+	/// mean/variance/std/trimmedMean: sliding sums with BORDER_REFLECT_101 (same as blur), CV_32F (CV_64F for CV_64F input).
+	/// variance is the windowed variance E[x^2]-E[x]^2, whereas varianceFilter/stdFilter compute blur((x-blur(x))^2).
+	/// </summary>
+	/// <param name="src">input (8U, 8S, 16U, 16S, 32S, 32F, 64F)</param>
+	/// <param name="kernelSize">kernelShape (rectangle kernel)</param>
+	/// <param name="minv">local minimum</param>
+	/// <param name="maxv">local maximum</param>
+	/// <param name="mean">local mean</param>
+	/// <param name="variance">local variance</param>
+	/// <param name="std">local standard deviation</param>
+	/// <param name="trimmedMean">local mean without the local min and max: (sum - min - max) / (n - 2)</param>
+	CP_EXPORT void localStatisticsFilter(cv::InputArray src, const cv::Size kernelSize, cv::OutputArray minv, cv::OutputArray maxv, cv::OutputArray mean, cv::OutputArray variance = cv::noArray(), cv::OutputArray std = cv::noArray(), cv::OutputArray trimmedMean = cv::noArray());
+
+	//replace each pixel by the nearer one of the local min and max in the (2r+1)x(2r+1) kernel
 	CP_EXPORT void blurRemoveMinMax(const cv::Mat& src, cv::Mat& dest, const int r);
 	//MORPH_RECT=0, MORPH_CROSS=1, MORPH_ELLIPSE
 	CP_EXPORT void maxFilter(cv::InputArray src, cv::OutputArray dest, cv::Size kernelSize, int shape = cv::MORPH_RECT);
@@ -53,6 +53,12 @@ namespace cp
 		template <class srcType>
 		void makeMask_(cv::Mat& srcL, cv::Mat& srcR, cv::Mat& dispL, cv::Mat& dispR, double alpha, int invalidvalue, double disp_amp);
 		template <class srcType>
+		void blendAndPostFilter(cv::Mat& dest, cv::Mat& destR, cv::Mat& destdisp, cv::Mat& destdispR, double alpha, int invalidvalue, double disp_amp);
+		template <class srcType>
+		void viewsynthBatch(const cv::Mat& srcL, const cv::Mat& srcR, const cv::Mat& dispL, const cv::Mat& dispR, std::vector<cv::Mat>& dest, std::vector<cv::Mat>& destdisp, const std::vector<double>& alpha, int invalidvalue, double disp_amp, int disptype);
+		std::vector<cv::Mat> batchWarpedDispL;//warped disparity maps of the batch, reused across calls
+		std::vector<cv::Mat> batchWarpedDispR;
+		template <class srcType>
 		void viewsynthSingle(cv::Mat& src, cv::Mat& disp, cv::Mat& dest, cv::Mat& destdisp, double alpha, int invalidvalue, double disp_amp, int disptype);
 
 	public:
@@ -126,6 +132,8 @@ namespace cp
 
 		void operator()(cv::Mat& src, cv::Mat& disp, cv::Mat& dest, cv::Mat& destdisp, double alpha, int invalidvalue, double disp_amp);
 		void operator()(const cv::Mat& srcL, const cv::Mat& srcR, const cv::Mat& dispL, const cv::Mat& dispR, cv::Mat& dest, cv::Mat& destdisp, double alpha, int invalidvalue, double disp_amp);
+		//render the views of all alpha at once (multi-view displays): the disparity maps of all views are forward-warped in one sweep of the source pixels, and the rest runs in parallel across views
+		void operator()(const cv::Mat& srcL, const cv::Mat& srcR, const cv::Mat& dispL, const cv::Mat& dispR, std::vector<cv::Mat>& dest, std::vector<cv::Mat>& destdisp, const std::vector<double>& alpha, int invalidvalue, double disp_amp);
 
 		cv::Mat diskMask;
 		cv::Mat allMask;//all mask
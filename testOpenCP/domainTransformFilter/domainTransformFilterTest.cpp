@@ -37,7 +37,7 @@ void guiDomainTransformFilterTest(Mat& src)
 	int norm = 0;
 	createTrackbar("normL1/L2",wname,&norm,1);
 	int implimentation=0;
-	createTrackbar("impliment",wname,&implimentation,2);
+	createTrackbar("impliment",wname,&implimentation,3);
 	int sw=0;
 	createTrackbar("RF/NC/IC",wname,&sw,2);
 	int color = 0;
@@ -93,7 +93,7 @@ void guiDomainTransformFilterTest(Mat& src)
 	 int norm = 0;
 	 createTrackbar("normL1/L2",wname,&norm,1);
 	 int implimentation=0;
-	 createTrackbar("impliment",wname,&implimentation,2);
+	 createTrackbar("impliment",wname,&implimentation,3);
 	 int sw=0;
 	 createTrackbar("RF/NC/IC",wname,&sw,5);
 
@@ -289,8 +289,55 @@ void testPSNRAccuracy(Mat& src)
 	}
 }
 
+void testQualityMetricsAccumulator(Mat& src)
+{
+	Mat dst; addNoise(src, dst, 20);
+
+	QualityMetricsAccumulator qm;
+	qm.accumulate(dst, src);
+	cout << "PSNR: " << getPSNR(dst, src) << " | " << qm.getPSNR() << endl;
+	cout << "SSIM: " << getSSIM(dst, src) << " | " << qm.getSSIM() << endl;
+	cout << "GMSD: " << getGMSD(src, dst) << " | " << qm.getGMSD() << endl;
+
+	//merge of two halves
+	const Rect top(0, 0, src.cols, src.rows / 2);
+	const Rect bottom(0, src.rows / 2, src.cols, src.rows - src.rows / 2);
+	QualityMetricsAccumulator qmt(QualityMetricsAccumulator::METRIC_MSE);
+	QualityMetricsAccumulator qmb(QualityMetricsAccumulator::METRIC_MSE);
+	qmt.accumulate(dst(top), src(top));
+	qmb.accumulate(dst(bottom), src(bottom));
+	qmt.merge(qmb);
+	cout << "PSNR (merge): " << qmt.getPSNR() << endl;
+
+	const int iteration = 100;
+	{
+		Timer t("PSNR+SSIM+GMSD", 0, false);
+		for (int i = 0; i < iteration; i++)
+		{
+			t.start();
+			getPSNR(dst, src);
+			getSSIM(dst, src);
+			getGMSD(src, dst);
+			t.getpushLapTime();
+		}
+		t.getLapTimeMedian(true);
+	}
+	{
+		Timer t("QualityMetricsAccumulator", 0, false);
+		for (int i = 0; i < iteration; i++)
+		{
+			t.start();
+			qm.clear();
+			qm.accumulate(dst, src);
+			t.getpushLapTime();
+		}
+		t.getLapTimeMedian(true);
+	}
+}
+
 void testPSNR(Mat& src)
 {
 	testPSNRAccuracy(src);
 	testPSNRTime(src);
+	testQualityMetricsAccumulator(src);
 }
\ No newline at end of file